@@ -0,0 +1,602 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * bench.c: Shared support for the benchmark drivers.                      *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "door.h"
+#include "error.h"
+#include "bench.h"
+
+static const char* const transport_names[bench_transports] = {
+	"socket",
+	"loopback",
+	"local"
+};
+
+static const char* const door_suffixes[] = {
+	"-echo",
+	"-sink"
+};
+
+/* The server process for socket doors, or 0. */
+static pid_t server_pid = 0;
+
+/* The door descriptors a loopback or local server created in this process.
+ * The benchmarks never revoke them.
+ */
+static int server_doors[2] = { -1, -1 };
+
+/* Which transport the server is currently using. */
+static enum bench_transport server_transport = bench_socket;
+static const struct bench_options* server_opts = NULL;
+
+/* Has bench_report() printed anything yet? */
+static bool reported = false;
+
+const char* bench_transport_name( enum bench_transport t )
+{
+	return transport_names[t];
+}
+
+void bench_parse( int argc,
+                  char** argv,
+                  const char* usage,
+                  struct bench_options* opts
+                )
+{
+	bool any = false;
+	int c, i;
+
+	opts->format = bench_csv;
+	opts->duration = 1.0;
+	opts->rate = 0.0;
+	opts->cma_min = 65536;
+	opts->path = "/tmp/door-bench";
+
+	for ( i = 0; i < bench_transports; ++i )
+		opts->transports[i] = false;
+
+	while ( -1 != ( c = getopt( argc, argv, "f:t:d:r:c:p:h" ) ) ) {
+		switch (c) {
+			case 'f':
+				if ( 0 == strcmp( optarg, "csv" ) )
+					opts->format = bench_csv;
+				else if ( 0 == strcmp( optarg, "json" ) )
+					opts->format = bench_json;
+				else
+					goto bad;
+				break;
+
+			case 't':
+				for ( i = 0; i < bench_transports; ++i )
+					if ( 0 == strcmp( optarg,
+					                  transport_names[i]
+					                )
+					   )
+						break;
+
+				if ( bench_transports == i )
+					goto bad;
+
+				opts->transports[i] = true;
+				any = true;
+				break;
+
+			case 'd':
+				opts->duration = atof(optarg);
+				if ( 0.0 >= opts->duration )
+					goto bad;
+				break;
+
+			case 'r':
+				opts->rate = atof(optarg);
+				if ( 0.0 > opts->rate )
+					goto bad;
+				break;
+
+			case 'c':
+				opts->cma_min = (size_t)strtoul( optarg, NULL, 0 );
+				break;
+
+			case 'p':
+				opts->path = optarg;
+				break;
+
+			default:
+				goto bad;
+		}
+	}
+
+	if ( ! any )
+		for ( i = 0; i < bench_transports; ++i )
+			opts->transports[i] = true;
+
+	return;
+
+bad:
+	fprintf( stderr,
+	         "usage: %s [-f csv|json] [-t socket|loopback|local]... "
+	         "[-d seconds] [-r rate] [-c cma_min] [-p path] %s\n",
+	         argv[0],
+	         usage
+	       );
+	exit(EXIT_FAILURE);
+}
+
+uint64_t bench_now(void)
+{
+	struct timespec now;
+
+	if ( 0 != clock_gettime( CLOCK_MONOTONIC, &now ) )
+		fatal_system_error( __FILE__, __LINE__, "clock_gettime" );
+
+	return (uint64_t)now.tv_sec * 1000000000U + (uint64_t)now.tv_nsec;
+}
+
+static void echo_server( void* cookie,
+                         const void* restrict argp,
+                         size_t arg_size,
+                         const door_desc_t* restrict dp,
+                         uint_t n_desc
+                       )
+{
+	door_return( argp, arg_size, NULL, 0 );
+
+	fatal_system_error( __FILE__, __LINE__, "door_return" );
+}
+
+static void sink_server( void* cookie,
+                         const void* restrict argp,
+                         size_t arg_size,
+                         const door_desc_t* restrict dp,
+                         uint_t n_desc
+                       )
+{
+	door_return( NULL, 0, NULL, 0 );
+
+	fatal_system_error( __FILE__, __LINE__, "door_return" );
+}
+
+static void door_path( char* buf,
+                       size_t size,
+                       const struct bench_options* opts,
+                       enum bench_door which
+                     )
+{
+	snprintf( buf, size, "%s%s", opts->path, door_suffixes[which] );
+
+	return;
+}
+
+static void create_doors( const struct bench_options* opts,
+                          enum bench_transport t
+                        )
+/* Creates the echo and sink doors in this process, raises their limits to
+ * cover the whole throughput sweep, and attaches them unless they are local.
+ */
+{
+	static const door_server_proc_t procs[2] = { echo_server, sink_server };
+	int i;
+
+	for ( i = 0; i < 2; ++i ) {
+		char path[256];
+		int d;
+
+		d = door_create_transport( procs[i],
+		                           NULL,
+		                           0,
+		                           ( bench_loopback == t ) ?
+		                           DOOR_TRANSPORT_LOOPBACK :
+		                           DOOR_TRANSPORT_SOCKET
+		                         );
+		if ( 0 > d )
+			fatal_system_error( __FILE__, __LINE__, "door_create" );
+
+		if ( 0 != door_setparam( d,
+		                         DOOR_PARAM_DATA_MAX,
+		                         BENCH_PAYLOAD_MAX
+		                       )
+		   )
+			fatal_system_error( __FILE__, __LINE__, "door_setparam" );
+
+/* Passing large arguments by reference is the only way a socket can carry
+ * the top of the sweep.  Not every system supports it.
+ */
+		if ( 0 != opts->cma_min &&
+		     0 != door_setparam( d, DOOR_PARAM_CMA_MIN, opts->cma_min ) &&
+		     ENOTSUP != errno
+		   )
+			fatal_system_error( __FILE__, __LINE__, "door_setparam" );
+
+		if ( bench_local != t ) {
+			door_path( path, sizeof(path), opts, (enum bench_door)i );
+			door_detach(path);
+
+			if ( 0 != door_attach_r( d, path ) )
+				fatal_system_error( __FILE__,
+				                    __LINE__,
+				                    "door_attach_r"
+				                  );
+		}
+
+		server_doors[i] = d;
+	}
+
+	return;
+}
+
+void bench_server_start( const struct bench_options* opts,
+                         enum bench_transport t
+                       )
+{
+	server_transport = t;
+	server_opts = opts;
+
+	if ( bench_socket == t ) {
+/* Serve the socket doors from a child, so that calls cross processes.  The
+ * child tells us over a pipe once they are attached.
+ */
+		int ready[2];
+		char c;
+
+		if ( 0 != pipe(ready) )
+			fatal_system_error( __FILE__, __LINE__, "pipe" );
+
+		fflush(stdout);
+		server_pid = fork();
+
+		if ( 0 > server_pid )
+			fatal_system_error( __FILE__, __LINE__, "fork" );
+		else if ( 0 == server_pid ) {
+			close(ready[0]);
+			create_doors( opts, t );
+
+			if ( 1 != write( ready[1], "", 1 ) )
+				fatal_system_error( __FILE__, __LINE__, "write" );
+
+			for (;;)
+				pause();
+		}
+
+		close(ready[1]);
+		if ( 1 != read( ready[0], &c, 1 ) ) {
+			fprintf( stderr, "The benchmark server failed.\n" );
+			exit(EXIT_FAILURE);
+		}
+		close(ready[0]);
+	}
+	else
+		create_doors( opts, t );
+
+	return;
+}
+
+void bench_server_stop(void)
+{
+	int i;
+
+	if ( bench_local != server_transport )
+		for ( i = 0; i < 2; ++i ) {
+			char path[256];
+
+			door_path( path, sizeof(path), server_opts, (enum bench_door)i );
+			door_detach(path);
+		}
+
+	if ( 0 != server_pid ) {
+		kill( server_pid, SIGTERM );
+		waitpid( server_pid, NULL, 0 );
+		server_pid = 0;
+	}
+
+	return;
+}
+
+int bench_open( const struct bench_options* opts,
+                enum bench_transport t,
+                enum bench_door which
+              )
+{
+	char path[256];
+
+	if ( bench_local == t )
+		return server_doors[which];
+
+	door_path( path, sizeof(path), opts, which );
+
+	return door_open(path);
+}
+
+void bench_close( enum bench_transport t, int d )
+{
+	if ( bench_local != t )
+		door_close(d);
+
+	return;
+}
+
+void bench_pace_start( struct bench_pace* pace, double duration, double rate )
+{
+	pace->begin = pace->due = pace->last = bench_now();
+	pace->end = pace->begin + (uint64_t)( duration * 1e9 );
+	pace->interval = ( 0.0 < rate ) ? (uint64_t)( 1e9 / rate ) : 0;
+
+	if ( 0.0 < rate && 0 == pace->interval )
+		pace->interval = 1;
+
+	return;
+}
+
+uint64_t bench_pace_next( struct bench_pace* pace )
+{
+	const uint64_t now = bench_now();
+	uint64_t due;
+
+	pace->last = now;
+
+	if ( 0 == pace->interval ) {
+		if ( now >= pace->end )
+			return 0;
+
+		return now;
+	}
+
+	due = pace->due;
+	if ( due >= pace->end )
+		return 0;
+
+	pace->due += pace->interval;
+
+/* If we are behind, start at once: the time lost is part of the latency. */
+	if ( due > now ) {
+		struct timespec until;
+
+		until.tv_sec = (time_t)( due / 1000000000U );
+		until.tv_nsec = (long)( due % 1000000000U );
+
+		while ( EINTR == clock_nanosleep( CLOCK_MONOTONIC,
+		                                  TIMER_ABSTIME,
+		                                  &until,
+		                                  NULL
+		                                )
+		      )
+			;
+	}
+
+	return due;
+}
+
+double bench_pace_seconds( const struct bench_pace* pace )
+{
+	return (double)( pace->last - pace->begin ) / 1e9;
+}
+
+void bench_result_init( struct bench_result* r,
+                        const char* benchmark,
+                        enum bench_transport t,
+                        size_t payload,
+                        unsigned int threads,
+                        unsigned int processes,
+                        double rate
+                      )
+{
+	r->benchmark = benchmark;
+	r->transport = t;
+	r->payload = payload;
+	r->threads = threads;
+	r->processes = processes;
+	r->rate = rate;
+	r->ops = r->errors = 0;
+	r->seconds = 0.0;
+	r->min_ns = r->mean_ns = r->max_ns = 0.0;
+	histogram_reset(&r->latency);
+
+	return;
+}
+
+void bench_record( struct bench_result* r, uint64_t start_ns, bool ok )
+{
+	const uint64_t now = bench_now();
+	const uint64_t elapsed = ( now > start_ns ) ? now - start_ns : 0;
+	const double ns = (double)elapsed;
+
+	if ( ! ok ) {
+		++r->errors;
+		return;
+	}
+
+	if ( 0 == r->ops || ns < r->min_ns )
+		r->min_ns = ns;
+	if ( ns > r->max_ns )
+		r->max_ns = ns;
+
+	++r->ops;
+	r->mean_ns += ( ns - r->mean_ns ) / (double)r->ops;
+	histogram_record( &r->latency, elapsed );
+
+	return;
+}
+
+void bench_merge( struct bench_result* dst, const struct bench_result* src )
+{
+	const unsigned long long ops = dst->ops + src->ops;
+
+	if ( 0 != src->ops ) {
+		if ( 0 == dst->ops || src->min_ns < dst->min_ns )
+			dst->min_ns = src->min_ns;
+		if ( src->max_ns > dst->max_ns )
+			dst->max_ns = src->max_ns;
+
+		dst->mean_ns = ( dst->mean_ns * (double)dst->ops +
+		                 src->mean_ns * (double)src->ops
+		               ) / (double)ops;
+	}
+
+	dst->ops = ops;
+	dst->errors += src->errors;
+	histogram_merge( &dst->latency, &src->latency );
+
+/* The clients ran side by side, so the measurement lasted as long as the
+ * slowest of them.
+ */
+	if ( src->seconds > dst->seconds )
+		dst->seconds = src->seconds;
+
+	return;
+}
+
+void bench_call_loop( int d,
+                      size_t payload,
+                      double duration,
+                      double rate,
+                      struct bench_result* r
+                    )
+{
+	struct bench_pace pace;
+	char* data = NULL;
+	void* rbuf = NULL;
+	uint64_t due;
+
+	if ( 0 != payload ) {
+		data = malloc(payload);
+		rbuf = malloc(payload);
+
+		if ( NULL == data || NULL == rbuf )
+			fatal_system_error( __FILE__, __LINE__, "malloc" );
+
+		memset( data, 'x', payload );
+	}
+
+	bench_pace_start( &pace, duration, rate );
+
+	while ( 0 != ( due = bench_pace_next(&pace) ) ) {
+		door_arg_t params;
+		bool ok;
+
+		params.data_ptr = data;
+		params.data_size = payload;
+		params.desc_ptr = NULL;
+		params.desc_num = 0;
+		params.rbuf = rbuf;
+		params.rsize = payload;
+
+		ok = ( 0 == door_call( d, &params ) );
+		bench_record( r, due, ok );
+
+/* The library may hand back a buffer of its own. */
+		if ( ok && params.rbuf != rbuf )
+			free(params.rbuf);
+	}
+
+	r->seconds = bench_pace_seconds(&pace);
+
+	free(data);
+	free(rbuf);
+
+	return;
+}
+
+void bench_begin( const struct bench_options* opts )
+{
+	if ( bench_json == opts->format )
+		printf("[\n");
+	else
+		printf( "benchmark,transport,payload,threads,processes,rate,ops,"
+		        "errors,seconds,ops_per_sec,mib_per_sec,min_ns,mean_ns,"
+		        "p50_ns,p90_ns,p99_ns,p999_ns,max_ns\n"
+		      );
+
+	reported = false;
+
+	return;
+}
+
+void bench_report( const struct bench_options* opts,
+                   const struct bench_result* r
+                 )
+{
+	const double ops_rate = ( 0.0 < r->seconds ) ? r->ops / r->seconds : 0.0;
+	const double mib = ops_rate * (double)r->payload / ( 1024.0 * 1024.0 );
+	const struct histogram* h = &r->latency;
+
+	if ( bench_json == opts->format ) {
+		printf( "%s  {\"benchmark\": \"%s\", \"transport\": \"%s\", "
+		        "\"payload\": %lu, \"threads\": %u, \"processes\": %u, "
+		        "\"rate\": %.1f, \"ops\": %llu, \"errors\": %llu, "
+		        "\"seconds\": %.6f, \"ops_per_sec\": %.1f, "
+		        "\"mib_per_sec\": %.3f, \"min_ns\": %.0f, "
+		        "\"mean_ns\": %.1f, \"p50_ns\": %llu, \"p90_ns\": %llu, "
+		        "\"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %.0f}",
+		        reported ? ",\n" : "",
+		        r->benchmark,
+		        transport_names[r->transport],
+		        (unsigned long)r->payload,
+		        r->threads,
+		        r->processes,
+		        r->rate,
+		        r->ops,
+		        r->errors,
+		        r->seconds,
+		        ops_rate,
+		        mib,
+		        r->min_ns,
+		        r->mean_ns,
+		        (unsigned long long)histogram_percentile( h, 50.0 ),
+		        (unsigned long long)histogram_percentile( h, 90.0 ),
+		        (unsigned long long)histogram_percentile( h, 99.0 ),
+		        (unsigned long long)histogram_percentile( h, 99.9 ),
+		        r->max_ns
+		      );
+	}
+	else {
+		printf( "%s,%s,%lu,%u,%u,%.1f,%llu,%llu,%.6f,%.1f,%.3f,%.0f,%.1f,"
+		        "%llu,%llu,%llu,%llu,%.0f\n",
+		        r->benchmark,
+		        transport_names[r->transport],
+		        (unsigned long)r->payload,
+		        r->threads,
+		        r->processes,
+		        r->rate,
+		        r->ops,
+		        r->errors,
+		        r->seconds,
+		        ops_rate,
+		        mib,
+		        r->min_ns,
+		        r->mean_ns,
+		        (unsigned long long)histogram_percentile( h, 50.0 ),
+		        (unsigned long long)histogram_percentile( h, 90.0 ),
+		        (unsigned long long)histogram_percentile( h, 99.0 ),
+		        (unsigned long long)histogram_percentile( h, 99.9 ),
+		        r->max_ns
+		      );
+	}
+
+	reported = true;
+	fflush(stdout);
+
+	return;
+}
+
+void bench_end( const struct bench_options* opts )
+{
+	if ( bench_json == opts->format )
+		printf( "%s]\n", reported ? "\n" : "" );
+
+	return;
+}
@@ -0,0 +1,175 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * bench.h: Shared support for the benchmark drivers: option parsing,      *
+ *          timing, the doors under test, and CSV or JSON results.         *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#ifndef H_BENCH
+#define H_BENCH
+
+#include "standards.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "histogram.h"
+
+/* Where the doors under test live.  A socket door is served by a child
+ * process; a loopback door by this one, through the in-memory transport; a
+ * local door is called on its door_create() descriptor, without any
+ * transport at all.
+ */
+enum bench_transport {
+	bench_socket = 0,
+	bench_loopback,
+	bench_local,
+	bench_transports
+};
+
+enum bench_format {
+	bench_csv = 0,
+	bench_json
+};
+
+struct bench_options {
+	enum bench_format	format;
+/* Which transports to measure, indexed by enum bench_transport. */
+	bool			transports[bench_transports];
+	double			duration;	/* Seconds per measurement. */
+/* Operations per second, spread over all clients, or 0 to start each one as
+ * soon as the last finishes.
+ */
+	double			rate;
+	size_t			cma_min;	/* The doors' DOOR_PARAM_CMA_MIN */
+	const char*		path;		/* Prefix of the door paths. */
+};
+
+/* One measurement: one line of CSV, or one object in the JSON array.  Under
+ * a fixed rate, each latency counts from when the operation was due to
+ * start, not from when it did, so that a stall is charged to every call it
+ * delayed and not just the one in progress.
+ */
+struct bench_result {
+	const char*		benchmark;
+	enum bench_transport	transport;
+	size_t			payload;	/* Bytes of argument data. */
+	unsigned int		threads;	/* Per process. */
+	unsigned int		processes;
+	unsigned long long	ops;		/* Successful operations. */
+	unsigned long long	errors;		/* Failed operations. */
+	double			seconds;	/* Wall-clock time taken. */
+	double			min_ns;		/* Fastest operation. */
+	double			mean_ns;
+	double			max_ns;		/* Slowest operation. */
+	double			rate;		/* Target, or 0. */
+	struct histogram	latency;
+};
+
+/* The doors every benchmark server offers.  The echo door returns its
+ * argument; the sink door accepts any amount of data and returns nothing.
+ */
+enum bench_door {
+	bench_echo = 0,
+	bench_sink
+};
+
+/* The largest argument the doors accept: the top of the throughput sweep. */
+#define BENCH_PAYLOAD_MAX	( (size_t)64 * 1024 * 1024 )
+
+extern const char* bench_transport_name( enum bench_transport t );
+
+/* Parses the options common to every driver, printing a usage message and
+ * exiting on error.  Any transport not selected with -t is off; if none is
+ * selected, all are on.
+ */
+extern void bench_parse( int argc,
+                         char** argv,
+                         const char* usage,
+                         struct bench_options* opts
+                       );
+
+/* The time in nanoseconds, from an arbitrary origin. */
+extern uint64_t bench_now(void);
+
+/* Starts serving both doors over the given transport, and stops again. */
+extern void bench_server_start( const struct bench_options* opts,
+                                enum bench_transport t
+                              );
+extern void bench_server_stop(void);
+
+/* Returns a descriptor on which a client can call the given door, or -1,
+ * setting errno.  Release it with bench_close().
+ */
+extern int bench_open( const struct bench_options* opts,
+                       enum bench_transport t,
+                       enum bench_door which
+                     );
+extern void bench_close( enum bench_transport t, int d );
+
+/* Schedules operations for one client: back to back if rate is 0, otherwise
+ * rate per second, due at fixed intervals whether or not the previous one
+ * has finished.
+ */
+struct bench_pace {
+	uint64_t	begin;
+	uint64_t	end;
+	uint64_t	interval;	/* Nanoseconds, or 0. */
+	uint64_t	due;		/* When the next operation is due. */
+	uint64_t	last;		/* When the last one finished. */
+};
+
+extern void bench_pace_start( struct bench_pace* pace,
+                              double duration,
+                              double rate
+                            );
+
+/* Waits until the next operation is due and returns the time it was due, or
+ * 0 once the duration has passed.
+ */
+extern uint64_t bench_pace_next( struct bench_pace* pace );
+
+/* The seconds from the start until the last operation finished. */
+extern double bench_pace_seconds( const struct bench_pace* pace );
+
+/* Clears r for a new measurement with the given description. */
+extern void bench_result_init( struct bench_result* r,
+                               const char* benchmark,
+                               enum bench_transport t,
+                               size_t payload,
+                               unsigned int threads,
+                               unsigned int processes,
+                               double rate
+                             );
+
+/* Calls the door d with payload bytes of data for duration seconds, at the
+ * given rate, and records each call in r, which must be initialized.
+ */
+extern void bench_call_loop( int d,
+                             size_t payload,
+                             double duration,
+                             double rate,
+                             struct bench_result* r
+                           );
+
+/* Times a single operation that was due at start_ns and succeeded if ok. */
+extern void bench_record( struct bench_result* r, uint64_t start_ns, bool ok );
+
+/* Adds the counts and latencies of src, measured concurrently, into dst. */
+extern void bench_merge( struct bench_result* dst,
+                         const struct bench_result* src
+                       );
+
+/* Prints results: the CSV header or opening bracket, one result, and the
+ * closing bracket.
+ */
+extern void bench_begin( const struct bench_options* opts );
+extern void bench_report( const struct bench_options* opts,
+                          const struct bench_result* result
+                        );
+extern void bench_end( const struct bench_options* opts );
+
+#endif /* !defined(H_BENCH) */
@@ -0,0 +1,70 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * churn.c: Benchmark of opening and closing doors.                        *
+ *                                                                         *
+ *          The program opens a door by name and closes it again, over     *
+ *          and over, over each selected transport that has names, and     *
+ *          reports how long each pair takes.                              *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <stdlib.h>
+
+#include "door.h"
+#include "bench.h"
+
+int main( int argc, char** argv )
+{
+	struct bench_options opts;
+	int t;
+
+	bench_parse( argc, argv, "", &opts );
+	bench_begin(&opts);
+
+	for ( t = 0; t < bench_transports; ++t ) {
+		struct bench_result r;
+		struct bench_pace pace;
+		uint64_t due;
+
+/* A local door is never opened. */
+		if ( ! opts.transports[t] || bench_local == t )
+			continue;
+
+		bench_server_start( &opts, (enum bench_transport)t );
+
+		bench_result_init( &r,
+		                   "open_close",
+		                   (enum bench_transport)t,
+		                   0,
+		                   1,
+		                   1,
+		                   opts.rate
+		                 );
+		bench_pace_start( &pace, opts.duration, opts.rate );
+
+		while ( 0 != ( due = bench_pace_next(&pace) ) ) {
+			const int d = bench_open( &opts,
+			                          (enum bench_transport)t,
+			                          bench_echo
+			                        );
+
+			if ( 0 <= d )
+				bench_close( (enum bench_transport)t, d );
+
+			bench_record( &r, due, 0 <= d );
+		}
+
+		r.seconds = bench_pace_seconds(&pace);
+		bench_report( &opts, &r );
+
+		bench_server_stop();
+	}
+
+	bench_end(&opts);
+
+	return EXIT_SUCCESS;
+}
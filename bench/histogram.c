@@ -0,0 +1,120 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * histogram.c: High-dynamic-range latency histograms for the benchmarks.  *
+ *                                                                         *
+ *              Values below HISTOGRAM_SUB_COUNT have a bucket each.       *
+ *              Above that, every power of two gets HISTOGRAM_SUB_COUNT    *
+ *              buckets of equal width, so the relative error stays the    *
+ *              same from nanoseconds to minutes.                          *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <string.h>
+
+#include "histogram.h"
+
+static unsigned int top_bit( uint64_t value )
+/* The position of the most significant bit set in value, which is not 0. */
+{
+	unsigned int bit = 0;
+
+	while ( value >>= 1 )
+		++bit;
+
+	return bit;
+}
+
+static size_t bucket_of( uint64_t value )
+{
+	unsigned int shift;
+	size_t index;
+
+	if ( value < HISTOGRAM_SUB_COUNT )
+		return (size_t)value;
+
+	shift = top_bit(value) - HISTOGRAM_SUB_BITS;
+	index = (size_t)( shift + 1 ) * HISTOGRAM_SUB_COUNT +
+	        (size_t)( ( value >> shift ) - HISTOGRAM_SUB_COUNT );
+
+	return ( index < HISTOGRAM_BUCKETS ) ? index : HISTOGRAM_BUCKETS - 1;
+}
+
+static uint64_t bucket_top( size_t index )
+/* The largest value that falls in the given bucket. */
+{
+	unsigned int shift;
+	uint64_t base;
+
+	if ( index < HISTOGRAM_SUB_COUNT )
+		return (uint64_t)index;
+
+	shift = (unsigned int)( index / HISTOGRAM_SUB_COUNT ) - 1;
+	base = HISTOGRAM_SUB_COUNT + index % HISTOGRAM_SUB_COUNT;
+
+	return ( ( base + 1 ) << shift ) - 1;
+}
+
+void histogram_reset( struct histogram* h )
+{
+	memset( h, 0, sizeof(*h) );
+
+	return;
+}
+
+void histogram_record( struct histogram* h, uint64_t value )
+{
+	++h->counts[bucket_of(value)];
+	++h->total;
+
+	if ( value > h->max )
+		h->max = value;
+
+	return;
+}
+
+void histogram_merge( struct histogram* dst, const struct histogram* src )
+{
+	size_t i;
+
+	for ( i = 0; i < HISTOGRAM_BUCKETS; ++i )
+		dst->counts[i] += src->counts[i];
+
+	dst->total += src->total;
+
+	if ( src->max > dst->max )
+		dst->max = src->max;
+
+	return;
+}
+
+uint64_t histogram_percentile( const struct histogram* h, double percentile )
+{
+	uint64_t wanted, seen = 0;
+	double exact;
+	size_t i;
+
+	if ( 0 == h->total )
+		return 0;
+
+/* Round the rank up, without needing libm's ceil(). */
+	exact = percentile / 100.0 * (double)h->total;
+	wanted = (uint64_t)exact;
+	if ( (double)wanted < exact || 0 == wanted )
+		++wanted;
+
+	for ( i = 0; i < HISTOGRAM_BUCKETS; ++i ) {
+		seen += h->counts[i];
+
+		if ( seen >= wanted ) {
+			const uint64_t top = bucket_top(i);
+
+			return ( top < h->max ) ? top : h->max;
+		}
+	}
+
+	return h->max;
+}
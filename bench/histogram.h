@@ -0,0 +1,51 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * histogram.h: High-dynamic-range latency histograms for the benchmarks.  *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#ifndef H_HISTOGRAM
+#define H_HISTOGRAM
+
+#include "standards.h"
+
+#include <stdint.h>
+
+/* Each power of two is split into this many linear sub-buckets, so that any
+ * value is reported to within 1/128th, better than 1%, of its true size.
+ */
+#define HISTOGRAM_SUB_BITS	7
+#define HISTOGRAM_SUB_COUNT	( 1U << HISTOGRAM_SUB_BITS )
+
+/* Values up to 2^40 ns, about 18 minutes, are kept apart.  Anything longer
+ * lands in the last bucket.
+ */
+#define HISTOGRAM_MAX_BITS	40
+#define HISTOGRAM_BUCKETS	( HISTOGRAM_SUB_COUNT * \
+                                  ( HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1 ) )
+
+struct histogram {
+	uint64_t	total;		/* Values recorded. */
+	uint64_t	max;		/* The largest, exactly. */
+	uint64_t	counts[HISTOGRAM_BUCKETS];
+};
+
+extern void histogram_reset( struct histogram* h );
+extern void histogram_record( struct histogram* h, uint64_t value );
+
+/* Adds the counts of src to dst. */
+extern void histogram_merge( struct histogram* dst,
+                             const struct histogram* src
+                           );
+
+/* Returns the smallest value that at least percentile percent of the recorded
+ * values do not exceed, rounded up to the top of its bucket, or 0 if the
+ * histogram is empty.
+ */
+extern uint64_t histogram_percentile( const struct histogram* h,
+                                      double percentile
+                                    );
+
+#endif /* !defined(H_HISTOGRAM) */
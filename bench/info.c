@@ -0,0 +1,93 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * info.c: Benchmark of door_info() and door_getparam().                   *
+ *                                                                         *
+ *         The program asks an open door about itself, over and over, with *
+ *         each call in turn, over each selected transport, and reports    *
+ *         how long each query takes.                                      *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <stdlib.h>
+
+#include "door.h"
+#include "error.h"
+#include "bench.h"
+
+static bool query_info( int d )
+{
+	struct door_info info;
+
+	return 0 == door_info( d, &info );
+}
+
+static bool query_param( int d )
+{
+	size_t value;
+
+	return 0 == door_getparam( d, DOOR_PARAM_DATA_MAX, &value );
+}
+
+static const struct {
+	const char*	name;
+	bool		(*query)(int d);
+} queries[] = {
+	{ "door_info", query_info },
+	{ "door_getparam", query_param }
+};
+
+int main( int argc, char** argv )
+{
+	struct bench_options opts;
+	int t;
+
+	bench_parse( argc, argv, "", &opts );
+	bench_begin(&opts);
+
+	for ( t = 0; t < bench_transports; ++t ) {
+		size_t i;
+		int d;
+
+		if ( ! opts.transports[t] )
+			continue;
+
+		bench_server_start( &opts, (enum bench_transport)t );
+
+		d = bench_open( &opts, (enum bench_transport)t, bench_echo );
+		if ( 0 > d )
+			fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+		for ( i = 0; i < sizeof(queries) / sizeof(queries[0]); ++i ) {
+			struct bench_result r;
+			struct bench_pace pace;
+			uint64_t due;
+
+			bench_result_init( &r,
+			                   queries[i].name,
+			                   (enum bench_transport)t,
+			                   0,
+			                   1,
+			                   1,
+			                   opts.rate
+			                 );
+			bench_pace_start( &pace, opts.duration, opts.rate );
+
+			while ( 0 != ( due = bench_pace_next(&pace) ) )
+				bench_record( &r, due, queries[i].query(d) );
+
+			r.seconds = bench_pace_seconds(&pace);
+			bench_report( &opts, &r );
+		}
+
+		bench_close( (enum bench_transport)t, d );
+		bench_server_stop();
+	}
+
+	bench_end(&opts);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,72 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * latency.c: Benchmark of small-call round-trip latency.                  *
+ *                                                                         *
+ *            The program calls an echo door one call at a time, with a    *
+ *            few small argument sizes, over each selected transport, and  *
+ *            reports the distribution of round-trip times.  With -r, the  *
+ *            calls are due at a fixed rate.                               *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <stdlib.h>
+
+#include "door.h"
+#include "error.h"
+#include "bench.h"
+
+static const size_t payloads[] = { 0, 16, 64, 256, 1024 };
+
+int main( int argc, char** argv )
+{
+	struct bench_options opts;
+	int t;
+
+	bench_parse( argc, argv, "", &opts );
+	bench_begin(&opts);
+
+	for ( t = 0; t < bench_transports; ++t ) {
+		size_t i;
+		int d;
+
+		if ( ! opts.transports[t] )
+			continue;
+
+		bench_server_start( &opts, (enum bench_transport)t );
+
+		d = bench_open( &opts, (enum bench_transport)t, bench_echo );
+		if ( 0 > d )
+			fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+		for ( i = 0; i < sizeof(payloads) / sizeof(payloads[0]); ++i ) {
+			struct bench_result r;
+
+			bench_result_init( &r,
+			                   "latency",
+			                   (enum bench_transport)t,
+			                   payloads[i],
+			                   1,
+			                   1,
+			                   opts.rate
+			                 );
+			bench_call_loop( d,
+			                 payloads[i],
+			                 opts.duration,
+			                 opts.rate,
+			                 &r
+			               );
+			bench_report( &opts, &r );
+		}
+
+		bench_close( (enum bench_transport)t, d );
+		bench_server_stop();
+	}
+
+	bench_end(&opts);
+
+	return EXIT_SUCCESS;
+}
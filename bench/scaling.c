@@ -0,0 +1,259 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * scaling.c: Benchmark of concurrent clients.                             *
+ *                                                                         *
+ *            The program calls an echo door with small arguments from     *
+ *            several threads at once, and for socket doors from several   *
+ *            processes at once, and reports the combined rate and         *
+ *            latencies.  Each thread has a descriptor of its own.         *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "door.h"
+#include "error.h"
+#include "bench.h"
+
+static const unsigned int thread_counts[] = { 1, 2, 4, 8 };
+static const unsigned int process_counts[] = { 1, 2, 4 };
+static const size_t payload = 16;
+
+#define MAX_THREADS	8U
+
+#define MAX_PROCESSES	4U
+
+struct worker {
+	pthread_t		thread;
+	int			d;
+	double			duration;
+	double			rate;
+	struct bench_result	result;
+};
+
+static void* worker_proc( void* arg )
+{
+	struct worker* w = arg;
+
+	bench_call_loop( w->d, payload, w->duration, w->rate, &w->result );
+
+	return NULL;
+}
+
+static void run_threads( const struct bench_options* opts,
+                         enum bench_transport t,
+                         unsigned int threads,
+                         double rate,
+                         struct bench_result* r
+                       )
+/* Runs the given number of client threads in this process, each at the given
+ * rate, and adds up their results into r, which must be initialized.
+ */
+{
+	struct worker workers[MAX_THREADS];
+	unsigned int i;
+
+	for ( i = 0; i < threads; ++i ) {
+		bench_result_init( &workers[i].result,
+		                   r->benchmark,
+		                   t,
+		                   payload,
+		                   1,
+		                   1,
+		                   rate
+		                 );
+
+		workers[i].d = bench_open( opts, t, bench_echo );
+		if ( 0 > workers[i].d )
+			fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+		workers[i].duration = opts->duration;
+		workers[i].rate = rate;
+
+		if ( 0 != pthread_create( &workers[i].thread,
+		                          NULL,
+		                          worker_proc,
+		                          &workers[i]
+		                        )
+		   )
+			fatal_system_error( __FILE__, __LINE__, "pthread_create" );
+	}
+
+	for ( i = 0; i < threads; ++i ) {
+		if ( 0 != pthread_join( workers[i].thread, NULL ) )
+			fatal_system_error( __FILE__, __LINE__, "pthread_join" );
+
+		bench_merge( r, &workers[i].result );
+		bench_close( t, workers[i].d );
+	}
+
+	return;
+}
+
+static void read_all( int fd, void* buf, size_t size )
+/* A result holds a whole histogram, too large to cross a pipe in one piece. */
+{
+	char* p = buf;
+
+	while ( 0 < size ) {
+		const ssize_t n = read( fd, p, size );
+
+		if ( 0 >= n )
+			fatal_system_error( __FILE__, __LINE__, "read" );
+
+		p += n;
+		size -= (size_t)n;
+	}
+
+	return;
+}
+
+static void write_all( int fd, const void* buf, size_t size )
+{
+	const char* p = buf;
+
+	while ( 0 < size ) {
+		const ssize_t n = write( fd, p, size );
+
+		if ( 0 >= n )
+			fatal_system_error( __FILE__, __LINE__, "write" );
+
+		p += n;
+		size -= (size_t)n;
+	}
+
+	return;
+}
+
+static void run_processes( const struct bench_options* opts,
+                           enum bench_transport t,
+                           unsigned int processes,
+                           unsigned int threads,
+                           double rate,
+                           struct bench_result* r
+                         )
+/* Forks the given number of client processes, each running the given number
+ * of threads, and adds up the results they send back, each through a pipe
+ * of its own.
+ */
+{
+	int results[MAX_PROCESSES];
+	unsigned int i;
+
+	fflush(stdout);
+
+	for ( i = 0; i < processes; ++i ) {
+		int fds[2];
+		pid_t pid;
+
+		if ( 0 != pipe(fds) )
+			fatal_system_error( __FILE__, __LINE__, "pipe" );
+
+		pid = fork();
+
+		if ( 0 > pid )
+			fatal_system_error( __FILE__, __LINE__, "fork" );
+		else if ( 0 == pid ) {
+			struct bench_result mine;
+
+			close(fds[0]);
+
+			mine = *r;
+			run_threads( opts, t, threads, rate, &mine );
+			write_all( fds[1], &mine, sizeof(mine) );
+
+			_exit(EXIT_SUCCESS);
+		}
+
+		close(fds[1]);
+		results[i] = fds[0];
+	}
+
+	for ( i = 0; i < processes; ++i ) {
+		struct bench_result theirs;
+
+		read_all( results[i], &theirs, sizeof(theirs) );
+		close(results[i]);
+
+		bench_merge( r, &theirs );
+	}
+
+	for ( i = 0; i < processes; ++i )
+		wait(NULL);
+
+	return;
+}
+
+int main( int argc, char** argv )
+{
+	struct bench_options opts;
+	int t;
+
+	bench_parse( argc, argv, "", &opts );
+	bench_begin(&opts);
+
+	for ( t = 0; t < bench_transports; ++t ) {
+		size_t i, j;
+
+		if ( ! opts.transports[t] )
+			continue;
+
+		bench_server_start( &opts, (enum bench_transport)t );
+
+/* Only a socket door can be reached from another process. */
+		for ( i = 0; i < sizeof(process_counts) / sizeof(unsigned int); ++i )
+			for ( j = 0;
+			      j < sizeof(thread_counts) / sizeof(unsigned int);
+			      ++j
+			    ) {
+				struct bench_result r;
+				const unsigned int clients = thread_counts[j] *
+				                             process_counts[i];
+
+				if ( bench_socket != t && 1 != process_counts[i] )
+					continue;
+
+				bench_result_init( &r,
+				                   "scaling",
+				                   (enum bench_transport)t,
+				                   payload,
+				                   thread_counts[j],
+				                   process_counts[i],
+				                   opts.rate
+				                 );
+
+/* The target rate is for all the clients together. */
+				if ( 1 == process_counts[i] )
+					run_threads( &opts,
+					             (enum bench_transport)t,
+					             thread_counts[j],
+					             opts.rate / clients,
+					             &r
+					           );
+				else
+					run_processes( &opts,
+					               (enum bench_transport)t,
+					               process_counts[i],
+					               thread_counts[j],
+					               opts.rate / clients,
+					               &r
+					             );
+
+				bench_report( &opts, &r );
+			}
+
+		bench_server_stop();
+	}
+
+	bench_end(&opts);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,70 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * throughput.c: Benchmark of data throughput against argument size.       *
+ *                                                                         *
+ *               The program sends arguments from 16 bytes up to 64 MiB,   *
+ *               growing by a factor of four, to a door that discards      *
+ *               them, over each selected transport, and reports the rate  *
+ *               at which the data arrive.                                 *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <stdlib.h>
+
+#include "door.h"
+#include "error.h"
+#include "bench.h"
+
+static const size_t smallest = 16;
+
+int main( int argc, char** argv )
+{
+	struct bench_options opts;
+	int t;
+
+	bench_parse( argc, argv, "", &opts );
+	bench_begin(&opts);
+
+	for ( t = 0; t < bench_transports; ++t ) {
+		size_t payload;
+		int d;
+
+		if ( ! opts.transports[t] )
+			continue;
+
+		bench_server_start( &opts, (enum bench_transport)t );
+
+		d = bench_open( &opts, (enum bench_transport)t, bench_sink );
+		if ( 0 > d )
+			fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+		for ( payload = smallest;
+		      payload <= BENCH_PAYLOAD_MAX;
+		      payload *= 4
+		    ) {
+			struct bench_result r;
+
+			bench_result_init( &r,
+			                   "throughput",
+			                   (enum bench_transport)t,
+			                   payload,
+			                   1,
+			                   1,
+			                   opts.rate
+			                 );
+			bench_call_loop( d, payload, opts.duration, opts.rate, &r );
+			bench_report( &opts, &r );
+		}
+
+		bench_close( (enum bench_transport)t, d );
+		bench_server_stop();
+	}
+
+	bench_end(&opts);
+
+	return EXIT_SUCCESS;
+}
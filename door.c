@@ -10,9 +10,9 @@
 
 #include <assert.h>
 #include <errno.h>
-#include <fcntl.h>
 #include <limits.h>
 #include <pthread.h>
+#include <setjmp.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -21,17 +21,21 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
-#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <sys/un.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "door.h"
 #include "door_info.h"
 #include "error.h"
+#include "flight.h"
+#include "lockstat.h"
 #include "messages.h"
+#include "stats.h"
+#include "trace.h"
+#include "transport.h"
 
 /* The default size of door_table, used unless {OPEN_MAX} is a lower, 
  * positive number.
@@ -41,6 +45,19 @@ static const size_t open_default = 1024U;
 /* The value of {PAGE_SIZE}, to be filled in by sysconf(): */
 static size_t page_size = 0;
 
+/* The classes of calls, DOOR_PRIORITY_NORMAL up to DOOR_PRIORITY_HIGH. */
+#define PRIORITIES	( DOOR_PRIORITY_HIGH + 1U )
+
+/* The transports a door can use, indexed by the DOOR_TRANSPORT_ constants
+ * door_create_transport() takes.
+ */
+static const struct door_transport* const transports[] = {
+	[DOOR_TRANSPORT_SOCKET] = &door_socket_transport,
+	[DOOR_TRANSPORT_LOOPBACK] = &door_loopback_transport
+};
+
+#define TRANSPORT_COUNT	( sizeof(transports) / sizeof(transports[0]) )
+
 /* Several functions manipulate the door_table, which is an array of 
  * OPEN_MAX fd_data structures.  A file descriptor fd refers to a 
  * valid, local door if and only if door_table[fd] holds valid data.
@@ -64,13 +81,31 @@ struct fd_data {
 };
 
 struct door_data {
+	const struct door_transport*	transport;	/* Carries the door */
 	pid_t		target;			/* Server PID */
 	door_server_proc_t	server_proc;	/* Points to server proc */
+	door_batch_proc_t	batch_proc;	/* Or to this one, or NULL */
 	void*		cookie;			/* Passed to the above */
 	door_attr_t	attr;			/* Attributes */
 	door_id_t	id;			/* System-wide unique ID */
 	size_t		data_min;		/* Minimum length of input */
 	size_t		data_max;		/* Maximum length of input */
+	size_t		desc_max;		/* Maximum descriptors passed */
+	size_t		cma_min;		/* Pass by reference from here */
+/* The most calls from other processes that may run at once, or 0 for no
+ * limit, how many of those only high-priority calls may use, and the most
+ * calls that may wait for a thread beyond those.  Those running are counted
+ * in active, and those waiting are queued by priority and then by client,
+ * with the clients of each priority listed in the order they take turns.
+ */
+	size_t		max_active;
+	size_t		high_reserved;
+	size_t		max_queued;
+	size_t		active;
+	size_t		queued;
+	struct waiting_client*	waiting_head[PRIORITIES];
+	struct waiting_client*	waiting_tail[PRIORITIES];
+	struct door_counters*	counters;	/* What door_stats() reports */
 /* Number of pointers to this structure; each listener thread holds a copy,
  * so we should decrement this reference count and free it only when it hits.
  * 0.  Signed in order to more easily detect underflow.  We don't bother to
@@ -78,6 +113,12 @@ struct door_data {
  * first.
  */
 	int		pointers;
+/* Holds that calls and queries from this process take while they use the
+ * structure.  Like pointers, they keep it from being freed, but they do not
+ * keep the door referenced.  Should the last pointer go while a hold remains,
+ * pointers falls to -1, and the last hold frees the structure.
+ */
+	int		holds;
 	bool		revoked;	/* Has this door been revoked? */
 	bool		attachments;	/* Is this thread attached? */
 /* Has this door been unreferenced at least once? */
@@ -87,7 +128,27 @@ struct door_data {
 };
 
 struct conn_data {
+	const struct door_transport*	transport;	/* Carries the door */
 	pthread_mutex_t	desc_lock;	/* A mutex lock on this descriptor. */
+/* The door's DOOR_PARAM_CMA_MIN, as the server reported it to us, and whether
+ * we have asked yet.  Protected by desc_lock.
+ */
+	size_t		cma_min;
+	bool		cma_known;
+/* The process that opened the descriptor, which is the one the server sees at
+ * the other end.  A child that inherits it through fork() must copy its data,
+ * for the server will not read it out of another process.
+ */
+	pid_t		opener;
+/* The tag of the last call sent, so that we can tell its reply from those to
+ * calls abandoned earlier.  Protected by desc_lock.
+ */
+	uint64_t	last_tag;
+/* How many requests we gave up waiting for the answers to.  The server
+ * answers requests in order, so the next that many answers are theirs, and
+ * we throw them away.  Protected by desc_lock.
+ */
+	unsigned int	stale_requests;
 };
 
 /* The door table is an array of fd_data structures.  The type member denotes
@@ -108,16 +169,119 @@ struct door_connect_t {
 	struct door_data*	data_ptr;
 };
 
+/* A door_call() on a door in this process does not go through a transport.
+ * The calling thread waits on one of these structures, and door_return()
+ * copies the results straight into its door_arg_t and wakes it.
+ */
+struct local_call {
+	door_arg_t*	params;		/* The caller's arguments, or NULL. */
+	int		error;		/* The errno to report, or 0. */
+	bool		done;		/* Has the server returned? */
+	pthread_mutex_t	lock;		/* Protects error and done. */
+	pthread_cond_t	finished;	/* Signaled when done is set. */
+};
+
+/* The door_call() or pipelined calls to another process that are waiting for
+ * their replies, for the cleanup handler that abandons them should the calling
+ * thread be cancelled.
+ */
+struct pending_call {
+	const struct door_transport*	transport;
+	int				door;
+	uint64_t			tag;	/* That of the first call. */
+	size_t				count;	/* Calls with tags from tag. */
+	pthread_mutex_t*		lock;	/* The held desc_lock. */
+};
+
+/* The calls from another process running or waiting on one server
+ * connection, so that a cancel message can find the thread serving one.  The
+ * connection's listener and each call on the list hold a reference.
+ */
+struct conn_calls {
+	pthread_mutex_t			lock;	/* Protects the list and refs. */
+	struct door_server_args_t*	first;
+	int				refs;
+	struct door_data*		door;	/* Whose reference we hold. */
+	pid_t				client;	/* The peer, or 0 if unknown. */
+};
+
+/* The calls from one client process waiting for a thread on a door, oldest
+ * first.  The door starts one from each waiting client in turn, so that a
+ * client that floods it delays the others by no more than a call apiece.
+ * Protected by the door's lock_data.
+ */
+struct waiting_client {
+	pid_t				pid;
+	struct door_server_args_t*	head;
+	struct door_server_args_t*	tail;
+	struct waiting_client*		next;
+};
+
+/* What admit_call() decides to do with a call. */
+enum admission {
+	admit_run,	/* Start its thread now. */
+	admit_queue,	/* It waits for an earlier call to end. */
+	admit_refuse	/* Too many calls are waiting already. */
+};
+
 /* Data the thread calling the door server procedure will need.
  */
 struct door_server_args_t {
+	const struct door_transport*	transport;	/* Carries fd */
 	int			fd;	
 	void*			data_ptr;
 	door_desc_t*		desc_ptr;
 	size_t			data_size;
 	uint_t			desc_num;
 	door_server_proc_t	server_proc;
+	door_batch_proc_t	batch_proc;	/* If not NULL, instead. */
 	void*			cookie;
+/* The next call of the batch this one begins, or NULL, and the results of
+ * them all while the batch server procedure runs.  The calls after the first
+ * are on no list but this one, and the thread serving them frees them.
+ */
+	struct door_server_args_t*	batch_next;
+	door_batch_call_t*	batch_calls;
+/* The buffer to free when the thread exits, or NULL.  For a call from another
+ * process, this holds the data and descriptors; a local call passes the
+ * caller's own data buffer, which we must not free.
+ */
+	void*			buffer;
+	struct local_call*	local;	/* A local caller, or NULL. */
+/* The door of a call from this process, which it holds until it ends, or NULL
+ * for a call from another process.
+ */
+	struct door_data*	door;
+/* Where door_return() goes back to on the listener running a call inline, or
+ * NULL on a thread of the call's own.
+ */
+	jmp_buf*		inline_return;
+	uint64_t		tag;	/* The call's tag, for the reply. */
+	unsigned int		priority;	/* DOOR_PRIORITY_*. */
+	bool			one_way;	/* Does no one want a reply? */
+/* The connection's calls, which this one is on, or NULL for a local call.
+ * The rest is protected by calls->lock.
+ */
+	struct conn_calls*		calls;
+	struct door_server_args_t*	next;
+	pthread_t		thread;
+	bool			started;	/* Is thread valid? */
+	bool			cancelled;	/* Has the client cancelled? */
+/* The next call from the same client waiting for a thread on the door,
+ * protected by its lock_data.
+ */
+	struct door_server_args_t*	queue_next;
+/* The door's counters, which we hold a reference to until the invocation
+ * ends, and when it began.
+ */
+	struct door_counters*	counters;
+	uint64_t		start_ns;
+	door_id_t		id;	/* The door's, for tracing. */
+/* When the server procedure started and called door_return(), or 0, for the
+ * flight recorder.
+ */
+	uint64_t		dispatch_ns;
+	uint64_t		return_ns;
 };
 
 /* A thread which attempts to create, resize, destroy or move door_table 
@@ -128,6 +292,12 @@ struct door_server_args_t {
  */
 pthread_rwlock_t door_table_lock;
 
+/* How each kind of lock has been taken, indexed by the DOOR_LOCK_ constants.
+ * Only a build with DOOR_LOCKSTAT defined counts them; it prints them at
+ * exit, too.
+ */
+static door_lock_stats_t lock_stats[DOOR_LOCKS];
+
 /* Stores the current value of OPEN_MAX. */
 static size_t open_max;
 
@@ -153,8 +323,11 @@ static pthread_key_t door_arg_buf;
  */
 static pthread_key_t server_arg_buf;
 
-/* It doesn't matter what this refers to, only that it's unique: */
-const char* const DOOR_UNREF_DATA = { 0 };
+/* It doesn't matter what this refers to, only that it's unique, and so not
+ * NULL, which is what a call without data passes.
+ */
+static const char unref_data = 0;
+const char* const DOOR_UNREF_DATA = &unref_data;
 
 /* Internal functions with file scope: */
 
@@ -231,7 +404,7 @@ fatal_system_error(__FILE__,__LINE__,"pthread_mutex_unlock");
 
 static void child_fork_handler(void)
 /* Close all local doors.  Wipe the door_table, freeing its memory.  
- * Also release the lock on the table, which prepare_fork_handler() 
+ * Also free the lock on the table, which prepare_fork_handler() 
  * claimed.
  *
  * Upon a fork, pthread_atfork() calls this function in the child 
@@ -250,7 +423,7 @@ static void child_fork_handler(void)
 door_table[i].data;
 
 				door_table[i].type = fd_none;
-				close(i);
+				p->transport->close(i);
 /* There are no threads handling doors in the child process; therefore, no
  * threads are waiting on the condition variable, and it is safe to destroy.
  */
@@ -274,6 +447,7 @@ fatal_system_error(__FILE__,__LINE__,"pthread_mutex_unlock");
 fatal_system_error(__FILE__,__LINE__,"pthread_mutex_destroy");
 				}
 
+				counters_forget(p->counters);
 				free(p);
 				door_table[i].data = NULL;
 			} /* end if (fd_server) */
@@ -292,11 +466,60 @@ fatal_system_error(__FILE__,__LINE__,"pthread_mutex_unlock");
  */
 	} /* end for */
 
-	if ( 0 != pthread_rwlock_unlock(&door_table_lock) )
-		fatal_system_error(__FILE__, __LINE__, "pthread_rwlock_unlock");
+/* The child's only thread is not the one that took the lock for writing, and
+ * an unlock from any other thread counts as a reader's, leaving the lock held.
+ * No other thread can hold it here, so start afresh.
+ */
+	if ( 0 != pthread_rwlock_init( &door_table_lock, NULL ) )
+		fatal_system_error(__FILE__, __LINE__, "pthread_rwlock_init");
+
+	return;
+}
+
+#ifdef DOOR_LOCKSTAT
+static void print_lock_stats(void)
+/* Reports how each kind of lock was taken, when the process exits. */
+{
+	static const char* const names[DOOR_LOCKS] = {
+		"door_table_lock",
+		"door_data lock_data",
+		"conn_data desc_lock"
+	};
+	door_lock_stats_t stats;
+	int i;
+
+	fprintf( stderr,
+	         "%-20s %14s %14s %14s %14s\n",
+	         "lock",
+	         "acquired",
+	         "contended",
+	         "wait ns",
+	         "max wait ns"
+	       );
+
+	for ( i = 0; i < DOOR_LOCKS; ++i ) {
+		door_lock_stats( i, &stats );
+		fprintf( stderr,
+		         "%-20s %14llu %14llu %14llu %14llu\n",
+		         names[i],
+		         stats.dl_acquired,
+		         stats.dl_contended,
+		         stats.dl_wait_ns,
+		         stats.dl_max_wait_ns
+		       );
+	}
+
+	return;
+}
+
+static void lock_stats_init(void)
+{
+	if ( 0 != atexit(print_lock_stats) )
+		fatal_system_error(__FILE__, __LINE__, "atexit");
 
 	return;
 }
+#endif /* defined(DOOR_LOCKSTAT) */
 
 static void client_init(void)
 /* Initializes the client's data structures.  Currently, the first call
@@ -319,6 +542,15 @@ static void client_init(void)
 
 	page_size = (size_t)x;
 
+#ifdef DOOR_LOCKSTAT
+/* A server initializes the client as well, so this could run twice. */
+	{
+		static pthread_once_t lock_stats_ready = PTHREAD_ONCE_INIT;
+
+		pthread_once( &lock_stats_ready, lock_stats_init );
+	}
+#endif
+
 	return;
 }
 
@@ -334,9 +566,12 @@ static void server_init(void)
  * while leaving the once-control triggered and the lock intact.
  *
  * This function initializes the thread-specific data door_return()
- * uses.
+ * uses.  Servers need {PAGE_SIZE} as well, so it also does the client's
+ * initialization.
  */
 {
+	client_init();
+
 	if ( 0 != pthread_rwlock_init( &door_table_lock, NULL ) )
 		fatal_system_error(__FILE__, __LINE__, "pthread_rwlock_init");
 
@@ -422,7 +657,10 @@ static struct fd_data* init_door_table(void)
 	long sys;
 	size_t i;
 
-	if ( 0 != pthread_rwlock_wrlock(&door_table_lock) )
+	if ( 0 != LOCKSTAT_WRLOCK( &door_table_lock,
+	                           &lock_stats[DOOR_LOCK_TABLE]
+	                         )
+	   )
 		fatal_system_error(__FILE__, __LINE__, "pthread_rwlock_wrlock");
 
 /* Once we hold the lock, if door_table is not NULL, then this thread 
@@ -474,7 +712,10 @@ static struct fd_data* resize_door_table( int did )
 	size_t i, guess, new_max;
 	long sys;
 
-	if ( 0 != pthread_rwlock_wrlock(&door_table_lock) )
+	if ( 0 != LOCKSTAT_WRLOCK( &door_table_lock,
+	                           &lock_stats[DOOR_LOCK_TABLE]
+	                         )
+	   )
 		fatal_system_error(__FILE__, __LINE__, "pthread_rwlock_wrlock");
 
 /* Once we hold the lock, if did < open_max, we were in a race to resize 
@@ -505,9 +746,10 @@ realloc( door_table, new_max * sizeof(struct fd_data) );
 
 /* The implementation depends on empty entries being zeroed out. */
 		if (door_table) {
-			for ( i = open_max; i < new_max; ++i )
+			for ( i = open_max; i < new_max; ++i ) {
 				door_table[i].type = fd_none;
 				door_table[i].data = NULL;
+			}
 
 			open_max = new_max;
 		} /* end if (door_table) */
@@ -520,32 +762,366 @@ realloc( door_table, new_max * sizeof(struct fd_data) );
 	return door_table;
 }
 
-static void* start_server_proc( void* p )
-/* Invokes the given server procedure based on the arguments in args.
+static inline size_t desc_offset( size_t data_size )
+/* When a buffer holds data_size bytes of data followed by an array of
+ * door_desc_t structures, returns the offset of the array: data_size rounded
+ * up to a multiple of the size of a door_id_t.
  */
 {
-	const struct door_server_args_t* args = p;
+	static const size_t align = sizeof(door_id_t);
 
-/* Store the socket fd where door_return() can retrieve it. */
-	if ( 0 != pthread_setspecific( caller_fd, &args->fd ) )
-		fatal_system_error(__FILE__,__LINE__,"pthread_setspecific");
+	return ( data_size + align - 1 ) / align * align;
+}
 
-/* Free the data buffer when this thread exits (outside the critical path). */
-	if ( 0 != pthread_setspecific( door_arg_buf, args->data_ptr ) )
-		fatal_system_error(__FILE__,__LINE__,"pthread_setspecific");
+static void close_descs( const door_desc_t* desc_ptr, uint_t desc_num )
+/* Closes every descriptor in the list.  Used to clean up after a message
+ * whose descriptors we received, but cannot deliver.
+ */
+{
+	uint_t i;
 
-/* Also free the argument buffer when this thread exits. */
-	if ( 0 != pthread_setspecific( server_arg_buf, args ) )
-		fatal_system_error(__FILE__,__LINE__,"pthread_setspecific");
+	for ( i = 0; i < desc_num; ++i )
+		close( desc_ptr[i].d_data.d_desc.d_descriptor );
 
-	(args->server_proc)( args->cookie,
-	                     args->data_ptr,
-	                     args->data_size,
-	                     args->desc_ptr,
-	                     args->desc_num
-	                   );
+	return;
+}
 
-	return NULL;
+static void release_descs( const door_desc_t* desc_ptr, uint_t desc_num )
+/* Closes each descriptor in the list that is tagged DOOR_RELEASE.  Call this
+ * once the message passing them has been sent.
+ */
+{
+	uint_t i;
+
+	for ( i = 0; i < desc_num; ++i )
+		if ( DOOR_RELEASE & desc_ptr[i].d_attributes )
+			close( desc_ptr[i].d_data.d_desc.d_descriptor );
+
+	return;
+}
+
+static int dup_descs( door_desc_t* to,
+                      const door_desc_t* from,
+                      uint_t desc_num
+                    )
+/* Gives the receiver of a local call or reply its own copies of the
+ * descriptors in from, just as passing them through a transport would, and
+ * stores them in to.  Closes the originals tagged DOOR_RELEASE.
+ *
+ * Returns 0 on success, or an errno value if it could not duplicate them
+ * all, in which case it closes any copies it made and releases nothing.
+ */
+{
+	uint_t i;
+
+	for ( i = 0; i < desc_num; ++i ) {
+		const int d = dup( from[i].d_data.d_desc.d_descriptor );
+
+		if ( 0 > d ) {
+			const int error = errno;
+
+			close_descs( to, i );
+			return error;
+		}
+
+		bzero( &to[i], sizeof(door_desc_t) );
+		to[i].d_attributes = DOOR_DESCRIPTOR;
+		to[i].d_data.d_desc.d_descriptor = d;
+	}
+
+	release_descs( from, desc_num );
+
+	return 0;
+}
+
+static void wake_local_call( struct local_call* call, int error )
+/* Tells the caller waiting on a local door call that it has finished, and
+ * should report error, or 0 for success.
+ */
+{
+	if ( 0 != pthread_mutex_lock(&call->lock) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_mutex_lock");
+
+	call->error = error;
+	call->done = true;
+
+	if ( 0 != pthread_cond_signal(&call->finished) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_cond_signal");
+
+	if ( 0 != pthread_mutex_unlock(&call->lock) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_mutex_unlock");
+
+	return;
+}
+
+static void finish_local_call( struct local_call* call,
+                               const void* data_ptr,
+                               size_t data_size,
+                               const door_desc_t* desc_ptr,
+                               uint_t desc_num
+                             )
+/* Delivers the results of a local door call to the waiting caller, exactly as
+ * door_call() would have received them from a transport, and wakes it up.
+ */
+{
+	door_arg_t* const params = call->params;
+	int error = 0;
+
+	if ( NULL == params ) {
+/* The caller cannot receive any data. */
+		if ( 0 != data_size || 0 != desc_num )
+			error = ENOMEM;
+	}
+	else {
+		size_t buffer_size;
+		void* buf = params->rbuf;
+		door_desc_t* out_desc = NULL;
+
+		if ( 0 == desc_num )
+			buffer_size = data_size;
+		else
+			buffer_size = desc_offset(data_size) +
+			              desc_num * sizeof(door_desc_t);
+
+		if ( buffer_size > params->rsize &&
+		     0 != posix_memalign( &buf, page_size, buffer_size )
+		   ) {
+			error = ENOMEM;
+			params->data_size = 0;
+		}
+		else {
+			if ( 0 != desc_num ) {
+				out_desc = (door_desc_t*)
+( (char*)buf + desc_offset(data_size) );
+				error = dup_descs( out_desc, desc_ptr, desc_num );
+			}
+
+			if ( 0 == error ) {
+/* A server procedure may return a slice of its arguments, which are the
+ * caller's own buffer, and often rbuf itself.
+ */
+				if ( 0 != data_size )
+					memmove( buf, data_ptr, data_size );
+
+				params->rbuf = buf;
+				params->data_ptr = buf;
+				params->rsize = buffer_size;
+				params->data_size = data_size;
+				params->desc_ptr = out_desc;
+				params->desc_num = desc_num;
+			}
+			else if ( buf != params->rbuf )
+				free(buf);
+		}
+	} /* end if ( NULL == params ) */
+
+	wake_local_call( call, error );
+
+	return;
+}
+
+static void begin_invocation( struct door_server_args_t* args,
+                              struct door_data* p
+                            )
+/* Counts the call that args describes as started on the door p, and takes a
+ * reference to its counters for the invocation to update when it ends.
+ */
+{
+	struct door_counters* const c = p->counters;
+
+	counters_hold(c);
+	counters_add( &c->stats.ds_calls, 1 );
+	counters_add( &c->stats.ds_bytes_in, args->data_size );
+	counters_add( &c->stats.ds_active, 1 );
+
+	args->counters = c;
+	args->start_ns = counters_now();
+	args->id = p->id;
+	args->dispatch_ns = 0;
+	args->return_ns = 0;
+
+	return;
+}
+
+static void end_invocation( struct door_server_args_t* args,
+                            size_t data_size
+                          )
+/* Counts the invocation as finished, having returned data_size bytes, and
+ * releases its counters.  Does nothing the second time.
+ */
+{
+	struct door_counters* const c = args->counters;
+
+	if ( NULL == c )
+		return;
+
+	counters_add( &c->stats.ds_bytes_out, data_size );
+	counters_latency( c, counters_now() - args->start_ns );
+	counters_sub( &c->stats.ds_active, 1 );
+
+	args->counters = NULL;
+	counters_release(c);
+
+	return;
+}
+
+static void record_if_slow( const struct door_server_args_t* args )
+/* Hands the invocation args describes, which has just finished, to the
+ * flight recorder if it took long enough.
+ */
+{
+	const uint64_t now = counters_now();
+
+	if ( ! flight_is_slow( now - args->start_ns ) )
+		return;
+
+	flight_record( args->id,
+	               args->data_size,
+	               args->start_ns,
+	               args->dispatch_ns,
+	               ( 0 != args->return_ns ) ? args->return_ns : now,
+	               now
+	             );
+
+	return;
+}
+
+static int check_results( const void* data_ptr,
+                          size_t data_size,
+                          const door_desc_t* desc_ptr,
+                          uint_t num_desc
+                        )
+/* Checks the results a server procedure returns, as door_return() does
+ * before it sends them.
+ *
+ * Returns 0 if they will do, or the errno to report.
+ */
+{
+	uint_t i;
+
+	if ( ( NULL == data_ptr && 0 != data_size ) ||
+	     ( NULL == desc_ptr && 0 != num_desc )
+	   )
+		return EFAULT;
+
+	if ( DESC_LIMIT < num_desc )
+		return EMFILE;
+
+	for ( i = 0; i < num_desc; ++i )
+		if ( !( DOOR_DESCRIPTOR & desc_ptr[i].d_attributes ) )
+			return EINVAL;
+
+	return 0;
+}
+
+static int deliver_results( struct door_server_args_t* args,
+                            const void* data_ptr,
+                            size_t data_size,
+                            const door_desc_t* desc_ptr,
+                            uint_t num_desc
+                          )
+/* Sends the results of the invocation args describes to the caller, as
+ * door_return() does once it has checked them, and ends the invocation.  The
+ * caller has disabled cancellation.
+ *
+ * Returns 0 on success, or -1 if it cannot send them, setting errno.
+ */
+{
+	static const int ERROR = -1, SUCCESS = 0;
+	struct door_counters* counters;
+	struct msg_door_return outgoing;
+	struct iovec send_iovs[2];
+
+	DOOR_PROBE3( call_return, args->id, data_size, num_desc );
+	args->return_ns = counters_now();
+
+	if ( args->one_way ) {
+/* No one is waiting for the results.  Any descriptors the server asked us to
+ * release go as if we had passed them.
+ */
+		end_invocation( args, 0 );
+		release_descs( desc_ptr, num_desc );
+		record_if_slow(args);
+		return SUCCESS;
+	}
+
+	if ( NULL != args->local ) {
+/* A local call.  Hand the results straight to the waiting caller. */
+		end_invocation( args, data_size );
+		finish_local_call( args->local,
+		                   data_ptr,
+		                   data_size,
+		                   desc_ptr,
+		                   num_desc
+		                 );
+		record_if_slow(args);
+		return SUCCESS;
+	}
+
+	msg_door_return_init( &outgoing, data_size, num_desc, args->tag );
+
+	bzero( send_iovs, 2*sizeof(struct iovec) );
+
+	send_iovs[0].iov_base = &outgoing;
+	send_iovs[0].iov_len = sizeof(outgoing);
+
+	send_iovs[1].iov_base = (void*)data_ptr;
+	send_iovs[1].iov_len = data_size;
+
+/* Count the call as finished before the client can see the results, so that
+ * anything it asks afterwards reflects the call.  Keep the counters long
+ * enough to count a failure to send them.
+ */
+	counters = args->counters;
+	if ( NULL != counters )
+		counters_hold(counters);
+
+	end_invocation( args, data_size );
+
+	if ( 0 > args->transport->send( args->fd,
+	                                send_iovs,
+	                                2,
+	                                desc_ptr,
+	                                num_desc
+	                              )
+	   ) {
+		if ( NULL != counters ) {
+			counters_error( counters, errno );
+			counters_release(counters);
+		}
+
+		return ERROR;
+	}
+
+	if ( NULL != counters )
+		counters_release(counters);
+
+	release_descs( desc_ptr, num_desc );
+	record_if_slow(args);
+
+	return SUCCESS;
+}
+
+static void deliver_error( struct door_server_args_t* args, int error )
+/* Fails the invocation args describes with error, which the caller gets in
+ * place of results, and ends it.
+ */
+{
+	DOOR_PROBE3( call_return, args->id, 0, 0 );
+	args->return_ns = counters_now();
+
+	if ( NULL != args->counters )
+		counters_error( args->counters, error );
+	end_invocation( args, 0 );
+
+	if ( NULL != args->local )
+		wake_local_call( args->local, error );
+	else if ( ! args->one_way )
+		xmit_call_error( args->transport, args->fd, error, args->tag );
+
+	record_if_slow(args);
+
+	return;
 }
 
 static void* start_unreferenced_invocation_thread( void* p )
@@ -557,6 +1133,8 @@ static void* start_unreferenced_invocation_thread( void* p )
 
 	const door_server_proc_t server_proc =
 ((struct door_data*)p)->server_proc;
+	const door_batch_proc_t batch_proc =
+((struct door_data*)p)->batch_proc;
 	void* const cookie = ((struct door_data*)p)->cookie;
 
 /* We should set the file descriptor key to an invalid value, just in case the
@@ -567,7 +1145,15 @@ static void* start_unreferenced_invocation_thread( void* p )
 		fatal_system_error(__FILE__,__LINE__,"pthread_setspecific");
 
 /* The Sun man page says that the dp parameter is 0, not NULL. */
-	server_proc( cookie, DOOR_UNREF_DATA, 0, NULL, 0 );
+	if ( NULL != batch_proc ) {
+		door_batch_call_t call;
+
+		bzero( &call, sizeof(call) );
+		call.argp = DOOR_UNREF_DATA;
+		batch_proc( cookie, &call, 1 );
+	}
+	else
+		server_proc( cookie, DOOR_UNREF_DATA, 0, NULL, 0 );
 
 	return NULL;
 }
@@ -579,6 +1165,8 @@ static inline void invoke_unreferenced( struct door_data* p )
 {
 	pthread_t thread_id;
 
+	DOOR_PROBE1( unref, p->id );
+
 	if ( 0 !=
 	     pthread_create( &thread_id,
 	                     NULL,
@@ -588,6 +1176,8 @@ static inline void invoke_unreferenced( struct door_data* p )
 	   )
 		fatal_system_error( __FILE__, __LINE__, "pthread_create" );
 
+	pthread_detach(thread_id);
+
 	return;
 }
 
@@ -597,7 +1187,10 @@ static inline void lock_door_table(void)
  * memory.
  */
 {
-	if ( 0 != pthread_rwlock_rdlock(&door_table_lock) ) {
+	if ( 0 != LOCKSTAT_RDLOCK( &door_table_lock,
+	                           &lock_stats[DOOR_LOCK_TABLE]
+	                         )
+	   ) {
 		perror("pthread_rwlock_rdlock");
 		exit(EXIT_FAILURE);
 	}
@@ -626,7 +1219,10 @@ static inline void lock_door_data( struct door_data* p )
 {
 	assert( NULL != p );
 
-	if ( 0 != pthread_mutex_lock( & p->lock_data ) )
+	if ( 0 != LOCKSTAT_MUTEX_LOCK( & p->lock_data,
+	                               &lock_stats[DOOR_LOCK_DATA]
+	                             )
+	   )
 		fatal_system_error( __FILE__, __LINE__, "Lock door_data" );
 
 	return;
@@ -663,6 +1259,48 @@ static inline void increment_door_data_pointers( struct door_data* p )
 	return;
 }
 
+static void free_door_data( struct door_data* p )
+/* Frees the door_data structure p, which the calling thread has locked, and
+ * all memory allocated to its members.
+ *
+ * According to the POSIX spec, attempting to destroy a pthread_cond_t that
+ * other threads are waiting on causes undefined behavior.  Because there are
+ * no other copies of p left, however, there must be no such threads.
+ * Likewise, we must free the lock because destroying an owned lock causes
+ * undefined behavior.  Because there are no other copies of p left, there
+ * must not be any other threads waiting to grab the lock.
+ */
+{
+	pthread_cond_destroy( & p->can_listen );
+	unlock_door_data(p);
+	pthread_mutex_destroy( & p->lock_data );
+	counters_release(p->counters);
+	free(p);
+
+	return;
+}
+
+static void drop_door_data( struct door_data* p )
+/* Lets go of a hold that hold_local_door_data() took on p, freeing it if the
+ * door was released meanwhile.  Like release_door_data(), it locks the data
+ * itself.
+ */
+{
+	assert( NULL != p );
+
+	lock_door_data(p);
+
+	assert( 0 < p->holds );
+	--p->holds;
+
+	if ( 0 > p->pointers && 0 == p->holds )
+		free_door_data(p);
+	else
+		unlock_door_data(p);
+
+	return;
+}
+
 static inline void release_door_data( struct door_data* p )
 /* Decrements the reference count of pointers to the structure by 1.  If the
  * new reference count is 0, this function frees all memory allocated to the
@@ -689,20 +1327,16 @@ static inline void release_door_data( struct door_data* p )
  */
 	assert( 0 <= p->pointers );
 
-	if ( 0 == p->pointers ) {
-/* We hold the last copy of the data.  We can and should safely free it.
- *
- * According to the POSIX spec, attempting to destroy a pthread_cond_t that
- * other threads are waiting on causes undefined behavior.  Because there are
- * no other copies of p left, however, there must be no such threads.
- * Likewise, we must free the lock because destroying an owned lock causes
- * undefined behavior.  Because there are no other copies of p left, there
- * must not be any other threads waiting to grab the lock.
+	if ( 0 == p->pointers && 0 == p->holds ) {
+/* We hold the last copy of the data.  We can and should safely free it. */
+		free_door_data(p);
+	}
+	else if ( 0 == p->pointers ) {
+/* A call or query from this process still holds the data.  The last to let
+ * go frees it.
  */
-		pthread_cond_destroy( & p->can_listen );
+		--p->pointers;
 		unlock_door_data(p);
-		pthread_mutex_destroy( & p->lock_data );
-		free(p);
 	}
 	else if ( ( ! p->revoked ) &&
 	          ( 2 == p->pointers ) &&
@@ -714,6 +1348,7 @@ static inline void release_door_data( struct door_data* p )
 		--p->pointers;
 		p->was_unref = true;
 		p->attr |= DOOR_IS_UNREF;
+		counters_add( &p->counters->stats.ds_unref, 1 );
 
 		unlock_door_data(p);
 		invoke_unreferenced(p);
@@ -726,418 +1361,2928 @@ static inline void release_door_data( struct door_data* p )
 	return;
 }
 
-static inline void handle_door_call( int fd, struct door_data* p )
-/* Reads a msg_door_call message from the connected socket fd, calls
- * that thread's server procedure with the correct parameters.
+static void release_calls( struct conn_calls* calls )
+/* Drops a reference to the list of calls on a connection, freeing it with the
+ * last.  That also releases the connection's reference to its door, which
+ * must outlive any call running on it.
  */
 {
-	struct msg_door_call incoming;
-	void* argp = NULL;
-	ssize_t arg_size;
-	struct iovec read_iovs[2];
-	struct msghdr read_hdr;
-	struct door_server_args_t* arg_ptr;
+	int refs;
+
+	if ( 0 != pthread_mutex_lock(&calls->lock) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_mutex_lock");
+
+	refs = --calls->refs;
+
+	if ( 0 != pthread_mutex_unlock(&calls->lock) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_mutex_unlock");
+
+	if ( 0 == refs ) {
+		struct door_data* const door = calls->door;
+
+		pthread_mutex_destroy(&calls->lock);
+		free(calls);
+		release_door_data(door);
+	}
+
+	return;
+}
+
+/* Calls that wait for a thread start it once an earlier call ends. */
+static void* start_server_proc( void* p );
+
+static void start_call( struct door_server_args_t* args )
+/* Starts the thread to run the call that args describes, which must be on its
+ * connection's list if it comes from another process.  Should the client have
+ * cancelled the call while it waited, the thread never runs the server
+ * procedure.  The calling thread must block all signals, for the new one to
+ * inherit.
+ */
+{
+	struct conn_calls* const calls = args->calls;
 	pthread_t thread_id;
 
-	if ( 0 > recv( fd, &incoming, sizeof(incoming), MSG_PEEK ) ) {
-		return;
+/* No one can cancel a call from this process. */
+	if ( NULL != calls && 0 != pthread_mutex_lock(&calls->lock) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_mutex_lock");
+
+	if ( 0 != pthread_create( &thread_id, NULL, start_server_proc, args ) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_create");
+
+	args->thread = thread_id;
+	args->started = true;
+
+	if ( args->cancelled )
+		pthread_cancel(thread_id);
+
+	if ( NULL != calls && 0 != pthread_mutex_unlock(&calls->lock) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_mutex_unlock");
+
+/* No one joins the thread, so its resources must go back when it exits. */
+	pthread_detach(thread_id);
+
+	return;
+}
+
+static void append_waiting( struct door_data* p,
+                            unsigned int priority,
+                            struct waiting_client* client
+                          )
+/* Puts client at the end of the door p's turns for calls of the given
+ * priority.  The caller holds its lock.
+ */
+{
+	client->next = NULL;
+	if ( NULL == p->waiting_tail[priority] )
+		p->waiting_head[priority] = client;
+	else
+		p->waiting_tail[priority]->next = client;
+	p->waiting_tail[priority] = client;
+
+	return;
+}
+
+static size_t priority_limit( const struct door_data* p, unsigned int priority )
+/* Returns how many calls may be running on the door p,
+ * whose lock the caller holds, for one of the given priority to start, or
+ * SIZE_MAX if there is no limit.
+ */
+{
+	if ( 0 == p->max_active )
+		return SIZE_MAX;
+	else if ( DOOR_PRIORITY_HIGH == priority )
+		return p->max_active;
+	else if ( p->high_reserved < p->max_active )
+		return p->max_active - p->high_reserved;
+	else
+		return 0;
+}
+
+static bool queue_call( struct door_data* p,
+                        struct door_server_args_t* args,
+                        pid_t pid
+                      )
+/* Puts the call args describes, from the client pid, on the end of that
+ * client's queue for its priority on the door p, whose lock the caller holds.
+ * A client with no calls of that priority waiting yet takes its turn after
+ * those that have.
+ *
+ * Returns false, having queued nothing, if it cannot allocate the memory.
+ */
+{
+	struct waiting_client* client;
+
+	for ( client = p->waiting_head[args->priority];
+	      NULL != client && pid != client->pid;
+	      client = client->next
+	    )
+		;
+
+	if ( NULL == client ) {
+		client = malloc( sizeof(struct waiting_client) );
+		if ( NULL == client )
+			return false;
+
+		client->pid = pid;
+		client->head = NULL;
+		append_waiting( p, args->priority, client );
 	}
 
-	if ( ! is_msg_door_call(&incoming) ) {
-/* If we're here and the next message isn't a door_call, something
- * broke.  (Eliminate this check for speed?)
+	args->queue_next = NULL;
+	if ( NULL == client->head )
+		client->head = args;
+	else
+		client->tail->queue_next = args;
+	client->tail = args;
+
+	return true;
+}
+
+static struct door_server_args_t* take_waiting( struct door_data* p,
+                                               unsigned int priority
+                                             )
+/* Takes the oldest call of the given priority from the client whose turn is
+ * next on the door p, whose lock the caller holds, and returns it.  At least
+ * one such call must be waiting.
  */
-		xmit_error( fd, EBADMSG );
-		return;
+{
+	struct waiting_client* const client = p->waiting_head[priority];
+	struct door_server_args_t* const args = client->head;
+
+	client->head = args->queue_next;
+
+	p->waiting_head[priority] = client->next;
+	if ( NULL == p->waiting_head[priority] )
+		p->waiting_tail[priority] = NULL;
+
+/* A client with more calls waiting goes to the back of the line. */
+	if ( NULL == client->head )
+		free(client);
+	else
+		append_waiting( p, priority, client );
+
+	return args;
+}
+
+static bool withdraw_waiting( struct door_data* p,
+                              struct door_server_args_t* args,
+                              pid_t pid
+                            )
+/* Takes the call args describes off the client pid's queue on the door p,
+ * whose lock the caller holds.  Returns false if it is not there, having had
+ * its thread already.
+ */
+{
+	const unsigned int priority = args->priority;
+	struct waiting_client* client;
+	struct waiting_client* before = NULL;
+	struct door_server_args_t* call;
+	struct door_server_args_t* previous = NULL;
+
+	for ( client = p->waiting_head[priority];
+	      NULL != client && pid != client->pid;
+	      client = client->next
+	    )
+		before = client;
+
+	if ( NULL == client )
+		return false;
+
+	for ( call = client->head;
+	      NULL != call && args != call;
+	      call = call->queue_next
+	    )
+		previous = call;
+
+	if ( NULL == call )
+		return false;
+
+	if ( NULL == previous )
+		client->head = args->queue_next;
+	else
+		previous->queue_next = args->queue_next;
+	if ( args == client->tail )
+		client->tail = previous;
+
+/* A client with no more calls waiting gives up its turn. */
+	if ( NULL == client->head ) {
+		if ( NULL == before )
+			p->waiting_head[priority] = client->next;
+		else
+			before->next = client->next;
+		if ( client == p->waiting_tail[priority] )
+			p->waiting_tail[priority] = before;
+
+		free(client);
 	}
 
-	arg_size = msg_door_call_get_arg_size(&incoming);
+	return true;
+}
+
+static void finish_call_slot( struct door_data* p )
+/* Hands the thread of a call that has just ended on the door p to the waiting
+ * call of the highest priority that the door's limits
+ * still allow, if any.  Otherwise, frees it.
+ */
+{
+	struct door_server_args_t* next = NULL;
+	unsigned int priority;
 
 	lock_door_data(p);
-	if ( 0 > arg_size ||
-	     p->data_max < (size_t)arg_size ||
-	     p->data_min > (size_t)arg_size
-	   ) {
-		unlock_door_data(p);
-		xmit_error( fd, ENOBUFS );
-		return;
+
+/* The call that ended still counts in active, so a waiting one may have its
+ * thread while active is at the limit for its priority, or whatever the limit
+ * if the door would otherwise be idle.
+ */
+	for ( priority = PRIORITIES; NULL == next && 0 < priority; --priority )
+		if ( NULL != p->waiting_head[priority - 1] &&
+		     ( 1 == p->active ||
+		       p->active <= priority_limit( p, priority - 1 )
+		     )
+		   )
+			next = take_waiting( p, priority - 1 );
+
+	if ( NULL != next ) {
+		--p->queued;
+		counters_sub( &p->counters->stats.ds_queued, 1 );
 	}
 	else
-		unlock_door_data(p);
+		--p->active;
 
-	if ( 0 != arg_size ) {
-		argp = malloc((size_t)arg_size);
+	unlock_door_data(p);
 
-		if ( NULL == argp ) {
-			xmit_error( fd, ENOBUFS );
-			return;
-		}
-	}
-/* We have stored the socket to send the results to where door_return()
- * can retrieve it.  We know that arg_size is an appropriate amount of
- * data; furthermore, if it is nonzero, argp points to a buffer large
- * enough to hold it, and which will automatically be freed upon thread
- * cancellation.
- */
-	bzero( read_iovs, 2*sizeof(struct iovec) );
-	bzero( &read_hdr, sizeof(read_hdr) );
+	if ( NULL != next )
+		start_call(next);
 
-	read_hdr.msg_iov = read_iovs;
-	read_hdr.msg_iovlen = 2;
+	return;
+}
 
-	read_iovs[0].iov_base = &incoming;
-	read_iovs[0].iov_len = sizeof(incoming);
+static enum admission admit_call( struct door_data* p,
+                                  struct door_server_args_t* args
+                                )
+/* Decides whether the door p can take the call that args describes, given its
+ * limits on the calls running and waiting.  A call it admits is counted as
+ * started and put on its connection's list, or, from this process, takes a
+ * hold on p; one that must wait for a thread also goes on the end of its
+ * client's queue.  The calls of a batch that args begins go with it.
+ */
+{
+	struct conn_calls* const calls = args->calls;
+	enum admission result;
 
-	read_iovs[1].iov_base = argp;
-	read_iovs[1].iov_len = (size_t)arg_size;
+	lock_door_data(p);
 
-	if ( (ssize_t)sizeof(struct msg_door_call) + arg_size !=
-	     recvmsg( fd, &read_hdr, 0 )
+/* An idle door always has a thread for the call, whatever its limits say. */
+	if ( 0 == p->active ||
+	     p->active < priority_limit( p, args->priority )
 	   ) {
-		xmit_error( fd, EBADMSG );
-		return;
+		++p->active;
+		result = admit_run;
+	}
+	else if ( p->queued < p->max_queued &&
+	          queue_call( p,
+	                      args,
+	                      ( NULL != calls ) ? calls->client : getpid()
+	                    )
+	        ) {
+		++p->queued;
+		result = admit_queue;
 	}
+	else
+		result = admit_refuse;
 
-/* Handle the door call asynchronously, so as not to block the socket.  (Also,
- * this allows door_return() to keep track of which call it's returning from
- * using thread-specific data.
+	if ( admit_refuse != result ) {
+		struct door_server_args_t* member;
+
+/* Every call of a batch counts, though they share a thread. */
+		for ( member = args; NULL != member; member = member->batch_next )
+			begin_invocation( member, p );
+		if ( admit_queue == result )
+			counters_add( &p->counters->stats.ds_queued, 1 );
+
+		if ( NULL == calls )
+			++p->holds;
+		else {
+/* The call's thread cannot take it off the list before it is there. */
+			if ( 0 != pthread_mutex_lock(&calls->lock) )
+				fatal_system_error(__FILE__,
+				                   __LINE__,
+				                   "pthread_mutex_lock"
+				                  );
+
+			args->next = calls->first;
+			calls->first = args;
+			++calls->refs;
+
+			if ( 0 != pthread_mutex_unlock(&calls->lock) )
+				fatal_system_error(__FILE__,
+				                   __LINE__,
+				                   "pthread_mutex_unlock"
+				                  );
+		}
+	}
+
+	unlock_door_data(p);
+
+	return result;
+}
+
+static void leave_thread( struct door_server_args_t* args )
+/* Takes the call that args describes off its connection's list, if it comes
+ * from another process, and gives up the thread serving it to a waiting call.
+ * The call keeps its reference to the list, or its hold on its door.
  */
-	arg_ptr = malloc( sizeof(struct door_server_args_t) );
-	if ( NULL == arg_ptr ) {
-		xmit_error( fd, ENOBUFS );
+{
+	struct conn_calls* const calls = args->calls;
+	struct door_server_args_t** link;
+
+	if ( NULL == calls ) {
+		finish_call_slot(args->door);
 		return;
 	}
 
-	arg_ptr->fd = fd;
-	arg_ptr->data_ptr = argp;
-	arg_ptr->data_size = (size_t)arg_size;
-	arg_ptr->desc_ptr = NULL;
-	arg_ptr->desc_num = 0;
-/* No other function alters these data members during the door's lifetime.
- * Therefore, we do not need to lock the data to prevent another process from
- * writing to them while we are reading.
- */
-	arg_ptr->server_proc = p->server_proc;
-	arg_ptr->cookie = p->cookie;
+	if ( 0 != pthread_mutex_lock(&calls->lock) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_mutex_lock");
 
-	if ( 0 != pthread_create( &thread_id, NULL, start_server_proc, arg_ptr ) )
-		fatal_system_error(__FILE__,__LINE__,"pthread_create");
+	for ( link = &calls->first; args != *link; link = &(*link)->next )
+		;
+	*link = args->next;
+
+	if ( 0 != pthread_mutex_unlock(&calls->lock) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_mutex_unlock");
+
+	finish_call_slot(calls->door);
 
 	return;
 }
 
-static inline void handle_msg_request( int fd, struct door_data* p )
-/* Reads a request message from the connected socket fd, generates a message
- * based on the information to which p points, and transmits that message
- * back.
- *
- * Transmits back an error message (EINVAL) if it does not recognize the
- * request.
+static void end_server_thread( void* p )
+/* Runs as the thread serving the call p describes exits, whether its server
+ * procedure returned, called door_return() or was cancelled, and gives up the
+ * thread, taking a call from another process off its connection's list.
  */
 {
-	struct msg_request incoming;
+	struct door_server_args_t* const args = p;
+	struct conn_calls* calls;
 
-	if ( 0 > recv( fd, &incoming, sizeof(incoming), 0 ) ) {
+/* A deferred call is no longer the thread's, and may be finished already. */
+	if ( args != pthread_getspecific(server_arg_buf) )
 		return;
-	}
 
-	if ( ! is_msg_request(&incoming) ) {
-/* If it's not an informational request, we shouldn't be here. */
-		xmit_error( fd, EBADMSG );
-		return;
+/* Only a cancelled call is still unfinished.  The client expects no reply. */
+	if ( NULL != args->counters ) {
+		counters_error( args->counters, ECANCELED );
+		end_invocation( args, 0 );
 	}
 
-	switch ( msg_request_decode(&incoming) ) {
-		case 0: { /* door_info */
-			struct msg_door_info outgoing;
+	calls = args->calls;
+	leave_thread(args);
 
-			lock_door_data(p);	/* Necessary? */
-			msg_door_info_init( &outgoing,
-			                    p->target,
-			                    p->server_proc,
-			                    p->cookie,
-			                    p->attr,
-			                    p->id
-			                  );
-			unlock_door_data(p);
+	if ( NULL != calls )
+		release_calls(calls);
+	else
+		drop_door_data(args->door);
 
-			send( fd, &outgoing, sizeof(outgoing), MSG_EOR );
-			break;
-		}
-		case 1: { /* data_max */
-			struct msg_door_getparam outgoing;
+	return;
+}
 
-			lock_door_data(p);
-			msg_door_getparam_init( &outgoing, 1, p->data_max );
-			unlock_door_data(p);
-			send( fd, &outgoing, sizeof(outgoing), MSG_EOR );
-			break;
-		}
-		case 2: { /* data_min */
-			struct msg_door_getparam outgoing;
+static void return_batch( struct door_server_args_t* args )
+/* Sends each call of the batch that args begins the results the batch server
+ * procedure set for it, or fails them all with ENOMEM if there are none, and
+ * frees all but the first, which the thread frees as it exits.  The caller
+ * has disabled cancellation.
+ */
+{
+	door_batch_call_t* const calls = args->batch_calls;
+	struct door_server_args_t* call = args;
+	struct door_server_args_t* next;
+	size_t i;
 
-			lock_door_data(p);
-			msg_door_getparam_init( &outgoing, 2, p->data_min );
-			send( fd, &outgoing, sizeof(outgoing), MSG_EOR );
-			unlock_door_data(p);
-			break;
-		}
-		case 3: { /* desc_max */
-			struct msg_door_getparam outgoing;
+	for ( i = 0; NULL != call; ++i, call = next ) {
+		next = call->batch_next;
 
-/* The implementation does not yet support descriptor passing. */
-			msg_door_getparam_init( &outgoing, 3, 0 );
-			send( fd, &outgoing, sizeof(outgoing), MSG_EOR );
-			break;
+		if ( NULL == calls )
+			deliver_error( call, ENOMEM );
+		else {
+			const door_batch_call_t* const c = &calls[i];
+			int error = c->error;
+
+			if ( 0 == error )
+				error = check_results( c->data_ptr,
+				                       c->data_size,
+				                       c->desc_ptr,
+				                       c->desc_num
+				                     );
+
+/* A call whose results cannot be sent has lost its client, and is counted as
+ * failed, so there is no one left to tell.
+ */
+			if ( 0 != error )
+				deliver_error( call, error );
+			else
+				deliver_results( call,
+				                 c->data_ptr,
+				                 c->data_size,
+				                 c->desc_ptr,
+				                 c->desc_num
+				               );
 		}
-		default: { /* Bad or unknown request! */
-			xmit_error( fd, EINVAL );
+
+		if ( call != args ) {
+			free(call->buffer);
+			free(call);
 		}
 	}
 
+	free(calls);
+	args->batch_calls = NULL;
+	args->batch_next = NULL;
+
 	return;
 }
 
-static void* connection_listen( void* connection_ptr )
-/* Listen for messages on the given connection.  The argument is a
- * pointer to a door_connect_t structure.  This thread must free it when
- * finished.
- *
- * It performs little or no argument-checking and always "returns" NULL.
+static void serve_batch( struct door_server_args_t* args )
+/* Hands the calls of the batch that args begins to the batch server
+ * procedure, sends their results, and ends the thread.
  */
 {
-	const int fd = ((struct door_connect_t*)connection_ptr)->listen_fd;
-	struct door_data* const p =
-((struct door_connect_t*)connection_ptr)->data_ptr;
-	long long int code;	/* The incoming message code. */
-
-/* Since we've already copied the data to local storage, we no longer need
- * the buffer.
- */
-	free(connection_ptr);
+	struct door_server_args_t* call;
+	door_batch_call_t* calls;
+	size_t count = 0, i;
+
+/* The calls of the batch reach the procedure together. */
+	for ( call = args; NULL != call; call = call->batch_next ) {
+		call->dispatch_ns = args->dispatch_ns;
+		++count;
+	}
 
-/* Peek ahead at the type of the next message. */
-	while ( 0 <= ( code = message_type(fd) ) ) {
-		switch (code) {
-			case code_request:
-				handle_msg_request( fd, p );
-				break;
-			case code_door_call:
-				handle_door_call( fd, p );
-				break;
-			default: {
-				xmit_error( fd, ENOTSUP );
-/* We could recover from this error. We could at least linger.  At present, we
- * just close the socket.
- */
-				close(fd);
-			}
+	calls = calloc( count, sizeof(door_batch_call_t) );
+	args->batch_calls = calls;
+
+	if ( NULL != calls ) {
+		for ( i = 0, call = args;
+		      NULL != call;
+		      ++i, call = call->batch_next
+		    ) {
+			calls[i].argp = call->data_ptr;
+			calls[i].arg_size = call->data_size;
+			calls[i].dp = call->desc_ptr;
+			calls[i].n_desc = call->desc_num;
 		}
+
+		(args->batch_proc)( args->cookie, calls, count );
 	}
 
-/* Our attempt to read a request code failed.  Could this be because the
- * connection no longer exists?
- */
+	pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, NULL );
 
-	release_door_data(p);
-	return NULL;
+	return_batch(args);
+
+	pthread_exit(NULL);
 }
 
-static void* door_listen( void* int_ptr )
-/* This function listens on the door descriptor pointed to by d_ptr
- * (a pointer to const int), and spawns a new thread to listen on each 
- * connection to this descriptor.
- *
- * When the door closes (or becomes invalid), accept() will fail, and 
- * the thread will terminate itself, calling free() on d_ptr.
+static void* start_server_proc( void* p )
+/* Invokes the given server procedure based on the arguments in args.
  *
- * This function is intended as an argument to pthread_create().  It
- * does not handle bad arguments robustly (as they are programming
- * errors).  It always "returns" NULL.
+ * Only the server procedure itself may be cancelled, as the client may ask.
  */
 {
-	const int d = *(const int*)int_ptr;	/* Our door descriptor. */
-/* Keep a reference to the door's associated data. */
-	struct door_data* p;
-	int endpoint;
+	struct door_server_args_t* args = p;
 
-/* Since we've already copied the data to local storage, we no longer need 
- * the buffer.
- */
-	free(int_ptr);
+	pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, NULL );
 
-	lock_door_table();
+/* Store the connection fd where door_return() can retrieve it. */
+	if ( 0 != pthread_setspecific( caller_fd, &args->fd ) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_setspecific");
 
-	if ( fd_server != door_table[d].type ) {
-/* We lost a race with door_revoke(), and the door is no longer valid. */
-		unlock_door_table();
-		return NULL;
-	}
+/* Free the data buffer when this thread exits (outside the critical path). */
+	if ( 0 != pthread_setspecific( door_arg_buf, args->buffer ) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_setspecific");
 
-	p = door_table[d].data;
-	unlock_door_table();	
+/* Also free the argument buffer when this thread exits. */
+	if ( 0 != pthread_setspecific( server_arg_buf, args ) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_setspecific");
+
+	pthread_cleanup_push( end_server_thread, args );
+
+	DOOR_PROBE3( call_dispatch, args->id, args->data_size, args->desc_num );
+	args->dispatch_ns = counters_now();
+
+/* A call cancelled while it waited for us never starts. */
+	pthread_setcancelstate( PTHREAD_CANCEL_ENABLE, NULL );
+	pthread_testcancel();
+
+/* A batch server procedure serves the whole batch, and ends the thread. */
+	if ( NULL != args->batch_proc )
+		serve_batch(args);
+
+	(args->server_proc)( args->cookie,
+	                     args->data_ptr,
+	                     args->data_size,
+	                     args->desc_ptr,
+	                     args->desc_num
+	                   );
+
+	pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, NULL );
+
+/* door_complete() answers a deferred call, and may have freed args already. */
+	if ( args != pthread_getspecific(server_arg_buf) )
+		pthread_exit(NULL);
+
+/* The server procedure returned without calling door_return().  The caller
+ * would wait forever, so give it an empty result.
+ */
+	end_invocation( args, 0 );
+
+	if ( NULL != args->local )
+		finish_local_call( args->local, NULL, 0, NULL, 0 );
+	else if ( ! args->one_way ) {
+		struct msg_door_return outgoing;
+
+		msg_door_return_init( &outgoing, 0, 0, args->tag );
+		transport_send_msg( args->transport,
+		                    args->fd,
+		                    &outgoing,
+		                    sizeof(outgoing)
+		                  );
+	}
+
+	record_if_slow(args);
+
+	pthread_cleanup_pop(1);
+
+	return NULL;
+}
+
+static bool is_same_user( const struct door_transport* t, int fd )
+/* Returns true if the peer connected to fd runs as the same user as this
+ * process, and so can pass us data by reference.
+ */
+{
+	pid_t pid;
+	uid_t uid;
+
+	if ( 0 != t->peer_cred( fd, &pid, &uid ) )
+		return false;
+
+	return geteuid() == uid;
+}
+
+static int read_call_ref( const struct door_transport* t,
+                          int fd,
+                          const struct msg_door_call_ref* ref,
+                          void* argp,
+                          size_t arg_size
+                        )
+/* Copies the arg_size bytes of argument data that the msg_door_call_ref
+ * message ref describes from the client's address space into argp.  The
+ * client must be the process at the other end of the connection fd; we
+ * refuse to read from any other.
+ *
+ * Returns 0 on success, or an error code to send back to the client.
+ */
+{
+#if defined(__linux__)
+	pid_t pid;
+	uid_t uid;
+	struct iovec local, remote;
+	ssize_t bytes_read;
+
+	if ( 0 != t->peer_cred( fd, &pid, &uid ) )
+		return errno;
+
+	if ( pid != msg_door_call_ref_get_pid(ref) )
+		return EPERM;
+
+	local.iov_base = argp;
+	local.iov_len = arg_size;
+	remote.iov_base = msg_door_call_ref_get_address(ref);
+	remote.iov_len = arg_size;
+
+/* A single call may return a partial read, so keep going until done. */
+	while ( 0 < local.iov_len ) {
+		bytes_read = process_vm_readv( pid, &local, 1, &remote, 1, 0 );
+
+		if ( 0 > bytes_read )
+			return errno;
+		else if ( 0 == bytes_read )
+			return EFAULT;
+
+		local.iov_base = (char*)local.iov_base + bytes_read;
+		local.iov_len -= (size_t)bytes_read;
+		remote.iov_base = (char*)remote.iov_base + bytes_read;
+		remote.iov_len -= (size_t)bytes_read;
+	}
+
+	return 0;
+#else
+	return ENOTSUP;
+#endif
+}
+
+static inline void refuse_call( const struct door_transport* t,
+                                 int fd,
+                                 struct door_data* p,
+                                 int error,
+                                 uint64_t tag,
+                                 bool one_way
+                               )
+/* Counts a call that the door p cannot serve, and sends the client error in
+ * reply to the call with the given tag, unless the call is one_way.
+ */
+{
+	counters_error( p->counters, error );
+	if ( ! one_way )
+		xmit_call_error( t, fd, error, tag );
+
+	return;
+}
+
+static struct door_server_args_t* receive_call( int fd,
+                                                struct door_data* p,
+                                                struct conn_calls* calls
+                                              )
+/* Reads a msg_door_call message from the connection fd, and returns the
+ * arguments for a thread to call the door p's server procedure with, or NULL
+ * if it refused the call.
+ *
+ * Also handles a msg_door_call_ref message, whose data we copy out of the
+ * client instead of the connection.
+ */
+{
+	const struct door_transport* const t = p->transport;
+	union {
+		struct msg_door_call		call;
+		struct msg_door_call_ref	ref;
+	} incoming;
+	bool by_ref, one_way;
+	size_t header_size;
+	uint64_t tag, deadline;
+	unsigned int priority;
+	void* argp = NULL;
+	ssize_t arg_size;
+	ssize_t bytes_read;
+	door_desc_t* desc_ptr = NULL;
+	uint_t desc_num;
+	struct iovec read_iovs[2];
+	struct door_server_args_t* arg_ptr;
+
+	if ( 0 > t->peek( fd, &incoming, sizeof(incoming) ) ) {
+		return NULL;
+	}
+
+	by_ref = is_msg_door_call_ref(&incoming.call);
+
+	if ( ! ( by_ref || is_msg_door_call(&incoming.call) ) ) {
+/* If we're here and the next message isn't a door_call, something
+ * broke.  (Eliminate this check for speed?)
+ */
+		t->discard(fd);
+		refuse_call( t, fd, p, EBADMSG, 0, false );
+		return NULL;
+	}
+
+	tag = msg_door_call_get_tag(&incoming.call);
+	deadline = msg_door_call_get_deadline(&incoming.call);
+	priority = msg_door_call_get_priority(&incoming.call);
+	one_way = 0 != ( CALL_FLAG_ONE_WAY &
+	                 msg_door_call_get_flags(&incoming.call)
+	               );
+	header_size = by_ref ? sizeof(struct msg_door_call_ref) :
+	                       sizeof(struct msg_door_call);
+	arg_size = msg_door_call_get_arg_size(&incoming.call);
+	desc_num = msg_door_call_get_ndesc(&incoming.call);
+
+	lock_door_data(p);
+	if ( by_ref &&
+	     ( 0 == p->cma_min || 0 > arg_size || p->cma_min > (size_t)arg_size )
+	   ) {
+/* We never offered to read this call by reference. */
+		unlock_door_data(p);
+		t->discard(fd);
+		refuse_call( t, fd, p, ENOTSUP, tag, one_way );
+		return NULL;
+	}
+	else if ( 0 > arg_size ||
+	     p->data_max < (size_t)arg_size ||
+	     p->data_min > (size_t)arg_size
+	   ) {
+		unlock_door_data(p);
+		t->discard(fd);
+		refuse_call( t, fd, p, ENOBUFS, tag, one_way );
+		return NULL;
+	}
+	else if ( p->desc_max < desc_num ) {
+/* Solaris reports ENOTSUP for a door that refuses descriptors outright, and
+ * ENFILE for one that merely accepts fewer.
+ */
+		const int error = ( DOOR_REFUSE_DESC & p->attr ) ? ENOTSUP : ENFILE;
+
+		unlock_door_data(p);
+		t->discard(fd);
+		refuse_call( t, fd, p, error, tag, one_way );
+		return NULL;
+	}
+	else
+		unlock_door_data(p);
+
+	if ( 0 != arg_size || 0 != desc_num ) {
+/* Any descriptors share the argument buffer, following the data. */
+		argp = malloc( desc_offset((size_t)arg_size) +
+		               desc_num * sizeof(door_desc_t)
+		             );
+
+		if ( NULL == argp ) {
+			t->discard(fd);
+			refuse_call( t, fd, p, ENOBUFS, tag, one_way );
+			return NULL;
+		}
+
+		if ( 0 != desc_num )
+			desc_ptr = (door_desc_t*)
+( (char*)argp + desc_offset((size_t)arg_size) );
+	}
+/* We have stored the connection to send the results to where door_return()
+ * can retrieve it.  We know that arg_size is an appropriate amount of
+ * data; furthermore, if it is nonzero, argp points to a buffer large
+ * enough to hold it, and which will automatically be freed upon thread
+ * cancellation.
+ */
+	bzero( read_iovs, 2*sizeof(struct iovec) );
+
+	read_iovs[0].iov_base = &incoming;
+	read_iovs[0].iov_len = header_size;
+
+	read_iovs[1].iov_base = argp;
+	read_iovs[1].iov_len = by_ref ? 0 : (size_t)arg_size;
+
+	bytes_read = t->recv( fd, read_iovs, 2, desc_ptr, desc_num );
+
+	if ( (ssize_t)( header_size + read_iovs[1].iov_len ) != bytes_read ) {
+		const int error = ( 0 > bytes_read ) ? errno : EBADMSG;
+
+		if ( 0 <= bytes_read )
+			close_descs( desc_ptr, desc_num );
+
+		free(argp);
+		refuse_call( t, fd, p, error, tag, one_way );
+		return NULL;
+	}
+
+	if ( by_ref ) {
+		const int error =
+read_call_ref( t, fd, &incoming.ref, argp, (size_t)arg_size );
+
+/* The client may not let us read its memory, for all that it runs as our user:
+ * it may be undumpable, or Yama may allow only its ancestors to trace it.  It
+ * sends the call again with the data, so this one has not failed yet.
+ */
+		if ( EPERM == error || EFAULT == error ) {
+			close_descs( desc_ptr, desc_num );
+			free(argp);
+			xmit_call_error( t, fd, CALL_ERROR_UNREADABLE, tag );
+			return NULL;
+		}
+		else if ( 0 != error ) {
+			close_descs( desc_ptr, desc_num );
+			free(argp);
+			refuse_call( t, fd, p, error, tag, one_way );
+			return NULL;
+		}
+	}
+
+	if ( 0 != deadline && deadline <= counters_now() ) {
+/* The client has stopped waiting for the reply, so don't run the call.  It may
+ * even have reused the buffer we read a call by reference from, but only
+ * after the deadline, so we check once we've read it.
+ */
+		close_descs( desc_ptr, desc_num );
+		free(argp);
+		refuse_call( t, fd, p, ETIMEDOUT, tag, one_way );
+		return NULL;
+	}
+
+	DOOR_PROBE3( call_receive, p->id, arg_size, desc_num );
+
+/* Handle the door call asynchronously, so as not to block the connection.  (Also,
+ * this allows door_return() to keep track of which call it's returning from
+ * using thread-specific data.
+ */
+	arg_ptr = malloc( sizeof(struct door_server_args_t) );
+	if ( NULL == arg_ptr ) {
+		close_descs( desc_ptr, desc_num );
+		free(argp);
+		refuse_call( t, fd, p, ENOBUFS, tag, one_way );
+		return NULL;
+	}
+
+	arg_ptr->transport = t;
+	arg_ptr->fd = fd;
+	arg_ptr->data_ptr = argp;
+	arg_ptr->data_size = (size_t)arg_size;
+	arg_ptr->desc_ptr = desc_ptr;
+	arg_ptr->desc_num = desc_num;
+	arg_ptr->buffer = argp;
+	arg_ptr->local = NULL;
+	arg_ptr->door = NULL;
+	arg_ptr->inline_return = NULL;
+	arg_ptr->tag = tag;
+/* A class this version does not know gets the highest it does. */
+	arg_ptr->priority =
+( DOOR_PRIORITY_HIGH < priority ) ? DOOR_PRIORITY_HIGH : priority;
+	arg_ptr->one_way = one_way;
+/* No other function alters these data members during the door's lifetime.
+ * Therefore, we do not need to lock the data to prevent another process from
+ * writing to them while we are reading.
+ */
+	arg_ptr->server_proc = p->server_proc;
+	arg_ptr->batch_proc = p->batch_proc;
+	arg_ptr->cookie = p->cookie;
+	arg_ptr->batch_next = NULL;
+	arg_ptr->batch_calls = NULL;
+	arg_ptr->calls = calls;
+	arg_ptr->started = false;
+	arg_ptr->cancelled = false;
+
+	return arg_ptr;
+}
+
+static void refuse_args( struct door_server_args_t* args, int error )
+/* Refuses the call from another process that args describes with error, and
+ * frees it, along with the rest of the batch it begins.
+ */
+{
+	struct door_server_args_t* next;
+
+	for ( ; NULL != args; args = next ) {
+		next = args->batch_next;
+
+		close_descs( args->desc_ptr, args->desc_num );
+		free(args->buffer);
+		refuse_call( args->transport,
+		             args->fd,
+		             args->calls->door,
+		             error,
+		             args->tag,
+		             args->one_way
+		           );
+		free(args);
+	}
+
+	return;
+}
+
+static void run_inline( struct door_data* p, struct door_server_args_t* args )
+/* Runs the server procedure of the door p, which has DOOR_INLINE, on the call
+ * from another process that args describes, on the connection's listener,
+ * and frees args once the call is answered.  The invocation has begun.
+ * door_return() comes back here rather than ending the thread.  The call
+ * takes no thread, so the door's limits neither admit nor queue it, and it is
+ * on no list for a cancel message to find.
+ */
+{
+	struct conn_calls* const calls = args->calls;
+	jmp_buf returned;
+	int cancel_state;
+
+	pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, &cancel_state );
+
+/* Should the procedure defer the call, it keeps the connection until it
+ * completes.
+ */
+	if ( 0 != pthread_mutex_lock(&calls->lock) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_mutex_lock");
+	++calls->refs;
+	if ( 0 != pthread_mutex_unlock(&calls->lock) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_mutex_unlock");
+
+	args->inline_return = &returned;
+
+	if ( 0 != pthread_setspecific( server_arg_buf, args ) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_setspecific");
+
+	DOOR_PROBE3( call_dispatch, args->id, args->data_size, args->desc_num );
+	args->dispatch_ns = counters_now();
+
+	if ( 0 == setjmp(returned) ) {
+		(args->server_proc)( args->cookie,
+		                     args->data_ptr,
+		                     args->data_size,
+		                     args->desc_ptr,
+		                     args->desc_num
+		                   );
+
+/* The server procedure returned without calling door_return().  Give the
+ * caller an empty result, unless someone else will answer.
+ */
+		if ( args == pthread_getspecific(server_arg_buf) )
+			deliver_results( args, NULL, 0, NULL, 0 );
+	}
+
+/* A deferred call, and its arguments, now belong to door_complete(). */
+	if ( args == pthread_getspecific(server_arg_buf) ) {
+		if ( 0 != pthread_setspecific( server_arg_buf, NULL ) )
+			fatal_system_error(__FILE__,__LINE__,"pthread_setspecific");
+
+		free(args->buffer);
+		free(args);
+		release_calls(calls);
+	}
+
+	pthread_setcancelstate( cancel_state, NULL );
+
+	return;
+}
+
+static inline void handle_door_call( int fd,
+                                     struct door_data* p,
+                                     struct conn_calls* calls
+                                   )
+/* Reads a door call from the connection fd, and calls the door p's server
+ * procedure on a thread of its own, or on this one if the door has
+ * DOOR_INLINE.  A call with a thread of its own goes on the connection's list
+ * of calls until the thread exits.
+ *
+ * A door with a batch server procedure takes every call already waiting on
+ * the connection, up to DOOR_BATCH_MAX, for the same thread.
+ */
+{
+	const struct door_transport* const t = p->transport;
+	struct door_server_args_t* args;
+	struct door_server_args_t* last;
+	long long int code;
+	bool run_here;
+	size_t i;
+
+	args = receive_call( fd, p, calls );
+	if ( NULL == args )
+		return;
+
+	lock_door_data(p);
+	run_here = ( 0 != ( DOOR_INLINE & p->attr ) );
+	if (run_here)
+		begin_invocation( args, p );
+	unlock_door_data(p);
+
+	if (run_here) {
+		run_inline( p, args );
+		return;
+	}
+
+/* Stop at the first message that is not a call, for the listener to handle. */
+	last = args;
+	for ( i = 1;
+	      NULL != p->batch_proc &&
+	      DOOR_BATCH_MAX > i &&
+	      0 == t->wait( fd, 0 );
+	      ++i
+	    ) {
+		code = message_type( t, fd );
+		if ( code_door_call != code && code_door_call_ref != code )
+			break;
+
+		last->batch_next = receive_call( fd, p, calls );
+		if ( NULL != last->batch_next )
+			last = last->batch_next;
+	}
+
+	switch ( admit_call( p, args ) ) {
+		case admit_run:
+			start_call(args);
+			break;
+		case admit_queue:
+			break;
+		case admit_refuse:
+/* Shed the call at once, so that the client can back off. */
+			refuse_args( args, EAGAIN );
+			break;
+	}
+
+	return;
+}
+
+static inline void handle_door_cancel( int fd,
+                                       struct door_data* p,
+                                       struct conn_calls* calls
+                                     )
+/* Reads a msg_door_cancel message from the connection fd, and cancels the
+ * thread running the call it names, unless the door p has DOOR_NO_CANCEL.
+ * The call may well have finished already.
+ */
+{
+	struct msg_door_cancel incoming;
+	struct door_server_args_t* call;
+	uint64_t tag;
+	bool no_cancel;
+
+	if ( (ssize_t)sizeof(incoming) !=
+	     transport_recv_msg( p->transport, fd, &incoming, sizeof(incoming) )
+	   )
+		return;
+
+/* Cancelling one call of a batch would cancel them all. */
+	lock_door_data(p);
+	no_cancel = ( 0 != ( DOOR_NO_CANCEL & p->attr ) ) ||
+	            NULL != p->batch_proc;
+	unlock_door_data(p);
+
+	if (no_cancel)
+		return;
+
+	tag = msg_door_cancel_get_tag(&incoming);
+
+	if ( 0 != pthread_mutex_lock(&calls->lock) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_mutex_lock");
+
+/* The thread is still on the list, so it has not exited. */
+	for ( call = calls->first; NULL != call; call = call->next )
+		if ( tag == call->tag ) {
+/* A call still waiting for a thread is cancelled as it starts. */
+			if ( ! call->cancelled ) {
+				call->cancelled = true;
+				if ( call->started )
+					pthread_cancel(call->thread);
+				DOOR_PROBE1( call_cancel, p->id );
+			}
+			break;
+		}
+
+	if ( 0 != pthread_mutex_unlock(&calls->lock) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_mutex_unlock");
+
+	return;
+}
+
+static struct conn_calls* create_calls( struct door_data* p, int fd )
+/* Returns a new, empty list of calls on the connection fd to the door p, or
+ * NULL.  It takes over the connection's reference to p.
+ */
+{
+	struct conn_calls* calls = malloc( sizeof(struct conn_calls) );
+	uid_t uid;
+
+	if ( NULL == calls )
+		return NULL;
+
+	if ( 0 != pthread_mutex_init( &calls->lock, NULL ) ) {
+		free(calls);
+		return NULL;
+	}
+
+	calls->first = NULL;
+	calls->refs = 1;
+	calls->door = p;
+
+/* Clients we cannot tell apart share their turns. */
+	if ( 0 != p->transport->peer_cred( fd, &calls->client, &uid ) )
+		calls->client = 0;
+
+	return calls;
+}
+
+static inline door_server_proc_t door_proc( const struct door_data* p )
+/* Returns the server procedure of the door p, whichever kind it is, for
+ * door_info() to report.
+ */
+{
+	if ( NULL != p->batch_proc )
+		return (door_server_proc_t)p->batch_proc;
+
+	return p->server_proc;
+}
+
+static inline void handle_msg_request( int fd, struct door_data* p )
+/* Reads a request message from the connection fd, generates a message based
+ * on the information to which p points, and transmits that message back.
+ *
+ * Transmits back an error message (EINVAL) if it does not recognize the
+ * request.
+ */
+{
+	const struct door_transport* const t = p->transport;
+	struct msg_request incoming;
+
+	if ( 0 > transport_recv_msg( t, fd, &incoming, sizeof(incoming) ) ) {
+		return;
+	}
+
+	if ( ! is_msg_request(&incoming) ) {
+/* If it's not an informational request, we shouldn't be here. */
+		xmit_error( t, fd, EBADMSG );
+		return;
+	}
+
+	switch ( msg_request_decode(&incoming) ) {
+		case 0: { /* door_info */
+			struct msg_door_info outgoing;
+
+			lock_door_data(p);	/* Necessary? */
+			msg_door_info_init( &outgoing,
+			                    p->target,
+			                    door_proc(p),
+			                    p->cookie,
+			                    p->attr,
+			                    p->id
+			                  );
+			unlock_door_data(p);
+
+			transport_send_msg( t, fd, &outgoing, sizeof(outgoing) );
+			break;
+		}
+		case 1: { /* data_max */
+			struct msg_door_getparam outgoing;
+
+			lock_door_data(p);
+			msg_door_getparam_init( &outgoing, 1, p->data_max );
+			unlock_door_data(p);
+			transport_send_msg( t, fd, &outgoing, sizeof(outgoing) );
+			break;
+		}
+		case 2: { /* data_min */
+			struct msg_door_getparam outgoing;
+
+			lock_door_data(p);
+			msg_door_getparam_init( &outgoing, 2, p->data_min );
+			transport_send_msg( t, fd, &outgoing, sizeof(outgoing) );
+			unlock_door_data(p);
+			break;
+		}
+		case 3: { /* desc_max */
+			struct msg_door_getparam outgoing;
+
+			lock_door_data(p);
+			msg_door_getparam_init( &outgoing, 3, p->desc_max );
+			unlock_door_data(p);
+			transport_send_msg( t, fd, &outgoing, sizeof(outgoing) );
+			break;
+		}
+		case 4: { /* cma_min */
+			struct msg_door_getparam outgoing;
+			size_t cma_min = 0;
+
+/* Only offer to read calls by reference from clients that we expect to be
+ * allowed to read.
+ */
+			if ( is_same_user( t, fd ) ) {
+				lock_door_data(p);
+				cma_min = p->cma_min;
+				unlock_door_data(p);
+			}
+
+			msg_door_getparam_init( &outgoing, 4, cma_min );
+			transport_send_msg( t, fd, &outgoing, sizeof(outgoing) );
+			break;
+		}
+		case 5: { /* max_active */
+			struct msg_door_getparam outgoing;
+
+			lock_door_data(p);
+			msg_door_getparam_init( &outgoing, 5, p->max_active );
+			unlock_door_data(p);
+			transport_send_msg( t, fd, &outgoing, sizeof(outgoing) );
+			break;
+		}
+		case 6: { /* max_queued */
+			struct msg_door_getparam outgoing;
+
+			lock_door_data(p);
+			msg_door_getparam_init( &outgoing, 6, p->max_queued );
+			unlock_door_data(p);
+			transport_send_msg( t, fd, &outgoing, sizeof(outgoing) );
+			break;
+		}
+		case 7: { /* high_reserved */
+			struct msg_door_getparam outgoing;
+
+			lock_door_data(p);
+			msg_door_getparam_init( &outgoing, 7, p->high_reserved );
+			unlock_door_data(p);
+			transport_send_msg( t, fd, &outgoing, sizeof(outgoing) );
+			break;
+		}
+		case REQ_DOOR_STATS: {
+			struct msg_door_stats outgoing;
+			door_stats_t stats;
+
+			counters_snapshot( p->counters, &stats );
+			msg_door_stats_init( &outgoing, &stats );
+			transport_send_msg( t, fd, &outgoing, sizeof(outgoing) );
+			break;
+		}
+		default: { /* Bad or unknown request! */
+			xmit_error( t, fd, EINVAL );
+		}
+	}
+
+	return;
+}
+
+static void* connection_listen( void* connection_ptr )
+/* Listen for messages on the given connection.  The argument is a
+ * pointer to a door_connect_t structure.  This thread must free it when
+ * finished.
+ *
+ * It performs little or no argument-checking and always "returns" NULL.
+ */
+{
+	const int fd = ((struct door_connect_t*)connection_ptr)->listen_fd;
+	struct door_data* const p =
+((struct door_connect_t*)connection_ptr)->data_ptr;
+	long long int code;	/* The incoming message code. */
+	struct conn_calls* calls;
+
+/* Since we've already copied the data to local storage, we no longer need
+ * the buffer.
+ */
+	free(connection_ptr);
+
+/* Without a list of its calls, we cannot serve the connection. */
+	calls = create_calls( p, fd );
+	if ( NULL == calls )
+		p->transport->close(fd);
+
+/* Peek ahead at the type of the next message. */
+	while ( NULL != calls &&
+	        0 <= ( code = message_type( p->transport, fd ) )
+	      ) {
+		switch (code) {
+			case code_request:
+				handle_msg_request( fd, p );
+				break;
+			case code_door_call:
+			case code_door_call_ref:
+				handle_door_call( fd, p, calls );
+				break;
+			case code_door_cancel:
+				handle_door_cancel( fd, p, calls );
+				break;
+			default: {
+				xmit_error( p->transport, fd, ENOTSUP );
+/* We could recover from this error. We could at least linger.  At present, we
+ * just close the connection.
+ */
+				p->transport->close(fd);
+			}
+		}
+	}
+
+/* Our attempt to read a request code failed.  Could this be because the
+ * connection no longer exists?
+ */
+	counters_sub( &p->counters->stats.ds_connections, 1 );
+
+/* Calls still running on the connection keep the door until they end. */
+	if ( NULL != calls )
+		release_calls(calls);
+	else
+		release_door_data(p);
+	return NULL;
+}
+
+static void* door_listen( void* int_ptr )
+/* This function listens on the door descriptor pointed to by d_ptr
+ * (a pointer to const int), and spawns a new thread to listen on each 
+ * connection to this descriptor.
+ *
+ * When the door closes (or becomes invalid), accept() will fail, and 
+ * the thread will terminate itself, calling free() on d_ptr.
+ *
+ * This function is intended as an argument to pthread_create().  It
+ * does not handle bad arguments robustly (as they are programming
+ * errors).  It always "returns" NULL.
+ */
+{
+	const int d = *(const int*)int_ptr;	/* Our door descriptor. */
+/* Keep a reference to the door's associated data. */
+	struct door_data* p;
+	int endpoint;
+
+/* Since we've already copied the data to local storage, we no longer need 
+ * the buffer.
+ */
+	free(int_ptr);
+
+	lock_door_table();
+
+	if ( fd_server != door_table[d].type ) {
+/* We lost a race with door_revoke(), and the door is no longer valid. */
+		unlock_door_table();
+		return NULL;
+	}
+
+	p = door_table[d].data;
+	unlock_door_table();	
+
+	assert( NULL != p );
+
+	lock_door_data(p);
+	increment_door_data_pointers(p);
+	unlock_door_data(p);
+
+/* If DOOR_PRIVATE is implemented, we should ensure that only one server
+ * thread listens at a time.  Currently, it isn't.
+ */
+
+	while ( ! p->revoked ) {
+		while ( ! p->attachments ) {
+/* Wait for another thread to call listen() on the door.  The POSIX standard
+ * requires us to own the mutex lock when we call posix_cond_wait().  That
+ * function will atomically release the lock if it blocks, so door_attach() 
+ * won't deadlock.
+ *
+ * The case where we will need to loop more than once here is extremely rare,
+ * whereas the case where we skip this loop entirely is common, so I bring the
+ * locking and unlocking inside the loop to optimize the latter.
+ */
+			lock_door_data(p);
+
+			if ( 0 != pthread_cond_wait( &p->can_listen,
+			                             &p->lock_data
+			                           )
+			   ) {
+				fatal_system_error( __FILE__,
+				                    __LINE__,
+				                    "pthread_cond_wait"
+			                  );
+			} /* end if ( 0 != pthread_cond_wait(...) ) */
+			if ( p->revoked ) {
+/* A call to door_revoke() woke us.  Terminate the thread. */
+				unlock_door_data(p);
+				release_door_data(p);
+				return NULL;
+			} /* end if (p->revoked) */
+			else
+				unlock_door_data(p);
+		} /* end while ( ! p-> attachments ) */
+
+/* The p->attachments predicate is true, meaning that the door is ready to
+ * accept connections.  We've unlocked the door_table entry, so other threads
+ * may now modify it without deadlock.
+ */
+		while ( 0 <= ( endpoint = p->transport->accept(d) ) ) {
+/* We have a new connection.  Spawn another thread to listen on it.  The
+ * door_revoke() function closes the file descriptor, which should cause
+ * accept() to fail.
+ */
+/* Information the new thread will need, and free: */
+			struct door_connect_t* arg;
+/* We'll get back the thread ID, but not keep it. */
+			pthread_t thread_id;
+
+			DOOR_PROBE2( accept, p->id, endpoint );
+
+			arg =
+(struct door_connect_t*)malloc(sizeof(struct door_connect_t));
+			if ( NULL == arg )
+				return NULL;
+
+			arg->listen_fd = endpoint;
+			arg->data_ptr = p;
+
+			lock_door_data(p);
+			increment_door_data_pointers(p);
+			unlock_door_data(p);
+			counters_add( &p->counters->stats.ds_connections, 1 );
+
+			if (
+0 != pthread_create( &thread_id, NULL, connection_listen, (void*)arg )
+			) {
+/* No one's listening!  Close the connection.  Also, there's no one
+ * else to free arg, so do that now.
+ */
+				free(arg);
+				p->transport->close(endpoint);
+				counters_sub( &p->counters->stats.ds_connections, 1 );
+				release_door_data(p);
+			} /* end if */
+			else
+				pthread_detach(thread_id);
+		} /* end while ( 0 <= accept() ) */
+/* If accept() reports EINVAL, that means that our descriptor is no longer
+ * accepting connections.  If that isn't because it's been revoked, we should
+ * wait for it to be re-attached with door_attach(). 
+ */
+		if ( EINVAL == errno )
+			p->attachments = false;
+
+	} /* end while ( ! p->revoked ) */
+
+/* Our door has been revoked, or failed unrecoverably. */
+	release_door_data(p);
+	return NULL;
+}
+
+static int spawn_door_server( int d )
+/* Spawn a thread to listen on door descriptor d for incoming 
+ * connections.  The new thread and its children attempt to block all signals.
+ *
+ * Copies d, which has an unknown lifetime, to automatic storage.  The
+ * new thread must free() this storage before it terminates.
+ *
+ * Returns 0 on success, -1 on failure, and sets errno.
+ */
+{
+	static const int ERROR = -1;
+	int* p;
+	pthread_t thread_id;
+	sigset_t all_signals;
+	sigset_t old_mask;
+	int retval;
+
+	if ( d < 0 || (size_t)d >= open_max ) {
+		errno = EBADF;
+		return ERROR;
+	}
+
+
+	p = (int*)malloc(sizeof(int));
+
+	if ( NULL == p ) {
+		errno = ENOMEM;
+		return ERROR;
+	}
+
+	*p = d;
+
+	sigfillset(&all_signals);
+
+	pthread_sigmask( SIG_BLOCK, &all_signals, &old_mask );
+	retval = pthread_create( &thread_id, NULL, door_listen, (void*)p );
+	pthread_sigmask( SIG_SETMASK, &old_mask, NULL );
+
+	return retval;
+}
+
+static inline struct door_data* local_door_data( int d )
+/* If d is the descriptor of a local door, return a pointer to its associated
+ * door_data structure.  Otherwise, return NULL.  Takes no hold on it; see
+ * hold_local_door_data().
+ *
+ * Returns the pointer, rather than true, to avoid a race condition in which
+ * a door might be revoked after we return true, but before we copy the
+ * pointer.
+ */
+{
+	struct door_data* retval;
+
+	if ( NULL == door_table )
+		return NULL;
+
+	lock_door_table();
+
+	if ( open_max <= (size_t)d || fd_server != door_table[d].type )
+		retval = NULL;
+	else
+		retval = door_table[d].data;
+
+	unlock_door_table();
+
+	return retval;
+}
+
+static struct door_data* hold_local_door_data( int d )
+/* If d is the descriptor of a local door, takes a hold on its door_data
+ * structure and returns a pointer to it.  Otherwise, returns NULL.  The
+ * caller must let go with drop_door_data().
+ *
+ * The hold is taken under the lock on door_table, so that door_revoke(),
+ * which takes that lock exclusively to clear the entry, cannot free the
+ * structure in between.
+ */
+{
+	struct door_data* retval;
+
+	if ( NULL == door_table )
+		return NULL;
+
+	lock_door_table();
+
+	if ( open_max <= (size_t)d || fd_server != door_table[d].type )
+		retval = NULL;
+	else {
+		retval = door_table[d].data;
+
+		lock_door_data(retval);
+		++retval->holds;
+		unlock_door_data(retval);
+	}
+
+	unlock_door_table();
+
+	return retval;
+}
+
+static long long int next_reply_among( struct conn_data* conn,
+                                      int d,
+                                      uint64_t first,
+                                      size_t count,
+                                      uint64_t deadline,
+                                      uint64_t* tag
+                                    )
+/* Waits for the reply to any of the count calls with tags from first on the
+ * client descriptor d, whose connection data conn is, or to a request if
+ * first is 0 and count 1.  Stores the tag of the reply in *tag, and returns
+ * its type as message_type() does.  Discards any replies to calls, and any
+ * answers to requests, abandoned earlier on the way.  With a deadline other
+ * than 0, gives up at that CLOCK_MONOTONIC time, failing with ETIMEDOUT.  The
+ * caller must hold the descriptor's desc_lock.
+ */
+{
+	static const long long ERROR = -1;
+	const struct door_transport* const t = conn->transport;
+
+	for (;;) {
+		union {
+			struct msg_error	error;
+			struct msg_door_return	ret;
+		} incoming;
+		long long int code;
+		uint64_t reply_tag;
+
+		if ( 0 != deadline && 0 != t->wait( d, deadline ) )
+			return ERROR;
+
+		code = message_type( t, d );
+		if ( 0 > code )
+			return code;
+
+/* Answers to requests carry no tag. */
+		if ( code_error != code && code_door_return != code )
+			reply_tag = 0;
+		else {
+			if ( 0 > t->peek( d, &incoming, sizeof(incoming) ) )
+				return ERROR;
+
+			reply_tag = ( code_error == code ) ?
+			            msg_error_get_tag(&incoming.error) :
+			            msg_door_return_get_tag(&incoming.ret);
+		}
+
+		if ( 0 == reply_tag && 0 < conn->stale_requests )
+			--conn->stale_requests;
+		else if ( code_error != code && code_door_return != code )
+			return code;
+		else if ( reply_tag - first < count ) {
+			*tag = reply_tag;
+			return code;
+		}
+
+		t->discard(d);
+	}
+}
+
+static long long int next_reply( struct conn_data* conn,
+                                int d,
+                                uint64_t tag,
+                                uint64_t deadline
+                              )
+/* Waits for the reply to the call with the given tag on the client descriptor
+ * d, whose connection data conn is, or to a request if tag is 0, as
+ * next_reply_among() does.
+ */
+{
+	uint64_t reply_tag;
+
+	return next_reply_among( conn, d, tag, 1, deadline, &reply_tag );
+}
+
+static long long int next_answer( struct conn_data* conn,
+                                 int d,
+                                 uint64_t deadline
+                               )
+/* Waits for the answer to the request just sent on the client descriptor d,
+ * whose connection data conn is, as next_reply() does.  Should the deadline
+ * pass first, the answer is left for a later wait to throw away.
+ */
+{
+	const long long int type = next_reply( conn, d, 0, deadline );
+
+	if ( 0 > type && ETIMEDOUT == errno )
+		++conn->stale_requests;
+
+	return type;
+}
+
+static int fetch_param( struct conn_data* conn,
+                        int d,
+                        unsigned int param,
+                        uint64_t deadline,
+                        size_t* out
+                      )
+/* Asks the server at the other end of the client descriptor d, whose
+ * connection data conn is, for the value of the given door parameter, and
+ * stores it in *out.  With a deadline other than 0, gives up at that
+ * CLOCK_MONOTONIC time, failing with ETIMEDOUT.  The caller must hold the
+ * descriptor's desc_lock.
+ *
+ * Returns 0 on success, or -1 on failure, setting errno.
+ */
+{
+	static const int ERROR = -1;
+	static const int SUCCESS = 0;
+
+	const struct door_transport* const t = conn->transport;
+	struct msg_request outgoing;
+	long long int type;
+
+	msg_request_init( &outgoing, param );
+	if ( 0 > transport_send_msg( t, d, &outgoing, sizeof(outgoing) ) )
+		return ERROR;
+
+	type = next_answer( conn, d, deadline );
+	if ( 0 > type )
+		return ERROR;
+
+	if ( code_door_getparam == type ) {
+		struct msg_door_getparam incoming;
+
+		if ( 0 > transport_recv_msg( t, d, &incoming, sizeof(incoming) ) )
+			return ERROR;
+
+		*out =  msg_door_getparam_decode(&incoming);
+	}
+	else if ( code_error == type ) {
+		struct msg_error incoming;
+
+		if ( 0 > transport_recv_msg( t, d, &incoming, sizeof(incoming) ) )
+			return ERROR;
+
+		errno = msg_error_decode(&incoming);
+		return ERROR;
+	}
+	else {
+		errno = EBADMSG;
+		return ERROR;
+	} /* end if (message type) */
+
+	return SUCCESS;
+}
+
+static int fetch_stats( struct conn_data* conn,
+                        int d,
+                        door_stats_t* stats
+                      )
+/* Asks the server at the other end of the client descriptor d, whose
+ * connection data conn is, for its door's statistics, and stores them in
+ * *stats.  The caller must hold the descriptor's desc_lock.
+ *
+ * Returns 0 on success, or -1 on failure, setting errno.
+ */
+{
+	static const int ERROR = -1;
+	static const int SUCCESS = 0;
+
+	const struct door_transport* const t = conn->transport;
+	struct msg_request outgoing;
+	long long int type;
+
+	msg_request_init( &outgoing, REQ_DOOR_STATS );
+	if ( 0 > transport_send_msg( t, d, &outgoing, sizeof(outgoing) ) )
+		return ERROR;
+
+	type = next_answer( conn, d, 0 );
+	if ( 0 > type )
+		return ERROR;
+
+	if ( code_door_stats == type ) {
+		static const size_t header =
+offsetof( struct msg_door_stats, counters );
+
+		struct msg_door_stats incoming;
+		ssize_t size;
+		size_t received;
+
+		size = transport_recv_msg( t, d, &incoming, sizeof(incoming) );
+		if ( 0 > size )
+			return ERROR;
+
+/* An older or newer server may send a different number of counters than we
+ * know of.  Trust only those that actually arrived.
+ */
+		if ( (size_t)size < header ) {
+			errno = EBADMSG;
+			return ERROR;
+		}
+
+		received = ( (size_t)size - header ) / sizeof(uint64_t);
+		if ( incoming.count > received )
+			incoming.count = (uint32_t)received;
+
+		msg_door_stats_decode( &incoming, stats );
+	}
+	else if ( code_error == type ) {
+		struct msg_error incoming;
+
+		if ( 0 > transport_recv_msg( t, d, &incoming, sizeof(incoming) ) )
+			return ERROR;
+
+		errno = msg_error_decode(&incoming);
+		return ERROR;
+	}
+	else {
+		errno = EBADMSG;
+		return ERROR;
+	} /* end if (message type) */
+
+	return SUCCESS;
+}
+
+static int refuse_local_call( struct door_data* p, int error )
+/* Counts a local call that the door p cannot serve.  Returns -1, setting
+ * errno to error.
+ */
+{
+	static const int ERROR = -1;
+
+	counters_error( p->counters, error );
+	errno = error;
+
+	return ERROR;
+}
+
+static int local_door_call( struct door_data* p,
+                            door_arg_t* params,
+                            uint64_t deadline,
+                            unsigned int priority,
+                            bool one_way
+                          )
+/* Calls the local door p directly.  A new thread runs the server procedure on
+ * the caller's own data buffer, with no message and no copy, and the calling
+ * thread waits for door_return() to deliver the results to params.  The
+ * checks and errors are the same as for a call through a transport, and the
+ * door's limits on the calls running and waiting apply alike.
+ *
+ * A one_way call returns once the thread has started, or the call is queued,
+ * so the thread gets a copy of the data instead, and discards the results.
+ *
+ * With a deadline other than 0, a call still waiting for a thread at that
+ * CLOCK_MONOTONIC time leaves the queue and fails with ETIMEDOUT, as the
+ * server refuses a call from another process that reaches it too late.  One
+ * that has started works on the caller's own buffer, so it runs to the end.
+ *
+ * Returns 0 on success, or -1 on failure, setting errno.
+ */
+{
+	static const int ERROR = -1, SUCCESS = 0;
+
+	struct local_call call;
+	struct door_server_args_t* arg_ptr;
+	door_desc_t* passed = NULL;
+	void* buffer = NULL;
+	const void* data_ptr = NULL;
+	size_t data_size = 0;
+	const door_desc_t* desc_ptr = NULL;
+	uint_t desc_num = 0;
+	pthread_t thread_id;
+	pthread_condattr_t attr;
+	struct timespec until;
+	sigset_t all_signals, old_mask;
+	enum admission admission;
+	int error;
+
+	if ( NULL != params ) {
+		if ( 0 != params->data_size ) {
+			data_ptr = params->data_ptr;
+			data_size = params->data_size;
+		}
+		desc_ptr = params->desc_ptr;
+		desc_num = params->desc_num;
+	}
+
+	lock_door_data(p);
+	if ( p->revoked )
+		error = EBADF;
+	else if ( p->data_max < data_size || p->data_min > data_size )
+		error = ENOBUFS;
+	else if ( p->desc_max < desc_num )
+		error = ( DOOR_REFUSE_DESC & p->attr ) ? ENOTSUP : ENFILE;
+	else
+		error = 0;
+	unlock_door_data(p);
+
+	if ( 0 != error )
+		return refuse_local_call( p, error );
+
+	arg_ptr = malloc( sizeof(struct door_server_args_t) );
+	if ( NULL == arg_ptr ) {
+		return refuse_local_call( p, ENOMEM );
+	}
+
+/* As for a call from another process, any descriptors follow the data. */
+	if ( one_way && ( 0 != data_size || 0 != desc_num ) ) {
+		buffer = malloc( desc_offset(data_size) +
+		                 desc_num * sizeof(door_desc_t)
+		               );
+
+		if ( NULL == buffer ) {
+			free(arg_ptr);
+			return refuse_local_call( p, ENOMEM );
+		}
+
+		memcpy( buffer, data_ptr, data_size );
+		data_ptr = buffer;
+		if ( 0 != desc_num )
+			passed = (door_desc_t*)
+( (char*)buffer + desc_offset(data_size) );
+	}
+	else if ( 0 != desc_num ) {
+		buffer = malloc( desc_num * sizeof(door_desc_t) );
+		passed = buffer;
+
+		if ( NULL == buffer ) {
+			free(arg_ptr);
+			return refuse_local_call( p, ENOMEM );
+		}
+	}
+
+	if ( 0 != desc_num ) {
+		error = dup_descs( passed, desc_ptr, desc_num );
+		if ( 0 != error ) {
+			free(buffer);
+			free(arg_ptr);
+			return refuse_local_call( p, error );
+		}
+	}
+
+	call.params = params;
+	call.error = 0;
+	call.done = false;
+	pthread_mutex_init( &call.lock, NULL );
+
+/* The deadline is on the clock counters_now() reads. */
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+	pthread_cond_init( &call.finished, &attr );
+	pthread_condattr_destroy(&attr);
+	until.tv_sec = (time_t)( deadline / 1000000000U );
+	until.tv_nsec = (long)( deadline % 1000000000U );
+
+/* The server thread frees the buffer, but never the caller's data. */
+	arg_ptr->transport = p->transport;
+	arg_ptr->fd = -1;
+	arg_ptr->data_ptr = (void*)data_ptr;
+	arg_ptr->data_size = data_size;
+	arg_ptr->desc_ptr = passed;
+	arg_ptr->desc_num = desc_num;
+	arg_ptr->server_proc = p->server_proc;
+	arg_ptr->batch_proc = p->batch_proc;
+	arg_ptr->cookie = p->cookie;
+	arg_ptr->batch_next = NULL;
+	arg_ptr->batch_calls = NULL;
+	arg_ptr->buffer = buffer;
+	arg_ptr->local = one_way ? NULL : &call;
+	arg_ptr->door = p;
+	arg_ptr->inline_return = NULL;
+	arg_ptr->tag = 0;
+	arg_ptr->priority = priority;
+	arg_ptr->one_way = one_way;
+	arg_ptr->calls = NULL;
+	arg_ptr->started = false;
+	arg_ptr->cancelled = false;
+
+	admission = admit_call( p, arg_ptr );
+
+	if ( admit_refuse == admission ) {
+		close_descs( passed, desc_num );
+		free(buffer);
+		free(arg_ptr);
+		pthread_cond_destroy(&call.finished);
+		pthread_mutex_destroy(&call.lock);
+		return refuse_local_call( p, EAGAIN );
+	}
+
+/* A queued call starts once an earlier one ends. */
+	if ( admit_run == admission ) {
+/* Server threads block all signals, as they do for calls from another process.
+ */
+		sigfillset(&all_signals);
+		pthread_sigmask( SIG_BLOCK, &all_signals, &old_mask );
+		error = pthread_create( &thread_id,
+		                        NULL,
+		                        start_server_proc,
+		                        arg_ptr
+		                      );
+		pthread_sigmask( SIG_SETMASK, &old_mask, NULL );
+
+		if ( 0 != error ) {
+			end_invocation( arg_ptr, 0 );
+			finish_call_slot(p);
+			drop_door_data(p);
+			close_descs( passed, desc_num );
+			free(buffer);
+			free(arg_ptr);
+			pthread_cond_destroy(&call.finished);
+			pthread_mutex_destroy(&call.lock);
+			return refuse_local_call( p, error );
+		}
+
+		pthread_detach(thread_id);
+	}
+
+	if (one_way) {
+		pthread_cond_destroy(&call.finished);
+		pthread_mutex_destroy(&call.lock);
+		return SUCCESS;
+	}
+
+	if ( 0 != pthread_mutex_lock(&call.lock) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_mutex_lock");
+
+	while ( ! call.done ) {
+		bool withdrawn = false;
+
+		if ( 0 == deadline || admit_run == admission )
+			error = pthread_cond_wait( &call.finished, &call.lock );
+		else
+			error = pthread_cond_timedwait( &call.finished,
+			                                &call.lock,
+			                                &until
+			                              );
+
+		if ( ETIMEDOUT == error ) {
+/* The server thread takes call.lock with no other lock held, so we let go of
+ * it before we take the door's.  A call taken off the queue never starts.
+ */
+			if ( 0 != pthread_mutex_unlock(&call.lock) )
+				fatal_system_error(__FILE__,
+				                   __LINE__,
+				                   "pthread_mutex_unlock"
+				                  );
+
+			lock_door_data(p);
+			withdrawn = withdraw_waiting( p, arg_ptr, getpid() );
+			if (withdrawn) {
+				--p->queued;
+				counters_sub( &p->counters->stats.ds_queued, 1 );
+			}
+			unlock_door_data(p);
+
+			if (withdrawn) {
+				end_invocation( arg_ptr, 0 );
+				drop_door_data(p);
+				close_descs( passed, desc_num );
+				free(buffer);
+				free(arg_ptr);
+				pthread_cond_destroy(&call.finished);
+				pthread_mutex_destroy(&call.lock);
+				return refuse_local_call( p, ETIMEDOUT );
+			}
+
+/* Too late: its thread has it, so wait for the results. */
+			admission = admit_run;
+			if ( 0 != pthread_mutex_lock(&call.lock) )
+				fatal_system_error(__FILE__,
+				                   __LINE__,
+				                   "pthread_mutex_lock"
+				                  );
+		}
+		else if ( 0 != error )
+			fatal_system_error(__FILE__,__LINE__,"pthread_cond_wait");
+	}
+
+	if ( 0 != pthread_mutex_unlock(&call.lock) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_mutex_unlock");
+
+	pthread_cond_destroy(&call.finished);
+	pthread_mutex_destroy(&call.lock);
+
+	if ( 0 != call.error ) {
+		errno = call.error;
+		return ERROR;
+	}
+
+	return SUCCESS;
+}
+
+static void cancel_call( const struct door_transport* t,
+                         int d,
+                         uint64_t tag
+                       )
+/* Tells the server at the other end of the client descriptor d, which t
+ * carries, that we have given up on the call with the given tag.  Leaves
+ * errno alone.
+ */
+{
+	const int saved_errno = errno;
+	struct msg_door_cancel outgoing;
+
+	msg_door_cancel_init( &outgoing, tag );
+	transport_send_msg( t, d, &outgoing, sizeof(outgoing) );
+
+	errno = saved_errno;
+
+	return;
+}
+
+static void abandon_call( void* p )
+/* Cleans up after a thread cancelled while waiting for the replies to the
+ * calls p describes: tells the server, and releases the descriptor.
+ */
+{
+	const struct pending_call* const call = p;
+	size_t i;
+
+	for ( i = 0; i < call->count; ++i )
+		cancel_call( call->transport, call->door, call->tag + i );
+
+	if ( 0 != pthread_mutex_unlock(call->lock) )
+		fatal_system_error(__FILE__,__LINE__,"mutex unlock");
+
+	return;
+}
+
+static int check_call( const door_arg_t* params )
+/* Checks the arguments of a door call, as door_call() does before it sends
+ * anything.  params may be NULL.
+ *
+ * Returns 0 if they will do, or the errno to report.
+ */
+{
+	uint_t i;
+
+	if ( NULL == params )
+		return 0;
+
+	if ( ( 0 != params->data_size ) &&
+	     ( ( NULL == params->data_ptr ) ||
+	       ( NULL == params->rbuf && 0 != params->rsize )
+	     )
+	   ) {
+/* The caller passed in an invalid buffer.  It is not an error to call
+ * a door with a non-NULL params and a NULL params->data_ptr, as this
+ * correctly indicates that the door takes no data, but may return
+ * some.  However, the function thinks it's passing in actual data, so
+ * something's gone wrong.  It is likewise not an error to pass in a
+ * NULL params->rbuf, as this indicates that the system should allocate
+ * a results buffer if we need one.  However, if the caller thinks that
+ * NULL points to a valid buffer, something's gone wrong.  We can
+ * recover, but better to point out the logic error.
+ */
+		return EFAULT;
+	}
+
+	if ( NULL == params->desc_ptr && 0 != params->desc_num )
+		return EFAULT;
+
+/* More descriptors than one message can carry. */
+	if ( DESC_LIMIT < params->desc_num )
+		return ENFILE;
+
+	for ( i = 0; i < params->desc_num; ++i )
+		if ( !( DOOR_DESCRIPTOR & params->desc_ptr[i].d_attributes ) )
+			return EINVAL;
+
+	return 0;
+}
+
+static int learn_cma_min( struct conn_data* conn,
+                          int door,
+                          uint64_t deadline
+                        )
+/* Asks the server at the other end of the client descriptor door, whose
+ * connection data conn is, whether its door will read calls by reference,
+ * unless we have asked already.  A server that does not know the parameter,
+ * or won't offer it to us, leaves it at 0.  The caller holds the descriptor's
+ * desc_lock, and must have no calls outstanding on it: we would throw their
+ * replies away while waiting for the answer.  With a deadline other than 0,
+ * gives up at that CLOCK_MONOTONIC time, and asks again next time.
+ *
+ * Returns 0 on success, or -1 if the deadline passed, setting errno to
+ * ETIMEDOUT.
+ */
+{
+	static const int ERROR = -1, SUCCESS = 0;
+
+	if (conn->cma_known)
+		return SUCCESS;
+
+	if ( 0 != fetch_param( conn,
+	                       door,
+	                       DOOR_PARAM_CMA_MIN,
+	                       deadline,
+	                       &conn->cma_min
+	                     )
+	   ) {
+		conn->cma_min = 0;
+		if ( ETIMEDOUT == errno )
+			return ERROR;
+	}
+
+	conn->cma_known = true;
+
+	return SUCCESS;
+}
+
+static int send_call( const struct door_transport* t,
+                      struct conn_data* conn,
+                      int door,
+                      const door_arg_t* params,
+                      uint64_t tag,
+                      uint64_t deadline,
+                      unsigned int priority,
+                      bool one_way,
+                      bool cancellable
+                    )
+/* Sends the call params describes, which check_call() has passed, with the
+ * given tag over the client descriptor door, whose connection data conn and
+ * transport t are, and whose desc_lock the caller holds.  Closes any
+ * descriptors the caller asked us to release once they are on their way.
+ * The calling thread may be cancelled while it waits for the reply if
+ * cancellable is true.
+ *
+ * Returns 0 on success, or -1 on failure, setting errno.
+ */
+{
+	static const int ERROR = -1, SUCCESS = 0;
+	union {
+		struct msg_door_call		call;
+		struct msg_door_call_ref	ref;
+	} outgoing;
+	const void* data_ptr = NULL;
+	size_t data_size = 0;
+	const door_desc_t* desc_ptr = NULL;
+	uint_t desc_num = 0;
+	struct iovec send_iovs[2];
+	bool by_ref;
+	uint_t i;
+
+	if ( NULL != params ) {
+		if ( 0 != params->data_size ) {
+			data_ptr = params->data_ptr;
+			data_size = params->data_size;
+		}
+		desc_ptr = params->desc_ptr;
+		desc_num = params->desc_num;
+	}
 
-	assert( NULL != p );
+	DOOR_PROBE3( call_send, door, data_size, desc_num );
 
-	lock_door_data(p);
-	increment_door_data_pointers(p);
-	unlock_door_data(p);
+/* Only the process the server sees may send its data by reference, and only
+ * if the data outlives the call.  A thread cancelled while it waits could free
+ * it before the server reads it, whether or not the call has a deadline.
+ */
+	by_ref = ( ! one_way && ! cancellable && getpid() == conn->opener );
 
-/* If DOOR_PRIVATE is implemented, we should ensure that only one server
- * thread listens at a time.  Currently, it isn't.
+/* Nor may a call that releases descriptors, since it could not send them again
+ * should the server be unable to read the data.
  */
+	for ( i = 0; by_ref && i < desc_num; ++i )
+		if ( DOOR_RELEASE & desc_ptr[i].d_attributes )
+			by_ref = false;
 
-	while ( ! p->revoked ) {
-		while ( ! p->attachments ) {
-/* Wait for another thread to call listen() on the door.  The POSIX standard
- * requires us to own the mutex lock when we call posix_cond_wait().  That
- * function will atomically release the lock if it blocks, so door_attach() 
- * won't deadlock.
+	if ( by_ref &&
+	     page_size <= data_size &&
+	     0 != learn_cma_min( conn, door, deadline )
+	   )
+		return ERROR;
+
+	bzero( send_iovs, 2*sizeof(struct iovec) );
+
+	if ( by_ref && 0 != conn->cma_min && conn->cma_min <= data_size ) {
+/* Send only the address of our data.  The server reads it out of our address
+ * space while we wait for the reply, so it stays valid.  If we give up at the
+ * deadline, the server refuses the call once it sees the deadline has passed.
+ */
+		msg_door_call_ref_init( &outgoing.ref,
+		                        data_ptr,
+		                        data_size,
+		                        desc_num,
+		                        tag,
+		                        deadline,
+		                        priority,
+		                        0
+		                      );
+
+		send_iovs[0].iov_base = &outgoing.ref;
+		send_iovs[0].iov_len = sizeof(outgoing.ref);
+	}
+	else {
+		msg_door_call_init( &outgoing.call,
+		                    data_size,
+		                    desc_num,
+		                    tag,
+		                    deadline,
+		                    priority,
+		                    one_way ? CALL_FLAG_ONE_WAY : 0
+		                  );
+
+		send_iovs[0].iov_base = &outgoing.call;
+		send_iovs[0].iov_len = sizeof(outgoing.call);
+
+		send_iovs[1].iov_base = (void*)data_ptr;
+		send_iovs[1].iov_len = data_size;
+	}
+
+	if ( 0 > t->send( door, send_iovs, 2, desc_ptr, desc_num ) )
+		return ERROR;
+
+/* The descriptors are on their way, so we can close any the caller asked us
+ * to release.
+ */
+	release_descs( desc_ptr, desc_num );
+
+	return SUCCESS;
+}
+
+static int receive_reply( const struct door_transport* t,
+                          int door,
+                          long long int incoming_code,
+                          door_arg_t* params
+                        )
+/* Receives the reply of type incoming_code to a call, which next_reply() has
+ * found waiting on the client descriptor door, and stores the results in
+ * params, as door_call() describes.  The caller holds the descriptor's
+ * desc_lock.  If the reply is of the wrong kind, closes the descriptor.
  *
- * The case where we will need to loop more than once here is extremely rare,
- * whereas the case where we skip this loop entirely is common, so I bring the
- * locking and unlocking inside the loop to optimize the latter.
+ * Returns 0 on success, or -1 on failure, setting errno.
  */
-			lock_door_data(p);
+{
+	static const int ERROR = -1, SUCCESS = 0;
 
-			if ( 0 != pthread_cond_wait( &p->can_listen,
-			                             &p->lock_data
-			                           )
+	if ( code_error == incoming_code ) {
+/* We received an error message back. */
+		struct msg_error incoming;
+
+		if (
+0 > transport_recv_msg( t, door, &incoming, sizeof(incoming) )
+		   )
+			return ERROR;
+
+		errno = msg_error_decode(&incoming);
+		return ERROR;
+	} /* end if ( code_error == incoming_code ) */
+	else if ( code_door_return == incoming_code ) {
+/* The server responded with a door_return message, as expected. */
+		struct msg_door_return incoming;
+		ssize_t return_size, bytes_read;
+		uint_t return_desc;
+		size_t buffer_size;
+		void* return_buf = NULL;
+		door_desc_t* return_desc_ptr = NULL;
+		bool new_buffer = false;
+		struct iovec recv_iovs[2];
+
+		if ( 0 > t->peek( door, &incoming, sizeof(incoming) ) )
+			return ERROR;
+
+		return_size = msg_door_return_get_data_size(&incoming);
+		return_desc = msg_door_return_get_ndesc(&incoming);
+
+		if ( NULL == params ) {
+/* We cannot receive any data.  Either way, the reply must not stay queued
+ * ahead of the next one.
+ */
+			t->discard(door);
+
+			if ( 0 != return_size || 0 != return_desc ) {
+				errno = ENOMEM;
+				return ERROR;
+			} /* end if ( 0 != return_size ) */
+
+			DOOR_PROBE3( call_reply, door, 0, 0 );
+			return SUCCESS;
+		} /* end if ( NULL == params ) */
+
+		if ( 0 > return_size || DESC_LIMIT < return_desc ) {
+/* The door returned too much data for us to even address! */
+			t->discard(door);
+			errno = ENOMEM;
+			params->data_size = 0;
+			return ERROR;
+		}
+
+/* Any descriptors go into the results buffer, after the data. */
+		if ( 0 == return_desc )
+			buffer_size = (size_t)return_size;
+		else
+			buffer_size = desc_offset((size_t)return_size) +
+			              return_desc * sizeof(door_desc_t);
+
+		if ( buffer_size > params->rsize ) {
+/* Allocate a new buffer. */
+			if ( 0 != posix_memalign( &return_buf,
+			                          page_size,
+			                          buffer_size
+			                        )
 			   ) {
-				fatal_system_error( __FILE__,
-				                    __LINE__,
-				                    "pthread_cond_wait"
-			                  );
-			} /* end if ( 0 != pthread_cond_wait(...) ) */
-			if ( p->revoked ) {
-/* A call to door_revoke() woke us.  Terminate the thread. */
-				unlock_door_data(p);
-				release_door_data(p);
-				return NULL;
-			} /* end if (p->revoked) */
-			else
-				unlock_door_data(p);
-		} /* end while ( ! p-> attachments ) */
+				t->discard(door);
+				params->data_size = 0;
+				errno = ENOMEM;
+				return ERROR;
+			}
+			new_buffer = true;
+		} /* end if ( buffer_size > params->rsize ) */
+		else
+			return_buf = params->rbuf;
 
-/* The p->attachments predicate is true, meaning that the door is ready to
- * accept connections.  We've unlocked the door_table entry, so other threads
- * may now modify it without deadlock.
+		if ( 0 != return_desc )
+			return_desc_ptr = (door_desc_t*)
+( (char*)return_buf + desc_offset((size_t)return_size) );
+
+/* The return_buf variable now points to a buffer big enough to hold 
+ * the requested data.
  */
-		while ( 0 <= ( endpoint = accept( d, NULL, 0 ) )
-		       ) {
-/* We have a new connection.  Spawn another thread to listen on it.  The
- * door_revoke() function closes the file descriptor, which should cause
- * accept() to fail.
+		bzero( recv_iovs, 2*sizeof(struct iovec) );
+
+		recv_iovs[0].iov_base = &incoming;
+		recv_iovs[0].iov_len = sizeof(incoming);
+
+		recv_iovs[1].iov_base = return_buf;
+		recv_iovs[1].iov_len = (size_t)return_size;
+
+		bytes_read = t->recv( door,
+		                      recv_iovs,
+		                      2,
+		                      return_desc_ptr,
+		                      return_desc
+		                    );
+
+		if ( (ssize_t)sizeof(incoming) + return_size !=
+		     bytes_read
+		   ) {
+/* Failed to read the data that should be there. */
+			const int error = ( 0 > bytes_read ) ? errno : EBADMSG;
+
+			if ( 0 <= bytes_read )
+				close_descs( return_desc_ptr, return_desc );
+
+			if (new_buffer)
+				free(return_buf);
+
+			params->rsize = 0;
+			errno = error;
+			return ERROR;
+		} /* end if( bytes_read < return_size ) */
+		else {
+/* We read the correct amount of data. */
+			params->rbuf = return_buf;
+			params->data_ptr = return_buf;
+			params->rsize = buffer_size;
+			params->data_size = (size_t)return_size;
+			params->desc_ptr = return_desc_ptr;
+			params->desc_num = return_desc;
+
+			DOOR_PROBE3( call_reply, door, return_size, return_desc );
+			return SUCCESS;
+		} /* end if ( number of bytes read ). */
+	} /* end if ( type of message received ) */
+
+/* We received the wrong kind of message. */
+	t->close(door);
+	errno = EBADMSG;
+	return ERROR;
+}
+
+static bool refused_by_ref( struct conn_data* conn,
+                            int door,
+                            long long int incoming_code
+                          )
+/* Tells whether the reply of type incoming_code, which next_reply() has found
+ * waiting on the client descriptor door, whose connection data conn is,
+ * refuses a call by reference because the server could not read its data.
+ * If so, takes the reply, and stops sending calls on the descriptor by
+ * reference.  The caller holds the descriptor's desc_lock.
+ */
+{
+	const struct door_transport* const t = conn->transport;
+	struct msg_error incoming;
+
+	if ( code_error != incoming_code ||
+	     (ssize_t)sizeof(incoming) !=
+	     t->peek( door, &incoming, sizeof(incoming) ) ||
+	     CALL_ERROR_UNREADABLE != msg_error_decode(&incoming)
+	   )
+		return false;
+
+	transport_recv_msg( t, door, &incoming, sizeof(incoming) );
+	conn->cma_min = 0;
+
+	return true;
+}
+
+static int call_door( int door,
+                      door_arg_t* params,
+                      uint64_t deadline,
+                      unsigned int priority,
+                      bool one_way,
+                      int cancel_state
+                    )
+/* Does the work of door_call_priority() and door_call_oneway(), which have
+ * disabled cancellation of the calling thread.  Only while waiting for the
+ * reply from another process does this restore cancel_state.  A thread
+ * cancelled there abandons the call, as it would on reaching the deadline.
+ * A one_way call returns once it is sent, and never waits.
+ */
+{
+	static const int ERROR = -1, SUCCESS = 0;
+	uint64_t tag;
+	struct pending_call abandon;
+	long long int incoming_code;
+	const struct door_transport* t;
+	struct conn_data* conn;
+	struct door_data* local;
+	pthread_mutex_t* lock = NULL;
+	int result;
+
+	result = check_call(params);
+	if ( 0 != result ) {
+		errno = result;
+		return ERROR;
+	}
+
+	local = hold_local_door_data(door);
+	if ( NULL != local ) {
+/* A door this process created.  Skip the transport entirely. */
+		DOOR_PROBE3( call_send,
+		             door,
+		             ( NULL == params ) ? 0 : params->data_size,
+		             ( NULL == params ) ? 0 : params->desc_num
+		           );
+
+		result = local_door_call( local,
+		                          params,
+		                          deadline,
+		                          priority,
+		                          one_way
+		                        );
+		drop_door_data(local);
+
+		if ( 0 != result )
+			return ERROR;
+
+		if (one_way)
+			return SUCCESS;
+
+		DOOR_PROBE3( call_reply,
+		             door,
+		             ( NULL == params ) ? 0 : params->data_size,
+		             ( NULL == params ) ? 0 : params->desc_num
+		           );
+		return SUCCESS;
+	}
+
+	lock_door_table();
+	if ( 0 > door ||
+	     open_max <= (size_t)door ||
+	     fd_client != door_table[door].type
+	   ) {
+/* Not a door at all. */
+		unlock_door_table();
+		errno = EBADF;
+		return ERROR;
+	}
+
+/* A non-local door. */
+	conn = door_table[door].data;
+	t = conn->transport;
+	lock = &conn->desc_lock;
+	unlock_door_table();
+
+	if ( 0 != LOCKSTAT_MUTEX_LOCK( lock, &lock_stats[DOOR_LOCK_DESC] ) )
+		fatal_system_error(__FILE__,__LINE__,"mutex lock");
+
+	tag = ++conn->last_tag;
+
+/* Should the server be unable to read the data of a call by reference, we
+ * send it again with the data, under the same tag.
+ */
+	do {
+		if ( 0 != send_call( t,
+		                     conn,
+		                     door,
+		                     params,
+		                     tag,
+		                     deadline,
+		                     priority,
+		                     one_way,
+		                     PTHREAD_CANCEL_ENABLE == cancel_state
+		                   )
+		   ) {
+			if ( 0 != pthread_mutex_unlock(lock) )
+				fatal_system_error(__FILE__,
+				                   __LINE__,
+				                   "mutex unlock"
+				                  );
+
+			return ERROR;
+		}
+
+/* The server sends nothing back, so the descriptor is free for the next call.
+ */
+		if (one_way) {
+			if ( 0 != pthread_mutex_unlock(lock) )
+				fatal_system_error(__FILE__,
+				                   __LINE__,
+				                   "mutex unlock"
+				                  );
+
+			return SUCCESS;
+		}
+
+/* We've now sent the message, and await a msg_door_return in reply.  The door
+ * descriptor's mutex is locked.
+ */
+
+		abandon.transport = t;
+		abandon.door = door;
+		abandon.tag = tag;
+		abandon.count = 1;
+		abandon.lock = lock;
+
+		pthread_cleanup_push( abandon_call, &abandon );
+		pthread_setcancelstate( cancel_state, NULL );
+
+		incoming_code = next_reply( conn, door, tag, deadline );
+
+		pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, NULL );
+		pthread_cleanup_pop(0);
+	} while ( 0 <= incoming_code &&
+	          refused_by_ref( conn, door, incoming_code )
+	        );
+
+	if ( 0 > incoming_code ) {
+		if ( ETIMEDOUT == errno )
+			cancel_call( t, door, tag );
+
+		result = ERROR;
+	}
+	else
+		result = receive_reply( t, door, incoming_code, params );
+
+/* Unlocking leaves errno alone. */
+	if ( 0 != pthread_mutex_unlock(lock) )
+		fatal_system_error(__FILE__,__LINE__,"mutex unlock");
+
+	return ( 0 == result ) ? SUCCESS : ERROR;
+}
+
+static int take_reply( struct conn_data* conn,
+                       int door,
+                       uint64_t first,
+                       size_t count,
+                       door_arg_t* params,
+                       int* status,
+                       int cancel_state
+                     )
+/* Waits for the reply to one of the count pipelined calls on the client
+ * descriptor door, whose connection data conn is, whose tags run from first
+ * and whose arguments are in params, and receives it.  Stores 0 or the errno it reports in the call's
+ * entry in status.  The caller holds the descriptor's desc_lock, and has
+ * disabled cancellation, which we restore to cancel_state while we wait.
+ *
+ * Returns 0 once it has taken a reply, or -1 if the connection has failed,
+ * setting errno.
+ */
+{
+	static const int ERROR = -1, SUCCESS = 0;
+	const struct door_transport* const t = conn->transport;
+	long long int incoming_code;
+	uint64_t tag = 0;
+	size_t i;
+	bool resent;
+
+	do {
+		pthread_setcancelstate( cancel_state, NULL );
+		incoming_code =
+next_reply_among( conn, door, first, count, 0, &tag );
+		pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, NULL );
+
+		if ( 0 > incoming_code )
+			return ERROR;
+
+		if ( code_error != incoming_code &&
+		     code_door_return != incoming_code
+		   ) {
+/* We received the wrong kind of message. */
+			t->close(door);
+			errno = EBADMSG;
+			return ERROR;
+		}
+
+		i = (size_t)( tag - first );
+
+/* A call whose data the server could not read goes again with the data, and
+ * its reply is still to come.
+ */
+		resent = refused_by_ref( conn, door, incoming_code );
+		if ( resent &&
+		     0 != send_call( t,
+		                     conn,
+		                     door,
+		                     &params[i],
+		                     tag,
+		                     0,
+		                     DOOR_PRIORITY_NORMAL,
+		                     false,
+		                     PTHREAD_CANCEL_ENABLE == cancel_state
+		                   )
+		   ) {
+			status[i] = errno;
+			return SUCCESS;
+		}
+	} while (resent);
+
+	if ( 0 == receive_reply( t, door, incoming_code, &params[i] ) )
+		status[i] = 0;
+	else
+		status[i] = errno;
+
+	return SUCCESS;
+}
+
+static int call_door_pipelined( int door,
+                                door_arg_t* params,
+                                int* status,
+                                size_t count,
+                                int cancel_state
+                              )
+/* Does the work of door_call_pipelined(), which has disabled cancellation of
+ * the calling thread, storing the outcome of each call in status.  Sends all
+ * the calls before waiting for any reply, and takes the replies as they
+ * come, in whatever order the server finishes the calls.  Only while waiting
+ * for a reply does this restore cancel_state.  A thread cancelled there
+ * abandons every call still running.
+ *
+ * Returns 0 if it made the calls, whether or not they succeeded, or -1 if it
+ * made none, setting errno.
+ */
+{
+	static const int ERROR = -1, SUCCESS = 0;
+	struct pending_call abandon;
+	const struct door_transport* t;
+	struct conn_data* conn;
+	struct door_data* local;
+	pthread_mutex_t* lock;
+	uint64_t first;
+	size_t i, sent, answered = 0;
+	int error = 0;
+
+	for ( i = 0; i < count; ++i ) {
+		error = check_call(&params[i]);
+		if ( 0 != error ) {
+			errno = error;
+			return ERROR;
+		}
+	}
+
+	local = hold_local_door_data(door);
+	if ( NULL != local ) {
+/* A call to a door in this process never waits for a round trip, so there is
+ * nothing to gain by overlapping them.
  */
-/* Information the new thread will need, and free: */
-			struct door_connect_t* arg;
-/* We'll get back the thread ID, but not keep it. */
-			pthread_t thread_id;
+		for ( i = 0; i < count; ++i )
+			if ( 0 == local_door_call( local,
+			                           &params[i],
+			                           0,
+			                           DOOR_PRIORITY_NORMAL,
+			                           false
+			                         )
+			   )
+				status[i] = 0;
+			else
+				status[i] = errno;
 
-			arg =
-(struct door_connect_t*)malloc(sizeof(struct door_connect_t));
-			if ( NULL == arg )
-				return NULL;
+		drop_door_data(local);
+		return SUCCESS;
+	}
 
-			arg->listen_fd = endpoint;
-			arg->data_ptr = p;
+	lock_door_table();
+	if ( 0 > door ||
+	     open_max <= (size_t)door ||
+	     fd_client != door_table[door].type
+	   ) {
+		unlock_door_table();
+		errno = EBADF;
+		return ERROR;
+	}
 
-			lock_door_data(p);
-			increment_door_data_pointers(p);
-			unlock_door_data(p);
+	conn = door_table[door].data;
+	t = conn->transport;
+	lock = &conn->desc_lock;
+	unlock_door_table();
 
-			if (
-0 != pthread_create( &thread_id, NULL, connection_listen, (void*)arg )
-			) {
-/* No one's listening!  Close the connection.  Also, there's no one
- * else to free arg, so do that now.
+	if ( 0 != LOCKSTAT_MUTEX_LOCK( lock, &lock_stats[DOOR_LOCK_DESC] ) )
+		fatal_system_error(__FILE__,__LINE__,"mutex lock");
+
+/* Claim a tag for each call, so that a reply's tag says which it answers. */
+	first = conn->last_tag + 1;
+	conn->last_tag += count;
+
+	for ( i = 0; i < count; ++i )
+		status[i] = EINPROGRESS;
+
+/* A large call needs the door's DOOR_PARAM_CMA_MIN, which we must learn
+ * before the first call of the batch is out, unless it must be copied anyway.
  */
-				free(arg);
-				close(endpoint);
-				release_door_data(p);
-			} /* end if */
-		} /* end while ( 0 <= accept() ) */
-/* If accept() reports EINVAL, that means that our descriptor is no longer
- * accepting connections.  If that isn't because it's been revoked, we should
- * wait for it to be re-attached with door_attach(). 
+	for ( i = 0; i < count && PTHREAD_CANCEL_ENABLE != cancel_state; ++i )
+		if ( page_size <= params[i].data_size ) {
+			learn_cma_min( conn, door, 0 );
+			break;
+		}
+
+	abandon.transport = t;
+	abandon.door = door;
+	abandon.tag = first;
+	abandon.count = 0;
+	abandon.lock = lock;
+
+	pthread_cleanup_push( abandon_call, &abandon );
+
+	for ( sent = 0; sent < count && 0 == error; ++sent ) {
+		if ( 0 != send_call( t,
+		                     conn,
+		                     door,
+		                     &params[sent],
+		                     first + sent,
+		                     0,
+		                     DOOR_PRIORITY_NORMAL,
+		                     false,
+		                     PTHREAD_CANCEL_ENABLE == cancel_state
+		                   )
+		   ) {
+			error = errno;
+			break;
+		}
+		abandon.count = sent + 1;
+
+/* Take any replies already here, so that the server never waits to send them
+ * while we send it calls.
  */
-		if ( EINVAL == errno )
-			p->attachments = false;
+		while ( 0 == error && 0 == t->wait( door, 0 ) ) {
+			if ( 0 != take_reply( conn,
+			                      door,
+			                      first,
+			                      sent + 1,
+			                      params,
+			                      status,
+			                      cancel_state
+			                    )
+			   )
+				error = errno;
+			else
+				++answered;
+		}
+	}
 
-	} /* end while ( ! p->revoked ) */
+	while ( 0 == error && answered < sent ) {
+		if ( 0 != take_reply( conn,
+		                      door,
+		                      first,
+		                      sent,
+		                      params,
+		                      status,
+		                      cancel_state
+		                    )
+		   )
+			error = errno;
+		else
+			++answered;
+	}
 
-/* Our door has been revoked, or failed unrecoverably. */
-	release_door_data(p);
-	return NULL;
+	pthread_cleanup_pop(0);
+
+/* The calls we never sent, or whose replies we lost with the connection,
+ * share its fate.
+ */
+	for ( i = 0; i < count; ++i )
+		if ( EINPROGRESS == status[i] )
+			status[i] = error;
+
+	if ( 0 != pthread_mutex_unlock(lock) )
+		fatal_system_error(__FILE__,__LINE__,"mutex unlock");
+
+	return SUCCESS;
 }
 
-static int spawn_door_server( int d )
-/* Spawn a thread to listen on door descriptor d for incoming 
- * connections.  The new thread and its children attempt to block all signals.
- *
- * Copies d, which has an unknown lifetime, to automatic storage.  The
- * new thread must free() this storage before it terminates.
- *
- * Returns 0 on success, -1 on failure, and sets errno.
+static int create_door( door_server_proc_t server_procedure,
+                        door_batch_proc_t batch_procedure,
+                        void* cookie,
+                        door_attr_t attributes,
+                        int transport
+                      )
+/* Does the work of door_create_transport() and door_create_batch().  The door
+ * has one server procedure or the other.
  */
 {
 	static const int ERROR = -1;
-	int* p;
-	pthread_t thread_id;
-	sigset_t all_signals;
-	sigset_t old_mask;
-	int retval;
+	static const uint_t UNRECOGNIZED =
+~( DOOR_REFUSE_DESC | DOOR_UNREF | DOOR_UNREF_MULTI | DOOR_NO_CANCEL |
+   DOOR_INLINE );
 
-	if ( d < 0 || (size_t)d >= open_max ) {
-		errno = EBADF;
+	const struct door_transport* t;
+	int did;		/* The descriptor of the new door */
+	size_t default_buf;	/* The transport's default capacity */
+	struct door_data* p;	/* Holds the new table entry. */
+
+	if (
+(NULL == server_procedure && NULL == batch_procedure) ||
+(attributes & UNRECOGNIZED) ||
+(NULL != batch_procedure && ( DOOR_INLINE & attributes ))
+	   ) {
+		errno = EINVAL;
 		return ERROR;
 	}
 
-
-	p = (int*)malloc(sizeof(int));
-
-	if ( NULL == p ) {
-		errno = ENOMEM;
+	if ( 0 > transport ||
+	     TRANSPORT_COUNT <= (size_t)transport ||
+	     NULL == transports[transport]
+	   ) {
+		errno = EINVAL;
 		return ERROR;
 	}
 
-	*p = d;
+	t = transports[transport];
 
-	sigfillset(&all_signals);
+/* If this is the first time we've created a door, initialize the
+ * server module.  Among other things, this initializes door_table_lock 
+ * so that init_door_table() will work.
+ */
+	pthread_once( &is_server_ready, server_init );
 
-	pthread_sigmask( SIG_BLOCK, &all_signals, &old_mask );
-	retval = pthread_create( &thread_id, NULL, door_listen, (void*)p );
-	pthread_sigmask( SIG_SETMASK, &old_mask, NULL );
+/* If door_table does not exist, create it. */
+	if ( NULL == door_table )
+		if ( NULL == init_door_table() ) {
+			errno = ENOMEM;
+			return ERROR;
+		}
 
-	return retval;
-}
+	if ( 0 > ( did = t->create() ) )
+		return ERROR;
 
-static inline struct door_data* local_door_data( int d )
-/* If d is the descriptor of a local door, return a pointer to its associated
- * door_data structure.  Otherwise, return NULL.
+	if ( (size_t)did >= open_max )
+/* Our table is too small.  Better resize. */
+		if ( NULL == resize_door_table(did) ) {
+			t->close(did);
+			errno = ENOMEM;
+			return ERROR;
+		}
+
+	if ( 0 != t->get_capacity( did, &default_buf ) ) {
+		t->close(did);
+		return ERROR;
+	}
+
+	assert( default_buf > DOOR_CALL_RESERVED );
+
+/* Writes to the table can proceed in shared mode, as two doors being 
+ * created simultaneously will not have the same file descriptor, but 
+ * another thread must not move the table elsewhere until we finish.
  *
- * Returns the pointer, rather than true, to avoid a race condition in which
- * a door might be revoked after we return true, but before we copy the
- * pointer.
+ * Do not attempt to use the door until door_create() has returned, or 
+ * we may have a race!
  */
-{
-	struct door_data* retval;
+	p = (struct door_data*)calloc( 1, sizeof(struct door_data) );
+	if ( NULL == p ) {
+		t->close(did);
+		errno = ENOMEM;
+		return ERROR;
+	}
 
-	if ( NULL == door_table )
-		return NULL;
+	p->id = get_unique_id();
+	p->counters = counters_create(p->id);
+	if ( NULL == p->counters ) {
+		const int error = errno;
 
-	lock_door_table();
+		free(p);
+		t->close(did);
+		errno = error;
+		return ERROR;
+	}
 
-	if ( open_max <= (size_t)d || fd_server != door_table[d].type )
-		retval = NULL;
-	else
-		retval = door_table[d].data;
+	p->transport = t;
+	p->target = getpid();
+	p->server_proc = server_procedure;
+	p->batch_proc = batch_procedure;
+	p->cookie = cookie;
+	p->attr = attributes;
+	p->data_min = 0;
+	p->data_max = default_buf - DOOR_CALL_RESERVED;
+	p->desc_max = ( DOOR_REFUSE_DESC & attributes ) ? 0 : DESC_LIMIT;
+	p->cma_min = 0;
+	p->attachments = false;
+	p->revoked = false;
+	p->pointers = 0;
+	p->holds = 0;
+	p->was_unref = false;
+	pthread_cond_init( &p->can_listen, NULL );
+	pthread_mutex_init ( &p->lock_data, NULL );
 
+/* Only now may another thread find the door and take a hold on it. */
+	lock_door_table();
+	door_table[did].type = fd_server;
+	door_table[did].data = p;
 	unlock_door_table();
 
-	return retval;
+	if ( 0 != spawn_door_server(did) ) {
+		t->close(did);
+		return ERROR;
+	}
+
+/* Perhaps sync with the listener thread here, to prevent races? */
+
+	return did;
 }
 
+
 /* Functions <door.h> exports: */
 
 int door_attach( int d, const char* path )
@@ -1180,56 +4325,27 @@ int door_attach( int d, const char* path )
 	static const int SUCCESS = 0, ERROR = -1;
 	mode_t old_umask;		/* Used by umask() */
 
-	size_t path_len;
-	struct sockaddr_un address;
 	struct door_data* p;
+	int retval;
 
 	if ( NULL == path ) {
 		errno = EINVAL;
 		return ERROR;
 	}
 
-/* Implementations are allowed to do some tricky things with the 
- * sun_path array, but this code should work portably:
- */
-	path_len = strlen(path);
+	p = local_door_data(d);
 
-	if ( path_len >= sizeof(address.sun_path) ) {
-		errno = ENAMETOOLONG;
+	if ( NULL == p ) {
+		errno = EBADF;
 		return ERROR;
 	}
 
-	address.sun_family = AF_UNIX;
-
-/* Using memcpy and an explicit terminator are redundant, individually
- * and together, unless the data change from under us.  In that case,
- * we're already in a state of mortal sin.  I do it anyway, as the cost
- * is well worth making a buffer overrun impossible.
- */
-	memcpy( address.sun_path, path, path_len );
-	address.sun_path[path_len] = '\0';
-
 	old_umask = umask( S_IRWXU | S_IRWXG | S_IRWXO );
-
-	if ( 0 != bind( d,
-	                (const struct sockaddr*)&address,
-	                offsetof( struct sockaddr_un, sun_path ) + path_len
-	              )
-	   ) {
-		umask(old_umask);
-		return ERROR;
-	}
+	retval = p->transport->attach( d, path );
 	umask(old_umask);
 
-	if ( 0 != listen( d, SOMAXCONN ) )
-		return ERROR;
-
-	p = local_door_data(d);
-
-	if ( NULL == p ) {
-		errno = EBADF;
+	if ( 0 != retval )
 		return ERROR;
-	}
 
 /* Now, we can tell the listening thread to listen.  The POSIX standard tells
  * us to own this mutex when we call pthread_cond_signal() if we want 
@@ -1261,8 +4377,6 @@ int door_attach_r( int d, const char* path )
 {
 	static const int SUCCESS = 0, ERROR = -1;
 
-	size_t path_len;
-	struct sockaddr_un address;
 	struct door_data* p;
 
 	if ( NULL == path ) {
@@ -1270,37 +4384,6 @@ int door_attach_r( int d, const char* path )
 		return ERROR;
 	}
 
-/* Implementations are allowed to do some tricky things with the 
- * sun_path array, but this code should work portably:
- */
-	path_len = strlen(path);
-
-	if ( path_len >= sizeof(address.sun_path) ) {
-		errno = ENAMETOOLONG;
-		return ERROR;
-	}
-
-	address.sun_family = AF_UNIX;
-
-/* Using memcpy and an explicit terminator are redundant, individually
- * and together, unless the data change from under us.  In that case,
- * we're already in a state of mortal sin.  I do it anyway, as the cost
- * is well worth making a buffer overrun impossible.
- */
-	memcpy( address.sun_path, path, path_len );
-	address.sun_path[path_len] = '\0';
-
-	if ( 0 != bind( d,
-	                (const struct sockaddr*)&address,
-	                offsetof( struct sockaddr_un, sun_path ) + path_len
-	              )
-	   ) {
-		return ERROR;
-	}
-
-	if ( 0 != listen( d, SOMAXCONN ) )
-		return ERROR;
-
 	p = local_door_data(d);
 
 	if ( NULL == p ) {
@@ -1308,6 +4391,9 @@ int door_attach_r( int d, const char* path )
 		return ERROR;
 	}
 
+	if ( 0 != p->transport->attach( d, path ) )
+		return ERROR;
+
 /* Now, we can tell the listening thread to listen.  The POSIX standard tells
  * us to own this mutex when we call pthread_cond_signal() if we want 
  * "predictable scheduling behavior."
@@ -1333,14 +4419,18 @@ int door_call( int door, door_arg_t* params )
  * should work.
  *
  * Known bugs:
- * - File descriptor passing not supported yet.  All doors have a
- * DOOR_PARAM_DESC_MAX parameter of 0, and cannot increase it.
  * - If the client is multi-threaded and responses come back in a
  * different order than they were sent, this function will fail.
  * - If the client is multi-threaded and attempts to get a response from
  * the server while another door_call is in progress, this function can
  * fail.
- * - Cancellation is not supported.
+ * - A thread cancelled while it calls a door in this process is only
+ * cancelled once the call has returned.
+ *
+ * A call to a door this process created (a descriptor from door_create()
+ * rather than door_open()) runs the server procedure on a new thread in
+ * this process, passing it the caller's data buffer directly.  Nothing
+ * is copied until door_return() stores the results.
  *
  * Differences between this implementation and Sun's include:
  * - The SunOS 5.11 man page says, "If the results of a door invocation
@@ -1356,297 +4446,170 @@ int door_call( int door, door_arg_t* params )
  * the original buffer if necessary.
  * - The SunOS 5.11 man page says to deallocate a library-allocated
  * buffer using munmap().  In this implementation, the preferred method
- * is free().  However, the implementation currently allocates page-
- * aligned buffers using posix_memalign(), so either method should work.
- * - The values of errno might differ from those listed under some
- * circumstances.
- *
- * This function returns 0 on success or -1 on failure, setting errno
- * appropriately.  A partial list of errno values (FIXME: document more
- * fully):
- * - EBADMSG: The client received an inappropriate message in response.
- * - EFAULT: The user passed in a NULL data buffer with a non-zero data
- * size, or a NULL descriptor list with a non-zero number of 
- * descriptors.
- * - ENFILE: The user passed in too many descriptors (currently, more
- * than zero).
- * - ENOMEM: The server returned too much data for us to store.
- */
-{
-	static const int ERROR = -1, SUCCESS = 0;
-	struct msg_door_call outgoing;
-	long long int incoming_code;
-	pthread_mutex_t* lock = NULL;
-
-	if ( NULL == params || 0 == params->data_size ) {
-/* There are no parameters. */
-		lock_door_table();
-
-		if ( fd_client == door_table[door].type ) {
-/* A non-local door. */
-			lock =
-& ( (struct conn_data*)door_table[door].data )->desc_lock;
-			unlock_door_table();
-
-			if ( 0 != pthread_mutex_lock(lock) )
-				fatal_system_error(__FILE__,__LINE__,"mutex lock");
-
-			msg_door_call_init( &outgoing, 0 );
-			send( door, &outgoing, sizeof(outgoing), MSG_EOR );
-		}
-		else {
-			unlock_door_table();
-			errno = EBADF;
-			return ERROR;
-		}
-	}
-	else {
-/* Within this block, we know that params != NULL. */
-
-		if ( ( NULL == params->data_ptr ) ||
-		     ( NULL == params->rbuf && 0 != params->rsize )
-		   ) {
-/* The caller passed in an invalid buffer.  It is not an error to call
- * a door with a non-NULL params and a NULL params->data_ptr, as this
- * correctly indicates that the door takes no data, but may return
- * some.  However, the function thinks it's passing in actual data, so
- * something's gone wrong.  It is likewise not an error to pass in a
- * NULL params->rbuf, as this indicates that the system should allocate
- * a results buffer if we need one.  However, if the caller thinks that
- * NULL points to a valid buffer, something's gone wrong.  We can
- * recover, but better to point out the logic error.
+ * is free().  However, the implementation currently allocates page-
+ * aligned buffers using posix_memalign(), so either method should work.
+ * - Descriptors passed back by the server are stored in the results
+ * buffer, after the data, and desc_ptr and desc_num are set to describe
+ * them.  Only file descriptors (DOOR_DESCRIPTOR) can be passed, at most
+ * DESC_LIMIT (253) of them per call.
+ * - The values of errno might differ from those listed under some
+ * circumstances.
+ *
+ * This function returns 0 on success or -1 on failure, setting errno
+ * appropriately.  A partial list of errno values (FIXME: document more
+ * fully):
+ * - EBADMSG: The client received an inappropriate message in response.
+ * - EFAULT: The user passed in a NULL data buffer with a non-zero data
+ * size, or a NULL descriptor list with a non-zero number of 
+ * descriptors.
+ * - EINVAL: A descriptor in the list is not tagged DOOR_DESCRIPTOR.
+ * - EMFILE: The client could not receive all of the descriptors the
+ * server passed back.
+ * - ENFILE: The user passed in too many descriptors, for this
+ * implementation or for the door's DOOR_PARAM_DESC_MAX.
+ * - ENOMEM: The server returned too much data for us to store.
+ * - ENOTSUP: The user passed descriptors to a door created with
+ * DOOR_REFUSE_DESC.
  */
-			errno = EFAULT;
-			return ERROR;
-		}
+{
+	return door_call_timed( door, params, 0 );
+}
 
-		if ( 0 != params->desc_num ) {
-/* The caller tried to pass in door descriptors, which are not
- * yet supported.  This implementation considers all doors to accept a
- * maximum of zero descriptors.
+int door_call_oneway( int door, door_arg_t* params )
+/* As door_call(), but returns as soon as the call is on its way, and the
+ * server sends no reply, not even an error.  params describes only the data
+ * and descriptors passed; the results, if any, are discarded.  Since no one
+ * waits for the server, it copies the data even from a caller in this
+ * process, and a door that limits its calls drops a one-way call it would
+ * have refused.
  */
-			errno = ENFILE;
-			return ERROR;
-		}
-
-		lock_door_table();
-		if ( fd_client == door_table[door].type ) {
-/* A non-local door. */
-			struct iovec send_iovs[2];
-			struct msghdr send_hdr;
-
-			lock =
-& ( (struct conn_data*)door_table[door].data )->desc_lock;
-			unlock_door_table();
-
-			if ( 0 != pthread_mutex_lock(lock) )
-				fatal_system_error(__FILE__,__LINE__,"mutex lock");
-
-			bzero( &send_iovs[0], 2*sizeof(struct iovec) );
-			bzero( &send_hdr, sizeof(send_hdr) );
-
-			send_hdr.msg_iov = send_iovs;
-			send_hdr.msg_iovlen = 2;
-
-			send_iovs[0].iov_base = &outgoing;
-			send_iovs[0].iov_len = sizeof(outgoing);
-		
-			send_iovs[1].iov_base = (void*)params->data_ptr;
-			send_iovs[1].iov_len = params->data_size;
-
-			msg_door_call_init( &outgoing,
-			                    params->data_size
-			                  );
+{
+	int cancel_state, result;
+
+	pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, &cancel_state );
+	result = call_door( door,
+	                    params,
+	                    0,
+	                    DOOR_PRIORITY_NORMAL,
+	                    true,
+	                    cancel_state
+	                  );
+	pthread_setcancelstate( cancel_state, NULL );
+
+	return result;
+}
 
-			sendmsg( door, &send_hdr, MSG_EOR );
-		}
-		else {
-/* A local door, or not a door at all. */
-			unlock_door_table();
-			errno = EBADF;
-			return ERROR;
-		} /* end if (non-local door) */
-	} /* end if (Passed in any params?) */
-/* We've now sent the message, and await a msg_door_return in reply.  The door
- * descriptor's mutex is locked.
+int door_call_pipelined( int door,
+                         door_arg_t* params,
+                         int* errors,
+                         size_t count
+                       )
+/* As door_call() for each of the count calls params points to, but sends
+ * them all before waiting for any reply, and stores what each returned in
+ * errors.  Fails with the first error of any call.
  */
+{
+	static const int ERROR = -1, SUCCESS = 0;
+	int* status = errors;
+	int cancel_state, result;
+	size_t i;
 
-	incoming_code = message_type(door);
-	if ( 0 > incoming_code ) {
-		if ( 0 != pthread_mutex_unlock(lock) ) {
-			fatal_system_error(__FILE__,
-			                   __LINE__,
-			                   "mutex unlock"
-		                          );
-		}
+	if ( 0 == count )
+		return SUCCESS;
+
+	if ( NULL == params ) {
+		errno = EFAULT;
 		return ERROR;
 	}
-	else if ( code_error == incoming_code ) {
-/* We received an error message back. */
-		struct msg_error incoming;
 
-		if (
-0 > recv( door, &incoming, sizeof(incoming), MSG_WAITALL )
-		   ) {
-			if ( 0 != pthread_mutex_unlock(lock) ) {
-				fatal_system_error(__FILE__,
-				                   __LINE__,
-				                   "mutex unlock"
-		        	                  );
-			}
+	if ( NULL == status ) {
+		status = calloc( count, sizeof(int) );
+		if ( NULL == status ) {
+			errno = ENOMEM;
 			return ERROR;
 		}
+	}
 
-		errno = msg_error_decode(&incoming);
-		if ( 0 != pthread_mutex_unlock(lock) ) {
-			fatal_system_error(__FILE__,
-			                   __LINE__,
-			                   "mutex unlock"
-			                  );
-		}
-		return ERROR;
-	} /* end if ( code_error == incoming_code ) */
-	else if ( code_door_return == incoming_code ) {
-/* The server responded with a door_return message, as expected. */
-		struct msg_door_return incoming;
-		ssize_t return_size, bytes_read;
-		void* return_buf = NULL;
-		bool new_buffer = false;
-		struct iovec recv_iovs[2];
-		struct msghdr recv_hdr;
-
-		if (
-0 > recv( door, &incoming, sizeof(incoming), MSG_PEEK ) 
-		   ) {
-			if ( 0 != pthread_mutex_unlock(lock) ) {
-				fatal_system_error(__FILE__,
-				                   __LINE__,
-				                   "mutex unlock"
-		                                  );
-			}
-			return ERROR;
+	pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, &cancel_state );
+	result = call_door_pipelined( door,
+	                              params,
+	                              status,
+	                              count,
+	                              cancel_state
+	                            );
+	pthread_setcancelstate( cancel_state, NULL );
+
+/* Calls that were never sent share the error that stopped them. */
+	if ( 0 != result )
+		for ( i = 0; i < count; ++i )
+			status[i] = errno;
+
+	for ( i = 0; 0 == result && i < count; ++i )
+		if ( 0 != status[i] ) {
+			errno = status[i];
+			result = ERROR;
 		}
 
-		return_size = msg_door_return_get_data_size(&incoming);
-
-		if ( NULL == params ) {
-/* We cannot receive any data. */
-			if ( 0 != return_size ) {
-				if ( 0 != pthread_mutex_unlock(lock) ) {
-					fatal_system_error(__FILE__,
-					                   __LINE__,
-					                   "mutex unlock"
-					                  );
-				}
-				errno = ENOMEM;
-				return ERROR;
-			} /* end if ( 0 != return_size ) */
-
-			if ( 0 != pthread_mutex_unlock(lock) ) {
-				fatal_system_error(__FILE__,
-				                   __LINE__,
-				                   "mutex unlock"
-				                  );
-			}
-			return SUCCESS;
-		} /* end if ( NULL == params ) */
+	if ( status != errors ) {
+		const int saved_errno = errno;
 
-		if ( 0 > return_size ) {
-/* The door returned too much data for us to even address! */
-			if ( 0 != pthread_mutex_unlock(lock) ) {
-				fatal_system_error(__FILE__,
-				                   __LINE__,
-				                   "mutex unlock"
-				                  );
-			}
-			errno = ENOMEM;
-			params->data_size = 0;
-			return ERROR;
-		}
+		free(status);
+		errno = saved_errno;
+	}
 
-		if ( (size_t)return_size > params->rsize ) {
-/* Allocate a new buffer. */
-			if ( 0 != posix_memalign( &return_buf,
-			                          page_size,
-			                          (size_t)return_size
-			                        )
-			   ) {
-				if ( 0 != pthread_mutex_unlock(lock) ) {
-					fatal_system_error(__FILE__,
-					                   __LINE__,
-					                   "mutex unlock"
-					                  );
-				}
-				params->data_size = 0;
-				errno = ENOMEM;
-				return ERROR;
-			}
-			new_buffer = true;
-		} /* end if ( (size_t)return_size > params->rsize ) */
-		else
-			return_buf = params->rbuf;
+	return ( 0 == result ) ? SUCCESS : ERROR;
+}
 
-/* The return_buf variable now points to a buffer big enough to hold 
- * the requested data.
+int door_call_priority( int door,
+                        door_arg_t* params,
+                        unsigned long long timeout_ns,
+                        unsigned int priority
+                      )
+/* As door_call_timed(), but the call is of the class priority, which a door
+ * that limits its running calls serves first if it is DOOR_PRIORITY_HIGH.
+ * Fails with EINVAL if priority is not a class we know.
  */
-		bzero( recv_iovs, 2*sizeof(struct iovec) );
-		bzero( &recv_hdr, sizeof(recv_hdr) );
-
-		recv_hdr.msg_iov = recv_iovs;
-		recv_hdr.msg_iovlen = 2;
-
-		recv_iovs[0].iov_base = &incoming;
-		recv_iovs[0].iov_len = sizeof(incoming);
-
-		recv_iovs[1].iov_base = return_buf;
-		recv_iovs[1].iov_len = (size_t)return_size;
-
-		bytes_read = recvmsg( door, &recv_hdr, MSG_WAITALL );
+{
+	static const int ERROR = -1;
+	const uint64_t deadline =
+( 0 == timeout_ns ) ? 0 : counters_now() + (uint64_t)timeout_ns;
+	int cancel_state, result;
 
-		if ( (ssize_t)sizeof(incoming) + return_size !=
-		     bytes_read
-		   ) {
-/* Failed to read the data that should be there. */
-			if (new_buffer)
-				free(return_buf);
+	if ( DOOR_PRIORITY_HIGH < priority ) {
+		errno = EINVAL;
+		return ERROR;
+	}
 
-			params->rsize = 0;
-			if ( 0 != pthread_mutex_unlock(lock) ) {
-				fatal_system_error(__FILE__,
-				                   __LINE__,
-				                   "mutex unlock"
-				                  );
-			}
-			errno = EBADMSG;
-			return ERROR;
-		} /* end if( bytes_read < return_size ) */
-		else {
-/* We read the correct amount of data. */
-			params->rbuf = return_buf;
-			params->data_ptr = return_buf;
-			params->rsize = (size_t)return_size;
-			params->data_size = (size_t)return_size;
+/* Only the wait for the reply may be cancelled, where we know how to clean
+ * up.
+ */
+	pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, &cancel_state );
+	result = call_door( door, params, deadline, priority, false, cancel_state );
+	pthread_setcancelstate( cancel_state, NULL );
 
-			if ( 0 != pthread_mutex_unlock(lock) ) {
-				fatal_system_error(__FILE__,
-				                   __LINE__,
-				                   "mutex unlock"
-				                  );
-			}
-			return SUCCESS;
-		} /* end if ( number of bytes read ). */
-	} /* end if ( type of message received ) */
+	return result;
+}
 
-/* We received the wrong kind of message. */
-	close(door);
-	if ( 0 != pthread_mutex_unlock(lock) ) {
-		fatal_system_error(__FILE__,
-		                   __LINE__,
-		                   "mutex unlock"
-		                  );
-	}
-	errno = EBADMSG;
-	return ERROR;
+int door_call_timed( int door,
+                     door_arg_t* params,
+                     unsigned long long timeout_ns
+                   )
+/* As door_call(), but gives up on the call once timeout_ns nanoseconds have
+ * passed, failing with ETIMEDOUT.  A timeout of 0 waits as long as it takes.
+ *
+ * The call carries its deadline, and a server that receives it too late
+ * refuses it, also with ETIMEDOUT, rather than run it.  A reply that arrives
+ * after we have given up is discarded by the next call on the descriptor.
+ * Giving up, whether at the deadline or because the calling thread has been
+ * cancelled, also tells the server, which cancels the thread running the
+ * call unless the door has DOOR_NO_CANCEL.
+ *
+ * A call to a door this process created runs the server procedure on the
+ * caller's own buffer.  It gives up at the deadline only while it waits for
+ * a thread; once the server procedure has started, it waits for the end.
+ */
+{
+	return door_call_priority( door, params, timeout_ns, DOOR_PRIORITY_NORMAL );
 }
 
 int door_close( int d )
@@ -1677,10 +4640,13 @@ int door_close( int d )
 	}
 
 /* Lock the mutex to give operations in progress a chance to complete. */
-	if ( 0 != pthread_mutex_lock(&p->desc_lock) )
+	if ( 0 != LOCKSTAT_MUTEX_LOCK( &p->desc_lock,
+	                               &lock_stats[DOOR_LOCK_DESC]
+	                             )
+	   )
 		fatal_system_error( __FILE__, __LINE__, "desc_lock" );
 
-	retval = close(d);
+	retval = p->transport->close(d);
 
 /* Unlock the mutex in order to destroy it.  No other thread should re-acquire
  * it, because the door descriptor has now been closed and marked invalid.
@@ -1696,126 +4662,153 @@ int door_close( int d )
 	return retval;
 }
 
-int door_create( door_server_proc_t server_procedure,
-                 void* cookie,
-                 door_attr_t attributes
-               )
-/* See the SunOS 5.11 manual for a specification of how this function 
- * behaves.
- *
- * Currently, this implementation does not support any attributes other 
- * than DOOR_REFUSE_DESC, which it implements as a no-op.  It implements 
- * doors as UNIX domain sockets.
- *
- * It can return ERRNO codes of EINVAL (unrecognized attribute or NULL 
- * server procedure), ENOMEM (no memory for internal data structures), 
- * or any value set by socket.
+int door_complete( door_token_t* token,
+                   const void* restrict data_ptr,
+                   size_t data_size,
+                   const door_desc_t* restrict desc_ptr,
+                   uint_t num_desc
+                 )
+/* Sends the results of the call that door_defer() gave us token for, as
+ * door_return() would have, from whatever thread.  Unless they fail the
+ * checks door_return() makes, the call is finished, sent or not, and the
+ * token no longer valid.
  */
 {
-	static const int ERROR = -1;
-	static const uint_t UNRECOGNIZED =
-~( DOOR_REFUSE_DESC | DOOR_UNREF | DOOR_UNREF_MULTI );
-
-	int did;		/* The descriptor of the new door */
-	int default_buf;	/* Used by getsockopt() */
-/* Used by getsockopt(): */
-	socklen_t int_length = sizeof(int);
-	struct door_data* p;	/* Holds the new table entry. */
+	static const int ERROR = -1, SUCCESS = 0;
+	struct door_server_args_t* const args =
+(struct door_server_args_t*)token;
+	struct conn_calls* calls;
+	struct door_data* door;
+	int cancel_state, error, result;
 
-	if (
-(NULL == server_procedure) || (attributes & UNRECOGNIZED)
-	   ) {
+	if ( NULL == args ) {
 		errno = EINVAL;
 		return ERROR;
 	}
 
-/* If this is the first time we've created a door, initialize the
- * server module.  Among other things, this initializes door_table_lock 
- * so that init_door_table() will work.
- */
-	pthread_once( &is_server_ready, server_init );
+	error = check_results( data_ptr, data_size, desc_ptr, num_desc );
+	if ( 0 != error ) {
+		errno = error;
+		return ERROR;
+	}
 
-/* If door_table does not exist, create it. */
-	if ( NULL == door_table )
-		if ( NULL == init_door_table() ) {
-			errno = ENOMEM;
-			return ERROR;
-		}
+	pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, &cancel_state );
 
-/* Doors are currently sockets: */
-	if ( 0 > ( did = socket( AF_UNIX, SOCK_SEQPACKET, 0 ) ) )
-		return ERROR;
+	result = deliver_results( args, data_ptr, data_size, desc_ptr, num_desc );
 
-	if ( (size_t)did >= open_max )
-/* Our table is too small.  Better resize. */
-		if ( NULL == resize_door_table(did) ) {
-			close(did);
-			errno = ENOMEM;
-			return ERROR;
-		}
+	if ( 0 != result )
+		error = errno;
 
-	if ( 0 != getsockopt( did,
-	                      SOL_SOCKET,
-	                      SO_RCVBUF,
-	                      &default_buf,
-	                      &int_length
-	                    )
-	   ) {
-		close(did);
+/* The connection, or the door of a local call, may go once no call on it is
+ * left unanswered.
+ */
+	calls = args->calls;
+	door = args->door;
+	free(args->buffer);
+	free(args);
+	if ( NULL != calls )
+		release_calls(calls);
+	else if ( NULL != door )
+		drop_door_data(door);
+
+	pthread_setcancelstate( cancel_state, NULL );
+
+	if ( 0 != result ) {
+		errno = error;
 		return ERROR;
 	}
 
-	assert( default_buf > (int)DOOR_CALL_RESERVED );
+	return SUCCESS;
+}
+
+int door_create( door_server_proc_t server_procedure,
+                 void* cookie,
+                 door_attr_t attributes
+               )
+/* See the SunOS 5.11 manual for a specification of how this function 
+ * behaves.
+ *
+ * Currently, this implementation does not support any attributes other 
+ * than DOOR_REFUSE_DESC, DOOR_UNREF, DOOR_UNREF_MULTI, DOOR_NO_CANCEL and
+ * DOOR_INLINE.
+ * It implements doors as UNIX domain sockets.  A door created without DOOR_REFUSE_DESC
+ * accepts up to DESC_LIMIT (253) descriptors per call.
+ *
+ * It can return ERRNO codes of EINVAL (unrecognized attribute or NULL 
+ * server procedure), ENOMEM (no memory for internal data structures), 
+ * or any value set by socket.
+ */
+{
+	return door_create_transport( server_procedure,
+	                              cookie,
+	                              attributes,
+	                              DOOR_TRANSPORT_SOCKET
+	                            );
+}
 
-/* It makes no sense to keep a door open after exec(), as even if the
- * new program is also a door server, it won't know about this door.
+int door_create_batch( door_batch_proc_t batch_procedure,
+                       void* cookie,
+                       door_attr_t attributes,
+                       int transport
+                     )
+/* Creates a door as door_create_transport() does, but whose calls go to a
+ * batch server procedure.  The listener on each connection takes every call
+ * waiting there for the same thread.
  */
-	if ( 0 != fcntl( did, F_SETFL, FD_CLOEXEC ) ) {
-		close(did);
-		return ERROR;
-	}
+{
+	return create_door( NULL, batch_procedure, cookie, attributes, transport );
+}
 
-/* Writes to the table can proceed in shared mode, as two doors being 
- * created simultaneously will not have the same file descriptor, but 
- * another thread must not move the table elsewhere until we finish.
+int door_create_transport( door_server_proc_t server_procedure,
+                           void* cookie,
+                           door_attr_t attributes,
+                           int transport
+                         )
+/* Creates a door exactly as door_create() does, but carried by the given
+ * transport, one of the DOOR_TRANSPORT_ constants.  Everything above the
+ * transport -- the messages, the server threads, door_return() -- is the
+ * same whichever one the door uses.
  *
- * Do not attempt to use the door until door_create() has returned, or 
- * we may have a race!
+ * In addition to the errors door_create() reports, this function reports
+ * EINVAL for an unknown transport, and any error the transport reports.
  */
-	p = (struct door_data*)calloc( 1, sizeof(struct door_data) );
-	if ( NULL == p ) {
-		close(did);
-		errno = ENOMEM;
-		return ERROR;
-	}
-
-	lock_door_table();
-	door_table[did].type = fd_server;
-	door_table[did].data = p;
-	unlock_door_table();
+{
+	return create_door( server_procedure, NULL, cookie, attributes, transport );
+}
 
-	p->target = getpid();
-	p->server_proc = server_procedure;
-	p->cookie = cookie;
-	p->attr = attributes;
-	p->id = get_unique_id();
-	p->data_min = 0;
-	p->data_max = (size_t)default_buf - DOOR_CALL_RESERVED;
-	p->attachments = false;
-	p->revoked = false;
-	p->pointers = 0;
-	p->was_unref = false;
-	pthread_cond_init( &p->can_listen, NULL );
-	pthread_mutex_init ( &p->lock_data, NULL );
+door_token_t* door_defer(void)
+/* Hands the call the calling thread is serving over to a token for
+ * door_complete(), and frees the thread from it: the call no longer holds
+ * one of the door's DOOR_PARAM_MAX_ACTIVE, nor can the client cancel it.
+ * The rest of the server procedure runs with cancellation disabled, so that
+ * a cancel the client sent before the hand-off cannot end the thread while
+ * it holds the token.
+ */
+{
+	struct door_server_args_t* const args =
+pthread_getspecific(server_arg_buf);
 
-	if ( 0 != spawn_door_server(did) ) {
-		close(did);
-		return ERROR;
+	if ( NULL == args || NULL != args->batch_proc ) {
+/* Not a door invocation, or one that door_return_batch() must answer. */
+		errno = EINVAL;
+		return NULL;
 	}
 
-/* Perhaps sync with the listener thread here, to prevent races? */
+	pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, NULL );
 
-	return did;
+/* Once the thread forgets the call, its exit leaves the call alone.  The
+ * arguments go with the token.
+ */
+	if ( 0 != pthread_setspecific( server_arg_buf, NULL ) ||
+	     0 != pthread_setspecific( door_arg_buf, NULL )
+	   )
+		fatal_system_error(__FILE__,__LINE__,"pthread_setspecific");
+
+/* A call running inline never had a thread to leave. */
+	if ( NULL == args->inline_return )
+		leave_thread(args);
+
+	return (door_token_t*)args;
 }
 
 int door_detach ( const char* path )
@@ -1841,35 +4834,32 @@ int door_detach ( const char* path )
  * FIXME: document errno values.
  */
 {
-	static const int ERROR = -1;
+	static const int ERROR = -1, SUCCESS = 0;
 
-	struct stat buf;
+	size_t i;
 
 	if ( NULL == path ) {
 		errno = EINVAL;
 		return ERROR;
 	}
 
-/* Check that the target exists and is a socket.  Might produce an 
- * unusual errno value.
- */
-	if ( 0 != stat( path, &buf ) ) {
-		errno = EPERM;
-		return ERROR;
-	}
-
-	if ( !S_ISSOCK(buf.st_mode) ) {
-		errno = EPERM;
-		return ERROR;
-	}
+/* Code to decrement the attachment count goes here. */
 
-/* It is not an error to detach a door which you cannot open.  We 
- * could, however, attempt to open it and check socket options as well.
+/* Ask each transport in turn, newest first.  Each reports ENOENT for a path
+ * it does not carry; the socket transport, which checks that the target is
+ * a socket, has the last word.
  */
+	for ( i = TRANSPORT_COUNT; i-- > 0; ) {
+		if ( NULL == transports[i] )
+			continue;
 
-/* Code to decrement the attachment count goes here. */
+		if ( 0 == transports[i]->detach(path) )
+			return SUCCESS;
+		else if ( ENOENT != errno )
+			break;
+	}
 
-	return unlink(path);
+	return ERROR;
 }
 
 int door_getparam (int d, int param, size_t* out)
@@ -1883,7 +4873,7 @@ int door_getparam (int d, int param, size_t* out)
 	struct door_data* p;
 
 	if ( param < DOOR_PARAM_DATA_MAX ||
-	     param > DOOR_PARAM_DESC_MAX 
+	     param > DOOR_PARAM_HIGH_RESERVED
 	   ) {
 		errno = EINVAL;
 		return ERROR;
@@ -1898,9 +4888,9 @@ int door_getparam (int d, int param, size_t* out)
 
 	if ( NULL == p ) {
 /* Not a local door. */
-		struct msg_request outgoing;
+		struct conn_data* conn;
 		pthread_mutex_t* lock = NULL;
-		uint32_t type;
+		int retval;
 
 /* FIXME: This breaks dup() and dup2()! */
 		lock_door_table();
@@ -1910,70 +4900,20 @@ int door_getparam (int d, int param, size_t* out)
 			return ERROR;
 		}
 		else {
-			lock =
-& ( (struct conn_data*)door_table[d].data )->desc_lock;
+			conn = door_table[d].data;
+			lock = &conn->desc_lock;
 			unlock_door_table();
 		}
 
-		if ( 0 != pthread_mutex_lock(lock) )
+		if ( 0 != LOCKSTAT_MUTEX_LOCK( lock, &lock_stats[DOOR_LOCK_DESC] ) )
 			fatal_system_error(__FILE__,__LINE__,"mutex lock");
 
-		msg_request_init( &outgoing, param );
-		send( d, &outgoing, sizeof(outgoing), MSG_EOR );
-
-		if ( 0 > recv( d, &type, sizeof(type), MSG_PEEK ) ) {
-			if ( 0 != pthread_mutex_unlock(lock) )
-				fatal_system_error(__FILE__,__LINE__,"mutex unlock");
-
-			return ERROR;
-		}
-
-		if ( code_door_getparam == type ) {
-			struct msg_door_getparam incoming;
-
-			if (
-0 > recv( d, &incoming, sizeof(incoming), 0 )
-			   ) {
-				if ( 0 != pthread_mutex_unlock(lock) ) {
-					fatal_system_error(__FILE__,
-					                   __LINE__,
-					                   "mutex unlock"
-					                  );
-				}
-				return ERROR;
-			}
-
-			*out =  msg_door_getparam_decode(&incoming);
-		}
-		else if ( code_error == type ) {
-			struct msg_error incoming;
-
-			if (
-0 > recv( d, &incoming, sizeof(incoming), 0 )
-			   ) {
-				if ( 0 != pthread_mutex_unlock(lock) ) {
-					fatal_system_error(__FILE__,
-					                   __LINE__,
-					                   "mutex unlock"
-					                  );
-				}
-				return ERROR;
-			}
-
-			errno = msg_error_decode(&incoming);
-			if ( 0 != pthread_mutex_unlock(lock) ) {
-				fatal_system_error(__FILE__,
-				                   __LINE__,
-				                   "mutex unlock"
-		                                  );
-			}
-			return ERROR;
-		} /* end if (message type) */
+		retval = fetch_param( conn, d, (unsigned int)param, 0, out );
 
 		if ( 0 != pthread_mutex_unlock(lock) )
 			fatal_system_error(__FILE__,__LINE__,"mutex unlock");
 
-		return SUCCESS;
+		return retval;
 	} /* end if ( NULL == p ) */
 
 /* A local door. */
@@ -1991,10 +4931,36 @@ int door_getparam (int d, int param, size_t* out)
 				break;
 
 			case DOOR_PARAM_DESC_MAX:
-				*out = 0;
+				lock_door_data(p);
+				*out = p->desc_max;
+				unlock_door_data(p);
+				break;
+
+			case DOOR_PARAM_CMA_MIN:
+				lock_door_data(p);
+				*out = p->cma_min;
+				unlock_door_data(p);
+				break;
+
+			case DOOR_PARAM_MAX_ACTIVE:
+				lock_door_data(p);
+				*out = p->max_active;
+				unlock_door_data(p);
+				break;
+
+			case DOOR_PARAM_MAX_QUEUED:
+				lock_door_data(p);
+				*out = p->max_queued;
+				unlock_door_data(p);
+				break;
+
+			case DOOR_PARAM_HIGH_RESERVED:
+				lock_door_data(p);
+				*out = p->high_reserved;
+				unlock_door_data(p);
 				break;
 		} /* end switch */
-/* We already tested that param is one of those three. */
+/* We already tested that param is one of those seven. */
 
 	return SUCCESS;
 }
@@ -2018,6 +4984,8 @@ int door_info( int d, struct door_info* info )
 
 	if ( NULL == p ) {
 /* Not a local door. */
+		struct conn_data* conn;
+		const struct door_transport* t;
 		pthread_mutex_t* lock = NULL;
 		struct msg_request outgoing;
 		long long int code;
@@ -2030,16 +4998,17 @@ int door_info( int d, struct door_info* info )
 			return ERROR;
 		}
 		else {
-			lock =
-& ( (struct conn_data*)door_table[d].data )->desc_lock;
+			conn = door_table[d].data;
+			t = conn->transport;
+			lock = &conn->desc_lock;
 			unlock_door_table();
 		}
 
-		if ( 0 != pthread_mutex_lock(lock) )
+		if ( 0 != LOCKSTAT_MUTEX_LOCK( lock, &lock_stats[DOOR_LOCK_DESC] ) )
 			fatal_system_error(__FILE__,__LINE__,"mutex lock");
 
 		msg_request_init( &outgoing, REQ_DOOR_INFO );
-		if ( 0 > send( d, &outgoing, sizeof(outgoing), MSG_EOR ) ) {
+		if ( 0 > transport_send_msg( t, d, &outgoing, sizeof(outgoing) ) ) {
 			if ( 0 != pthread_mutex_unlock(lock) ) {
 				fatal_system_error(__FILE__,
 				                   __LINE__,
@@ -2049,13 +5018,13 @@ int door_info( int d, struct door_info* info )
 			return ERROR;
 		}
 
-		code = message_type(d);
+		code = next_answer( conn, d, 0 );
 
 		if ( code_door_info == code ) {
 			struct msg_door_info incoming;
 
 			if (
-0 > recv( d, &incoming, sizeof(incoming), 0 )
+0 > transport_recv_msg( t, d, &incoming, sizeof(incoming) )
 			   ) {
 				if ( 0 != pthread_mutex_unlock(lock) ) {
 					fatal_system_error(__FILE__,
@@ -2085,7 +5054,7 @@ int door_info( int d, struct door_info* info )
 			struct msg_error incoming;
 
 			if (
-0 > recv( d, &incoming, sizeof(incoming), 0 )
+0 > transport_recv_msg( t, d, &incoming, sizeof(incoming) )
 			   ) {
 				if ( 0 != pthread_mutex_unlock(lock) ) {
 					fatal_system_error(__FILE__,
@@ -2123,7 +5092,7 @@ int door_info( int d, struct door_info* info )
 
 	lock_door_data(p);	/* Necessary? */
 	info->di_target = p->target;
-	info->di_proc = (door_ptr_t)fptr2u64(p->server_proc);
+	info->di_proc = (door_ptr_t)fptr2u64(door_proc(p));
 	info->di_data = (door_ptr_t)optr2u64(p->cookie);
 	info->di_attributes = p->attr | DOOR_LOCAL;
 	info->di_uniquifier = p->id;
@@ -2134,16 +5103,17 @@ int door_info( int d, struct door_info* info )
 
 int door_open( const char* path )
 /* Drop-in replacement for open().  Currently, this opens a door 
- * descriptor, which is a socket connected to the UNIX domain socket at 
- * the requested pathname.
+ * descriptor, which is a connection to the door attached at the requested
+ * pathname, over whichever transport carries that door.  For the default
+ * transport, it is a socket connected to the UNIX domain socket there.
  */
 {
 	static const int ERROR = -1;
 	static pthread_once_t once_control = PTHREAD_ONCE_INIT;
-	struct sockaddr_un address;	/* Address to connect to */
+	const struct door_transport* t = NULL;
 /* File descriptor of the new door: */
-	int d;
-	size_t path_len;		/* Length of path. */
+	int d = -1;
+	size_t i;
 
 	pthread_once( &once_control, client_init );
 
@@ -2152,36 +5122,26 @@ int door_open( const char* path )
 		return ERROR;
 	}
 
-	d = socket( AF_UNIX, SOCK_SEQPACKET, 0 );
-	if ( 0 > d )
-		return ERROR;
-
-	path_len = strlen(path);
-	if ( offsetof( struct sockaddr_un, sun_path ) + path_len >=
-	     sizeof(struct sockaddr_un)
-	   ) {
-		errno = ENAMETOOLONG;
-		return ERROR;
-	}
+/* Ask each transport in turn, newest first.  Each reports ENOENT for a path
+ * it does not carry, and the socket transport has the last word.
+ */
+	for ( i = TRANSPORT_COUNT; i-- > 0; ) {
+		if ( NULL == transports[i] )
+			continue;
 
-	address.sun_family = AF_UNIX;
-	memcpy( &address.sun_path, path, path_len );
-	address.sun_path[path_len] = '\0';
+		t = transports[i];
+		d = t->connect(path);
 
-	if ( 0 != connect( d,
-	                   (const struct sockaddr*)&address, 
-	                   offsetof( struct sockaddr_un, sun_path ) + path_len
-	                 )
-	   ) {
-		close(d);
-		return ERROR;
+		if ( 0 <= d || ENOENT != errno )
+			break;
 	}
 
-	fcntl( d, F_SETFL, FD_CLOEXEC );
+	if ( 0 > d )
+		return ERROR;
 
 	if ( open_max <= (size_t)d ) {
 		if ( NULL == resize_door_table(d) ) {
-			close(d);
+			t->close(d);
 			errno = ENOMEM;
 			return ERROR;
 		}
@@ -2192,7 +5152,7 @@ int door_open( const char* path )
 (struct conn_data*)malloc(sizeof(struct conn_data));
 
 	if ( NULL == door_table[d].data ) {
-		close(d);
+		t->close(d);
 		unlock_door_table();
 		errno = ENOMEM;
 		return ERROR;
@@ -2205,10 +5165,16 @@ pthread_mutex_init( & ( (struct conn_data*)door_table[d].data )->desc_lock,
 			free(door_table[d].data);
 			door_table[d].data = NULL;
 			unlock_door_table();
-			close(d);
+			t->close(d);
 			return ERROR;
 	}
 	else {
+		( (struct conn_data*)door_table[d].data )->transport = t;
+		( (struct conn_data*)door_table[d].data )->cma_min = 0;
+		( (struct conn_data*)door_table[d].data )->cma_known = false;
+		( (struct conn_data*)door_table[d].data )->opener = getpid();
+		( (struct conn_data*)door_table[d].data )->last_tag = 0;
+		( (struct conn_data*)door_table[d].data )->stale_requests = 0;
 		door_table[d].type = fd_client;
 		unlock_door_table();
 	}
@@ -2225,8 +5191,9 @@ int door_return( const void* restrict data_ptr,
  * should work.
  *
  * Known bugs:
- * - Passing door descriptors is not supported yet.  Any attempt to do
- * so will fail with EMFILE.
+ * - Only file descriptors (DOOR_DESCRIPTOR) may be passed, and at most
+ * DESC_LIMIT (253) of them.  Passing more fails with EMFILE; passing an
+ * entry not tagged DOOR_DESCRIPTOR fails with EINVAL.
  *
  * Known incompatibilities:
  * - The pointer arguments now have the restrict qualifier.  No sane
@@ -2239,45 +5206,68 @@ int door_return( const void* restrict data_ptr,
  */
 {
 	static const int ERROR = -1;
-	int fd;
-	struct msg_door_return outgoing;
-	struct iovec send_iovs[2];
-	struct msghdr send_hdr;
+	int cancel_state, error;
+	struct door_server_args_t* args;
 
-	if ( ( NULL == data_ptr && 0 != data_size ) ||
-	     ( NULL == desc_ptr && 0 != num_desc )
-	   ) {
-		errno = EFAULT;
+	error = check_results( data_ptr, data_size, desc_ptr, num_desc );
+	if ( 0 != error ) {
+		errno = error;
 		return ERROR;
 	}
 
-	if ( 0 != num_desc ) {
-		errno = EMFILE;
+	args = pthread_getspecific(server_arg_buf);
+	if ( NULL == args || NULL != args->batch_proc ) {
+/* Not a door invocation, or an unreferenced one: there is no one to return
+ * to.  A batch returns with door_return_batch().
+ */
+		errno = EINVAL;
 		return ERROR;
 	}
 
-	fd = *(int*)pthread_getspecific(caller_fd);
+/* Once the results are on their way, the call can no longer be cancelled. */
+	pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, &cancel_state );
 
-	msg_door_return_init( &outgoing, data_size );
+	if ( 0 != deliver_results( args,
+	                           data_ptr,
+	                           data_size,
+	                           desc_ptr,
+	                           num_desc
+	                         )
+	   ) {
+		pthread_setcancelstate( cancel_state, NULL );
+		errno = EINVAL;
+		return ERROR;
+	}
 
-	bzero( send_iovs, 2*sizeof(struct iovec) );
-	bzero( &send_hdr, sizeof(send_hdr) );
+/* Everything worked.  A listener goes back to its connection; kill any other
+ * thread.
+ */
+	if ( NULL != args->inline_return )
+		longjmp( *args->inline_return, 1 );
 
-	send_hdr.msg_iov = send_iovs;
-	send_hdr.msg_iovlen = 2;
+	pthread_exit(NULL);
 
-	send_iovs[0].iov_base = &outgoing;
-	send_iovs[0].iov_len = sizeof(outgoing);
+/* NOTREACHED */
+}
 
-	send_iovs[1].iov_base = (void*)data_ptr;
-	send_iovs[1].iov_len = data_size;
+int door_return_batch(void)
+/* Sends the results the batch server procedure set for each call of the
+ * batch, as door_return() does for one, and ends the thread.
+ */
+{
+	static const int ERROR = -1;
+	struct door_server_args_t* const args =
+pthread_getspecific(server_arg_buf);
 
-	if ( 0 > sendmsg( fd, &send_hdr, MSG_EOR ) ) {
+	if ( NULL == args || NULL == args->batch_calls ) {
 		errno = EINVAL;
 		return ERROR;
 	}
 
-/* Everything worked, so kill this thread. */
+	pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, NULL );
+
+	return_batch(args);
+
 	pthread_exit(NULL);
 
 /* NOTREACHED */
@@ -2305,21 +5295,39 @@ int door_revoke( int d )
 
 	struct door_data* p;
 
-	lock_door_table();
+	if ( NULL == door_table ) {
+		errno = EBADF;
+		return ERROR;
+	}
 
-	p = local_door_data(d);
+/* Take the table exclusively, so that no thread is between finding the door
+ * there and taking a hold on its data when we clear the entry.
+ */
+	if ( 0 != LOCKSTAT_WRLOCK( &door_table_lock,
+	                           &lock_stats[DOOR_LOCK_TABLE]
+	                         )
+	   )
+		fatal_system_error(__FILE__, __LINE__, "pthread_rwlock_wrlock");
 
-	if ( NULL == p ) {
+	if ( open_max <= (size_t)d || fd_server != door_table[d].type ) {
+		unlock_door_table();
 		errno = EBADF;
 		return ERROR;
 	}
 
-	close(d);
+	p = door_table[d].data;
+	door_table[d].type = fd_none;
+	door_table[d].data = NULL;
+	unlock_door_table();
+
+	p->transport->close(d);
 
+	lock_door_data(p);
 	p->revoked = true;
 	pthread_cond_broadcast( & p->can_listen );
 	unlock_door_data(p);
 
+/* The door_table's reference. */
 	release_door_data(p);
 
 	return SUCCESS;
@@ -2329,8 +5337,9 @@ int door_setparam ( int d, int param, size_t val )
 /* See the SunOS 5.11 manual for a specification of how this function 
  * should work.
  *
- * At present, DOOR_PARAM_DESC_MAX must be 0.  Additionally, the function 
- * doesn't distinguish between files that aren't doors and doors created 
+ * At present, DOOR_PARAM_DESC_MAX may not exceed DESC_LIMIT (253), and
+ * must be 0 for a door created with DOOR_REFUSE_DESC.  Additionally, the
+ * function doesn't distinguish between files that aren't doors and doors created 
  * by other processes, so it never reports EPERM.  Changes also affect 
  * only future calls to door_call().
  */
@@ -2338,7 +5347,6 @@ int door_setparam ( int d, int param, size_t val )
 	static const int ERROR = -1;
 	static const int SUCCESS = 0;
 
-	int scratch;	/* Used by setsockopt() */
 	struct door_data* p;
 
 	p = local_door_data(d);
@@ -2362,15 +5370,16 @@ int door_setparam ( int d, int param, size_t val )
 				return ERROR;
 			}
 
-			if ( INT_MAX < val ) {
+			if ( SIZE_MAX - DOOR_CALL_RESERVED < val ) {
 				errno = ERANGE;
 				return ERROR;
 			}
 
-			scratch = (int)val + DOOR_CALL_RESERVED;
-
-			if (
-0 != setsockopt( d, SOL_SOCKET, SO_RCVBUF, &scratch, sizeof(int) )
+/* The transport reports ERANGE if it cannot hold that much. */
+			if ( 0 != p->transport->set_capacity( d,
+			                                      val +
+			                                      DOOR_CALL_RESERVED
+			                                    )
 			   ) {
 				return ERROR;
 			}
@@ -2391,18 +5400,74 @@ int door_setparam ( int d, int param, size_t val )
 			break;
 
 		case DOOR_PARAM_DESC_MAX:
-/* Implicitly 0 at present.  However, we distinguish between a request 
- * that fails because of DOOR_REFUSE_DESC and one that fails because we 
- * just don't support the option yet.
+/* We distinguish between a request that fails because of DOOR_REFUSE_DESC
+ * and one that fails because one message cannot carry that many descriptors.
+ */
+			if ( val > 0 && ( DOOR_REFUSE_DESC & p->attr ) ) {
+				errno = ENOTSUP;
+				return ERROR;
+			}
+
+			if ( val > DESC_LIMIT ) {
+				errno = ERANGE;
+				return ERROR;
+			}
+
+			lock_door_data(p);
+			p->desc_max = val;
+			unlock_door_data(p);
+			break;
+
+		case DOOR_PARAM_CMA_MIN:
+/* Passing less than a page by reference would cost more than it saves. */
+#if defined(__linux__)
+			if ( 0 != val && val < page_size ) {
+				errno = EINVAL;
+				return ERROR;
+			}
+
+			lock_door_data(p);
+			p->cma_min = val;
+			unlock_door_data(p);
+			break;
+#else
+			if ( 0 != val ) {
+				errno = ENOTSUP;
+				return ERROR;
+			}
+			break;
+#endif
+
+/* Lowering any limit leaves the calls already running or waiting alone.  The
+ * threads kept for high-priority calls must leave one for normal calls, or
+ * those would wait for ever.
  */
-			if ( val > 0 ) {
-				if (DOOR_REFUSE_DESC | p->attr)
-					errno = ENOTSUP;
-				else
-					errno = ERANGE;
+		case DOOR_PARAM_MAX_ACTIVE:
+			lock_door_data(p);
+			if ( 0 != val && p->high_reserved >= val ) {
+				unlock_door_data(p);
+				errno = EINVAL;
+				return ERROR;
+			}
+			p->max_active = val;
+			unlock_door_data(p);
+			break;
+
+		case DOOR_PARAM_MAX_QUEUED:
+			lock_door_data(p);
+			p->max_queued = val;
+			unlock_door_data(p);
+			break;
 
+		case DOOR_PARAM_HIGH_RESERVED:
+			lock_door_data(p);
+			if ( 0 != p->max_active && val >= p->max_active ) {
+				unlock_door_data(p);
+				errno = EINVAL;
 				return ERROR;
 			}
+			p->high_reserved = val;
+			unlock_door_data(p);
 			break;
 
 /* Either the program's buggy, or ahead of this version of the library. 
@@ -2414,3 +5479,95 @@ int door_setparam ( int d, int param, size_t val )
 
 	return SUCCESS;
 }
+
+int door_stats( int d, door_stats_t* stats )
+/* Not in Solaris.  Copies the counters of the door d into *stats.  For a
+ * local door, we read them directly; for a descriptor door_open() returned,
+ * we ask the server with a REQ_DOOR_STATS request over the connection.  The
+ * counters change without a lock, so this costs the door's server threads
+ * nothing, but the copy is not a consistent snapshot.
+ */
+{
+	static const int ERROR = -1;
+	static const int SUCCESS = 0;
+
+	struct door_data* p;
+
+	if ( NULL == stats ) {
+		errno = EFAULT;
+		return ERROR;
+	}
+
+	p = hold_local_door_data(d);
+
+	if ( NULL == p ) {
+/* Not a local door.  Ask the server. */
+		struct conn_data* conn;
+		int retval;
+
+		lock_door_table();
+		if ( NULL == door_table ||
+		     open_max <= (size_t)d ||
+		     fd_client != door_table[d].type
+		   ) {
+			unlock_door_table();
+			errno = EBADF;
+			return ERROR;
+		}
+
+		conn = door_table[d].data;
+		unlock_door_table();
+
+		if ( 0 != LOCKSTAT_MUTEX_LOCK( &conn->desc_lock,
+		                               &lock_stats[DOOR_LOCK_DESC]
+		                             )
+		   )
+			fatal_system_error(__FILE__,__LINE__,"mutex lock");
+
+		retval = fetch_stats( conn, d, stats );
+
+		if ( 0 != pthread_mutex_unlock(&conn->desc_lock) )
+			fatal_system_error(__FILE__,__LINE__,"mutex unlock");
+
+		return retval;
+	}
+
+/* The hold keeps the counters from being freed by a door_revoke(). */
+	counters_snapshot( p->counters, stats );
+	drop_door_data(p);
+
+	return SUCCESS;
+}
+
+int door_lock_stats( int lock, door_lock_stats_t* stats )
+/* See door.h.  Returns 0 on success, or -1, setting errno.
+ */
+{
+	static const int ERROR = -1, SUCCESS = 0;
+
+	if ( 0 > lock || DOOR_LOCKS <= lock ) {
+		errno = EINVAL;
+		return ERROR;
+	}
+
+	if ( NULL == stats ) {
+		errno = EFAULT;
+		return ERROR;
+	}
+
+#ifndef DOOR_LOCKSTAT
+	errno = ENOTSUP;
+	return ERROR;
+#endif
+
+	stats->dl_acquired =
+__atomic_load_n( &lock_stats[lock].dl_acquired, __ATOMIC_RELAXED );
+	stats->dl_contended =
+__atomic_load_n( &lock_stats[lock].dl_contended, __ATOMIC_RELAXED );
+	stats->dl_wait_ns =
+__atomic_load_n( &lock_stats[lock].dl_wait_ns, __ATOMIC_RELAXED );
+	stats->dl_max_wait_ns =
+__atomic_load_n( &lock_stats[lock].dl_max_wait_ns, __ATOMIC_RELAXED );
+
+	return SUCCESS;
+}
@@ -0,0 +1,246 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * flight.c: The slow-call flight recorder: a ring of the last invocations *
+ *           in this process that took longer than a threshold, which can  *
+ *           be read through the API or dumped from a signal handler.      *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include "door.h"
+#include "flight.h"
+
+/* Server threads record calls without a lock, and a signal handler may read
+ * them at any moment, so each slot carries a sequence number.  A writer
+ * takes the next ticket and makes the sequence number of its slot odd while
+ * it writes and 2 * (ticket + 1) once it's done.  A reader copies a slot and
+ * keeps the copy only if the number was the one it expected both before and
+ * after.  Two writers can only share a slot if DOOR_SLOW_CALLS other slow
+ * calls finish while one of them is writing, which we can live with.
+ */
+struct flight_slot {
+	unsigned long long	seq;
+	door_slow_call_t	call;
+};
+
+unsigned long long flight_threshold_ns = 0;
+
+static struct flight_slot ring[DOOR_SLOW_CALLS];
+
+/* The ticket of the next call to record. */
+static unsigned long long next_ticket = 0;
+
+static unsigned long long thread_id(void)
+{
+#ifdef __linux__
+	return (unsigned long long)syscall(SYS_gettid);
+#else
+	return (unsigned long long)pthread_self();
+#endif
+}
+
+void flight_record( door_id_t id,
+                    size_t data_size,
+                    uint64_t received,
+                    uint64_t dispatched,
+                    uint64_t returned,
+                    uint64_t finished
+                  )
+{
+	const unsigned long long ticket =
+__atomic_fetch_add( &next_ticket, 1, __ATOMIC_RELAXED );
+	struct flight_slot* const slot = &ring[ticket % DOOR_SLOW_CALLS];
+	struct timespec now;
+
+	__atomic_store_n( &slot->seq, 2 * ticket + 1, __ATOMIC_RELAXED );
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	clock_gettime( CLOCK_REALTIME, &now );
+
+	slot->call.sc_door = id;
+	slot->call.sc_data_size = data_size;
+	slot->call.sc_queue_ns = dispatched - received;
+	slot->call.sc_server_ns = returned - dispatched;
+	slot->call.sc_reply_ns = finished - returned;
+	slot->call.sc_thread = thread_id();
+	slot->call.sc_time = (unsigned long long)now.tv_sec * 1000000000U +
+	                     (unsigned long long)now.tv_nsec;
+
+	__atomic_store_n( &slot->seq, 2 * ticket + 2, __ATOMIC_RELEASE );
+
+	return;
+}
+
+static bool read_slot( unsigned long long ticket, door_slow_call_t* out )
+/* Copies the call with the given ticket into *out.  Returns false if it has
+ * been overwritten, or is still being written.
+ */
+{
+	const struct flight_slot* const slot = &ring[ticket % DOOR_SLOW_CALLS];
+	const unsigned long long expected = 2 * ticket + 2;
+
+	if ( expected != __atomic_load_n( &slot->seq, __ATOMIC_ACQUIRE ) )
+		return false;
+
+	*out = slot->call;
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	return expected == __atomic_load_n( &slot->seq, __ATOMIC_RELAXED );
+}
+
+static unsigned long long first_ticket( unsigned long long end, size_t n )
+/* The oldest of the last n tickets before end still in the ring. */
+{
+	if ( DOOR_SLOW_CALLS < n )
+		n = DOOR_SLOW_CALLS;
+
+	return ( end > n ) ? end - n : 0;
+}
+
+void door_slow_threshold( unsigned long long ns )
+{
+	__atomic_store_n( &flight_threshold_ns, ns, __ATOMIC_RELAXED );
+
+	return;
+}
+
+size_t door_slow_calls( door_slow_call_t* calls, size_t n )
+{
+	const unsigned long long end =
+__atomic_load_n( &next_ticket, __ATOMIC_ACQUIRE );
+	unsigned long long ticket;
+	size_t count = 0;
+
+	if ( NULL == calls )
+		return 0;
+
+	for ( ticket = first_ticket( end, n ); ticket < end; ++ticket )
+		if ( read_slot( ticket, &calls[count] ) )
+			++count;
+
+	return count;
+}
+
+static char* format_number( char* p, const char* label, unsigned long long n )
+/* Appends " label n" at p and returns the new end.  Uses nothing a signal
+ * handler cannot.
+ */
+{
+	char digits[20];
+	size_t i = 0;
+
+	*p++ = ' ';
+	while ( '\0' != *label )
+		*p++ = *label++;
+	*p++ = ' ';
+
+	do {
+		digits[i++] = (char)( '0' + n % 10 );
+		n /= 10;
+	} while ( 0 != n );
+
+	while ( 0 != i )
+		*p++ = digits[--i];
+
+	return p;
+}
+
+static int write_all( int fd, const char* buf, size_t size )
+{
+	static const int ERROR = -1, SUCCESS = 0;
+
+	while ( 0 != size ) {
+		const ssize_t written = write( fd, buf, size );
+
+		if ( 0 > written ) {
+			if ( EINTR == errno )
+				continue;
+			return ERROR;
+		}
+
+		buf += written;
+		size -= (size_t)written;
+	}
+
+	return SUCCESS;
+}
+
+int door_slow_dump( int fd )
+{
+	static const int ERROR = -1, SUCCESS = 0;
+	static const char header[] = "door slow calls:\n";
+	const unsigned long long end =
+__atomic_load_n( &next_ticket, __ATOMIC_ACQUIRE );
+	unsigned long long ticket;
+	const int saved_errno = errno;
+
+	if ( 0 != write_all( fd, header, sizeof(header) - 1 ) )
+		return ERROR;
+
+	for ( ticket = first_ticket( end, DOOR_SLOW_CALLS );
+	      ticket < end;
+	      ++ticket
+	    ) {
+/* Seven labels and numbers of at most 20 digits each. */
+		char line[256];
+		char* p = line;
+		door_slow_call_t call;
+
+		if ( ! read_slot( ticket, &call ) )
+			continue;
+
+		p = format_number( p, "time", call.sc_time );
+		p = format_number( p, "door", call.sc_door );
+		p = format_number( p, "size", call.sc_data_size );
+		p = format_number( p, "queue_ns", call.sc_queue_ns );
+		p = format_number( p, "server_ns", call.sc_server_ns );
+		p = format_number( p, "reply_ns", call.sc_reply_ns );
+		p = format_number( p, "thread", call.sc_thread );
+		*p++ = '\n';
+
+/* Skip the space before the first label. */
+		if ( 0 != write_all( fd, line + 1, (size_t)( p - line - 1 ) ) )
+			return ERROR;
+	}
+
+	errno = saved_errno;
+
+	return SUCCESS;
+}
+
+static void dump_handler( int sig )
+{
+	door_slow_dump(STDERR_FILENO);
+
+	return;
+}
+
+int door_slow_signal( int sig )
+{
+	struct sigaction action;
+
+	bzero( &action, sizeof(action) );
+	action.sa_handler = dump_handler;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+
+	return sigaction( sig, &action, NULL );
+}
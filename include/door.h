@@ -58,8 +58,28 @@ typedef unsigned int		door_attr_t;
  */
 typedef unsigned long long int	door_ptr_t;
 
+/* A descriptor passed to or from a door.  The only kind currently
+ * supported is a file descriptor, tagged DOOR_DESCRIPTOR in
+ * d_attributes.  If DOOR_RELEASE is also set, the sender's copy of the
+ * descriptor is closed once the message carrying it has been sent.
+ *
+ * The receiver gets a new descriptor for the same open file, just as if
+ * it had been passed with SCM_RIGHTS (which is how it was passed), and
+ * is responsible for closing it.  The d_id member is always 0 in this
+ * implementation.
+ */
+typedef struct door_desc_t {
+	door_attr_t	d_attributes;	/* Tag for the union. */
+	union {
+		struct {
+			int		d_descriptor;
+			door_id_t	d_id;	/* Unique ID, if a door. */
+		} d_desc;
+		int		d_resv[5];	/* As on Solaris. */
+	} d_data;
+} door_desc_t;
+
 /* Placeholders */
-typedef struct door_desc_t	door_desc_t;
 typedef struct door_cred_t	door_cred_t;
 typedef struct ucred_t		ucred_t;
 typedef struct door_tcred_t	door_tcred_t;
@@ -81,9 +101,9 @@ typedef struct door_info {
  */
 typedef struct door_arg_t {
 	const void*	data_ptr; /* Points to data */
-	door_desc_t*	desc_ptr; /* Currently unsupported.  Use NULL. */
+	door_desc_t*	desc_ptr; /* Descriptors to pass, or NULL. */
 	size_t		data_size; /* Size of data. */
-	uint_t		desc_num; /* Currently unsupported.  Use 0. */
+	uint_t		desc_num; /* Number of descriptors. */
 	void*		rbuf; /* Results buffer. */
 	size_t		rsize; /* Size of the results buffer. */
 } door_arg_t;
@@ -97,12 +117,61 @@ typedef struct door_arg_t {
 #define DOOR_LOCAL		0x020U
 #define DOOR_REVOKED		0x040U
 #define DOOR_IS_UNREF		0x080U
+/* Not in Solaris.  A door with DOOR_INLINE runs the server procedure for a
+ * call from another process on the thread that read the call from the
+ * connection, rather than handing it to a thread of its own, which saves a
+ * thread switch on every call.  Calls on a connection then run one after
+ * another, and DOOR_PARAM_MAX_ACTIVE does not apply to them, as they take no
+ * thread; nor can the client cancel them.  door_return() goes back to reading
+ * the connection, without running any cleanup handlers the procedure pushed,
+ * and the procedure must never end the thread.  Suits procedures that are
+ * short and never block; one that must wait can door_defer() its call.  A
+ * batch door cannot have it.
+ */
+#define DOOR_INLINE		0x100U
+
+/* Attributes of a door_desc_t: */
+#define DOOR_DESCRIPTOR		0x10000U
+#define DOOR_RELEASE		0x40000U
 
 /* Parameters for door_setparam() and door_getparam(): */
 /* 0 is the code for door_info in a request. */
 #define DOOR_PARAM_DATA_MAX	1
 #define DOOR_PARAM_DATA_MIN	2
 #define DOOR_PARAM_DESC_MAX	3
+/* Not in Solaris.  Calls carrying at least this many bytes of data are passed
+ * by reference: the server copies the data straight out of the client's
+ * address space with process_vm_readv(), bypassing the socket buffer and its
+ * limit on DOOR_PARAM_DATA_MAX.  Only clients running as the same user as the
+ * server use it, and only from a thread that has disabled cancellation: a
+ * thread cancelled while it waits for the reply might free the data before
+ * the server reads it, so the others always send a copy.  Calls that release
+ * descriptors are copied, too.  The server also needs permission to ptrace
+ * the client, which Yama's ptrace_scope of 1 or more, or a client that is not
+ * dumpable, denies.  Such a client sends the call again with its data, and
+ * copies every later call on that descriptor.  The default of 0 disables it.
+ * Linux only.
+ */
+#define DOOR_PARAM_CMA_MIN	4
+/* Not in Solaris.  Admission control for a door's calls, which would
+ * otherwise each get a thread of their own however many arrive.  At most
+ * DOOR_PARAM_MAX_ACTIVE of them run at once, and up to DOOR_PARAM_MAX_QUEUED
+ * more wait for one of those to end.  Each client process's calls, this
+ * process's own included, wait in arrival order, and the clients take turns,
+ * so one that floods the door does not hold up the rest.  The door refuses
+ * any others at once with EAGAIN, so that the client can back off.  A
+ * DOOR_PARAM_MAX_ACTIVE of 0, the default, sets no limit.
+ */
+#define DOOR_PARAM_MAX_ACTIVE	5
+#define DOOR_PARAM_MAX_QUEUED	6
+/* Not in Solaris.  How many of a door's DOOR_PARAM_MAX_ACTIVE threads to keep
+ * for calls of DOOR_PRIORITY_HIGH.  Normal calls start only while fewer than
+ * DOOR_PARAM_MAX_ACTIVE less this many calls run, so a burst of them cannot
+ * keep an urgent call waiting for a thread.  0 by default.  It must be less
+ * than a DOOR_PARAM_MAX_ACTIVE other than 0: door_setparam() refuses to set
+ * either so that it isn't, with EINVAL.
+ */
+#define DOOR_PARAM_HIGH_RESERVED	7
 
 /* This argument to a door server indicates that it's been unreferenced. */
 extern const char* const DOOR_UNREF_DATA;
@@ -113,6 +182,63 @@ extern int door_bind(int did);
 /* Partially implemented. */
 extern int door_call( int d, door_arg_t* params );
 
+/* Not in Solaris.  As door_call(), but fails with ETIMEDOUT once timeout_ns
+ * nanoseconds have passed without a reply, or 0 to wait indefinitely.  The
+ * server does not run a call that reaches it after the deadline.  A call to
+ * a door in this process gives up only while it waits for a thread; one that
+ * has started always runs to the end.
+ *
+ * Either function gives up on a call to another process if the calling thread
+ * is cancelled while it waits for the reply.  Unless the door has
+ * DOOR_NO_CANCEL, the server then cancels the thread running the call, as it
+ * does when the deadline passes.
+ */
+extern int door_call_timed( int d,
+                            door_arg_t* params,
+                            unsigned long long timeout_ns
+                          );
+
+/* Not in Solaris.  As door_call_timed(), but the call is of the given class.
+ * A door that limits its running calls starts every waiting call of
+ * DOOR_PRIORITY_HIGH before any of DOOR_PRIORITY_NORMAL, which door_call()
+ * and door_call_timed() make, and may keep threads for them (see
+ * DOOR_PARAM_HIGH_RESERVED).  Calls to a door in this process wait for a
+ * thread in the same queues, so the class applies to them just the same.
+ */
+#define DOOR_PRIORITY_NORMAL	0
+#define DOOR_PRIORITY_HIGH	1
+
+extern int door_call_priority( int d,
+                               door_arg_t* params,
+                               unsigned long long timeout_ns,
+                               unsigned int priority
+                             );
+
+/* Not in Solaris.  Sends a call to the door and returns as soon as it is on
+ * its way, for a notification whose results the caller would ignore.  The
+ * server sends no reply, so calls can follow one another on a descriptor
+ * without waiting.  Nor does it report errors, such as a refusal for want of
+ * room to queue the call; door_stats() on the server counts them.  The
+ * results of door_return() are discarded, and params->rbuf left alone.
+ */
+extern int door_call_oneway( int d, door_arg_t* params );
+
+/* Not in Solaris.  Makes the count calls params points to through the one
+ * descriptor, as door_call() would make each in turn, but sends them all
+ * before waiting for any reply, so that they cost one round trip rather than
+ * count.  The server runs them at once, as it would calls from as many
+ * threads, and replies as each finishes; every reply finds its own params by
+ * the tag it carries, whatever the order.  Stores 0 or the errno each call
+ * failed with in errors, if not NULL.  Returns 0 if every call succeeded, or
+ * -1 with errno set to the first error in the list.  Invalid params for any
+ * call fail them all before any is sent.
+ */
+extern int door_call_pipelined( int d,
+                                door_arg_t* params,
+                                int* errors,
+                                size_t count
+                              );
+
 /* This type is subtly different from the original implementation: the const
  * and restrict qualifiers are new, and the argument buffer is now a void*
  * rather than char*.  Legacy code should still run, but if you want to
@@ -136,6 +262,210 @@ extern int door_create( door_server_proc_t server_procedure,
                         door_attr_t attributes
                       );
 
+/* Not in Solaris.  Transports that can carry a door.  DOOR_TRANSPORT_SOCKET,
+ * a UNIX domain socket attached to the filesystem, is what door_create()
+ * uses.  DOOR_TRANSPORT_LOOPBACK passes messages through memory, without the
+ * kernel, and only this process can open it; door_attach() gives it a name,
+ * but creates no file.  It exists to measure the library's own overhead.
+ */
+#define DOOR_TRANSPORT_SOCKET	0
+#define DOOR_TRANSPORT_LOOPBACK	1
+
+/* Not in Solaris.  Creates a door like door_create(), carried by one of the
+ * transports above.  The door is attached, opened, called and returned from
+ * exactly as any other; door_open() finds it whichever transport it uses.
+ */
+extern int door_create_transport( door_server_proc_t server_procedure,
+                                  void* cookie,
+                                  door_attr_t attributes,
+                                  int transport
+                                );
+
+/* Not in Solaris.  A door can instead hand its server procedure every call
+ * waiting on a connection at once, up to DOOR_BATCH_MAX of them, so that it
+ * can share the cost of a lookup or a lock among them.  Each call of the
+ * batch has its own arguments, which stay valid until the results are sent,
+ * and its own results, which the procedure fills in: data_ptr and data_size,
+ * desc_ptr and desc_num as door_return() takes them, or an errno in error to
+ * fail the call instead.  They start out empty.
+ */
+#define DOOR_BATCH_MAX	64
+
+typedef struct door_batch_call {
+	const void*		argp;
+	size_t			arg_size;
+	const door_desc_t*	dp;
+	uint_t			n_desc;
+	const void*		data_ptr;
+	size_t			data_size;
+	const door_desc_t*	desc_ptr;
+	uint_t			desc_num;
+	int			error;
+} door_batch_call_t;
+
+/* The batch server procedure.  Returning sends every call its results, so
+ * they must outlive the procedure; door_return_batch() sends them from its
+ * own stack.  An unreferenced invocation is a batch of one call whose argp is
+ * DOOR_UNREF_DATA.
+ */
+typedef void (*door_batch_proc_t)( void*		cookie,
+                                   door_batch_call_t*	calls,
+                                   size_t		count
+                                 );
+
+/* Not in Solaris.  Creates a door like door_create_transport(), whose
+ * calls go to a batch server procedure.  The calls of a batch run on one
+ * thread, and take one of DOOR_PARAM_MAX_ACTIVE between them.  The server
+ * does not cancel them, whether or not the door has DOOR_NO_CANCEL.  A call
+ * from this process is a batch of its own.
+ */
+extern int door_create_batch( door_batch_proc_t batch_procedure,
+                              void* cookie,
+                              door_attr_t attributes,
+                              int transport
+                            );
+
+/* Not in Solaris.  Sends every call of the batch the thread is serving the
+ * results the procedure set, and ends the thread, as door_return() does for
+ * a single call.  Fails with EINVAL outside a batch server procedure.
+ */
+extern int door_return_batch(void);
+
+/* Not in Solaris.  Counters a door keeps about its own use.  A call is
+ * counted in ds_calls, ds_bytes_in and ds_active once the server has read it
+ * and admitted it; also in ds_queued while it waits for a thread, if the
+ * door's DOOR_PARAM_MAX_ACTIVE makes it; in ds_bytes_out and ds_latency,
+ * and no longer in ds_active, once the server procedure returns.  A call the
+ * server refuses, or whose results it cannot send, is counted in ds_errors
+ * and in ds_errno[] under its errno, or under 0 if that is DOOR_STATS_ERRNO
+ * or more.  ds_latency[i] counts calls that took from 2^i up to 2^(i+1)
+ * nanoseconds; the last bucket also counts any longer ones.
+ */
+#define DOOR_STATS_ERRNO	256
+#define DOOR_STATS_BUCKETS	48
+
+typedef struct door_stats {
+	unsigned long long	ds_calls;	/* Invocations started */
+	unsigned long long	ds_bytes_in;	/* Argument data received */
+	unsigned long long	ds_bytes_out;	/* Results returned */
+	unsigned long long	ds_errors;	/* Calls that failed */
+	unsigned long long	ds_unref;	/* Unreferenced invocations */
+	unsigned long long	ds_connections;	/* Clients connected now */
+	unsigned long long	ds_active;	/* Invocations in progress */
+	unsigned long long	ds_errno[DOOR_STATS_ERRNO];
+	unsigned long long	ds_latency[DOOR_STATS_BUCKETS];
+	unsigned long long	ds_queued;	/* Calls waiting for a thread */
+} door_stats_t;
+
+/* Not in Solaris.  Copies the counters of the door d into *stats.  The
+ * descriptor may be one door_create() returned, or one door_open() returned,
+ * in which case the server sends its counters over the connection.  Reports
+ * EBADF for any other descriptor.
+ */
+extern int door_stats( int d, door_stats_t* stats );
+
+/* Not in Solaris.  Publishes the counters of each door this process creates
+ * from now on in a file of its own in the directory dir, such as /dev/shm.
+ * The door keeps its counters in that file, through a shared mapping, so a
+ * collector can map it and read them without a system call, and without
+ * any help from the server.  The file is named door.<pid>.<door ID>, the
+ * door ID being the di_uniquifier door_info() reports, and is removed once
+ * the door is revoked and its last invocation finishes.  A NULL dir stops
+ * publishing.  Reports the errno of access() if dir is not a directory this
+ * process can create files in; door_create() reports the errno of open() or
+ * mmap() if it cannot create one after all.
+ *
+ * The file begins with a door_stats_header_t, in the server's byte order.
+ * The door_stats_t holding the counters lies dh_stats_offset bytes from the
+ * start, and is dh_stats_size bytes long; read no more of it than you know,
+ * as later versions may add counters at the end.  Read each counter with a
+ * single aligned 64-bit load.  The counters change while you read them, and
+ * together are no more a consistent snapshot than door_stats() gives.
+ */
+#define DOOR_STATS_MAGIC	0x444f4f5253544154ULL	/* "DOORSTAT" */
+#define DOOR_STATS_VERSION	1
+
+typedef struct door_stats_header {
+	unsigned long long	dh_magic;	/* DOOR_STATS_MAGIC */
+	unsigned int		dh_version;	/* DOOR_STATS_VERSION */
+	unsigned int		dh_header_size;	/* This structure's size */
+	unsigned long long	dh_stats_offset;
+	unsigned long long	dh_stats_size;
+	unsigned long long	dh_pid;		/* The server's */
+	door_id_t		dh_door;	/* The door's di_uniquifier */
+} door_stats_header_t;
+
+extern int door_stats_export( const char* dir );
+
+/* Not in Solaris.  Built with DOOR_LOCKSTAT defined (make LOCKSTAT=1), the
+ * library counts how often its threads take each kind of lock, how often
+ * they had to wait for it, and for how long, and prints the counts to
+ * standard error when the process exits.  DOOR_LOCK_DATA sums the locks of
+ * every local door, and DOOR_LOCK_DESC those of every door_open()
+ * descriptor.
+ */
+#define DOOR_LOCK_TABLE	0	/* The table of door descriptors */
+#define DOOR_LOCK_DATA	1	/* Each local door's data */
+#define DOOR_LOCK_DESC	2	/* Each client descriptor, held for a call */
+#define DOOR_LOCKS	3
+
+typedef struct door_lock_stats {
+	unsigned long long	dl_acquired;	/* Times taken */
+	unsigned long long	dl_contended;	/* Of those, times waited for */
+	unsigned long long	dl_wait_ns;	/* Total time waited */
+	unsigned long long	dl_max_wait_ns;	/* Longest wait */
+} door_lock_stats_t;
+
+/* Not in Solaris.  Copies the counts for the kind of lock given, one of the
+ * DOOR_LOCK_ constants, into *stats.  Reports EINVAL for any other value,
+ * and ENOTSUP if the library was built without DOOR_LOCKSTAT.
+ */
+extern int door_lock_stats( int lock, door_lock_stats_t* stats );
+
+/* Not in Solaris.  The flight recorder keeps the last DOOR_SLOW_CALLS
+ * invocations served in this process that took at least a threshold of
+ * time, from when the server read the call to when it finished sending the
+ * results.  Each record splits that time into the wait for a server thread,
+ * the server procedure, and sending the reply.  A server procedure that
+ * returns without calling door_return() is recorded with no reply time.
+ */
+#define DOOR_SLOW_CALLS	256
+
+typedef struct door_slow_call {
+	door_id_t		sc_door;	/* The door's di_uniquifier */
+	size_t			sc_data_size;	/* Argument data */
+	unsigned long long	sc_queue_ns;	/* Waiting for a thread */
+	unsigned long long	sc_server_ns;	/* In the server procedure */
+	unsigned long long	sc_reply_ns;	/* Sending the results */
+/* The server thread: its kernel thread ID on Linux, and otherwise its
+ * pthread_t, converted.
+ */
+	unsigned long long	sc_thread;
+	unsigned long long	sc_time;	/* Finished, in ns since the Epoch */
+} door_slow_call_t;
+
+/* Not in Solaris.  Records every invocation that takes ns nanoseconds or
+ * more, from now on.  The default, 0, records nothing.
+ */
+extern void door_slow_threshold( unsigned long long ns );
+
+/* Not in Solaris.  Copies up to n of the most recent slow calls into calls,
+ * oldest first, and returns how many it copied.
+ */
+extern size_t door_slow_calls( door_slow_call_t* calls, size_t n );
+
+/* Not in Solaris.  Writes the recorded slow calls to the descriptor fd as
+ * text, one per line, oldest first.  It is async-signal-safe, so a signal
+ * handler may call it.  Returns 0 on success or -1 on failure, setting errno.
+ */
+extern int door_slow_dump( int fd );
+
+/* Not in Solaris.  Installs a handler that dumps the slow calls to standard
+ * error whenever the process receives the signal sig; SIGUSR2, say.  Returns
+ * 0 on success or -1 on failure, setting errno.
+ */
+extern int door_slow_signal( int sig );
+
 /* Currently unimplemented. */
 extern int door_cred( door_cred_t* info );
 
@@ -153,6 +483,32 @@ extern int door_return( const void* restrict data_ptr,
                         uint_t num_desc
                       );
 
+/* Not in Solaris.  A server procedure that must wait for something else
+ * before it can answer need not keep its thread.  door_defer() takes the
+ * call it is serving off the thread, and returns a token for the call, or
+ * NULL with errno EINVAL outside a server procedure, or in a batch one.  The
+ * procedure then returns, with no reply sent, and its thread is free for
+ * another call.  Any thread may later answer the call by passing the token to
+ * door_complete() with the results, as door_return() takes them.  The
+ * arguments stay valid until then.
+ *
+ * A deferred call no longer counts against DOOR_PARAM_MAX_ACTIVE, and the
+ * server no longer cancels it when the client gives up, but it still counts
+ * in ds_active until it completes.  door_complete() fails as door_return()
+ * does for invalid results, and the token stays valid; otherwise, the token
+ * is gone once it returns, whether or not the results could be sent.
+ */
+typedef struct door_token door_token_t;
+
+extern door_token_t* door_defer(void);
+
+extern int door_complete( door_token_t* token,
+                          const void* restrict data_ptr,
+                          size_t data_size,
+                          const door_desc_t* restrict desc_ptr,
+                          uint_t num_desc
+                        );
+
 extern int door_revoke( int d );
 
 /* Currently unimplemented. */
@@ -0,0 +1,48 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * flight.h: The interface between door.c and the slow-call flight         *
+ *           recorder in flight.c.                                         *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#ifndef H_FLIGHT
+#define H_FLIGHT
+
+#include "standards.h"
+#include "door.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* The threshold door_slow_threshold() sets, or 0. */
+extern unsigned long long flight_threshold_ns;
+
+/* Whether an invocation that took ns nanoseconds belongs in the recorder.
+ * This is all a call costs while the recorder is off.
+ */
+static inline bool flight_is_slow( uint64_t ns )
+{
+	const unsigned long long threshold =
+__atomic_load_n( &flight_threshold_ns, __ATOMIC_RELAXED );
+
+	return 0 != threshold && threshold <= ns;
+}
+
+/* Records an invocation of the door id with data_size bytes of arguments,
+ * given when the server read it, started the server procedure, was called
+ * back by door_return(), and finished, in nanoseconds from counters_now()'s
+ * origin.  A call the server procedure did not return from has returned ==
+ * finished.  Records on the calling thread, which must be the server's.
+ */
+extern void flight_record( door_id_t id,
+                           size_t data_size,
+                           uint64_t received,
+                           uint64_t dispatched,
+                           uint64_t returned,
+                           uint64_t finished
+                         );
+
+#endif /* !defined(H_FLIGHT) */
@@ -0,0 +1,131 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * lockstat.h: Contention counters for the library's locks, kept only in a *
+ *             build with DOOR_LOCKSTAT defined.                           *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#ifndef H_LOCKSTAT
+#define H_LOCKSTAT
+
+#include "standards.h"
+#include "door.h"
+
+#include <pthread.h>
+
+/* The library takes its locks through these macros, passing the counters of
+ * the kind of lock it takes.  Without DOOR_LOCKSTAT, they are the plain
+ * pthread calls, and the counters are never touched.
+ *
+ * An instrumented lock first tries to take the lock without waiting, and
+ * only if that fails counts the acquisition as contended and times the wait.
+ * An uncontended acquisition therefore costs one atomic increment more.
+ */
+#ifdef DOOR_LOCKSTAT
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "stats.h"
+
+static inline void lockstat_record( door_lock_stats_t* c,
+                                    bool contended,
+                                    uint64_t wait_ns
+                                  )
+{
+	unsigned long long max;
+
+	counters_add( &c->dl_acquired, 1 );
+
+	if ( ! contended )
+		return;
+
+	counters_add( &c->dl_contended, 1 );
+	counters_add( &c->dl_wait_ns, wait_ns );
+
+	max = __atomic_load_n( &c->dl_max_wait_ns, __ATOMIC_RELAXED );
+	while ( max < wait_ns &&
+	        ! __atomic_compare_exchange_n( &c->dl_max_wait_ns,
+	                                       &max,
+	                                       wait_ns,
+	                                       true,
+	                                       __ATOMIC_RELAXED,
+	                                       __ATOMIC_RELAXED
+	                                     )
+	      )
+		;
+
+	return;
+}
+
+static inline int lockstat_mutex_lock( pthread_mutex_t* m,
+                                       door_lock_stats_t* c
+                                     )
+{
+	uint64_t start;
+	int error;
+
+	if ( 0 == pthread_mutex_trylock(m) ) {
+		lockstat_record( c, false, 0 );
+		return 0;
+	}
+
+	start = counters_now();
+	error = pthread_mutex_lock(m);
+	if ( 0 == error )
+		lockstat_record( c, true, counters_now() - start );
+
+	return error;
+}
+
+static inline int lockstat_rdlock( pthread_rwlock_t* l, door_lock_stats_t* c )
+{
+	uint64_t start;
+	int error;
+
+	if ( 0 == pthread_rwlock_tryrdlock(l) ) {
+		lockstat_record( c, false, 0 );
+		return 0;
+	}
+
+	start = counters_now();
+	error = pthread_rwlock_rdlock(l);
+	if ( 0 == error )
+		lockstat_record( c, true, counters_now() - start );
+
+	return error;
+}
+
+static inline int lockstat_wrlock( pthread_rwlock_t* l, door_lock_stats_t* c )
+{
+	uint64_t start;
+	int error;
+
+	if ( 0 == pthread_rwlock_trywrlock(l) ) {
+		lockstat_record( c, false, 0 );
+		return 0;
+	}
+
+	start = counters_now();
+	error = pthread_rwlock_wrlock(l);
+	if ( 0 == error )
+		lockstat_record( c, true, counters_now() - start );
+
+	return error;
+}
+
+#define LOCKSTAT_MUTEX_LOCK( m, c )	lockstat_mutex_lock( (m), (c) )
+#define LOCKSTAT_RDLOCK( l, c )		lockstat_rdlock( (l), (c) )
+#define LOCKSTAT_WRLOCK( l, c )		lockstat_wrlock( (l), (c) )
+
+#else /* !defined(DOOR_LOCKSTAT) */
+
+#define LOCKSTAT_MUTEX_LOCK( m, c )	pthread_mutex_lock(m)
+#define LOCKSTAT_RDLOCK( l, c )		pthread_rwlock_rdlock(l)
+#define LOCKSTAT_WRLOCK( l, c )		pthread_rwlock_wrlock(l)
+
+#endif /* defined(DOOR_LOCKSTAT) */
+
+#endif /* !defined(H_LOCKSTAT) */
@@ -12,11 +12,13 @@
 #include "standards.h"
 #include "door.h"
 #include "door_info.h"
+#include "transport.h"
 
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #define DOOR_CALL_RESERVED	(sizeof(struct msg_door_call))
 #define DOOR_RETURN_RESERVED	(sizeof(struct msg_door_return))
@@ -27,31 +29,49 @@ enum msg_code {
 	code_door_info = 2,
 	code_door_getparam = 3,
 	code_door_call = 4,
-	code_door_return = 5
+	code_door_return = 5,
+	code_door_call_ref = 6,
+	code_door_stats = 7,
+	code_door_cancel = 8
 };
 
 #define REQ_DOOR_INFO		0
+/* Requests 1 and up ask for the DOOR_PARAM_ of the same number.  This one
+ * lies well clear of them, so that new parameters never collide with it.
+ */
+#define REQ_DOOR_STATS		0x100U
 
 /* Message types are 32-bit unsigned integers.  Therefore, the only
  * standard type guaranteed to hold any message type, or the value -1,
  * is a signed long long int.
  */
-static inline long long int message_type( int d )
+static inline long long int message_type( const struct door_transport* t,
+                                          int d
+                                        )
 {
 	static const long long ERROR = -1;
 	uint32_t type;
 
-	if ( (ssize_t)sizeof(type) >
-	      recv( d, &type, sizeof(type), MSG_PEEK )
-	   )
+	if ( (ssize_t)sizeof(type) > t->peek( d, &type, sizeof(type) ) )
 		return ERROR;
 
 	return (long long int)type;
 }
 
+/* An error in reply to a door call carries the call's tag, so that a client
+ * can tell it from the reply to a call it has given up on.  Any other error
+ * carries a tag of 0.
+ */
+
+/* Not an errno: the server could not read the data of a call by reference,
+ * and the client should send it again with the data.
+ */
+#define CALL_ERROR_UNREADABLE	(-1)
+
 struct msg_error {
 	uint32_t	code;
         int32_t		value;
+	uint64_t	tag;
 };
 
 static inline struct msg_error* msg_error_init( struct msg_error* p,
@@ -60,6 +80,7 @@ static inline struct msg_error* msg_error_init( struct msg_error* p,
 {
 	p->code = (uint32_t)code_error;
 	p->value = (int32_t)e;
+	p->tag = 0;
 
 	return p;
 }
@@ -69,14 +90,33 @@ static inline int msg_error_decode( const struct msg_error* p )
 	return (int)(p->value);
 }
 
-static inline int xmit_error( int fd, int error )
+static inline uint64_t msg_error_get_tag( const struct msg_error* p )
+{
+	return p->tag;
+}
+
+static inline int xmit_call_error( const struct door_transport* t,
+                                   int fd,
+                                   int error,
+                                   uint64_t tag
+                                 )
+/* Refuses the door call with the given tag. */
 {
 	const struct msg_error outgoing = {
 		.code = (uint32_t)code_error,
-		.value = (int32_t)error
+		.value = (int32_t)error,
+		.tag = tag
 	};
 
-	return send( fd, &outgoing, sizeof(outgoing), MSG_EOR );
+	return (int)transport_send_msg( t, fd, &outgoing, sizeof(outgoing) );
+}
+
+static inline int xmit_error( const struct door_transport* t,
+                              int fd,
+                              int error
+                            )
+{
+	return xmit_call_error( t, fd, error, 0 );
 }
 
 struct msg_request {
@@ -171,12 +211,23 @@ msg_door_getparam_decode( const struct msg_door_getparam* p )
 	return (size_t)(p->value);
 }
 
+/* The client numbers its calls on each connection from 1, and the reply
+ * echoes the tag.  The deadline is a CLOCK_MONOTONIC time in nanoseconds,
+ * after which the client no longer waits for the reply, or 0 for none.
+ */
 struct msg_door_call {
 	uint32_t	code;
 	uint32_t	ndesc;
 	uint64_t	arg_size;
+	uint64_t	tag;
+	uint64_t	deadline;
+	uint32_t	priority;	/* DOOR_PRIORITY_* */
+	uint32_t	flags;		/* CALL_FLAG_* */
 };
 
+/* The client expects no reply to the call, not even an error. */
+#define CALL_FLAG_ONE_WAY	0x1U
+
 static inline bool is_msg_door_call( const struct msg_door_call* p )
 {
 	return (uint32_t)code_door_call == p->code;
@@ -184,16 +235,31 @@ static inline bool is_msg_door_call( const struct msg_door_call* p )
 
 static inline struct msg_door_call*
 msg_door_call_init( struct msg_door_call* p,
-                    size_t data_size
+                    size_t data_size,
+                    uint_t desc_num,
+                    uint64_t tag,
+                    uint64_t deadline,
+                    unsigned int priority,
+                    uint32_t flags
                   )
 {
 	p -> code = (uint32_t)code_door_call;
-	p -> ndesc = 0U;
+	p -> ndesc = (uint32_t)desc_num;
 	p -> arg_size = (uint64_t)data_size;
+	p -> tag = tag;
+	p -> deadline = deadline;
+	p -> priority = (uint32_t)priority;
+	p -> flags = flags;
 
 	return p;
 }
 
+static inline uint_t
+msg_door_call_get_ndesc( const struct msg_door_call* p )
+{
+	return (uint_t)(p->ndesc);
+}
+
 static inline ssize_t
 msg_door_call_get_arg_size( const struct msg_door_call* p )
 {
@@ -203,22 +269,111 @@ msg_door_call_get_arg_size( const struct msg_door_call* p )
 		return (ssize_t)(p->arg_size);
 }
 
+static inline uint64_t
+msg_door_call_get_tag( const struct msg_door_call* p )
+{
+	return p->tag;
+}
+
+static inline uint64_t
+msg_door_call_get_deadline( const struct msg_door_call* p )
+{
+	return p->deadline;
+}
+
+static inline unsigned int
+msg_door_call_get_priority( const struct msg_door_call* p )
+{
+	return (unsigned int)(p->priority);
+}
+
+static inline uint32_t
+msg_door_call_get_flags( const struct msg_door_call* p )
+{
+	return p->flags;
+}
+
+/* A door call whose argument data stay in the client's address space.  The
+ * server reads them from there with process_vm_readv().  The call member
+ * holds the usual header, with code_door_call_ref as its code.
+ */
+struct msg_door_call_ref {
+	struct msg_door_call	call;
+	uint64_t		pid;
+	uint64_t		address;
+};
+
+static inline bool is_msg_door_call_ref( const struct msg_door_call* p )
+{
+	return (uint32_t)code_door_call_ref == p->code;
+}
+
+static inline struct msg_door_call_ref*
+msg_door_call_ref_init( struct msg_door_call_ref* p,
+                        const void* data_ptr,
+                        size_t data_size,
+                        uint_t desc_num,
+                        uint64_t tag,
+                        uint64_t deadline,
+                        unsigned int priority,
+                        uint32_t flags
+                      )
+{
+	msg_door_call_init( &p->call,
+	                    data_size,
+	                    desc_num,
+	                    tag,
+	                    deadline,
+	                    priority,
+	                    flags
+	                  );
+	p->call.code = (uint32_t)code_door_call_ref;
+	p->pid = (uint64_t)getpid();
+	p->address = optr2u64(data_ptr);
+
+	return p;
+}
+
+static inline pid_t
+msg_door_call_ref_get_pid( const struct msg_door_call_ref* p )
+{
+	return (pid_t)(p->pid);
+}
+
+static inline void*
+msg_door_call_ref_get_address( const struct msg_door_call_ref* p )
+{
+	return (void*)(uintptr_t)(p->address);
+}
+
 struct msg_door_return {
 	uint32_t        code;
 	uint32_t        ndesc;
 	uint64_t        arg_size;
+	uint64_t	tag;	/* The tag of the call returning. */
 };
 
 static inline struct msg_door_return*
-msg_door_return_init( struct msg_door_return* p, size_t data_size )
+msg_door_return_init( struct msg_door_return* p,
+                      size_t data_size,
+                      uint_t desc_num,
+                      uint64_t tag
+                    )
 {
 	p->code = (uint32_t)code_door_return;
-	p->ndesc = 0;
+	p->ndesc = (uint32_t)desc_num;
 	p->arg_size = (uint64_t)data_size;
+	p->tag = tag;
 
 	return p;
 }
 
+static inline uint_t
+msg_door_return_get_ndesc( const struct msg_door_return* p )
+{
+	return (uint_t)(p->ndesc);
+}
+
 static inline ssize_t
 msg_door_return_get_data_size( const struct msg_door_return* p )
 {
@@ -230,4 +385,76 @@ msg_door_return_get_data_size( const struct msg_door_return* p )
 	return (ssize_t)(p->arg_size);
 }
 
+static inline uint64_t
+msg_door_return_get_tag( const struct msg_door_return* p )
+{
+	return p->tag;
+}
+
+/* The statistics of a door, in answer to REQ_DOOR_STATS.  Each counter of a
+ * door_stats_t travels as a uint64_t, in the order the structure declares
+ * them.  The count member says how many follow, so that a client and server
+ * built with different versions of door_stats_t still agree on a prefix.
+ */
+#define MSG_DOOR_STATS_COUNTERS	\
+( sizeof(door_stats_t) / sizeof(unsigned long long) )
+
+struct msg_door_stats {
+	uint32_t	code;
+	uint32_t	count;
+	uint64_t	counters[MSG_DOOR_STATS_COUNTERS];
+};
+
+static inline struct msg_door_stats*
+msg_door_stats_init( struct msg_door_stats* p, const door_stats_t* stats )
+{
+	const unsigned long long* from = (const unsigned long long*)stats;
+	size_t i;
+
+	p->code = (uint32_t)code_door_stats;
+	p->count = (uint32_t)MSG_DOOR_STATS_COUNTERS;
+
+	for ( i = 0; i < MSG_DOOR_STATS_COUNTERS; ++i )
+		p->counters[i] = (uint64_t)from[i];
+
+	return p;
+}
+
+static inline door_stats_t*
+msg_door_stats_decode( const struct msg_door_stats* p, door_stats_t* stats )
+{
+	unsigned long long* to = (unsigned long long*)stats;
+	size_t i;
+
+	for ( i = 0; i < MSG_DOOR_STATS_COUNTERS; ++i )
+		to[i] = ( i < p->count ) ? (unsigned long long)p->counters[i] : 0;
+
+	return stats;
+}
+
+/* The client has given up on the call with the given tag.  It expects no
+ * reply.
+ */
+struct msg_door_cancel {
+	uint32_t	code;
+	uint32_t	reserved;
+	uint64_t	tag;
+};
+
+static inline struct msg_door_cancel*
+msg_door_cancel_init( struct msg_door_cancel* p, uint64_t tag )
+{
+	p->code = (uint32_t)code_door_cancel;
+	p->reserved = 0;
+	p->tag = tag;
+
+	return p;
+}
+
+static inline uint64_t
+msg_door_cancel_get_tag( const struct msg_door_cancel* p )
+{
+	return p->tag;
+}
+
 #endif /* !defined(H_MESSAGES) */
@@ -33,4 +33,11 @@
 #define _REENTRANT	1
 #define _THREAD_SAFE	1
 
+/* On Linux, also expose the extensions the library uses where they exist,
+ * such as process_vm_readv() and the SO_PEERCRED socket option.
+ */
+#ifdef __linux__
+#define _GNU_SOURCE	1
+#endif
+
 #endif /* defined(H_STANDARDS_INCLUDED) */
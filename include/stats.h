@@ -0,0 +1,153 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * stats.h: The counters each door keeps about its own use.                *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#ifndef H_STATS
+#define H_STATS
+
+#include "standards.h"
+#include "door.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <time.h>
+
+/* Every thread that serves a call updates these counters, so they change
+ * with relaxed atomic operations and no lock.  A snapshot is therefore not
+ * a consistent cut: ds_calls may already count a call that ds_active does
+ * not yet.
+ *
+ * The door's door_data holds one reference, and each invocation in progress
+ * another, since an invocation may outlive a revoked door's door_data.
+ *
+ * The counters of a door created while door_stats_export() is in effect
+ * live in a shared mapping of their own file, in the layout door.h
+ * documents, and not on the heap.
+ */
+struct door_counters {
+	int		refs;
+	void*		mapping;	/* The mapping holding us, or NULL */
+	size_t		mapping_size;
+	char*		path;		/* Its file */
+	pid_t		owner;		/* The process that created it */
+	door_stats_t	stats;
+};
+
+/* Returns new counters for the door id, with one reference, or NULL,
+ * setting errno.  They are published if door_stats_export() says so.
+ */
+extern struct door_counters* counters_create( door_id_t id );
+
+/* Unmaps published counters, also removing their file in the process that
+ * created them.
+ */
+extern void counters_unmap( struct door_counters* c );
+
+static inline void counters_hold( struct door_counters* c )
+{
+	__atomic_add_fetch( &c->refs, 1, __ATOMIC_RELAXED );
+
+	return;
+}
+
+static inline void counters_release( struct door_counters* c )
+{
+	if ( 0 == __atomic_sub_fetch( &c->refs, 1, __ATOMIC_ACQ_REL ) ) {
+		if ( NULL != c->mapping )
+			counters_unmap(c);
+		else
+			free(c);
+	}
+
+	return;
+}
+
+static inline void counters_forget( struct door_counters* c )
+/* Drops a forked child's copy of the counters.  Published counters are
+ * still the parent's, references and all, so the child only unmaps them.
+ */
+{
+	if ( NULL != c->mapping )
+		counters_unmap(c);
+	else
+		counters_release(c);
+
+	return;
+}
+
+static inline void counters_add( unsigned long long* counter,
+                                 unsigned long long n
+                               )
+{
+	__atomic_add_fetch( counter, n, __ATOMIC_RELAXED );
+
+	return;
+}
+
+static inline void counters_sub( unsigned long long* counter,
+                                 unsigned long long n
+                               )
+{
+	__atomic_sub_fetch( counter, n, __ATOMIC_RELAXED );
+
+	return;
+}
+
+static inline void counters_error( struct door_counters* c, int error )
+/* Counts a call that failed with the given errno. */
+{
+	const unsigned int slot =
+( 0 < error && DOOR_STATS_ERRNO > error ) ? (unsigned int)error : 0;
+
+	counters_add( &c->stats.ds_errors, 1 );
+	counters_add( &c->stats.ds_errno[slot], 1 );
+
+	return;
+}
+
+static inline uint64_t counters_now(void)
+/* The time in nanoseconds, from an arbitrary origin. */
+{
+	struct timespec now;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+
+	return (uint64_t)now.tv_sec * 1000000000U + (uint64_t)now.tv_nsec;
+}
+
+static inline void counters_latency( struct door_counters* c, uint64_t ns )
+/* Counts a call that took ns nanoseconds in bucket floor(log2(ns)). */
+{
+	unsigned int bucket = 0;
+
+	while ( 1 < ns && DOOR_STATS_BUCKETS - 1 > bucket ) {
+		ns >>= 1;
+		++bucket;
+	}
+
+	counters_add( &c->stats.ds_latency[bucket], 1 );
+
+	return;
+}
+
+static inline void counters_snapshot( const struct door_counters* c,
+                                      door_stats_t* out
+                                    )
+{
+	const unsigned long long* from = (const unsigned long long*)&c->stats;
+	unsigned long long* to = (unsigned long long*)out;
+	size_t i;
+
+/* door_stats_t holds nothing but unsigned long long counters. */
+	for ( i = 0; i < sizeof(door_stats_t) / sizeof(unsigned long long); ++i )
+		to[i] = __atomic_load_n( &from[i], __ATOMIC_RELAXED );
+
+	return;
+}
+
+#endif /* !defined(H_STATS) */
@@ -0,0 +1,61 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * trace.h: Statically defined tracepoints on the call lifecycle.          *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#ifndef H_TRACE
+#define H_TRACE
+
+#include "standards.h"
+
+/* Built with DOOR_USDT defined (make USDT=1), the library carries SystemTap
+ * SDT probes under the provider "door", which perf, bpftrace and stap can
+ * attach to without rebuilding; an unused probe costs a single nop.  That
+ * needs <sys/sdt.h>, from systemtap-sdt-dev or systemtap-sdt-devel.
+ * Otherwise, the probes compile to nothing.
+ *
+ * A client knows a door only by its descriptor; a server, by its door ID,
+ * the di_uniquifier door_info() reports.  The probes are:
+ *
+ * call_send(descriptor, data size, descriptors)
+ *	door_call() is about to send a call, or start a local one.
+ * call_receive(door ID, data size, descriptors)
+ *	The server has read a call off a connection.
+ * call_dispatch(door ID, data size, descriptors)
+ *	A server thread is about to run the server procedure.
+ * call_return(door ID, data size, descriptors)
+ *	The server procedure has called door_return().
+ * call_cancel(door ID)
+ *	The server is cancelling the thread running a call, as its client
+ *	gave up on it.
+ * call_reply(descriptor, data size, descriptors)
+ *	door_call() has received the results of a call.
+ * accept(door ID, connection)
+ *	The server has accepted a connection to the door.
+ * unref(door ID)
+ *	The server is about to deliver an unreferenced invocation.
+ *
+ * So, for instance, the time from call_receive to call_dispatch is how long
+ * a call waited for a thread, and from call_dispatch to call_return, how
+ * long the server procedure took.
+ */
+#ifdef DOOR_USDT
+
+#include <sys/sdt.h>
+
+#define DOOR_PROBE1( name, a )		DTRACE_PROBE1( door, name, a )
+#define DOOR_PROBE2( name, a, b )	DTRACE_PROBE2( door, name, a, b )
+#define DOOR_PROBE3( name, a, b, c )	DTRACE_PROBE3( door, name, a, b, c )
+
+#else /* !defined(DOOR_USDT) */
+
+#define DOOR_PROBE1( name, a )		( (void)0 )
+#define DOOR_PROBE2( name, a, b )	( (void)0 )
+#define DOOR_PROBE3( name, a, b, c )	( (void)0 )
+
+#endif /* defined(DOOR_USDT) */
+
+#endif /* !defined(H_TRACE) */
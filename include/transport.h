@@ -0,0 +1,169 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * transport.h: The interface between the Doors library and the channels   *
+ *              that carry its messages.  Each door, and each descriptor   *
+ *              opened on one, names the transport it uses; door.c never   *
+ *              touches a socket directly.                                 *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#ifndef H_TRANSPORT
+#define H_TRANSPORT
+
+#include "standards.h"
+#include "door.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/* The most descriptors a single message may carry, whatever the transport.
+ * Linux refuses to pass more than SCM_MAX_FD (253) file descriptors in one
+ * SCM_RIGHTS message.  This is also the initial DOOR_PARAM_DESC_MAX of a door
+ * that does not refuse descriptors.
+ */
+#define DESC_LIMIT	253U
+
+/* A buffer for ancillary data, large enough to hold DESC_LIMIT descriptors
+ * and correctly aligned for a struct cmsghdr.
+ */
+union desc_control {
+	struct cmsghdr	align;
+	char		buf[CMSG_SPACE( DESC_LIMIT * sizeof(int) )];
+};
+
+/* A transport moves whole messages between the two ends of a connection,
+ * preserving their boundaries and order, along with any descriptors passed
+ * with them.  Every endpoint is named by a file descriptor, so that door and
+ * client descriptors can index door_table whatever carries them.
+ *
+ * Unless noted otherwise, each operation returns 0 (or a count) on success,
+ * or -1 on failure, setting errno.
+ */
+struct door_transport {
+	const char*	name;
+
+/* Creates the endpoint of a new door, not yet reachable by anyone. */
+	int	(*create)(void);
+
+/* Makes the door d reachable at path, which must not already exist.  The
+ * new file's permissions follow the current umask.
+ */
+	int	(*attach)( int d, const char* path );
+
+/* Waits for a client to connect to the door d, and returns the server's
+ * end of the new connection.  Fails with EINVAL once the door is no longer
+ * attached, or with another error once it has been closed.
+ */
+	int	(*accept)( int d );
+
+/* Removes the door attached at path.  Fails with ENOENT if this transport
+ * has no door there.
+ */
+	int	(*detach)( const char* path );
+
+/* Connects to the door attached at path, and returns the client's end of
+ * the new connection.  Fails with ENOENT if this transport has no door
+ * there.
+ */
+	int	(*connect)( const char* path );
+
+/* Sends a single message, gathered from iov_num buffers.  The first buffer
+ * holds the message header.  The desc_num descriptors in desc_ptr travel
+ * with it; the caller has checked that each is tagged DOOR_DESCRIPTOR.
+ * Returns the number of bytes sent.
+ */
+	ssize_t	(*send)( int fd,
+	                 const struct iovec* iovs,
+	                 size_t iov_num,
+	                 const door_desc_t* desc_ptr,
+	                 uint_t desc_num
+	               );
+
+/* Copies up to size bytes from the start of the next message into buf,
+ * waiting for one if necessary, but leaves the message queued.  Returns the
+ * number of bytes copied, or 0 at end-of-file.
+ */
+	ssize_t	(*peek)( int fd, void* buf, size_t size );
+
+/* Waits until the next message, or end-of-file, is ready for peek or recv,
+ * but no later than deadline, a CLOCK_MONOTONIC time in nanoseconds.  Fails
+ * with ETIMEDOUT if nothing arrived by then.
+ */
+	int	(*wait)( int fd, uint64_t deadline );
+
+/* Receives the next message, scattering it into iov_num buffers.  The
+ * message must carry exactly desc_num descriptors, which are stored in
+ * desc_ptr, tagged DOOR_DESCRIPTOR.  If it carries any other number, any
+ * that arrived are closed and the call fails with EBADMSG, or EMFILE if
+ * this process could not accept them all.  Returns the number of bytes
+ * received.
+ */
+	ssize_t	(*recv)( int fd,
+	                 const struct iovec* iovs,
+	                 size_t iov_num,
+	                 door_desc_t* desc_ptr,
+	                 uint_t desc_num
+	               );
+
+/* Removes the next message, closing any descriptors it carries. */
+	void	(*discard)( int fd );
+
+/* Closes an endpoint: a door, or either end of a connection. */
+	int	(*close)( int fd );
+
+/* Reports or sets the size of the largest message the door d can receive
+ * (its receive buffer).
+ */
+	int	(*get_capacity)( int d, size_t* size );
+	int	(*set_capacity)( int d, size_t size );
+
+/* Reports the PID and effective UID of the process at the other end of the
+ * connection fd.
+ */
+	int	(*peer_cred)( int fd, pid_t* pid, uid_t* uid );
+};
+
+/* The default transport: a UNIX-domain SOCK_SEQPACKET socket, attached to
+ * the filesystem.
+ */
+extern const struct door_transport door_socket_transport;
+
+/* An in-memory transport, for clients in the same process as the door. */
+extern const struct door_transport door_loopback_transport;
+
+static inline ssize_t transport_send_msg( const struct door_transport* t,
+                                          int fd,
+                                          const void* msg,
+                                          size_t size
+                                        )
+/* Sends a message held in a single buffer, without descriptors. */
+{
+	struct iovec iov;
+
+	iov.iov_base = (void*)msg;
+	iov.iov_len = size;
+
+	return t->send( fd, &iov, 1, NULL, 0 );
+}
+
+static inline ssize_t transport_recv_msg( const struct door_transport* t,
+                                          int fd,
+                                          void* msg,
+                                          size_t size
+                                        )
+/* Receives a message into a single buffer, without descriptors. */
+{
+	struct iovec iov;
+
+	iov.iov_base = msg;
+	iov.iov_len = size;
+
+	return t->recv( fd, &iov, 1, NULL, 0 );
+}
+
+#endif /* !defined(H_TRANSPORT) */
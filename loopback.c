@@ -0,0 +1,1079 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * loopback.c: An in-memory transport, for doors whose clients run in the  *
+ *             same process.  Messages pass through lock-free queues       *
+ *             rather than the kernel, so a call costs only the library's  *
+ *             own work: the same encoding, dispatch and door_return() as  *
+ *             a call through a socket.                                    *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "door.h"
+#include "error.h"
+#include "transport.h"
+
+/* Every endpoint still needs a file descriptor, so that door.c can index
+ * door_table with it.  We open /dev/null to reserve one, and look up the
+ * endpoint it names in a table of our own.
+ *
+ * Loopback doors are attached to a name, not to the filesystem: only this
+ * process can open them, and nothing appears at the path.
+ *
+ * Locking: the table of endpoints and the list of attached doors share
+ * registry_lock, but only opening, attaching, accepting and closing take it.
+ * Sending and receiving look the endpoint up without a lock, which is safe
+ * because door.c never closes a connection while another thread is using
+ * it: a client holds the descriptor's desc_lock, and a server connection
+ * belongs to its listener thread.
+ */
+
+/* Cells in each direction of a connection, and in each door's backlog of
+ * connections waiting for accept().  Both must be powers of 2.
+ */
+#define QUEUE_CELLS	64U
+#define BACKLOG_CELLS	128U
+
+/* The initial capacity of a door, from which door_create_transport() derives
+ * its DOOR_PARAM_DATA_MAX.  Nothing limits it but memory.
+ */
+static const size_t default_capacity = 1048576U;
+
+/* Keep the producers' and consumers' counters on separate cache lines. */
+#define CACHE_LINE	64U
+
+/* A bounded multi-producer, multi-consumer queue of pointers, after Dmitry
+ * Vyukov's design: each cell carries a sequence number that tells a producer
+ * when it is free and a consumer when it is full, so neither ever takes a
+ * lock.  The semaphores count the items and free cells, which lets a thread
+ * block instead of spinning when the queue is empty or full.
+ *
+ * Hanging up a queue wakes every thread waiting on it.  Producers then fail,
+ * and consumers see end-of-file once they have drained it.  Each wake-up
+ * consumes a token, so whoever takes one because of the hangup puts it back.
+ */
+struct lo_cell {
+	size_t		seq;
+	void*		item;
+};
+
+struct lo_queue {
+	size_t		mask;		/* Number of cells, minus 1. */
+	sem_t		items;		/* Queued items, plus hangups. */
+	sem_t		slots;		/* Free cells, plus hangups. */
+	bool		hangup;		/* Has either end gone away? */
+	char		pad0[CACHE_LINE];
+	size_t		head;		/* The next cell to fill. */
+	char		pad1[CACHE_LINE];
+	size_t		tail;		/* The next cell to drain. */
+	char		pad2[CACHE_LINE];
+	struct lo_cell	cells[];
+};
+
+/* A message in flight, with its data and duplicates of the descriptors
+ * passed with it.
+ */
+struct lo_msg {
+	size_t		size;		/* Bytes of data. */
+	char*		data;		/* Follows the descriptors. */
+	uint_t		desc_num;	/* Number of descriptors. */
+	int		fds[];
+};
+
+/* Both ends of a connection hold the link, and the last one to close it
+ * frees it.
+ */
+struct lo_link {
+	struct lo_queue*	to_server;
+	struct lo_queue*	to_client;
+	unsigned int		ends;		/* Ends not yet closed. */
+};
+
+struct lo_endpoint {
+	bool			is_door;
+	int			fd;		/* Our placeholder. */
+
+/* For a door: */
+	struct lo_queue*	backlog;	/* Links to accept. */
+	char*			path;		/* Attached here, or NULL. */
+	size_t			capacity;	/* Largest message. */
+/* The owner's reference, plus one for each thread connecting to the door or
+ * waiting to accept a connection.  Protected by registry_lock.
+ */
+	unsigned int		refs;
+	struct lo_endpoint*	next;		/* Next attached door. */
+
+/* For either end of a connection: */
+	struct lo_link*		link;
+	struct lo_queue*	in;		/* Messages for us. */
+	struct lo_queue*	out;		/* Messages for the peer. */
+	struct lo_msg*		pending;	/* Peeked, not yet received. */
+};
+
+static pthread_once_t is_ready = PTHREAD_ONCE_INIT;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The endpoint each descriptor names, or NULL. */
+static struct lo_endpoint** endpoints = NULL;
+static size_t endpoint_max = 0;
+
+/* Doors attached to a path. */
+static struct lo_endpoint* attached = NULL;
+
+static void loopback_init(void)
+/* Allocates the table of endpoints, with an entry for every descriptor the
+ * process may open, up to a reasonable limit.
+ */
+{
+	static const size_t limit = 65536U;
+	long sys;
+
+	sys = sysconf(_SC_OPEN_MAX);
+
+	if ( 0 >= sys || (long)limit < sys )
+		endpoint_max = limit;
+	else
+		endpoint_max = (size_t)sys;
+
+	endpoints = calloc( endpoint_max, sizeof(struct lo_endpoint*) );
+	if ( NULL == endpoints )
+		endpoint_max = 0;
+
+	return;
+}
+
+static void lock_registry(void)
+{
+	if ( 0 != pthread_mutex_lock(&registry_lock) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_mutex_lock");
+
+	return;
+}
+
+static void unlock_registry(void)
+{
+	if ( 0 != pthread_mutex_unlock(&registry_lock) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_mutex_unlock");
+
+	return;
+}
+
+static inline void wait_sem( sem_t* sem )
+/* Waits on sem, ignoring interruptions by signals. */
+{
+	while ( 0 != sem_wait(sem) )
+		if ( EINTR != errno )
+			fatal_system_error(__FILE__,__LINE__,"sem_wait");
+
+	return;
+}
+
+static int wait_sem_until( sem_t* sem, uint64_t deadline )
+/* As wait_sem(), but gives up at deadline, a CLOCK_MONOTONIC time in
+ * nanoseconds.  sem_timedwait() measures CLOCK_REALTIME instead, so we
+ * convert, and check the monotonic clock again whenever it returns.
+ *
+ * Returns 0 once it has taken the token, or -1 with errno set to ETIMEDOUT.
+ */
+{
+	static const int ERROR = -1, SUCCESS = 0;
+
+	for (;;) {
+		struct timespec now, until;
+		uint64_t now_ns, left;
+
+		clock_gettime( CLOCK_MONOTONIC, &now );
+		now_ns = (uint64_t)now.tv_sec * 1000000000U + (uint64_t)now.tv_nsec;
+
+		if ( deadline <= now_ns ) {
+			if ( 0 == sem_trywait(sem) )
+				return SUCCESS;
+
+			errno = ETIMEDOUT;
+			return ERROR;
+		}
+
+		left = deadline - now_ns;
+		clock_gettime( CLOCK_REALTIME, &until );
+		until.tv_sec += (time_t)( left / 1000000000U );
+		until.tv_nsec += (long)( left % 1000000000U );
+		if ( 1000000000L <= until.tv_nsec ) {
+			until.tv_sec += 1;
+			until.tv_nsec -= 1000000000L;
+		}
+
+		if ( 0 == sem_timedwait( sem, &until ) )
+			return SUCCESS;
+
+		if ( ETIMEDOUT != errno && EINTR != errno )
+			fatal_system_error(__FILE__,__LINE__,"sem_timedwait");
+	}
+}
+
+static struct lo_queue* queue_create( size_t cells )
+/* Returns a new, empty queue with the given number of cells, or NULL. */
+{
+	struct lo_queue* q;
+	size_t i;
+
+	q = malloc( sizeof(struct lo_queue) + cells * sizeof(struct lo_cell) );
+	if ( NULL == q )
+		return NULL;
+
+	bzero( q, sizeof(struct lo_queue) );
+	q->mask = cells - 1;
+
+	for ( i = 0; i < cells; ++i ) {
+		q->cells[i].seq = i;
+		q->cells[i].item = NULL;
+	}
+
+	if ( 0 != sem_init( &q->items, 0, 0 ) ||
+	     0 != sem_init( &q->slots, 0, (unsigned int)cells )
+	   ) {
+		free(q);
+		return NULL;
+	}
+
+	return q;
+}
+
+static int queue_push( struct lo_queue* q, void* item )
+/* Adds item to the end of the queue, waiting for a free cell if necessary.
+ *
+ * Returns 0 on success, or -1 if the queue has been hung up, setting errno
+ * to EPIPE.
+ */
+{
+	static const int ERROR = -1, SUCCESS = 0;
+	struct lo_cell* cell;
+	size_t pos;
+
+	wait_sem(&q->slots);
+
+	if ( __atomic_load_n( &q->hangup, __ATOMIC_ACQUIRE ) ) {
+		sem_post(&q->slots);
+		errno = EPIPE;
+		return ERROR;
+	}
+
+/* Claim a cell.  Our token guarantees there is one, but a consumer may not
+ * have finished emptying it yet.
+ */
+	pos = __atomic_fetch_add( &q->head, 1, __ATOMIC_RELAXED );
+	cell = &q->cells[pos & q->mask];
+
+	while ( pos != __atomic_load_n( &cell->seq, __ATOMIC_ACQUIRE ) )
+		sched_yield();
+
+	cell->item = item;
+	__atomic_store_n( &cell->seq, pos + 1, __ATOMIC_RELEASE );
+
+	sem_post(&q->items);
+
+	return SUCCESS;
+}
+
+static void* queue_take( struct lo_queue* q )
+/* Removes the item at the front of the queue, for a consumer that has just
+ * taken a token from q->items.  Only one thread at a time may consume from a
+ * given queue.
+ *
+ * Returns the item, or NULL if the queue has been hung up and is empty.
+ */
+{
+	struct lo_cell* cell;
+	size_t pos;
+	void* item;
+
+	pos = __atomic_load_n( &q->tail, __ATOMIC_RELAXED );
+
+	if ( __atomic_load_n( &q->hangup, __ATOMIC_ACQUIRE ) &&
+	     pos == __atomic_load_n( &q->head, __ATOMIC_ACQUIRE )
+	   ) {
+/* We woke for the hangup, not for an item.  Leave the token for the next
+ * thread to wait here.
+ */
+		sem_post(&q->items);
+		return NULL;
+	}
+
+	__atomic_store_n( &q->tail, pos + 1, __ATOMIC_RELAXED );
+	cell = &q->cells[pos & q->mask];
+
+/* A producer may have claimed this cell but not yet filled it. */
+	while ( pos + 1 != __atomic_load_n( &cell->seq, __ATOMIC_ACQUIRE ) )
+		sched_yield();
+
+	item = cell->item;
+	__atomic_store_n( &cell->seq, pos + q->mask + 1, __ATOMIC_RELEASE );
+
+	sem_post(&q->slots);
+
+	return item;
+}
+
+static void* queue_pop( struct lo_queue* q )
+/* Removes the item at the front of the queue, waiting for one if necessary,
+ * as queue_take() does.
+ */
+{
+	wait_sem(&q->items);
+
+	return queue_take(q);
+}
+
+static void queue_hangup( struct lo_queue* q )
+/* Wakes every thread waiting on the queue, and makes later pushes fail. */
+{
+	__atomic_store_n( &q->hangup, true, __ATOMIC_RELEASE );
+
+	sem_post(&q->items);
+	sem_post(&q->slots);
+
+	return;
+}
+
+static void queue_destroy( struct lo_queue* q, void (*drop)(void*) )
+/* Frees the queue once no thread can use it, passing each item still queued
+ * to drop.
+ */
+{
+	size_t pos;
+
+	for ( pos = q->tail; pos != q->head; ++pos ) {
+		struct lo_cell* const cell = &q->cells[pos & q->mask];
+
+		if ( pos + 1 == cell->seq )
+			drop(cell->item);
+	}
+
+	sem_destroy(&q->items);
+	sem_destroy(&q->slots);
+	free(q);
+
+	return;
+}
+
+static void msg_free( void* p )
+/* Frees a message nobody will receive, closing the descriptors it carries. */
+{
+	struct lo_msg* const msg = p;
+	uint_t i;
+
+	for ( i = 0; i < msg->desc_num; ++i )
+		close(msg->fds[i]);
+
+	free(msg);
+
+	return;
+}
+
+static void link_release( struct lo_link* link )
+/* Hangs up both directions of the link, so that the other end sees
+ * end-of-file, and frees it once both ends have let go.
+ */
+{
+	queue_hangup(link->to_server);
+	queue_hangup(link->to_client);
+
+	if ( 0 == __atomic_sub_fetch( &link->ends, 1, __ATOMIC_ACQ_REL ) ) {
+		queue_destroy( link->to_server, msg_free );
+		queue_destroy( link->to_client, msg_free );
+		free(link);
+	}
+
+	return;
+}
+
+static void link_drop( void* p )
+/* Releases the server's end of a connection nobody accepted. */
+{
+	link_release(p);
+
+	return;
+}
+
+static struct lo_link* link_create(void)
+{
+	struct lo_link* link;
+
+	link = malloc(sizeof(struct lo_link));
+	if ( NULL == link )
+		return NULL;
+
+	link->to_server = queue_create(QUEUE_CELLS);
+	link->to_client = queue_create(QUEUE_CELLS);
+	link->ends = 2;
+
+	if ( NULL == link->to_server || NULL == link->to_client ) {
+		if ( NULL != link->to_server )
+			queue_destroy( link->to_server, msg_free );
+		if ( NULL != link->to_client )
+			queue_destroy( link->to_client, msg_free );
+		free(link);
+		return NULL;
+	}
+
+	return link;
+}
+
+static struct lo_endpoint* endpoint_create( bool is_door )
+/* Reserves a descriptor and enters a new endpoint for it in the table.  The
+ * caller fills in the rest of the endpoint before returning the descriptor
+ * to door.c.
+ *
+ * Returns the endpoint, or NULL on failure, setting errno.
+ */
+{
+	struct lo_endpoint* ep;
+	int fd;
+
+	pthread_once( &is_ready, loopback_init );
+
+	ep = calloc( 1, sizeof(struct lo_endpoint) );
+	if ( NULL == ep ) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	fd = open( "/dev/null", O_RDONLY );
+	if ( 0 > fd ) {
+		free(ep);
+		return NULL;
+	}
+
+	if ( endpoint_max <= (size_t)fd ) {
+		close(fd);
+		free(ep);
+		errno = EMFILE;
+		return NULL;
+	}
+
+	fcntl( fd, F_SETFD, FD_CLOEXEC );
+
+	ep->is_door = is_door;
+	ep->fd = fd;
+
+	return ep;
+}
+
+static void endpoint_install( struct lo_endpoint* ep )
+{
+	__atomic_store_n( &endpoints[ep->fd], ep, __ATOMIC_RELEASE );
+
+	return;
+}
+
+static struct lo_endpoint* endpoint_find( int fd )
+/* Returns the endpoint fd names, or NULL, setting errno to EBADF. */
+{
+	struct lo_endpoint* ep = NULL;
+
+	if ( 0 <= fd && endpoint_max > (size_t)fd )
+		ep = __atomic_load_n( &endpoints[fd], __ATOMIC_ACQUIRE );
+
+	if ( NULL == ep )
+		errno = EBADF;
+
+	return ep;
+}
+
+static void door_release( struct lo_endpoint* ep )
+/* Drops a reference to a door endpoint.  The caller holds registry_lock.
+ * Frees the endpoint, and any connections still waiting in its backlog, with
+ * the last reference.
+ */
+{
+	if ( 0 != --ep->refs )
+		return;
+
+	queue_destroy( ep->backlog, link_drop );
+	free(ep);
+
+	return;
+}
+
+static int loopback_create(void)
+{
+	static const int ERROR = -1;
+	struct lo_endpoint* ep;
+
+	ep = endpoint_create(true);
+	if ( NULL == ep )
+		return ERROR;
+
+	ep->backlog = queue_create(BACKLOG_CELLS);
+	if ( NULL == ep->backlog ) {
+		close(ep->fd);
+		free(ep);
+		errno = ENOMEM;
+		return ERROR;
+	}
+
+	ep->capacity = default_capacity;
+	ep->refs = 1;
+
+	endpoint_install(ep);
+
+	return ep->fd;
+}
+
+static int loopback_attach( int d, const char* path )
+/* Attaches the door d at path, which no other loopback door may be using. */
+{
+	static const int ERROR = -1, SUCCESS = 0;
+	struct lo_endpoint* ep;
+	struct lo_endpoint* p;
+	char* copy;
+
+	copy = malloc( strlen(path) + 1 );
+	if ( NULL == copy ) {
+		errno = ENOMEM;
+		return ERROR;
+	}
+	strcpy( copy, path );
+
+	lock_registry();
+
+	ep = endpoint_find(d);
+	if ( NULL == ep || ! ep->is_door ) {
+		unlock_registry();
+		free(copy);
+		errno = EBADF;
+		return ERROR;
+	}
+
+/* Like a socket, a door can only be bound once. */
+	if ( NULL != ep->path ) {
+		unlock_registry();
+		free(copy);
+		errno = EINVAL;
+		return ERROR;
+	}
+
+	for ( p = attached; NULL != p; p = p->next )
+		if ( 0 == strcmp( p->path, path ) ) {
+			unlock_registry();
+			free(copy);
+			errno = EADDRINUSE;
+			return ERROR;
+		}
+
+	ep->path = copy;
+	ep->next = attached;
+	attached = ep;
+
+	unlock_registry();
+
+	return SUCCESS;
+}
+
+static void unlink_door( struct lo_endpoint* ep )
+/* Removes the door from the list of attached doors.  The caller holds
+ * registry_lock.
+ */
+{
+	struct lo_endpoint** pp;
+
+	for ( pp = &attached; NULL != *pp; pp = &(*pp)->next )
+		if ( ep == *pp ) {
+			*pp = ep->next;
+			break;
+		}
+
+	free(ep->path);
+	ep->path = NULL;
+	ep->next = NULL;
+
+	return;
+}
+
+static struct lo_endpoint* find_attached( const char* path )
+/* Returns the door attached at path, or NULL.  The caller holds
+ * registry_lock.
+ */
+{
+	struct lo_endpoint* p;
+
+	for ( p = attached; NULL != p; p = p->next )
+		if ( 0 == strcmp( p->path, path ) )
+			return p;
+
+	return NULL;
+}
+
+static int loopback_accept( int d )
+/* Waits for a connection in the door's backlog, and gives the server's end
+ * of it a descriptor.
+ */
+{
+	static const int ERROR = -1;
+	struct lo_endpoint* door;
+	struct lo_endpoint* ep;
+	struct lo_link* link;
+
+	lock_registry();
+	door = endpoint_find(d);
+	if ( NULL == door || ! door->is_door ) {
+		unlock_registry();
+		errno = EBADF;
+		return ERROR;
+	}
+	++door->refs;
+	unlock_registry();
+
+	link = queue_pop(door->backlog);
+
+	lock_registry();
+	door_release(door);
+	unlock_registry();
+
+	if ( NULL == link ) {
+/* The door was closed. */
+		errno = EBADF;
+		return ERROR;
+	}
+
+	ep = endpoint_create(false);
+	if ( NULL == ep ) {
+		const int error = errno;
+
+		link_release(link);
+		errno = error;
+		return ERROR;
+	}
+
+	ep->link = link;
+	ep->in = link->to_server;
+	ep->out = link->to_client;
+
+	endpoint_install(ep);
+
+	return ep->fd;
+}
+
+static int loopback_detach( const char* path )
+{
+	static const int ERROR = -1, SUCCESS = 0;
+	struct lo_endpoint* ep;
+
+	lock_registry();
+
+	ep = find_attached(path);
+	if ( NULL == ep ) {
+		unlock_registry();
+		errno = ENOENT;
+		return ERROR;
+	}
+
+	unlink_door(ep);
+
+	unlock_registry();
+
+	return SUCCESS;
+}
+
+static int loopback_connect( const char* path )
+/* Creates a connection to the door attached at path, and queues it for the
+ * door's accept().
+ */
+{
+	static const int ERROR = -1;
+	struct lo_endpoint* door;
+	struct lo_endpoint* ep;
+	struct lo_link* link;
+
+	lock_registry();
+	door = find_attached(path);
+	if ( NULL == door ) {
+		unlock_registry();
+		errno = ENOENT;
+		return ERROR;
+	}
+	++door->refs;
+	unlock_registry();
+
+	link = link_create();
+	ep = ( NULL == link ) ? NULL : endpoint_create(false);
+
+	if ( NULL == ep ) {
+		const int error = ( NULL == link ) ? ENOMEM : errno;
+
+		if ( NULL != link ) {
+			link_release(link);
+			link_release(link);
+		}
+
+		lock_registry();
+		door_release(door);
+		unlock_registry();
+
+		errno = error;
+		return ERROR;
+	}
+
+	ep->link = link;
+	ep->in = link->to_client;
+	ep->out = link->to_server;
+
+	if ( 0 != queue_push( door->backlog, link ) ) {
+/* The door was closed while we were connecting. */
+		link_release(link);
+		close(ep->fd);
+		free(ep);
+		link_release(link);
+
+		lock_registry();
+		door_release(door);
+		unlock_registry();
+
+		errno = ECONNREFUSED;
+		return ERROR;
+	}
+
+	lock_registry();
+	door_release(door);
+	unlock_registry();
+
+	endpoint_install(ep);
+
+	return ep->fd;
+}
+
+static ssize_t loopback_send( int fd,
+                              const struct iovec* iovs,
+                              size_t iov_num,
+                              const door_desc_t* desc_ptr,
+                              uint_t desc_num
+                            )
+/* Copies the message into a single buffer and queues it for the peer.  The
+ * peer gets its own duplicates of the descriptors, as it would through a
+ * socket.
+ */
+{
+	static const ssize_t ERROR = -1;
+	struct lo_endpoint* ep;
+	struct lo_msg* msg;
+	size_t size = 0;
+	size_t i;
+	char* p;
+
+	ep = endpoint_find(fd);
+	if ( NULL == ep )
+		return ERROR;
+
+	if ( ep->is_door ) {
+		errno = ENOTCONN;
+		return ERROR;
+	}
+
+	for ( i = 0; i < iov_num; ++i )
+		size += iovs[i].iov_len;
+
+	if ( SSIZE_MAX < size ) {
+		errno = EMSGSIZE;
+		return ERROR;
+	}
+
+	msg = malloc( sizeof(struct lo_msg) + desc_num * sizeof(int) + size );
+	if ( NULL == msg ) {
+		errno = ENOBUFS;
+		return ERROR;
+	}
+
+	msg->size = size;
+	msg->data = (char*)( msg->fds + desc_num );
+	msg->desc_num = 0;
+
+	for ( i = 0; i < desc_num; ++i ) {
+		const int d = dup( desc_ptr[i].d_data.d_desc.d_descriptor );
+
+		if ( 0 > d ) {
+			const int error = errno;
+
+			msg_free(msg);
+			errno = error;
+			return ERROR;
+		}
+
+		msg->fds[msg->desc_num++] = d;
+	}
+
+	for ( i = 0, p = msg->data; i < iov_num; ++i ) {
+		if ( 0 != iovs[i].iov_len )
+			memcpy( p, iovs[i].iov_base, iovs[i].iov_len );
+		p += iovs[i].iov_len;
+	}
+
+	if ( 0 != queue_push( ep->out, msg ) ) {
+		msg_free(msg);
+		errno = EPIPE;
+		return ERROR;
+	}
+
+	return (ssize_t)size;
+}
+
+static struct lo_msg* next_msg( struct lo_endpoint* ep )
+/* Returns the next message for ep, waiting for one if necessary, without
+ * removing it.  Returns NULL at end-of-file.
+ */
+{
+	if ( NULL == ep->pending )
+		ep->pending = queue_pop(ep->in);
+
+	return ep->pending;
+}
+
+static ssize_t loopback_peek( int fd, void* buf, size_t size )
+{
+	static const ssize_t ERROR = -1;
+	struct lo_endpoint* ep;
+	struct lo_msg* msg;
+
+	ep = endpoint_find(fd);
+	if ( NULL == ep )
+		return ERROR;
+
+	if ( ep->is_door ) {
+		errno = ENOTCONN;
+		return ERROR;
+	}
+
+	msg = next_msg(ep);
+	if ( NULL == msg )
+		return 0;
+
+	if ( size > msg->size )
+		size = msg->size;
+
+	memcpy( buf, msg->data, size );
+
+	return (ssize_t)size;
+}
+
+static int loopback_wait( int fd, uint64_t deadline )
+/* Takes the next message off the queue as soon as it arrives, so that the
+ * peek or recv that follows finds it pending.
+ */
+{
+	static const int ERROR = -1, SUCCESS = 0;
+	struct lo_endpoint* ep;
+
+	ep = endpoint_find(fd);
+	if ( NULL == ep )
+		return ERROR;
+
+	if ( ep->is_door ) {
+		errno = ENOTCONN;
+		return ERROR;
+	}
+
+	if ( NULL != ep->pending )
+		return SUCCESS;
+
+	if ( 0 != wait_sem_until( &ep->in->items, deadline ) )
+		return ERROR;
+
+	ep->pending = queue_take(ep->in);
+
+	return SUCCESS;
+}
+
+static ssize_t loopback_recv( int fd,
+                              const struct iovec* iovs,
+                              size_t iov_num,
+                              door_desc_t* desc_ptr,
+                              uint_t desc_num
+                            )
+/* Scatters the next message into iovs and hands over its descriptors.  As
+ * with a SOCK_SEQPACKET socket, whatever does not fit is discarded.
+ */
+{
+	static const ssize_t ERROR = -1;
+	struct lo_endpoint* ep;
+	struct lo_msg* msg;
+	size_t copied = 0;
+	size_t i;
+
+	ep = endpoint_find(fd);
+	if ( NULL == ep )
+		return ERROR;
+
+	if ( ep->is_door ) {
+		errno = ENOTCONN;
+		return ERROR;
+	}
+
+	msg = next_msg(ep);
+	if ( NULL == msg )
+		return 0;
+
+	ep->pending = NULL;
+
+	if ( desc_num != msg->desc_num ) {
+		msg_free(msg);
+		errno = EBADMSG;
+		return ERROR;
+	}
+
+	for ( i = 0; i < iov_num && copied < msg->size; ++i ) {
+		size_t n = msg->size - copied;
+
+		if ( n > iovs[i].iov_len )
+			n = iovs[i].iov_len;
+
+		if ( 0 != n )
+			memcpy( iovs[i].iov_base, msg->data + copied, n );
+		copied += n;
+	}
+
+	for ( i = 0; i < desc_num; ++i ) {
+		bzero( &desc_ptr[i], sizeof(door_desc_t) );
+		desc_ptr[i].d_attributes = DOOR_DESCRIPTOR;
+		desc_ptr[i].d_data.d_desc.d_descriptor = msg->fds[i];
+	}
+
+	free(msg);
+
+	return (ssize_t)copied;
+}
+
+static void loopback_discard( int fd )
+{
+	struct lo_endpoint* ep;
+	struct lo_msg* msg;
+
+	ep = endpoint_find(fd);
+	if ( NULL == ep || ep->is_door )
+		return;
+
+	msg = next_msg(ep);
+	if ( NULL != msg ) {
+		ep->pending = NULL;
+		msg_free(msg);
+	}
+
+	return;
+}
+
+static int loopback_close( int fd )
+/* Takes the endpoint out of the table, hangs up whatever it was connected
+ * to, and releases its placeholder descriptor.
+ */
+{
+	static const int ERROR = -1;
+	struct lo_endpoint* ep;
+
+	lock_registry();
+
+	ep = endpoint_find(fd);
+	if ( NULL == ep ) {
+		unlock_registry();
+		return ERROR;
+	}
+
+	__atomic_store_n( &endpoints[fd], NULL, __ATOMIC_RELEASE );
+
+	if ( ep->is_door ) {
+/* Refuse new connections, and wake any thread waiting in accept(). */
+		if ( NULL != ep->path )
+			unlink_door(ep);
+
+		queue_hangup(ep->backlog);
+		door_release(ep);
+		unlock_registry();
+	}
+	else {
+		unlock_registry();
+
+		if ( NULL != ep->pending )
+			msg_free(ep->pending);
+
+		link_release(ep->link);
+		free(ep);
+	}
+
+	return close(fd);
+}
+
+static int loopback_get_capacity( int d, size_t* size )
+{
+	static const int ERROR = -1, SUCCESS = 0;
+	struct lo_endpoint* ep;
+
+	ep = endpoint_find(d);
+	if ( NULL == ep )
+		return ERROR;
+
+	*size = ep->capacity;
+
+	return SUCCESS;
+}
+
+static int loopback_set_capacity( int d, size_t size )
+{
+	static const int ERROR = -1, SUCCESS = 0;
+	struct lo_endpoint* ep;
+
+	ep = endpoint_find(d);
+	if ( NULL == ep )
+		return ERROR;
+
+	ep->capacity = size;
+
+	return SUCCESS;
+}
+
+static int loopback_peer_cred( int fd, pid_t* pid, uid_t* uid )
+/* The peer is always this process. */
+{
+	static const int ERROR = -1, SUCCESS = 0;
+
+	if ( NULL == endpoint_find(fd) )
+		return ERROR;
+
+	*pid = getpid();
+	*uid = geteuid();
+
+	return SUCCESS;
+}
+
+const struct door_transport door_loopback_transport = {
+	.name = "loopback",
+	.create = loopback_create,
+	.attach = loopback_attach,
+	.accept = loopback_accept,
+	.detach = loopback_detach,
+	.connect = loopback_connect,
+	.send = loopback_send,
+	.peek = loopback_peek,
+	.wait = loopback_wait,
+	.recv = loopback_recv,
+	.discard = loopback_discard,
+	.close = loopback_close,
+	.get_capacity = loopback_get_capacity,
+	.set_capacity = loopback_set_capacity,
+	.peer_cred = loopback_peer_cred
+};
@@ -0,0 +1,415 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * socket.c: The default transport, which carries doors over UNIX-domain   *
+ *           SOCK_SEQPACKET sockets attached to the filesystem.            *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "door.h"
+#include "transport.h"
+
+static int make_address( struct sockaddr_un* address,
+                         socklen_t* length,
+                         const char* path
+                       )
+/* Fills in a UNIX-domain socket address for path, and stores its length.
+ *
+ * Returns 0 on success, or -1 on failure, setting errno to ENAMETOOLONG.
+ */
+{
+	static const int ERROR = -1, SUCCESS = 0;
+	size_t path_len;
+
+/* Implementations are allowed to do some tricky things with the
+ * sun_path array, but this code should work portably:
+ */
+	path_len = strlen(path);
+
+	if ( path_len >= sizeof(address->sun_path) ) {
+		errno = ENAMETOOLONG;
+		return ERROR;
+	}
+
+	address->sun_family = AF_UNIX;
+
+/* Using memcpy and an explicit terminator are redundant, individually
+ * and together, unless the data change from under us.  In that case,
+ * we're already in a state of mortal sin.  I do it anyway, as the cost
+ * is well worth making a buffer overrun impossible.
+ */
+	memcpy( address->sun_path, path, path_len );
+	address->sun_path[path_len] = '\0';
+
+	*length = (socklen_t)( offsetof( struct sockaddr_un, sun_path ) +
+	                       path_len
+	                     );
+
+	return SUCCESS;
+}
+
+static int socket_create(void)
+/* Doors are sockets that will listen for connections once attached. */
+{
+	static const int ERROR = -1;
+	int d;
+
+	d = socket( AF_UNIX, SOCK_SEQPACKET, 0 );
+	if ( 0 > d )
+		return ERROR;
+
+/* It makes no sense to keep a door open after exec(), as even if the
+ * new program is also a door server, it won't know about this door.
+ */
+	if ( 0 != fcntl( d, F_SETFD, FD_CLOEXEC ) ) {
+		close(d);
+		return ERROR;
+	}
+
+	return d;
+}
+
+static int socket_attach( int d, const char* path )
+/* Binds the door's socket to path and starts listening on it.  Fails if a
+ * file already exists there.
+ */
+{
+	static const int ERROR = -1;
+	struct sockaddr_un address;
+	socklen_t length;
+
+	if ( 0 != make_address( &address, &length, path ) )
+		return ERROR;
+
+	if ( 0 != bind( d, (const struct sockaddr*)&address, length ) )
+		return ERROR;
+
+	return listen( d, SOMAXCONN );
+}
+
+static int socket_accept( int d )
+{
+	return accept( d, NULL, 0 );
+}
+
+static int socket_detach( const char* path )
+/* Unlinks the socket at path.  We check that the target exists and is a
+ * socket before removing it, and report EPERM if not, so as not to destroy
+ * an ordinary file by mistake.
+ */
+{
+	static const int ERROR = -1;
+	struct stat buf;
+
+	if ( 0 != stat( path, &buf ) ) {
+		errno = EPERM;
+		return ERROR;
+	}
+
+	if ( !S_ISSOCK(buf.st_mode) ) {
+		errno = EPERM;
+		return ERROR;
+	}
+
+	return unlink(path);
+}
+
+static int socket_connect( const char* path )
+{
+	static const int ERROR = -1;
+	struct sockaddr_un address;
+	socklen_t length;
+	int d;
+
+	if ( 0 != make_address( &address, &length, path ) )
+		return ERROR;
+
+	d = socket( AF_UNIX, SOCK_SEQPACKET, 0 );
+	if ( 0 > d )
+		return ERROR;
+
+	if ( 0 != connect( d, (const struct sockaddr*)&address, length ) ) {
+		const int error = errno;
+
+		close(d);
+		errno = error;
+		return ERROR;
+	}
+
+	fcntl( d, F_SETFD, FD_CLOEXEC );
+
+	return d;
+}
+
+static ssize_t socket_send( int fd,
+                            const struct iovec* iovs,
+                            size_t iov_num,
+                            const door_desc_t* desc_ptr,
+                            uint_t desc_num
+                          )
+/* Sends the message with sendmsg().  The file descriptors in desc_ptr travel
+ * with it as SCM_RIGHTS ancillary data.
+ */
+{
+	static const ssize_t ERROR = -1;
+	union desc_control control;
+	struct msghdr hdr;
+
+	if ( DESC_LIMIT < desc_num ) {
+		errno = EMFILE;
+		return ERROR;
+	}
+
+	bzero( &hdr, sizeof(hdr) );
+
+	hdr.msg_iov = (struct iovec*)iovs;
+	hdr.msg_iovlen = iov_num;
+
+	if ( 0 < desc_num ) {
+		struct cmsghdr* cmsg;
+		unsigned char* fds;
+		uint_t i;
+
+		bzero( &control, sizeof(control) );
+		hdr.msg_control = control.buf;
+		hdr.msg_controllen = CMSG_SPACE( desc_num * sizeof(int) );
+
+		cmsg = CMSG_FIRSTHDR(&hdr);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN( desc_num * sizeof(int) );
+
+		fds = CMSG_DATA(cmsg);
+		for ( i = 0; i < desc_num; ++i )
+			memcpy( fds + i * sizeof(int),
+			        &desc_ptr[i].d_data.d_desc.d_descriptor,
+			        sizeof(int)
+			      );
+	}
+
+	return sendmsg( fd, &hdr, MSG_EOR );
+}
+
+static ssize_t socket_peek( int fd, void* buf, size_t size )
+{
+	return recv( fd, buf, size, MSG_PEEK );
+}
+
+static int socket_wait( int fd, uint64_t deadline )
+/* Polls for input.  The timeout of poll() is in milliseconds, so we round up,
+ * and poll again if it wakes us before the deadline all the same.
+ */
+{
+	static const int ERROR = -1, SUCCESS = 0;
+
+	for (;;) {
+		struct pollfd pfd;
+		struct timespec now;
+		uint64_t now_ns, left, ms;
+		int ready;
+
+		clock_gettime( CLOCK_MONOTONIC, &now );
+		now_ns = (uint64_t)now.tv_sec * 1000000000U + (uint64_t)now.tv_nsec;
+		left = ( deadline > now_ns ) ? deadline - now_ns : 0;
+
+		ms = ( left + 999999U ) / 1000000U;
+		if ( INT_MAX < ms )
+			ms = INT_MAX;
+
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+
+		ready = poll( &pfd, 1, (int)ms );
+		if ( 0 < ready )
+			return SUCCESS;
+
+		if ( 0 == ready ) {
+			if ( 0 == left ) {
+				errno = ETIMEDOUT;
+				return ERROR;
+			}
+		}
+		else if ( EINTR != errno )
+			return ERROR;
+	}
+}
+
+static ssize_t socket_recv( int fd,
+                            const struct iovec* iovs,
+                            size_t iov_num,
+                            door_desc_t* desc_ptr,
+                            uint_t desc_num
+                          )
+/* Receives the message with recvmsg(), and collects the descriptors from its
+ * SCM_RIGHTS ancillary data.  A SOCK_SEQPACKET socket discards whatever part
+ * of the message does not fit in the buffers.
+ */
+{
+	static const ssize_t ERROR = -1;
+
+	union desc_control control;
+	struct msghdr hdr;
+	struct cmsghdr* cmsg;
+	uint_t received = 0;
+	ssize_t retval;
+
+	bzero( &hdr, sizeof(hdr) );
+
+	hdr.msg_iov = (struct iovec*)iovs;
+	hdr.msg_iovlen = iov_num;
+	hdr.msg_control = control.buf;
+	hdr.msg_controllen = sizeof(control.buf);
+
+	retval = recvmsg( fd, &hdr, 0 );
+	if ( 0 > retval )
+		return retval;
+
+	for ( cmsg = CMSG_FIRSTHDR(&hdr);
+	      NULL != cmsg;
+	      cmsg = CMSG_NXTHDR( &hdr, cmsg )
+	    ) {
+		const unsigned char* fds;
+		size_t i, n;
+
+		if ( SOL_SOCKET != cmsg->cmsg_level ||
+		     SCM_RIGHTS != cmsg->cmsg_type
+		   )
+			continue;
+
+		fds = CMSG_DATA(cmsg);
+		n = ( cmsg->cmsg_len - CMSG_LEN(0) ) / sizeof(int);
+
+		for ( i = 0; i < n; ++i, ++received ) {
+			int d;
+
+			memcpy( &d, fds + i * sizeof(int), sizeof(int) );
+
+			if ( received < desc_num ) {
+				bzero( &desc_ptr[received], sizeof(door_desc_t) );
+				desc_ptr[received].d_attributes = DOOR_DESCRIPTOR;
+				desc_ptr[received].d_data.d_desc.d_descriptor = d;
+			}
+			else
+				close(d);
+		} /* end for (each descriptor) */
+	} /* end for (each control message) */
+
+	if ( received != desc_num || ( MSG_CTRUNC & hdr.msg_flags ) ) {
+		const uint_t n = ( received < desc_num ) ? received : desc_num;
+		uint_t i;
+
+		for ( i = 0; i < n; ++i )
+			close( desc_ptr[i].d_data.d_desc.d_descriptor );
+
+		errno = ( MSG_CTRUNC & hdr.msg_flags ) ? EMFILE : EBADMSG;
+		return ERROR;
+	}
+
+	return retval;
+}
+
+static void socket_discard( int fd )
+/* Reading a single byte of a SOCK_SEQPACKET message consumes all of it.
+ * Since we supply no buffer for ancillary data, the system closes any
+ * descriptors the message carried.
+ */
+{
+	char scratch;
+
+	recv( fd, &scratch, sizeof(scratch), 0 );
+
+	return;
+}
+
+static int socket_close( int fd )
+{
+	return close(fd);
+}
+
+static int socket_get_capacity( int d, size_t* size )
+{
+	static const int ERROR = -1, SUCCESS = 0;
+	int buf;
+	socklen_t int_length = sizeof(int);
+
+	if ( 0 != getsockopt( d, SOL_SOCKET, SO_RCVBUF, &buf, &int_length ) )
+		return ERROR;
+
+	*size = (size_t)buf;
+
+	return SUCCESS;
+}
+
+static int socket_set_capacity( int d, size_t size )
+{
+	static const int ERROR = -1;
+	int buf;
+
+	if ( INT_MAX < size ) {
+		errno = ERANGE;
+		return ERROR;
+	}
+
+	buf = (int)size;
+
+	return setsockopt( d, SOL_SOCKET, SO_RCVBUF, &buf, sizeof(int) );
+}
+
+static int socket_peer_cred( int fd, pid_t* pid, uid_t* uid )
+{
+	static const int ERROR = -1;
+#if defined(SO_PEERCRED)
+	static const int SUCCESS = 0;
+	struct ucred cred;
+	socklen_t cred_len = sizeof(cred);
+
+	if ( 0 != getsockopt( fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len ) )
+		return ERROR;
+
+	*pid = cred.pid;
+	*uid = cred.uid;
+
+	return SUCCESS;
+#else
+	errno = ENOTSUP;
+	return ERROR;
+#endif
+}
+
+const struct door_transport door_socket_transport = {
+	.name = "socket",
+	.create = socket_create,
+	.attach = socket_attach,
+	.accept = socket_accept,
+	.detach = socket_detach,
+	.connect = socket_connect,
+	.send = socket_send,
+	.peek = socket_peek,
+	.wait = socket_wait,
+	.recv = socket_recv,
+	.discard = socket_discard,
+	.close = socket_close,
+	.get_capacity = socket_get_capacity,
+	.set_capacity = socket_set_capacity,
+	.peer_cred = socket_peer_cred
+};
@@ -0,0 +1,199 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * stats.c: Allocates each door's counters, on the heap or, once           *
+ *          door_stats_export() asks, in a shared mapping of a file that   *
+ *          collectors can read directly.                                  *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "door.h"
+#include "error.h"
+#include "stats.h"
+
+/* The counters start on a cache line of their own after the header. */
+#define COUNTERS_OFFSET \
+( ( sizeof(door_stats_header_t) + 63 ) & ~(size_t)63 )
+
+/* Where to publish new doors' counters, or NULL.  Protected by export_lock. */
+static char* export_dir = NULL;
+static pthread_mutex_t export_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int door_stats_export( const char* dir )
+{
+	static const int ERROR = -1, SUCCESS = 0;
+	char* copy = NULL;
+
+	if ( NULL != dir ) {
+		struct stat st;
+
+		if ( 0 != stat( dir, &st ) )
+			return ERROR;
+
+		if ( ! S_ISDIR(st.st_mode) ) {
+			errno = ENOTDIR;
+			return ERROR;
+		}
+
+		if ( 0 != access( dir, W_OK | X_OK ) )
+			return ERROR;
+
+		copy = strdup(dir);
+		if ( NULL == copy )
+			return ERROR;
+	}
+
+	if ( 0 != pthread_mutex_lock(&export_lock) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_mutex_lock");
+
+	free(export_dir);
+	export_dir = copy;
+
+	if ( 0 != pthread_mutex_unlock(&export_lock) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_mutex_unlock");
+
+	return SUCCESS;
+}
+
+static struct door_counters* map_counters( const char* path, door_id_t id )
+/* Creates the file path, maps it and lays out the header and counters for
+ * the door id in it.  Returns the counters, or NULL, setting errno.
+ */
+{
+	const size_t size = COUNTERS_OFFSET + sizeof(struct door_counters);
+	door_stats_header_t* header;
+	struct door_counters* c;
+	void* mapping;
+	int fd, error;
+
+	fd = open( path, O_RDWR | O_CREAT | O_EXCL, 0644 );
+	if ( 0 > fd )
+		return NULL;
+
+	if ( 0 != ftruncate( fd, (off_t)size ) ) {
+		error = errno;
+		close(fd);
+		unlink(path);
+		errno = error;
+		return NULL;
+	}
+
+	mapping = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	error = errno;
+	close(fd);
+
+	if ( MAP_FAILED == mapping ) {
+		unlink(path);
+		errno = error;
+		return NULL;
+	}
+
+/* The file is new, so both start out zeroed. */
+	c = (struct door_counters*)( (char*)mapping + COUNTERS_OFFSET );
+	c->refs = 1;
+	c->mapping = mapping;
+	c->mapping_size = size;
+	c->owner = getpid();
+
+	header = mapping;
+	header->dh_version = DOOR_STATS_VERSION;
+	header->dh_header_size = sizeof(door_stats_header_t);
+	header->dh_stats_offset =
+COUNTERS_OFFSET + offsetof( struct door_counters, stats );
+	header->dh_stats_size = sizeof(door_stats_t);
+	header->dh_pid = (unsigned long long)c->owner;
+	header->dh_door = id;
+
+/* A collector that sees the magic number sees the rest of the header. */
+	__atomic_store_n( &header->dh_magic, DOOR_STATS_MAGIC, __ATOMIC_RELEASE );
+
+	return c;
+}
+
+struct door_counters* counters_create( door_id_t id )
+{
+	struct door_counters* c;
+	char* path = NULL;
+	bool publish;
+
+	if ( 0 != pthread_mutex_lock(&export_lock) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_mutex_lock");
+
+	publish = ( NULL != export_dir );
+	if (publish) {
+		const int size = snprintf( NULL,
+		                           0,
+		                           "%s/door.%ld.%llu",
+		                           export_dir,
+		                           (long)getpid(),
+		                           id
+		                         );
+
+		path = malloc( (size_t)size + 1 );
+		if ( NULL != path )
+			sprintf( path,
+			         "%s/door.%ld.%llu",
+			         export_dir,
+			         (long)getpid(),
+			         id
+			       );
+	}
+
+	if ( 0 != pthread_mutex_unlock(&export_lock) )
+		fatal_system_error(__FILE__,__LINE__,"pthread_mutex_unlock");
+
+	if ( ! publish ) {
+		c = calloc( 1, sizeof(struct door_counters) );
+		if ( NULL != c )
+			c->refs = 1;
+
+		return c;
+	}
+
+	if ( NULL == path ) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	c = map_counters( path, id );
+	if ( NULL == c ) {
+		const int error = errno;
+
+		free(path);
+		errno = error;
+		return NULL;
+	}
+
+	c->path = path;
+
+	return c;
+}
+
+void counters_unmap( struct door_counters* c )
+{
+	char* const path = c->path;
+
+	if ( getpid() == c->owner )
+		unlink(path);
+
+	munmap( c->mapping, c->mapping_size );
+	free(path);
+
+	return;
+}
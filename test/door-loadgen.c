@@ -0,0 +1,551 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * door-loadgen.c: Load generator for capacity planning.                   *
+ *                                                                         *
+ *                 The program forks client processes, each running        *
+ *                 client threads that call the door attached at a path,   *
+ *                 with argument sizes drawn from a distribution.  The     *
+ *                 calls are either back to back or, with -r, due at a     *
+ *                 fixed total rate, in which case each latency counts     *
+ *                 from when the call was due.  It reports throughput,     *
+ *                 errors by errno, and latency percentiles.               *
+ *                                                                         *
+ *                 With -e, it first serves an echo door at the path from  *
+ *                 a child process of its own.                             *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "door.h"
+#include "error.h"
+#include "bench.h"
+#include "histogram.h"
+
+#define MAX_THREADS	256U
+
+/* Errors are counted by errno; anything larger lands in the last slot. */
+#define ERRNO_SLOTS	256U
+
+enum size_kind {
+	size_fixed = 0,
+	size_uniform,
+	size_exponential
+};
+
+/* How large each call's argument is. */
+struct size_dist {
+	enum size_kind	kind;
+	size_t		a;	/* The size, minimum or mean. */
+	size_t		b;	/* The maximum. */
+};
+
+struct options {
+	const char*		path;
+	unsigned int		processes;
+	unsigned int		threads;
+	double			rate;		/* In total, or 0. */
+	double			duration;
+	struct size_dist	sizes;
+	bool			serve;
+};
+
+/* What one client saw.  A process sends the sum of its threads' results to
+ * the parent through a pipe.
+ */
+struct totals {
+	unsigned long long	calls;
+	unsigned long long	errors;
+	unsigned long long	bytes_out;
+	unsigned long long	bytes_in;
+	double			seconds;
+	unsigned long long	by_errno[ERRNO_SLOTS];
+	struct histogram	latency;
+};
+
+struct client {
+	pthread_t		thread;
+	const struct options*	opts;
+	uint64_t		seed;
+	struct totals		totals;
+};
+
+static void usage( const char* name )
+{
+	fprintf( stderr,
+	         "usage: %s [-n processes] [-m threads] [-r calls/s] "
+	         "[-d seconds]\n"
+	         "       [-s fixed:N|uniform:MIN:MAX|exp:MEAN] [-e] path\n",
+	         name
+	       );
+	exit(EXIT_FAILURE);
+}
+
+static bool parse_sizes( const char* spec, struct size_dist* sizes )
+{
+	unsigned long a, b;
+
+	if ( 1 == sscanf( spec, "fixed:%lu", &a ) ) {
+		sizes->kind = size_fixed;
+		sizes->a = sizes->b = a;
+	}
+	else if ( 2 == sscanf( spec, "uniform:%lu:%lu", &a, &b ) && a <= b ) {
+		sizes->kind = size_uniform;
+		sizes->a = a;
+		sizes->b = b;
+	}
+	else if ( 1 == sscanf( spec, "exp:%lu", &a ) ) {
+/* Cut the tail off at a hundred times the mean. */
+		sizes->kind = size_exponential;
+		sizes->a = a;
+		sizes->b = a * 100;
+	}
+	else
+		return false;
+
+	return true;
+}
+
+static uint64_t next_random( uint64_t* state )
+/* xorshift64*: fast, and good enough for choosing sizes. */
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+
+	return *state * UINT64_C(2685821657736338717);
+}
+
+static size_t draw_size( const struct size_dist* sizes, uint64_t* state )
+{
+	double u;
+	size_t size;
+
+	switch (sizes->kind) {
+		case size_uniform:
+			return sizes->a + (size_t)( next_random(state) %
+			                            ( sizes->b - sizes->a + 1 )
+			                          );
+
+		case size_exponential:
+/* u lies in (0, 1], so its logarithm is finite. */
+			u = (double)( ( next_random(state) >> 11 ) + 1 ) /
+			    (double)( UINT64_C(1) << 53 );
+			size = (size_t)( -log(u) * (double)sizes->a );
+
+			return ( size < sizes->b ) ? size : sizes->b;
+
+		default:
+			return sizes->a;
+	}
+}
+
+static void* client_proc( void* arg )
+{
+	struct client* c = arg;
+	const struct options* opts = c->opts;
+	struct totals* t = &c->totals;
+	struct bench_pace pace;
+	char* data;
+	char* rbuf;
+	uint64_t due;
+	int d;
+
+	data = malloc( c->opts->sizes.b + 1 );
+	rbuf = malloc( c->opts->sizes.b + 1 );
+	if ( NULL == data || NULL == rbuf )
+		fatal_system_error( __FILE__, __LINE__, "malloc" );
+
+	memset( data, 'x', c->opts->sizes.b + 1 );
+
+	d = door_open(opts->path);
+	if ( 0 > d )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+	bench_pace_start( &pace,
+	                  opts->duration,
+	                  opts->rate / ( opts->processes * opts->threads )
+	                );
+
+	while ( 0 != ( due = bench_pace_next(&pace) ) ) {
+		door_arg_t params;
+		uint64_t now;
+		size_t sent;
+
+		sent = draw_size( &opts->sizes, &c->seed );
+
+		params.data_ptr = data;
+		params.data_size = sent;
+		params.desc_ptr = NULL;
+		params.desc_num = 0;
+		params.rbuf = rbuf;
+		params.rsize = opts->sizes.b + 1;
+
+		if ( 0 != door_call( d, &params ) ) {
+			const int error = errno;
+
+			++t->errors;
+			++t->by_errno[ (unsigned int)error < ERRNO_SLOTS ?
+			               (unsigned int)error :
+			               ERRNO_SLOTS - 1
+			             ];
+			continue;
+		}
+
+		now = bench_now();
+		histogram_record( &t->latency, ( now > due ) ? now - due : 0 );
+
+		++t->calls;
+		t->bytes_out += sent;
+		t->bytes_in += params.data_size;
+
+/* The library may hand back a buffer of its own. */
+		if ( params.rbuf != rbuf )
+			free(params.rbuf);
+	}
+
+	t->seconds = bench_pace_seconds(&pace);
+
+	door_close(d);
+	free(data);
+	free(rbuf);
+
+	return NULL;
+}
+
+static void add_totals( struct totals* dst, const struct totals* src )
+{
+	size_t i;
+
+	dst->calls += src->calls;
+	dst->errors += src->errors;
+	dst->bytes_out += src->bytes_out;
+	dst->bytes_in += src->bytes_in;
+
+	for ( i = 0; i < ERRNO_SLOTS; ++i )
+		dst->by_errno[i] += src->by_errno[i];
+
+	histogram_merge( &dst->latency, &src->latency );
+
+/* The clients ran side by side. */
+	if ( src->seconds > dst->seconds )
+		dst->seconds = src->seconds;
+
+	return;
+}
+
+static void run_process( const struct options* opts,
+                         unsigned int index,
+                         struct totals* totals
+                       )
+/* Runs this process's client threads and adds up what they saw. */
+{
+	static struct client clients[MAX_THREADS];
+	unsigned int i;
+
+	for ( i = 0; i < opts->threads; ++i ) {
+		memset( &clients[i], 0, sizeof(clients[i]) );
+		clients[i].opts = opts;
+		clients[i].seed = ( (uint64_t)getpid() << 32 ) ^
+		                  ( (uint64_t)index << 16 ) ^
+		                  (uint64_t)( i + 1 );
+
+		if ( 0 != pthread_create( &clients[i].thread,
+		                          NULL,
+		                          client_proc,
+		                          &clients[i]
+		                        )
+		   )
+			fatal_system_error( __FILE__, __LINE__, "pthread_create" );
+	}
+
+	for ( i = 0; i < opts->threads; ++i ) {
+		if ( 0 != pthread_join( clients[i].thread, NULL ) )
+			fatal_system_error( __FILE__, __LINE__, "pthread_join" );
+
+		add_totals( totals, &clients[i].totals );
+	}
+
+	return;
+}
+
+static void echo_proc( void* cookie,
+                       const void* restrict argp,
+                       size_t arg_size,
+                       const door_desc_t* restrict dp,
+                       uint_t n_desc
+                     )
+{
+	door_return( argp, arg_size, NULL, 0 );
+
+	fatal_system_error( __FILE__, __LINE__, "door_return" );
+}
+
+static pid_t serve_echo( const struct options* opts )
+/* Forks a child that serves an echo door at the path, and waits until it is
+ * attached.
+ */
+{
+	int ready[2];
+	pid_t pid;
+	char c;
+
+	if ( 0 != pipe(ready) )
+		fatal_system_error( __FILE__, __LINE__, "pipe" );
+
+	fflush(stdout);
+	pid = fork();
+
+	if ( 0 > pid )
+		fatal_system_error( __FILE__, __LINE__, "fork" );
+	else if ( 0 == pid ) {
+		int d;
+
+		close(ready[0]);
+
+		d = door_create( echo_proc, NULL, 0 );
+		if ( 0 > d )
+			fatal_system_error( __FILE__, __LINE__, "door_create" );
+
+		if ( 0 != door_setparam( d,
+		                         DOOR_PARAM_DATA_MAX,
+		                         opts->sizes.b + 1
+		                       )
+		   )
+			fatal_system_error( __FILE__, __LINE__, "door_setparam" );
+
+		door_detach(opts->path);
+		if ( 0 != door_attach( d, opts->path ) )
+			fatal_system_error( __FILE__, __LINE__, "door_attach" );
+
+		if ( 1 != write( ready[1], "", 1 ) )
+			fatal_system_error( __FILE__, __LINE__, "write" );
+
+		for (;;)
+			pause();
+	}
+
+	close(ready[1]);
+	if ( 1 != read( ready[0], &c, 1 ) ) {
+		fprintf( stderr, "The echo server failed.\n" );
+		exit(EXIT_FAILURE);
+	}
+	close(ready[0]);
+
+	return pid;
+}
+
+static void read_all( int fd, void* buf, size_t size )
+/* Reads a client process's totals.  If the client died, it has already said
+ * why.
+ */
+{
+	char* p = buf;
+
+	while ( 0 < size ) {
+		const ssize_t n = read( fd, p, size );
+
+		if ( 0 == n ) {
+			fprintf( stderr, "A client process failed.\n" );
+			exit(EXIT_FAILURE);
+		}
+		else if ( 0 > n )
+			fatal_system_error( __FILE__, __LINE__, "read" );
+
+		p += n;
+		size -= (size_t)n;
+	}
+
+	return;
+}
+
+static void write_all( int fd, const void* buf, size_t size )
+{
+	const char* p = buf;
+
+	while ( 0 < size ) {
+		const ssize_t n = write( fd, p, size );
+
+		if ( 0 >= n )
+			fatal_system_error( __FILE__, __LINE__, "write" );
+
+		p += n;
+		size -= (size_t)n;
+	}
+
+	return;
+}
+
+static void report( const struct options* opts, const struct totals* t )
+{
+	const double secs = ( 0.0 < t->seconds ) ? t->seconds : 1.0;
+	const struct histogram* h = &t->latency;
+	size_t i;
+
+	printf( "%s: %u processes x %u threads, %.1f s, ",
+	        opts->path,
+	        opts->processes,
+	        opts->threads,
+	        t->seconds
+	      );
+	if ( 0.0 < opts->rate )
+		printf( "target %.1f calls/s\n", opts->rate );
+	else
+		printf("closed loop\n");
+
+	printf( "calls:   %llu (%.1f/s)\n", t->calls, t->calls / secs );
+	printf( "bytes:   %llu out (%.3f MiB/s), %llu in (%.3f MiB/s)\n",
+	        t->bytes_out,
+	        t->bytes_out / secs / ( 1024.0 * 1024.0 ),
+	        t->bytes_in,
+	        t->bytes_in / secs / ( 1024.0 * 1024.0 )
+	      );
+	printf( "errors:  %llu\n", t->errors );
+
+	for ( i = 0; i < ERRNO_SLOTS; ++i )
+		if ( 0 != t->by_errno[i] )
+			printf( "         %llu x %s\n",
+			        t->by_errno[i],
+			        strerror( (int)i )
+			      );
+
+	printf( "latency: p50 %llu ns, p90 %llu ns, p99 %llu ns, "
+	        "p99.9 %llu ns, max %llu ns\n",
+	        (unsigned long long)histogram_percentile( h, 50.0 ),
+	        (unsigned long long)histogram_percentile( h, 90.0 ),
+	        (unsigned long long)histogram_percentile( h, 99.0 ),
+	        (unsigned long long)histogram_percentile( h, 99.9 ),
+	        (unsigned long long)h->max
+	      );
+
+	return;
+}
+
+int main( int argc, char** argv )
+{
+	static struct totals totals, theirs;
+	struct options opts;
+	pid_t server = 0;
+	int* results;
+	unsigned int i;
+	int c;
+
+	opts.processes = 1;
+	opts.threads = 1;
+	opts.rate = 0.0;
+	opts.duration = 10.0;
+	opts.sizes.kind = size_fixed;
+	opts.sizes.a = opts.sizes.b = 16;
+	opts.serve = false;
+
+	while ( -1 != ( c = getopt( argc, argv, "n:m:r:d:s:eh" ) ) ) {
+		switch (c) {
+			case 'n':
+				opts.processes = (unsigned int)atoi(optarg);
+				break;
+
+			case 'm':
+				opts.threads = (unsigned int)atoi(optarg);
+				break;
+
+			case 'r':
+				opts.rate = atof(optarg);
+				break;
+
+			case 'd':
+				opts.duration = atof(optarg);
+				break;
+
+			case 's':
+				if ( ! parse_sizes( optarg, &opts.sizes ) )
+					usage(argv[0]);
+				break;
+
+			case 'e':
+				opts.serve = true;
+				break;
+
+			default:
+				usage(argv[0]);
+		}
+	}
+
+	if ( argc != optind + 1 ||
+	     0 == opts.processes ||
+	     0 == opts.threads || MAX_THREADS < opts.threads ||
+	     0.0 >= opts.duration || 0.0 > opts.rate
+	   )
+		usage(argv[0]);
+
+	opts.path = argv[optind];
+
+	if (opts.serve)
+		server = serve_echo(&opts);
+
+	results = malloc( opts.processes * sizeof(int) );
+	if ( NULL == results )
+		fatal_system_error( __FILE__, __LINE__, "malloc" );
+
+	fflush(stdout);
+
+	for ( i = 0; i < opts.processes; ++i ) {
+		int fds[2];
+		pid_t pid;
+
+		if ( 0 != pipe(fds) )
+			fatal_system_error( __FILE__, __LINE__, "pipe" );
+
+		pid = fork();
+
+		if ( 0 > pid )
+			fatal_system_error( __FILE__, __LINE__, "fork" );
+		else if ( 0 == pid ) {
+			close(fds[0]);
+
+			run_process( &opts, i, &theirs );
+			write_all( fds[1], &theirs, sizeof(theirs) );
+
+			_exit(EXIT_SUCCESS);
+		}
+
+		close(fds[1]);
+		results[i] = fds[0];
+	}
+
+	for ( i = 0; i < opts.processes; ++i ) {
+		read_all( results[i], &theirs, sizeof(theirs) );
+		close(results[i]);
+
+		add_totals( &totals, &theirs );
+	}
+
+	for ( i = 0; i < opts.processes; ++i )
+		wait(NULL);
+
+	free(results);
+
+	if (opts.serve) {
+		door_detach(opts.path);
+		kill( server, SIGTERM );
+		waitpid( server, NULL, 0 );
+	}
+
+	report( &opts, &totals );
+
+	return ( 0 == totals.errors ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,240 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * door_admission1.c: Test driver for DOOR_PARAM_MAX_ACTIVE and            *
+ *                    DOOR_PARAM_MAX_QUEUED.                               *
+ *                                                                         *
+ *                    The program serves a door that runs one call at a    *
+ *                    time and lets one more wait, and calls it from three *
+ *                    connections at once, then three times at once from   *
+ *                    this process.  The first call must run, the second   *
+ *                    must wait for it, and the third must fail at once    *
+ *                    with EAGAIN.  The server procedure must never run    *
+ *                    twice at once.  A call from this process that is     *
+ *                    still waiting at its deadline must fail with         *
+ *                    ETIMEDOUT and leave the queue.                       *
+ *                                                                         *
+ *                    The program should not hang, fail an assertion or    *
+ *                    report any error messages.                           *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "door.h"
+#include "error.h"
+
+static const char* const door_path = "/tmp/door-admission";
+
+/* How many server procedures are running now, and the most there have been. */
+static unsigned int running = 0;
+static unsigned int most_running = 0;
+
+static void slow_server( void* cookie,
+                         const void* restrict argp,
+                         size_t arg_size,
+                         const door_desc_t* restrict dp,
+                         uint_t n_desc
+                       )
+{
+	unsigned int now;
+
+	if ( DOOR_UNREF_DATA == argp )
+		return;
+
+	now = __atomic_add_fetch( &running, 1, __ATOMIC_RELAXED );
+	if ( now > __atomic_load_n( &most_running, __ATOMIC_RELAXED ) )
+		__atomic_store_n( &most_running, now, __ATOMIC_RELAXED );
+
+	usleep(200000);
+
+	__atomic_sub_fetch( &running, 1, __ATOMIC_RELAXED );
+
+	door_return( NULL, 0, NULL, 0 );
+
+	fatal_system_error( __FILE__, __LINE__, "door_return" );
+}
+
+static int call_door( int door )
+{
+	door_arg_t params;
+	char c = 'x';
+
+	bzero( &params, sizeof(params) );
+	params.data_ptr = &c;
+	params.data_size = 1;
+
+	return door_call( door, &params );
+}
+
+static void* call_thread( void* p )
+{
+	if ( 0 != call_door( *(int*)p ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call" );
+
+	return NULL;
+}
+
+static void wait_for_stats( int server,
+                            unsigned long long active,
+                            unsigned long long queued
+                          )
+/* Waits until the door counts the given calls as active and queued. */
+{
+	door_stats_t stats;
+	int i;
+
+	for ( i = 0; i < 100; ++i ) {
+		if ( 0 != door_stats( server, &stats ) )
+			fatal_system_error( __FILE__, __LINE__, "door_stats" );
+
+		if ( active == stats.ds_active && queued == stats.ds_queued )
+			return;
+
+		usleep(1000);
+	}
+
+	assert( ! "The door never counted the calls" );
+}
+
+static int open_door(void)
+{
+	const int door = door_open(door_path);
+
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+	return door;
+}
+
+static void test_limits( int server, const int* doors )
+/* Makes three calls at once through doors, one on each. */
+{
+	pthread_t first, second;
+	struct timespec before, after;
+
+	__atomic_store_n( &most_running, 0, __ATOMIC_RELAXED );
+
+	if ( 0 != pthread_create( &first, NULL, call_thread, (void*)&doors[0] ) )
+		fatal_system_error( __FILE__, __LINE__, "pthread_create" );
+	wait_for_stats( server, 1, 0 );
+
+	if ( 0 != pthread_create( &second, NULL, call_thread, (void*)&doors[1] ) )
+		fatal_system_error( __FILE__, __LINE__, "pthread_create" );
+	wait_for_stats( server, 2, 1 );
+
+/* No room for a third: the door must refuse it without waiting. */
+	clock_gettime( CLOCK_MONOTONIC, &before );
+	assert( 0 != call_door(doors[2]) );
+	assert( EAGAIN == errno );
+	clock_gettime( CLOCK_MONOTONIC, &after );
+	assert( after.tv_sec - before.tv_sec < 1 );
+
+	if ( 0 != pthread_join( first, NULL ) ||
+	     0 != pthread_join( second, NULL )
+	   )
+		fatal_system_error( __FILE__, __LINE__, "pthread_join" );
+
+	assert( 1 == __atomic_load_n( &most_running, __ATOMIC_RELAXED ) );
+
+/* Once the door is idle, calls run again. */
+	if ( 0 != call_door(doors[2]) )
+		fatal_system_error( __FILE__, __LINE__, "door_call" );
+
+	wait_for_stats( server, 0, 0 );
+
+	return;
+}
+
+static void test_local_deadline( int server )
+/* Makes a call from this process that times out while another runs. */
+{
+	pthread_t first;
+	door_arg_t params;
+	char c = 'x';
+
+	if ( 0 != pthread_create( &first, NULL, call_thread, (void*)&server ) )
+		fatal_system_error( __FILE__, __LINE__, "pthread_create" );
+	wait_for_stats( server, 1, 0 );
+
+	bzero( &params, sizeof(params) );
+	params.data_ptr = &c;
+	params.data_size = 1;
+
+	assert( 0 != door_call_timed( server, &params, 50000000 ) );
+	assert( ETIMEDOUT == errno );
+	wait_for_stats( server, 1, 0 );
+
+	if ( 0 != pthread_join( first, NULL ) )
+		fatal_system_error( __FILE__, __LINE__, "pthread_join" );
+
+	assert( 1 == __atomic_load_n( &most_running, __ATOMIC_RELAXED ) );
+	wait_for_stats( server, 0, 0 );
+
+	return;
+}
+
+int main(void)
+{
+	door_stats_t stats;
+	int server, doors[3];
+	size_t value;
+	int i;
+
+	server = door_create( slow_server, NULL, 0 );
+	if ( 0 > server )
+		fatal_system_error( __FILE__, __LINE__, "door_create" );
+
+	if ( 0 != door_setparam( server, DOOR_PARAM_MAX_ACTIVE, 1 ) ||
+	     0 != door_setparam( server, DOOR_PARAM_MAX_QUEUED, 1 )
+	   )
+		fatal_system_error( __FILE__, __LINE__, "door_setparam" );
+
+	door_detach(door_path);
+	if ( 0 != door_attach( server, door_path ) )
+		fatal_system_error( __FILE__, __LINE__, "door_attach" );
+
+	for ( i = 0; i < 3; ++i )
+		doors[i] = open_door();
+
+/* Clients can read the limits, too. */
+	if ( 0 != door_getparam( doors[0], DOOR_PARAM_MAX_ACTIVE, &value ) )
+		fatal_system_error( __FILE__, __LINE__, "door_getparam" );
+	assert( 1 == value );
+	if ( 0 != door_getparam( doors[0], DOOR_PARAM_MAX_QUEUED, &value ) )
+		fatal_system_error( __FILE__, __LINE__, "door_getparam" );
+	assert( 1 == value );
+
+	test_limits( server, doors );
+
+/* Calls from this process count against the same limits. */
+	for ( i = 0; i < 3; ++i )
+		door_close(doors[i]);
+	for ( i = 0; i < 3; ++i )
+		doors[i] = server;
+
+	test_limits( server, doors );
+	test_local_deadline(server);
+
+	if ( 0 != door_stats( server, &stats ) )
+		fatal_system_error( __FILE__, __LINE__, "door_stats" );
+	assert( 8 == stats.ds_calls );
+	assert( 2 == stats.ds_errno[EAGAIN] );
+	assert( 1 == stats.ds_errno[ETIMEDOUT] );
+
+	if ( 0 != door_detach(door_path) )
+		fatal_system_error( __FILE__, __LINE__, "door_detach" );
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,167 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * door_batch1.c: Test driver for door_create_batch() and                  *
+ *                door_return_batch().                                     *
+ *                                                                         *
+ *                The program serves a door whose batch server procedure   *
+ *                capitalizes each argument, or fails a call whose         *
+ *                argument is '!', over a socket, over the loopback        *
+ *                transport and to itself.  Calls pipelined on one         *
+ *                descriptor must reach the procedure together at least    *
+ *                once, every call must get its own results, and a call    *
+ *                from this process must come alone.                       *
+ *                                                                         *
+ *                The program should not hang, fail an assertion or        *
+ *                report any error messages.                               *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "door.h"
+#include "error.h"
+
+static const char* const door_path = "/tmp/door-batch";
+
+#define CALLS 8
+#define ROUNDS 50
+
+/* The argument of a call the procedure fails, and how. */
+static const char fail_arg = '!';
+static const int fail_errno = ENOENT;
+
+/* The largest batch the procedure has served. */
+static size_t largest = 0;
+
+static void batch_server( void* cookie,
+                          door_batch_call_t* calls,
+                          size_t count
+                        )
+{
+	char results[DOOR_BATCH_MAX];
+	size_t i;
+	char arg;
+
+	if ( DOOR_UNREF_DATA == calls[0].argp )
+		return;
+
+	assert( 0 < count && DOOR_BATCH_MAX >= count );
+	if ( count > __atomic_load_n( &largest, __ATOMIC_RELAXED ) )
+		__atomic_store_n( &largest, count, __ATOMIC_RELAXED );
+
+/* A batch returns all at once. */
+	assert( 0 != door_return( NULL, 0, NULL, 0 ) );
+	assert( EINVAL == errno );
+
+	for ( i = 0; i < count; ++i ) {
+		assert( 1 == calls[i].arg_size );
+		assert( 0 == calls[i].n_desc );
+		arg = *(const char*)calls[i].argp;
+
+		if ( fail_arg == arg )
+			calls[i].error = fail_errno;
+		else {
+			results[i] = (char)toupper( (unsigned char)arg );
+			calls[i].data_ptr = &results[i];
+			calls[i].data_size = 1;
+		}
+	}
+
+/* The results are on our stack, so send them before we return. */
+	door_return_batch();
+
+	fatal_system_error( __FILE__, __LINE__, "door_return_batch" );
+}
+
+static void test_calls( int door )
+/* Makes a round of pipelined calls through the descriptor door. */
+{
+	door_arg_t params[CALLS];
+	char args[CALLS], rbufs[CALLS];
+	int errors[CALLS];
+	unsigned int i;
+
+	for ( i = 0; i < CALLS; ++i ) {
+		args[i] = ( 3 == i ) ? fail_arg : (char)( 'a' + i );
+		rbufs[i] = 0;
+
+		bzero( &params[i], sizeof(params[i]) );
+		params[i].data_ptr = &args[i];
+		params[i].data_size = 1;
+		params[i].rbuf = &rbufs[i];
+		params[i].rsize = 1;
+	}
+
+	assert( 0 != door_call_pipelined( door, params, errors, CALLS ) );
+	assert( fail_errno == errno );
+
+	for ( i = 0; i < CALLS; ++i ) {
+		if ( 3 == i ) {
+			assert( fail_errno == errors[i] );
+			assert( 0 == rbufs[i] );
+		}
+		else {
+			assert( 0 == errors[i] );
+			assert( 1 == params[i].data_size );
+			assert( 'A' + (char)i == rbufs[i] );
+		}
+	}
+
+	return;
+}
+
+static void test_transport( int transport )
+{
+	int server, door, i;
+
+	server = door_create_batch( batch_server, NULL, 0, transport );
+	if ( 0 > server )
+		fatal_system_error( __FILE__, __LINE__, "door_create_batch" );
+
+	door_detach(door_path);
+	if ( 0 != door_attach( server, door_path ) )
+		fatal_system_error( __FILE__, __LINE__, "door_attach" );
+
+	door = door_open(door_path);
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+/* The listener cannot always keep up with the calls. */
+	__atomic_store_n( &largest, 0, __ATOMIC_RELAXED );
+	for ( i = 0; i < ROUNDS; ++i )
+		test_calls(door);
+	assert( 1 < __atomic_load_n( &largest, __ATOMIC_RELAXED ) );
+
+	door_close(door);
+
+	if ( 0 != door_detach(door_path) )
+		fatal_system_error( __FILE__, __LINE__, "door_detach" );
+
+/* Our own calls come one at a time. */
+	if ( DOOR_TRANSPORT_SOCKET == transport ) {
+		__atomic_store_n( &largest, 0, __ATOMIC_RELAXED );
+		test_calls(server);
+		assert( 1 == __atomic_load_n( &largest, __ATOMIC_RELAXED ) );
+	}
+
+	return;
+}
+
+int main(void)
+{
+	test_transport(DOOR_TRANSPORT_SOCKET);
+	test_transport(DOOR_TRANSPORT_LOOPBACK);
+
+	return EXIT_SUCCESS;
+}
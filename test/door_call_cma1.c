@@ -0,0 +1,202 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * door_call_cma1.c: Test driver for passing large door_call() arguments   *
+ *                   by reference (DOOR_PARAM_CMA_MIN).                    *
+ *                                                                         *
+ *                   This program creates a door that accepts up to 16     *
+ *                   MiB of data and reads any call of 64 KiB or more      *
+ *                   straight out of the client.  The server procedure     *
+ *                   returns the sum of the bytes it received.  The client *
+ *                   makes one small call and one 8 MiB call, far larger   *
+ *                   than the socket buffer, and checks both sums.  A      *
+ *                   forked child, which the server will not read from,    *
+ *                   must still get the sum of a 128 KiB call through the  *
+ *                   descriptor it inherits, and through one the parent    *
+ *                   has not used.  A thread that can be cancelled sends   *
+ *                   a copy of a 128 KiB call, and must get its sum too.   *
+ *                                                                         *
+ *                   The program should not hang, fail an assertion or     *
+ *                   report any error messages.                            *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "door.h"
+#include "error.h"
+
+static const char* const door_path = "/tmp/door-cma";
+
+static const size_t data_max = 16U << 20;
+static const size_t cma_min = 64U << 10;
+static const size_t big_size = 8U << 20;
+static const size_t small_size = 1000U;
+/* Large enough to go by reference, yet small enough to copy. */
+static const size_t mid_size = 128U << 10;
+
+static unsigned long long checksum( const unsigned char* p, size_t n )
+{
+	unsigned long long sum = 0;
+	size_t i;
+
+	for ( i = 0; i < n; ++i )
+		sum += p[i];
+
+	return sum;
+}
+
+static void sum_server( void* cookie,
+                        const void* restrict argp,
+                        size_t arg_size,
+                        const door_desc_t* restrict dp,
+                        uint_t n_desc
+                      )
+{
+	const unsigned long long sum = checksum( argp, arg_size );
+
+	door_return( &sum, sizeof(sum), NULL, 0 );
+
+	fatal_system_error( __FILE__, __LINE__, "door_return" );
+}
+
+static unsigned long long call_cancellable( int door,
+                                            const unsigned char* data,
+                                            size_t n
+                                          )
+{
+	unsigned long long result = 0;
+	door_arg_t params;
+
+	bzero( &params, sizeof(params) );
+	params.data_ptr = data;
+	params.data_size = n;
+	params.rbuf = &result;
+	params.rsize = sizeof(result);
+
+	if ( 0 != door_call( door, &params ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call" );
+
+	assert( sizeof(result) == params.data_size );
+
+	return *(const unsigned long long*)params.data_ptr;
+}
+
+static unsigned long long call( int door, const unsigned char* data, size_t n )
+/* Makes the call from a thread that cannot be cancelled, which the server
+ * reads by reference.
+ */
+{
+	unsigned long long result;
+	int cancel_state;
+
+	pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, &cancel_state );
+	result = call_cancellable( door, data, n );
+	pthread_setcancelstate( cancel_state, NULL );
+
+	return result;
+}
+
+static void test_child( int door, int fresh, const unsigned char* data )
+/* Makes a call that the parent would pass by reference through both
+ * descriptors from a forked child.
+ */
+{
+	pid_t child;
+	int status;
+
+	child = fork();
+	if ( 0 > child )
+		fatal_system_error( __FILE__, __LINE__, "fork" );
+
+	if ( 0 == child ) {
+		assert( checksum( data, mid_size ) ==
+		        call( door, data, mid_size ) );
+		assert( checksum( data, mid_size ) ==
+		        call( fresh, data, mid_size ) );
+		_exit(EXIT_SUCCESS);
+	}
+
+	if ( child != waitpid( child, &status, 0 ) )
+		fatal_system_error( __FILE__, __LINE__, "waitpid" );
+	assert( WIFEXITED(status) && EXIT_SUCCESS == WEXITSTATUS(status) );
+
+	return;
+}
+
+int main(void)
+{
+	int server, door, fresh;
+	size_t value, i;
+	unsigned char* data;
+
+	server = door_create( sum_server, NULL, DOOR_REFUSE_DESC );
+	if ( 0 > server )
+		fatal_system_error( __FILE__, __LINE__, "door_create" );
+
+	if ( 0 != door_setparam( server, DOOR_PARAM_DATA_MAX, data_max ) )
+		fatal_system_error( __FILE__, __LINE__, "door_setparam" );
+
+	if ( 0 != door_setparam( server, DOOR_PARAM_CMA_MIN, cma_min ) )
+		fatal_system_error( __FILE__, __LINE__, "door_setparam" );
+
+	door_detach(door_path);
+
+	if ( 0 != door_attach( server, door_path ) )
+		fatal_system_error( __FILE__, __LINE__, "door_attach" );
+
+	if ( 0 != chmod( door_path, S_IRWXU ) )
+		fatal_system_error( __FILE__, __LINE__, "chmod" );
+
+	door = door_open(door_path);
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+	if ( 0 != door_getparam( door, DOOR_PARAM_CMA_MIN, &value ) )
+		fatal_system_error( __FILE__, __LINE__, "door_getparam" );
+	assert( cma_min == value );
+
+	data = malloc(big_size);
+	assert( NULL != data );
+
+	for ( i = 0; i < big_size; ++i )
+		data[i] = (unsigned char)( i * 7 );
+
+	assert( checksum( data, small_size ) == call( door, data, small_size ) );
+	assert( checksum( data, big_size ) == call( door, data, big_size ) );
+	assert( checksum( data, mid_size ) ==
+	        call_cancellable( door, data, mid_size ) );
+
+	fresh = door_open(door_path);
+	if ( 0 > fresh )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+	test_child( door, fresh, data );
+
+/* The parent still passes its data by reference. */
+	assert( checksum( data, big_size ) == call( fresh, data, big_size ) );
+
+	free(data);
+
+	if ( 0 != door_close(fresh) )
+		fatal_system_error( __FILE__, __LINE__, "door_close" );
+
+	if ( 0 != door_close(door) )
+		fatal_system_error( __FILE__, __LINE__, "door_close" );
+
+	door_detach(door_path);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,218 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * door_call_cma2.c: Test driver for calls by reference that the server    *
+ *                   cannot read (DOOR_PARAM_CMA_MIN).                     *
+ *                                                                         *
+ *                   This program creates a door that reads any call of 64 *
+ *                   KiB or more straight out of the client, and gives up  *
+ *                   its own right to trace other processes.  A forked     *
+ *                   child makes itself undumpable, so that the server may *
+ *                   not read its memory, and makes two 128 KiB calls, one *
+ *                   at a time and then pipelined.  The child must get the *
+ *                   sum of the bytes of each, and the door must count no  *
+ *                   errors.                                               *
+ *                                                                         *
+ *                   The program should not hang, fail an assertion or     *
+ *                   report any error messages.                            *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/capability.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "door.h"
+#include "error.h"
+
+static const char* const door_path = "/tmp/door-cma2";
+
+static const size_t cma_min = 64U << 10;
+static const size_t data_size = 128U << 10;
+
+static unsigned long long checksum( const unsigned char* p, size_t n )
+{
+	unsigned long long sum = 0;
+	size_t i;
+
+	for ( i = 0; i < n; ++i )
+		sum += p[i];
+
+	return sum;
+}
+
+static void sum_server( void* cookie,
+                        const void* restrict argp,
+                        size_t arg_size,
+                        const door_desc_t* restrict dp,
+                        uint_t n_desc
+                      )
+{
+	const unsigned long long sum = checksum( argp, arg_size );
+
+	door_return( &sum, sizeof(sum), NULL, 0 );
+
+	fatal_system_error( __FILE__, __LINE__, "door_return" );
+}
+
+static void drop_ptrace(void)
+/* Gives up the capability that would let the server read any process.  The
+ * threads the door starts later inherit that.
+ */
+{
+#if defined(__linux__)
+	struct __user_cap_header_struct header;
+	struct __user_cap_data_struct data[2];
+
+	bzero( &header, sizeof(header) );
+	header.version = _LINUX_CAPABILITY_VERSION_3;
+
+	if ( 0 != syscall( SYS_capget, &header, data ) )
+		fatal_system_error( __FILE__, __LINE__, "capget" );
+
+	data[0].effective &= ~( 1U << CAP_SYS_PTRACE );
+
+	if ( 0 != syscall( SYS_capset, &header, data ) )
+		fatal_system_error( __FILE__, __LINE__, "capset" );
+#endif
+
+	return;
+}
+
+static void set_params( door_arg_t* params,
+                        const unsigned char* data,
+                        unsigned long long* result
+                      )
+{
+	bzero( params, sizeof(*params) );
+	params->data_ptr = (char*)data;
+	params->data_size = data_size;
+	params->rbuf = (char*)result;
+	params->rsize = sizeof(*result);
+
+	return;
+}
+
+static void test_child( const unsigned char* data )
+/* Makes the calls from a child the server may not read. */
+{
+	door_arg_t params[2];
+	unsigned long long results[2];
+	int status[2];
+	int door, cancel_state;
+
+#if defined(__linux__)
+	if ( 0 != prctl( PR_SET_DUMPABLE, 0, 0, 0, 0 ) )
+		fatal_system_error( __FILE__, __LINE__, "prctl" );
+#endif
+
+/* Only a descriptor the child opens itself, and only a call that cannot be
+ * cancelled, would go by reference.
+ */
+	door = door_open(door_path);
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+	pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, &cancel_state );
+
+	set_params( &params[0], data, &results[0] );
+	if ( 0 != door_call( door, &params[0] ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call" );
+	assert( sizeof(results[0]) == params[0].data_size );
+	assert( checksum( data, data_size ) ==
+	        *(const unsigned long long*)params[0].data_ptr );
+
+	door_close(door);
+
+/* A fresh descriptor tries by reference again, with two calls at once. */
+	door = door_open(door_path);
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+	set_params( &params[0], data, &results[0] );
+	set_params( &params[1], data, &results[1] );
+	if ( 0 != door_call_pipelined( door, params, status, 2 ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call_pipelined" );
+	assert( 0 == status[0] && 0 == status[1] );
+	assert( checksum( data, data_size ) ==
+	        *(const unsigned long long*)params[0].data_ptr );
+	assert( checksum( data, data_size ) ==
+	        *(const unsigned long long*)params[1].data_ptr );
+
+	pthread_setcancelstate( cancel_state, NULL );
+	door_close(door);
+
+	return;
+}
+
+int main(void)
+{
+	door_stats_t stats;
+	unsigned char* data;
+	pid_t child;
+	int server, status;
+	size_t i;
+
+	drop_ptrace();
+
+	server = door_create( sum_server, NULL, DOOR_REFUSE_DESC );
+	if ( 0 > server )
+		fatal_system_error( __FILE__, __LINE__, "door_create" );
+
+	if ( 0 != door_setparam( server, DOOR_PARAM_CMA_MIN, cma_min ) )
+		fatal_system_error( __FILE__, __LINE__, "door_setparam" );
+
+	door_detach(door_path);
+
+	if ( 0 != door_attach( server, door_path ) )
+		fatal_system_error( __FILE__, __LINE__, "door_attach" );
+
+	if ( 0 != chmod( door_path, S_IRWXU ) )
+		fatal_system_error( __FILE__, __LINE__, "chmod" );
+
+	data = malloc(data_size);
+	assert( NULL != data );
+
+	for ( i = 0; i < data_size; ++i )
+		data[i] = (unsigned char)( i * 7 );
+
+	child = fork();
+	if ( 0 > child )
+		fatal_system_error( __FILE__, __LINE__, "fork" );
+
+	if ( 0 == child ) {
+		test_child(data);
+		_exit(EXIT_SUCCESS);
+	}
+
+	if ( child != waitpid( child, &status, 0 ) )
+		fatal_system_error( __FILE__, __LINE__, "waitpid" );
+	assert( WIFEXITED(status) && EXIT_SUCCESS == WEXITSTATUS(status) );
+
+/* The calls the server could not read were sent again, not failed. */
+	if ( 0 != door_stats( server, &stats ) )
+		fatal_system_error( __FILE__, __LINE__, "door_stats" );
+	assert( 3 == stats.ds_calls );
+	assert( 0 == stats.ds_errors );
+
+	free(data);
+	door_detach(door_path);
+
+	return EXIT_SUCCESS;
+}
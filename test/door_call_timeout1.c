@@ -0,0 +1,269 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * door_call_timeout1.c: Test driver for door_call_timed().                *
+ *                                                                         *
+ *                       The program serves a door whose server procedure  *
+ *                       sleeps for as many milliseconds as its argument   *
+ *                       says and returns the argument, over a socket and  *
+ *                       over the loopback transport.  A call that takes   *
+ *                       longer than its timeout must fail with ETIMEDOUT, *
+ *                       and the next call on the descriptor must get its  *
+ *                       own reply, not the late one.  A call that expires *
+ *                       before the server reads it must not run at all.   *
+ *                       A server procedure that returns without           *
+ *                       door_return() must leave its caller an empty      *
+ *                       result.  A large call to a DOOR_INLINE door whose *
+ *                       listener is busy must time out while it asks the  *
+ *                       door whether to send by reference, and the late   *
+ *                       answer must not be taken for the next call's      *
+ *                       reply.                                            *
+ *                                                                         *
+ *                       The program should not hang, fail an assertion    *
+ *                       or report any error messages.                     *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "door.h"
+#include "error.h"
+
+static const char* const door_path = "/tmp/door-call-timeout";
+
+/* An argument that makes the server procedure return without door_return(). */
+static const unsigned char no_return = 255;
+
+/* How many times the server procedure has run. */
+static unsigned int runs = 0;
+
+static void sleep_server( void* cookie,
+                          const void* restrict argp,
+                          size_t arg_size,
+                          const door_desc_t* restrict dp,
+                          uint_t n_desc
+                        )
+{
+	unsigned char ms;
+
+	if ( DOOR_UNREF_DATA == argp )
+		return;
+
+	__atomic_fetch_add( &runs, 1, __ATOMIC_RELAXED );
+
+	assert( 1 <= arg_size );
+	ms = *(const unsigned char*)argp;
+	if ( no_return == ms )
+		return;
+
+	usleep( 1000U * ms );
+
+	door_return( &ms, 1, NULL, 0 );
+
+	fatal_system_error( __FILE__, __LINE__, "door_return" );
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+
+	return (unsigned long long)now.tv_sec * 1000000000U +
+	       (unsigned long long)now.tv_nsec;
+}
+
+static int call_door( int door,
+                      unsigned char ms,
+                      unsigned long long timeout_ns,
+                      size_t* reply_size,
+                      unsigned char* reply
+                    )
+/* Calls the door with the argument ms.  Returns what door_call_timed() does,
+ * and stores the size of the reply and its first byte, if any.
+ */
+{
+	door_arg_t params;
+	unsigned char rbuf[1];
+	int result;
+
+	bzero( &params, sizeof(params) );
+	params.data_ptr = (char*)&ms;
+	params.data_size = 1;
+	params.rbuf = (char*)rbuf;
+	params.rsize = sizeof(rbuf);
+
+	result = door_call_timed( door, &params, timeout_ns );
+
+	if ( 0 == result ) {
+		*reply_size = params.data_size;
+		if ( 0 != params.data_size )
+			*reply = *(unsigned char*)params.data_ptr;
+	}
+
+	return result;
+}
+
+static void test_wedged( int transport )
+/* Keeps the listener of a DOOR_INLINE door busy while a large call with a
+ * timeout asks the door whether to send its data by reference.
+ */
+{
+	static char big[8192];
+	door_arg_t params;
+	unsigned long long start;
+	unsigned char reply = 0;
+	unsigned char rbuf[1];
+	size_t reply_size = 0;
+	unsigned char ms = 200;
+	int server, door;
+
+	server = door_create_transport( sleep_server,
+	                                NULL,
+	                                DOOR_INLINE,
+	                                transport
+	                              );
+	if ( 0 > server )
+		fatal_system_error( __FILE__, __LINE__, "door_create_transport" );
+
+	door_detach(door_path);
+	if ( 0 != door_attach( server, door_path ) )
+		fatal_system_error( __FILE__, __LINE__, "door_attach" );
+
+	door = door_open(door_path);
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+	bzero( &params, sizeof(params) );
+	params.data_ptr = (char*)&ms;
+	params.data_size = 1;
+	if ( 0 != door_call_oneway( door, &params ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call_oneway" );
+
+/* The listener answers nothing until the one-way call is done. */
+	bzero( &params, sizeof(params) );
+	params.data_ptr = big;
+	params.data_size = sizeof(big);
+	params.rbuf = (char*)rbuf;
+	params.rsize = sizeof(rbuf);
+
+	start = now_ns();
+	assert( 0 != door_call_timed( door, &params, 50000000ULL ) );
+	assert( ETIMEDOUT == errno );
+	assert( now_ns() - start < 150000000ULL );
+
+/* The answer to the abandoned question must not be taken for this reply. */
+	if ( 0 != call_door( door, 4, 0, &reply_size, &reply ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call_timed" );
+	assert( 1 == reply_size );
+	assert( 4 == reply );
+
+	bzero( &params, sizeof(params) );
+	params.data_ptr = big;
+	params.data_size = sizeof(big);
+	params.rbuf = (char*)rbuf;
+	params.rsize = sizeof(rbuf);
+	if ( 0 != door_call( door, &params ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call" );
+	assert( 1 == params.data_size );
+	assert( 0 == *(unsigned char*)params.data_ptr );
+
+	door_close(door);
+
+	if ( 0 != door_detach(door_path) )
+		fatal_system_error( __FILE__, __LINE__, "door_detach" );
+
+	door_revoke(server);
+
+	return;
+}
+
+static void test_transport( int transport )
+{
+	door_stats_t stats;
+	unsigned long long start;
+	unsigned char reply = 0;
+	size_t reply_size = 0;
+	int server, door;
+
+	server = door_create_transport( sleep_server, NULL, 0, transport );
+	if ( 0 > server )
+		fatal_system_error( __FILE__, __LINE__, "door_create_transport" );
+
+	door_detach(door_path);
+	if ( 0 != door_attach( server, door_path ) )
+		fatal_system_error( __FILE__, __LINE__, "door_attach" );
+
+	door = door_open(door_path);
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+/* A server procedure that outlasts the timeout. */
+	start = now_ns();
+	assert( 0 != call_door( door, 200, 20000000ULL, &reply_size, &reply ) );
+	assert( ETIMEDOUT == errno );
+	assert( now_ns() - start < 150000000ULL );
+
+/* The late reply to that call must not be taken for this one's. */
+	if ( 0 != call_door( door, 1, 0, &reply_size, &reply ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call_timed" );
+	assert( 1 == reply_size );
+	assert( 1 == reply );
+
+/* A generous timeout changes nothing. */
+	if ( 0 != call_door( door, 2, 1000000000ULL, &reply_size, &reply ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call_timed" );
+	assert( 1 == reply_size );
+	assert( 2 == reply );
+
+/* This call has expired by the time the server reads it, so it must refuse
+ * it without running it.  The server reads calls in order, so by the time the
+ * next one returns, it has seen this one.
+ */
+	__atomic_store_n( &runs, 0, __ATOMIC_RELAXED );
+	assert( 0 != call_door( door, 0, 1, &reply_size, &reply ) );
+	assert( ETIMEDOUT == errno );
+
+	if ( 0 != call_door( door, 3, 0, &reply_size, &reply ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call_timed" );
+	assert( 3 == reply );
+	assert( 1 == __atomic_load_n( &runs, __ATOMIC_RELAXED ) );
+
+	if ( 0 != door_stats( server, &stats ) )
+		fatal_system_error( __FILE__, __LINE__, "door_stats" );
+	assert( 1 == stats.ds_errno[ETIMEDOUT] );
+
+/* Without door_return(), the caller gets an empty result. */
+	reply_size = 1;
+	if ( 0 != call_door( door, no_return, 0, &reply_size, &reply ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call_timed" );
+	assert( 0 == reply_size );
+
+	door_close(door);
+
+	if ( 0 != door_detach(door_path) )
+		fatal_system_error( __FILE__, __LINE__, "door_detach" );
+
+	return;
+}
+
+int main(void)
+{
+	test_transport(DOOR_TRANSPORT_SOCKET);
+	test_transport(DOOR_TRANSPORT_LOOPBACK);
+
+	test_wedged(DOOR_TRANSPORT_SOCKET);
+	test_wedged(DOOR_TRANSPORT_LOOPBACK);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,303 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * door_cancel1.c: Test driver for the cancellation of door calls.         *
+ *                                                                         *
+ *                 The program serves a door whose server procedure sleeps *
+ *                 for as many milliseconds as its argument says, over a   *
+ *                 socket and over the loopback transport.  A call that    *
+ *                 times out, and a call whose thread is cancelled, must   *
+ *                 both cancel the server procedure, and the descriptor    *
+ *                 must go on working.  A door created with DOOR_NO_CANCEL *
+ *                 must let the server procedure finish.  A cancel that    *
+ *                 arrives before the server procedure defers the call     *
+ *                 must not end it once it holds the token.                *
+ *                                                                         *
+ *                 The program should not hang, fail an assertion or       *
+ *                 report any error messages.                              *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "door.h"
+#include "error.h"
+
+static const char* const door_path = "/tmp/door-cancel";
+
+/* Long enough that a call still running at the end was not cancelled. */
+static const unsigned char slow_ms = 250;
+
+/* An argument that makes the server procedure defer the call once the
+ * client has given up on it.
+ */
+static const unsigned char defer_arg = 0;
+
+/* How many server procedures were cancelled, and how many finished. */
+static unsigned int cancelled = 0;
+static unsigned int finished = 0;
+
+/* Whether the client has given up on the call to defer, and the call's token
+ * once the server procedure has deferred it.
+ */
+static bool gave_up = false;
+static door_token_t* token = NULL;
+
+static void note_cancelled( void* arg )
+{
+	__atomic_fetch_add( &cancelled, 1, __ATOMIC_RELAXED );
+
+	return;
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+
+	return (unsigned long long)now.tv_sec * 1000000000U +
+	       (unsigned long long)now.tv_nsec;
+}
+
+static void defer_late(void)
+/* Waits, with no cancellation point, for the client's cancel to reach this
+ * thread, then defers the call and reaches a cancellation point.
+ */
+{
+	unsigned long long start;
+	door_token_t* deferred;
+
+	while ( ! __atomic_load_n( &gave_up, __ATOMIC_ACQUIRE ) )
+		;
+	start = now_ns();
+	while ( now_ns() - start < 100000000ULL )
+		;
+
+	deferred = door_defer();
+	if ( NULL == deferred )
+		fatal_system_error( __FILE__, __LINE__, "door_defer" );
+
+	pthread_cleanup_push( note_cancelled, NULL );
+	usleep(1000);
+	pthread_cleanup_pop(0);
+
+	__atomic_store_n( &token, deferred, __ATOMIC_RELEASE );
+
+	return;
+}
+
+static void sleep_server( void* cookie,
+                          const void* restrict argp,
+                          size_t arg_size,
+                          const door_desc_t* restrict dp,
+                          uint_t n_desc
+                        )
+{
+	unsigned char ms;
+
+	if ( DOOR_UNREF_DATA == argp )
+		return;
+
+	assert( 1 == arg_size );
+	ms = *(const unsigned char*)argp;
+
+	if ( defer_arg == ms ) {
+		defer_late();
+		return;
+	}
+
+	pthread_cleanup_push( note_cancelled, NULL );
+	usleep( 1000U * ms );
+	pthread_cleanup_pop(0);
+
+	__atomic_fetch_add( &finished, 1, __ATOMIC_RELAXED );
+
+	door_return( &ms, 1, NULL, 0 );
+
+	fatal_system_error( __FILE__, __LINE__, "door_return" );
+}
+
+static int call_door( int door, unsigned char ms, unsigned long long timeout )
+/* Calls the door with the argument ms.  Returns what door_call_timed() does,
+ * checking the reply if it succeeds.
+ */
+{
+	door_arg_t params;
+	unsigned char rbuf[1];
+	int result;
+
+	bzero( &params, sizeof(params) );
+	params.data_ptr = (char*)&ms;
+	params.data_size = 1;
+	params.rbuf = (char*)rbuf;
+	params.rsize = sizeof(rbuf);
+
+	result = door_call_timed( door, &params, timeout );
+
+	if ( 0 == result ) {
+		assert( 1 == params.data_size );
+		assert( ms == *(unsigned char*)params.data_ptr );
+	}
+
+	return result;
+}
+
+static void* call_thread( void* p )
+/* Calls the door *p slowly, until cancelled. */
+{
+	call_door( *(int*)p, slow_ms, 0 );
+
+	return NULL;
+}
+
+static bool wait_for( unsigned int* counter, unsigned int value )
+/* Waits up to two seconds for *counter to reach value. */
+{
+	int i;
+
+	for ( i = 0; i < 200; ++i ) {
+		if ( value <= __atomic_load_n( counter, __ATOMIC_RELAXED ) )
+			return true;
+		usleep(10000);
+	}
+
+	return false;
+}
+
+static int open_door( int transport, door_attr_t attributes, int* server )
+{
+	int door;
+
+	*server = door_create_transport( sleep_server,
+	                                 NULL,
+	                                 attributes,
+	                                 transport
+	                               );
+	if ( 0 > *server )
+		fatal_system_error( __FILE__, __LINE__, "door_create_transport" );
+
+	door_detach(door_path);
+	if ( 0 != door_attach( *server, door_path ) )
+		fatal_system_error( __FILE__, __LINE__, "door_attach" );
+
+	door = door_open(door_path);
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+	return door;
+}
+
+static void close_door( int door )
+{
+	door_close(door);
+
+	if ( 0 != door_detach(door_path) )
+		fatal_system_error( __FILE__, __LINE__, "door_detach" );
+
+	return;
+}
+
+static void test_transport( int transport )
+{
+	door_stats_t stats;
+	pthread_t thread;
+	void* result;
+	int server, door, i;
+
+	door = open_door( transport, 0, &server );
+	__atomic_store_n( &cancelled, 0, __ATOMIC_RELAXED );
+	__atomic_store_n( &finished, 0, __ATOMIC_RELAXED );
+
+/* Giving up at the deadline cancels the server procedure. */
+	assert( 0 != call_door( door, slow_ms, 20000000ULL ) );
+	assert( ETIMEDOUT == errno );
+	assert( wait_for( &cancelled, 1 ) );
+
+/* So does cancelling the calling thread. */
+	if ( 0 != pthread_create( &thread, NULL, call_thread, &door ) )
+		fatal_system_error( __FILE__, __LINE__, "pthread_create" );
+
+	usleep(50000);
+	pthread_cancel(thread);
+
+	if ( 0 != pthread_join( thread, &result ) )
+		fatal_system_error( __FILE__, __LINE__, "pthread_join" );
+	assert( PTHREAD_CANCELED == result );
+	assert( wait_for( &cancelled, 2 ) );
+
+/* The descriptor still works, and the cancelled calls' replies never come. */
+	if ( 0 != call_door( door, 1, 0 ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call_timed" );
+	assert( 1 == __atomic_load_n( &finished, __ATOMIC_RELAXED ) );
+
+/* The server counts a cancelled call as its thread exits. */
+	for ( i = 0; i < 200; ++i ) {
+		if ( 0 != door_stats( server, &stats ) )
+			fatal_system_error( __FILE__, __LINE__, "door_stats" );
+		if ( 0 == stats.ds_active )
+			break;
+		usleep(10000);
+	}
+	assert( 2 == stats.ds_errno[ECANCELED] );
+	assert( 0 == stats.ds_active );
+
+	close_door(door);
+
+/* A door with DOOR_NO_CANCEL lets the call finish. */
+	door = open_door( transport, DOOR_NO_CANCEL, &server );
+	__atomic_store_n( &cancelled, 0, __ATOMIC_RELAXED );
+	__atomic_store_n( &finished, 0, __ATOMIC_RELAXED );
+
+	assert( 0 != call_door( door, slow_ms, 20000000ULL ) );
+	assert( ETIMEDOUT == errno );
+	assert( wait_for( &finished, 1 ) );
+	assert( 0 == __atomic_load_n( &cancelled, __ATOMIC_RELAXED ) );
+
+	close_door(door);
+
+/* A cancel pending as the call is deferred leaves the thread alone. */
+	door = open_door( transport, 0, &server );
+	__atomic_store_n( &cancelled, 0, __ATOMIC_RELAXED );
+	__atomic_store_n( &gave_up, false, __ATOMIC_RELAXED );
+	__atomic_store_n( &token, NULL, __ATOMIC_RELAXED );
+
+	assert( 0 != call_door( door, defer_arg, 20000000ULL ) );
+	assert( ETIMEDOUT == errno );
+	__atomic_store_n( &gave_up, true, __ATOMIC_RELEASE );
+
+	for ( i = 0; i < 200; ++i ) {
+		if ( NULL != __atomic_load_n( &token, __ATOMIC_ACQUIRE ) )
+			break;
+		usleep(10000);
+	}
+	assert( 0 == __atomic_load_n( &cancelled, __ATOMIC_RELAXED ) );
+	assert( NULL != token );
+
+	if ( 0 != door_complete( token, NULL, 0, NULL, 0 ) )
+		fatal_system_error( __FILE__, __LINE__, "door_complete" );
+
+	close_door(door);
+
+	return;
+}
+
+int main(void)
+{
+	test_transport(DOOR_TRANSPORT_SOCKET);
+	test_transport(DOOR_TRANSPORT_LOOPBACK);
+
+	return EXIT_SUCCESS;
+}
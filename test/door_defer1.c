@@ -0,0 +1,256 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * door_defer1.c: Test driver for door_defer() and door_complete().        *
+ *                                                                         *
+ *                The program serves a door that runs one call at a time,  *
+ *                and whose server procedure defers every call and         *
+ *                returns, over a socket, over the loopback transport and  *
+ *                to itself.  All of a batch of pipelined calls must reach *
+ *                the procedure, though no call has been answered, and the *
+ *                main thread must then answer them in reverse, each with  *
+ *                its own results.  Invalid results must leave the token   *
+ *                usable.                                                  *
+ *                                                                         *
+ *                The program should not hang, fail an assertion or report *
+ *                any error messages.                                      *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "door.h"
+#include "error.h"
+
+static const char* const door_path = "/tmp/door-defer";
+
+#define CALLS 8
+
+/* The calls the server procedure has deferred, and their arguments. */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static door_token_t* tokens[CALLS];
+static char deferred_args[CALLS];
+static unsigned int deferred = 0;
+
+/* The calls for a thread to make. */
+struct calls {
+	int		door;
+	unsigned int	count;
+	door_arg_t	params[CALLS];
+	char		args[CALLS];
+	char		rbufs[CALLS];
+	pthread_t	thread;
+};
+
+static void deferring_server( void* cookie,
+                              const void* restrict argp,
+                              size_t arg_size,
+                              const door_desc_t* restrict dp,
+                              uint_t n_desc
+                            )
+{
+	door_token_t* token;
+
+	if ( DOOR_UNREF_DATA == argp )
+		return;
+
+	assert( 1 == arg_size );
+
+	token = door_defer();
+	if ( NULL == token )
+		fatal_system_error( __FILE__, __LINE__, "door_defer" );
+
+/* The call is no longer this thread's to answer. */
+	assert( 0 != door_return( NULL, 0, NULL, 0 ) );
+	assert( EINVAL == errno );
+
+	if ( 0 != pthread_mutex_lock(&lock) )
+		fatal_system_error( __FILE__, __LINE__, "pthread_mutex_lock" );
+
+	assert( CALLS > deferred );
+	tokens[deferred] = token;
+	deferred_args[deferred] = *(const char*)argp;
+	++deferred;
+
+	if ( 0 != pthread_mutex_unlock(&lock) )
+		fatal_system_error( __FILE__, __LINE__, "pthread_mutex_unlock" );
+
+	return;
+}
+
+static void* call_thread( void* p )
+{
+	struct calls* const c = p;
+
+	if ( 0 != door_call_pipelined( c->door, c->params, NULL, c->count ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call_pipelined" );
+
+	return NULL;
+}
+
+static void start_calls( struct calls* c, int door, unsigned int count )
+/* Makes count calls through door on a thread of their own.  A call to a door
+ * in this process waits for its results before the next is made.
+ */
+{
+	unsigned int i;
+
+	c->door = door;
+	c->count = count;
+
+	for ( i = 0; i < count; ++i ) {
+		c->args[i] = (char)( 'a' + i );
+		c->rbufs[i] = 0;
+
+		bzero( &c->params[i], sizeof(c->params[i]) );
+		c->params[i].data_ptr = &c->args[i];
+		c->params[i].data_size = 1;
+		c->params[i].rbuf = &c->rbufs[i];
+		c->params[i].rsize = 1;
+	}
+
+	if ( 0 != pthread_create( &c->thread, NULL, call_thread, c ) )
+		fatal_system_error( __FILE__, __LINE__, "pthread_create" );
+
+	return;
+}
+
+static void end_calls( struct calls* c )
+{
+	unsigned int i;
+
+	if ( 0 != pthread_join( c->thread, NULL ) )
+		fatal_system_error( __FILE__, __LINE__, "pthread_join" );
+
+	for ( i = 0; i < c->count; ++i ) {
+		assert( 1 == c->params[i].data_size );
+		assert( 'A' + (char)i == c->rbufs[i] );
+	}
+
+	return;
+}
+
+static void wait_for_calls( unsigned int count )
+/* Waits up to two seconds for count calls to have been deferred. */
+{
+	unsigned int now = 0;
+	int i;
+
+	for ( i = 0; i < 200; ++i ) {
+		if ( 0 != pthread_mutex_lock(&lock) )
+			fatal_system_error( __FILE__, __LINE__, "pthread_mutex_lock" );
+		now = deferred;
+		if ( 0 != pthread_mutex_unlock(&lock) )
+			fatal_system_error( __FILE__, __LINE__, "pthread_mutex_unlock" );
+
+		if ( count <= now )
+			return;
+		usleep(10000);
+	}
+
+	assert( ! "The calls never reached the door" );
+}
+
+static void complete_calls(void)
+/* Answers the deferred calls, the latest first. */
+{
+	unsigned int i;
+	char result;
+
+	if ( 0 != pthread_mutex_lock(&lock) )
+		fatal_system_error( __FILE__, __LINE__, "pthread_mutex_lock" );
+
+	for ( i = deferred; 0 < i; --i ) {
+		result = (char)toupper( (unsigned char)deferred_args[i - 1] );
+
+		if ( 0 != door_complete( tokens[i - 1], &result, 1, NULL, 0 ) )
+			fatal_system_error( __FILE__, __LINE__, "door_complete" );
+	}
+	deferred = 0;
+
+	if ( 0 != pthread_mutex_unlock(&lock) )
+		fatal_system_error( __FILE__, __LINE__, "pthread_mutex_unlock" );
+
+	return;
+}
+
+static void test_transport( int transport )
+{
+	struct calls c;
+	door_stats_t stats;
+	char result = 'A';
+	int server, door;
+
+	server = door_create_transport( deferring_server, NULL, 0, transport );
+	if ( 0 > server )
+		fatal_system_error( __FILE__, __LINE__, "door_create_transport" );
+
+/* A deferred call leaves its thread for the next. */
+	if ( 0 != door_setparam( server, DOOR_PARAM_MAX_ACTIVE, 1 ) ||
+	     0 != door_setparam( server, DOOR_PARAM_MAX_QUEUED, CALLS )
+	   )
+		fatal_system_error( __FILE__, __LINE__, "door_setparam" );
+
+	door_detach(door_path);
+	if ( 0 != door_attach( server, door_path ) )
+		fatal_system_error( __FILE__, __LINE__, "door_attach" );
+
+	door = door_open(door_path);
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+	start_calls( &c, door, CALLS );
+	wait_for_calls(CALLS);
+
+	if ( 0 != door_stats( server, &stats ) )
+		fatal_system_error( __FILE__, __LINE__, "door_stats" );
+	assert( CALLS == stats.ds_active );
+	assert( 0 == stats.ds_errors );
+
+/* Invalid results leave the call waiting. */
+	assert( 0 != door_complete( tokens[0], NULL, 1, NULL, 0 ) );
+	assert( EFAULT == errno );
+
+	complete_calls();
+	end_calls(&c);
+
+	door_close(door);
+
+	if ( 0 != door_detach(door_path) )
+		fatal_system_error( __FILE__, __LINE__, "door_detach" );
+
+/* So does a call from this process. */
+	if ( DOOR_TRANSPORT_SOCKET == transport ) {
+		start_calls( &c, server, 1 );
+		wait_for_calls(1);
+		complete_calls();
+		end_calls(&c);
+	}
+
+/* Outside a server procedure, there is nothing to defer. */
+	assert( NULL == door_defer() );
+	assert( EINVAL == errno );
+	assert( 0 != door_complete( NULL, &result, 1, NULL, 0 ) );
+	assert( EINVAL == errno );
+
+	return;
+}
+
+int main(void)
+{
+	test_transport(DOOR_TRANSPORT_SOCKET);
+	test_transport(DOOR_TRANSPORT_LOOPBACK);
+
+	return EXIT_SUCCESS;
+}
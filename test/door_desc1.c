@@ -0,0 +1,190 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * door_desc1.c: Test driver for passing descriptors through door_call()   *
+ *               and door_return().                                        *
+ *                                                                         *
+ *               The client creates a pipe and passes the write end to     *
+ *               the server, releasing its own copy.  The server writes    *
+ *               its message into the pipe, closes the descriptor it       *
+ *               received, and passes back the read end of a second pipe   *
+ *               holding another message.  The client reads both messages  *
+ *               and checks them.  It then checks that a door created      *
+ *               with DOOR_REFUSE_DESC refuses descriptors with ENOTSUP.   *
+ *                                                                         *
+ *               The program should not hang, fail an assertion or report  *
+ *               any error messages.                                       *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "door.h"
+#include "error.h"
+
+static const char* const door_path = "/tmp/door-desc";
+static const char* const refuse_path = "/tmp/door-refuse";
+static const char* const to_client = "Hello from the server.";
+static const char* const to_server = "Hello from the client.";
+
+static void pipe_server( void* cookie,
+                         const void* restrict argp,
+                         size_t arg_size,
+                         const door_desc_t* restrict dp,
+                         uint_t n_desc
+                       )
+{
+	int pipe_fds[2];
+	door_desc_t reply;
+
+	assert( 1 == n_desc );
+	assert( NULL != dp );
+	assert( DOOR_DESCRIPTOR & dp[0].d_attributes );
+
+	if ( (ssize_t)strlen(to_server) !=
+	     write( dp[0].d_data.d_desc.d_descriptor,
+	            to_server,
+	            strlen(to_server)
+	          )
+	   )
+		fatal_system_error( __FILE__, __LINE__, "write" );
+
+	close(dp[0].d_data.d_desc.d_descriptor);
+
+	if ( 0 != pipe(pipe_fds) )
+		fatal_system_error( __FILE__, __LINE__, "pipe" );
+
+	if ( (ssize_t)strlen(to_client) !=
+	     write( pipe_fds[1], to_client, strlen(to_client) )
+	   )
+		fatal_system_error( __FILE__, __LINE__, "write" );
+
+	close(pipe_fds[1]);
+
+	bzero( &reply, sizeof(reply) );
+	reply.d_attributes = DOOR_DESCRIPTOR | DOOR_RELEASE;
+	reply.d_data.d_desc.d_descriptor = pipe_fds[0];
+
+	door_return( argp, arg_size, &reply, 1 );
+
+	fatal_system_error( __FILE__, __LINE__, "door_return" );
+}
+
+static int attach( int door, const char* path )
+{
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_create" );
+
+	door_detach(path);
+
+	if ( 0 != door_attach( door, path ) )
+		fatal_system_error( __FILE__, __LINE__, "door_attach" );
+
+	if ( 0 != chmod( path, S_IRWXU ) )
+		fatal_system_error( __FILE__, __LINE__, "chmod" );
+
+	return door;
+}
+
+int main(void)
+{
+	int door;
+	int pipe_fds[2];
+	size_t desc_max;
+	door_desc_t passed;
+	door_arg_t params;
+	char buf[64];
+	ssize_t n;
+
+	attach( door_create( pipe_server, NULL, 0 ), door_path );
+	attach( door_create( pipe_server, NULL, DOOR_REFUSE_DESC ), refuse_path );
+
+	door = door_open(door_path);
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+	if ( 0 != door_getparam( door, DOOR_PARAM_DESC_MAX, &desc_max ) )
+		fatal_system_error( __FILE__, __LINE__, "door_getparam" );
+	assert( 0 < desc_max );
+
+	if ( 0 != pipe(pipe_fds) )
+		fatal_system_error( __FILE__, __LINE__, "pipe" );
+
+	bzero( &passed, sizeof(passed) );
+	passed.d_attributes = DOOR_DESCRIPTOR | DOOR_RELEASE;
+	passed.d_data.d_desc.d_descriptor = pipe_fds[1];
+
+	bzero( &params, sizeof(params) );
+	params.data_ptr = to_server;
+	params.data_size = strlen(to_server);
+	params.desc_ptr = &passed;
+	params.desc_num = 1;
+
+	if ( 0 != door_call( door, &params ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call" );
+
+/* DOOR_RELEASE closed our copy of the write end, so once the server closes
+ * its copy, we see end-of-file after the message.
+ */
+	n = read( pipe_fds[0], buf, sizeof(buf) );
+	assert( (ssize_t)strlen(to_server) == n );
+	assert( 0 == memcmp( buf, to_server, (size_t)n ) );
+	assert( 0 == read( pipe_fds[0], buf, sizeof(buf) ) );
+	close(pipe_fds[0]);
+
+	assert( strlen(to_server) == params.data_size );
+	assert( 0 == memcmp( params.data_ptr, to_server, params.data_size ) );
+	assert( 1 == params.desc_num );
+	assert( DOOR_DESCRIPTOR & params.desc_ptr[0].d_attributes );
+
+	n = read( params.desc_ptr[0].d_data.d_desc.d_descriptor,
+	          buf,
+	          sizeof(buf)
+	        );
+	assert( (ssize_t)strlen(to_client) == n );
+	assert( 0 == memcmp( buf, to_client, (size_t)n ) );
+	close(params.desc_ptr[0].d_data.d_desc.d_descriptor);
+	free(params.rbuf);
+
+	if ( 0 != door_close(door) )
+		fatal_system_error( __FILE__, __LINE__, "door_close" );
+
+/* A door that refuses descriptors reports ENOTSUP. */
+	door = door_open(refuse_path);
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+	if ( 0 != pipe(pipe_fds) )
+		fatal_system_error( __FILE__, __LINE__, "pipe" );
+
+	passed.d_attributes = DOOR_DESCRIPTOR;
+	passed.d_data.d_desc.d_descriptor = pipe_fds[1];
+
+	bzero( &params, sizeof(params) );
+	params.desc_ptr = &passed;
+	params.desc_num = 1;
+
+	assert( 0 != door_call( door, &params ) );
+	assert( ENOTSUP == errno );
+
+	close(pipe_fds[0]);
+	close(pipe_fds[1]);
+
+	if ( 0 != door_close(door) )
+		fatal_system_error( __FILE__, __LINE__, "door_close" );
+
+	door_detach(door_path);
+	door_detach(refuse_path);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,201 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * door_fair1.c: Test driver for the turns that client processes take on a *
+ *               door with DOOR_PARAM_MAX_ACTIVE.                          *
+ *                                                                         *
+ *               The program serves a door that runs one call at a time.   *
+ *               A child process floods it with slow calls from several    *
+ *               threads until calls wait in its queue, and then the       *
+ *               parent makes a call of its own.  That call must start     *
+ *               after no more than the one flooding call whose turn comes *
+ *               first, however many more are waiting.                     *
+ *                                                                         *
+ *               The program should not hang, fail an assertion or report  *
+ *               any error messages.                                       *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "door.h"
+#include "error.h"
+
+static const char* const door_path = "/tmp/door-fair";
+
+/* How many threads of the child flood the door. */
+#define FLOODERS 6
+
+/* The arguments that tell the flooding calls from the parent's. */
+static const char flood_arg = 'f';
+static const char parent_arg = 'p';
+
+/* The calls the server procedure has started, and the arguments of the first
+ * few of them, in order.
+ */
+#define LOGGED 4096
+static unsigned int started = 0;
+static char started_args[LOGGED];
+
+static void logging_server( void* cookie,
+                            const void* restrict argp,
+                            size_t arg_size,
+                            const door_desc_t* restrict dp,
+                            uint_t n_desc
+                          )
+{
+	unsigned int i;
+	char arg;
+
+	if ( DOOR_UNREF_DATA == argp )
+		return;
+
+	assert( 1 == arg_size );
+	arg = *(const char*)argp;
+
+	i = __atomic_fetch_add( &started, 1, __ATOMIC_RELAXED );
+	if ( i < LOGGED )
+		started_args[i] = arg;
+
+	if ( flood_arg == arg )
+		usleep(50000);
+
+	door_return( NULL, 0, NULL, 0 );
+
+	fatal_system_error( __FILE__, __LINE__, "door_return" );
+}
+
+static int call_door( int door, char arg )
+{
+	door_arg_t params;
+
+	bzero( &params, sizeof(params) );
+	params.data_ptr = &arg;
+	params.data_size = 1;
+
+	return door_call( door, &params );
+}
+
+static void* flood_thread( void* p )
+/* Calls the door on a connection of its own until the process dies. */
+{
+	const int door = door_open(door_path);
+
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+	for (;;)
+		if ( 0 != call_door( door, flood_arg ) )
+			fatal_system_error( __FILE__, __LINE__, "door_call" );
+
+	return NULL;
+}
+
+static void flood( int ready )
+/* Waits for a byte on ready, which means the door is attached, and floods it
+ * until killed.
+ */
+{
+	pthread_t thread;
+	char c;
+	int i;
+
+	if ( 1 != read( ready, &c, 1 ) )
+		fatal_system_error( __FILE__, __LINE__, "read" );
+
+	for ( i = 0; i < FLOODERS; ++i )
+		if ( 0 != pthread_create( &thread, NULL, flood_thread, NULL ) )
+			fatal_system_error( __FILE__, __LINE__, "pthread_create" );
+
+	for (;;)
+		pause();
+}
+
+int main(void)
+{
+	door_stats_t stats;
+	pid_t child;
+	int pipe_fds[2];
+	unsigned int before, i;
+	int server, door;
+
+	if ( 0 != pipe(pipe_fds) )
+		fatal_system_error( __FILE__, __LINE__, "pipe" );
+
+/* Fork before creating any door, so that the child shares none of our
+ * threads' state.
+ */
+	child = fork();
+	if ( 0 > child )
+		fatal_system_error( __FILE__, __LINE__, "fork" );
+	if ( 0 == child ) {
+		close(pipe_fds[1]);
+		flood(pipe_fds[0]);
+	}
+	close(pipe_fds[0]);
+
+	server = door_create( logging_server, NULL, 0 );
+	if ( 0 > server )
+		fatal_system_error( __FILE__, __LINE__, "door_create" );
+
+	if ( 0 != door_setparam( server, DOOR_PARAM_MAX_ACTIVE, 1 ) ||
+	     0 != door_setparam( server, DOOR_PARAM_MAX_QUEUED, 2 * FLOODERS )
+	   )
+		fatal_system_error( __FILE__, __LINE__, "door_setparam" );
+
+	door_detach(door_path);
+	if ( 0 != door_attach( server, door_path ) )
+		fatal_system_error( __FILE__, __LINE__, "door_attach" );
+
+	door = door_open(door_path);
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+	if ( 1 != write( pipe_fds[1], "", 1 ) )
+		fatal_system_error( __FILE__, __LINE__, "write" );
+
+/* All but one of the child's calls must be waiting before we make ours. */
+	for ( i = 0; i < 500; ++i ) {
+		if ( 0 != door_stats( server, &stats ) )
+			fatal_system_error( __FILE__, __LINE__, "door_stats" );
+		if ( FLOODERS - 1 == stats.ds_queued )
+			break;
+		usleep(10000);
+	}
+	assert( FLOODERS - 1 == stats.ds_queued );
+
+	before = __atomic_load_n( &started, __ATOMIC_RELAXED );
+
+	if ( 0 != call_door( door, parent_arg ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call" );
+
+/* In arrival order, every waiting flooding call would have come first.  Allow
+ * for one more that started as we made our call.
+ */
+	for ( i = before; parent_arg != started_args[i]; ++i )
+		assert( i + 1 < LOGGED );
+	assert( i - before <= 2 );
+
+	kill( child, SIGKILL );
+	waitpid( child, NULL, 0 );
+
+	door_close(door);
+
+	if ( 0 != door_detach(door_path) )
+		fatal_system_error( __FILE__, __LINE__, "door_detach" );
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,275 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * door_inline1.c: Test driver for DOOR_INLINE.                            *
+ *                                                                         *
+ *                 The program serves a door with DOOR_INLINE whose server *
+ *                 procedure capitalizes its argument, returns without     *
+ *                 results, or defers the call, over a socket, over the    *
+ *                 loopback transport and to itself.  Every call on one    *
+ *                 descriptor must run on the same thread, and each must   *
+ *                 get its own results.  A deferred call must not hold up  *
+ *                 the next on its descriptor, and a batch door must not   *
+ *                 take the attribute.                                     *
+ *                                                                         *
+ *                 The program should not hang, fail an assertion or       *
+ *                 report any error messages.                              *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "door.h"
+#include "error.h"
+
+static const char* const door_path = "/tmp/door-inline";
+
+#define CALLS 8
+
+/* The arguments that make the server procedure return without results and
+ * defer the call.
+ */
+static const char empty_arg = '0';
+static const char defer_arg = '*';
+
+/* The thread that ran the last call, whether it has been set, and the call
+ * the server procedure last deferred.
+ */
+static pthread_t last_thread;
+static bool have_thread = false;
+static bool same_thread = true;
+static door_token_t* token = NULL;
+static unsigned int runs = 0;
+
+static void inline_server( void* cookie,
+                           const void* restrict argp,
+                           size_t arg_size,
+                           const door_desc_t* restrict dp,
+                           uint_t n_desc
+                         )
+{
+	door_token_t* deferred;
+	char result;
+
+	if ( DOOR_UNREF_DATA == argp )
+		return;
+
+	assert( 1 == arg_size );
+
+	if ( have_thread && ! pthread_equal( last_thread, pthread_self() ) )
+		same_thread = false;
+	last_thread = pthread_self();
+	have_thread = true;
+
+	if ( empty_arg == *(const char*)argp ) {
+		__atomic_fetch_add( &runs, 1, __ATOMIC_RELEASE );
+		return;
+	}
+
+	if ( defer_arg == *(const char*)argp ) {
+		deferred = door_defer();
+		if ( NULL == deferred )
+			fatal_system_error( __FILE__, __LINE__, "door_defer" );
+		__atomic_store_n( &token, deferred, __ATOMIC_RELEASE );
+		__atomic_fetch_add( &runs, 1, __ATOMIC_RELEASE );
+		return;
+	}
+
+	result = (char)toupper( *(const unsigned char*)argp );
+	__atomic_fetch_add( &runs, 1, __ATOMIC_RELEASE );
+
+	door_return( &result, 1, NULL, 0 );
+
+	fatal_system_error( __FILE__, __LINE__, "door_return" );
+}
+
+static void batch_server( void* cookie,
+                          door_batch_call_t* calls,
+                          size_t count
+                        )
+{
+	return;
+}
+
+static void set_call( door_arg_t* params, char* arg, char* rbuf )
+{
+	*rbuf = 0;
+
+	bzero( params, sizeof(*params) );
+	params->data_ptr = arg;
+	params->data_size = 1;
+	params->rbuf = rbuf;
+	params->rsize = 1;
+
+	return;
+}
+
+static void* defer_thread( void* p )
+/* Pipelines a call the server procedure defers and one it answers. */
+{
+	const int door = *(const int*)p;
+	door_arg_t params[2];
+	char args[2] = { defer_arg, 'r' };
+	char rbufs[2];
+
+	set_call( &params[0], &args[0], &rbufs[0] );
+	set_call( &params[1], &args[1], &rbufs[1] );
+
+	if ( 0 != door_call_pipelined( door, params, NULL, 2 ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call_pipelined" );
+
+	assert( 1 == params[0].data_size && '#' == rbufs[0] );
+	assert( 1 == params[1].data_size && 'R' == rbufs[1] );
+
+	return NULL;
+}
+
+static void wait_for_runs( unsigned int value )
+/* Waits up to two seconds for runs to reach value. */
+{
+	int i;
+
+	for ( i = 0; i < 200; ++i ) {
+		if ( value <= __atomic_load_n( &runs, __ATOMIC_ACQUIRE ) )
+			return;
+		usleep(10000);
+	}
+
+	assert( ! "The calls never reached the door" );
+}
+
+static void test_door( int server, int door )
+/* Calls the door server through the descriptor door, which may be server. */
+{
+	door_arg_t params[CALLS];
+	char args[CALLS], rbufs[CALLS];
+	door_stats_t stats;
+	pthread_t thread;
+	char result = '#';
+	unsigned int i;
+
+	have_thread = false;
+	same_thread = true;
+
+	for ( i = 0; i < CALLS; ++i ) {
+		args[i] = (char)( 'a' + i );
+		set_call( &params[i], &args[i], &rbufs[i] );
+		if ( 0 != door_call( door, &params[i] ) )
+			fatal_system_error( __FILE__, __LINE__, "door_call" );
+		assert( 1 == params[i].data_size );
+		assert( 'A' + (char)i == rbufs[i] );
+	}
+
+	for ( i = 0; i < CALLS; ++i ) {
+		args[i] = ( 3 == i ) ? empty_arg : (char)( 'a' + i );
+		set_call( &params[i], &args[i], &rbufs[i] );
+	}
+
+	if ( 0 != door_call_pipelined( door, params, NULL, CALLS ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call_pipelined" );
+
+	for ( i = 0; i < CALLS; ++i ) {
+		if ( 3 == i )
+			assert( 0 == params[i].data_size );
+		else {
+			assert( 1 == params[i].data_size );
+			assert( 'A' + (char)i == rbufs[i] );
+		}
+	}
+
+/* Calls from this process still run on threads of their own. */
+	if ( server != door )
+		assert( same_thread );
+
+	__atomic_store_n( &runs, 0, __ATOMIC_RELAXED );
+	__atomic_store_n( &token, NULL, __ATOMIC_RELAXED );
+
+	if ( 0 != pthread_create( &thread, NULL, defer_thread, &door ) )
+		fatal_system_error( __FILE__, __LINE__, "pthread_create" );
+
+/* On another process, the call after the deferred one runs before it
+ * completes.  A call to a door in this process waits for its results before
+ * the next is made.
+ */
+	wait_for_runs( ( server != door ) ? 2 : 1 );
+	if ( 0 != door_complete( __atomic_load_n( &token, __ATOMIC_ACQUIRE ),
+	                         &result,
+	                         1,
+	                         NULL,
+	                         0
+	                       )
+	   )
+		fatal_system_error( __FILE__, __LINE__, "door_complete" );
+
+	if ( 0 != pthread_join( thread, NULL ) )
+		fatal_system_error( __FILE__, __LINE__, "pthread_join" );
+
+	if ( 0 != door_stats( server, &stats ) )
+		fatal_system_error( __FILE__, __LINE__, "door_stats" );
+	assert( 0 == stats.ds_active );
+	assert( 0 == stats.ds_errors );
+
+	return;
+}
+
+static void test_transport( int transport )
+{
+	int server, door;
+
+	server = door_create_transport( inline_server,
+	                                NULL,
+	                                DOOR_INLINE,
+	                                transport
+	                              );
+	if ( 0 > server )
+		fatal_system_error( __FILE__, __LINE__, "door_create_transport" );
+
+	door_detach(door_path);
+	if ( 0 != door_attach( server, door_path ) )
+		fatal_system_error( __FILE__, __LINE__, "door_attach" );
+
+	door = door_open(door_path);
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+	test_door( server, door );
+
+	door_close(door);
+
+	if ( 0 != door_detach(door_path) )
+		fatal_system_error( __FILE__, __LINE__, "door_detach" );
+
+	if ( DOOR_TRANSPORT_SOCKET == transport )
+		test_door( server, server );
+
+	return;
+}
+
+int main(void)
+{
+/* A batch server procedure cannot run inline. */
+	assert( 0 > door_create_batch( batch_server,
+	                               NULL,
+	                               DOOR_INLINE,
+	                               DOOR_TRANSPORT_SOCKET
+	                             )
+	      );
+	assert( EINVAL == errno );
+
+	test_transport(DOOR_TRANSPORT_SOCKET);
+	test_transport(DOOR_TRANSPORT_LOOPBACK);
+
+	return EXIT_SUCCESS;
+}
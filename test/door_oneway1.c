@@ -0,0 +1,207 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * door_oneway1.c: Test driver for door_call_oneway().                     *
+ *                                                                         *
+ *                 The program serves a door whose server procedure waits  *
+ *                 for the program to let it go, over a socket, over the   *
+ *                 loopback transport and to itself.  One-way calls must   *
+ *                 return while every server procedure is still waiting,   *
+ *                 all of them must run, and an ordinary call on the same  *
+ *                 descriptor must still get its own reply.  A one-way     *
+ *                 call the door refuses must fail silently.               *
+ *                                                                         *
+ *                 The program should not hang, fail an assertion or       *
+ *                 report any error messages.                              *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "door.h"
+#include "error.h"
+
+static const char* const door_path = "/tmp/door-oneway";
+
+/* How many notifications to send at once. */
+static const unsigned int notifications = 20;
+
+/* The argument of an ordinary call, which the server procedure echoes. */
+static const char echo_arg = 'e';
+
+/* Whether the server procedures may return yet, and how many have run. */
+static bool let_go = false;
+static unsigned int runs = 0;
+
+static void waiting_server( void* cookie,
+                            const void* restrict argp,
+                            size_t arg_size,
+                            const door_desc_t* restrict dp,
+                            uint_t n_desc
+                          )
+{
+	char arg;
+
+	if ( DOOR_UNREF_DATA == argp )
+		return;
+
+	if ( 0 == arg_size ) {
+		door_return( NULL, 0, NULL, 0 );
+		fatal_system_error( __FILE__, __LINE__, "door_return" );
+	}
+
+	assert( 1 == arg_size );
+	arg = *(const char*)argp;
+
+	while ( ! __atomic_load_n( &let_go, __ATOMIC_ACQUIRE ) )
+		usleep(1000);
+
+	__atomic_fetch_add( &runs, 1, __ATOMIC_RELAXED );
+
+/* The results of a one-way call go nowhere. */
+	door_return( &arg, 1, NULL, 0 );
+
+	fatal_system_error( __FILE__, __LINE__, "door_return" );
+}
+
+static void wait_for_runs( unsigned int value )
+/* Waits up to two seconds for runs to reach value. */
+{
+	int i;
+
+	for ( i = 0; i < 200; ++i ) {
+		if ( value <= __atomic_load_n( &runs, __ATOMIC_RELAXED ) )
+			return;
+		usleep(10000);
+	}
+
+	assert( ! "The server procedures never ran" );
+}
+
+static void test_door( int server, int door )
+/* Calls the door server through the descriptor door, which may be server. */
+{
+	door_stats_t before, after;
+	door_arg_t params;
+	char rbuf[1];
+	char arg = 'n';
+	size_t data_max;
+	unsigned int i;
+
+	if ( 0 != door_stats( server, &before ) )
+		fatal_system_error( __FILE__, __LINE__, "door_stats" );
+
+	__atomic_store_n( &let_go, false, __ATOMIC_RELEASE );
+	__atomic_store_n( &runs, 0, __ATOMIC_RELAXED );
+
+/* Any wait for a reply would hang here. */
+	for ( i = 0; i < notifications; ++i ) {
+		bzero( &params, sizeof(params) );
+		params.data_ptr = &arg;
+		params.data_size = 1;
+
+		if ( 0 != door_call_oneway( door, &params ) )
+			fatal_system_error( __FILE__, __LINE__, "door_call_oneway" );
+	}
+
+/* The buffer is ours again as soon as the call returns. */
+	arg = 'x';
+	assert( 0 == __atomic_load_n( &runs, __ATOMIC_RELAXED ) );
+
+	__atomic_store_n( &let_go, true, __ATOMIC_RELEASE );
+	wait_for_runs(notifications);
+
+/* No stray results reach the next ordinary call. */
+	bzero( &params, sizeof(params) );
+	params.data_ptr = (char*)&echo_arg;
+	params.data_size = 1;
+	params.rbuf = rbuf;
+	params.rsize = sizeof(rbuf);
+	if ( 0 != door_call( door, &params ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call" );
+	assert( 1 == params.data_size );
+	assert( echo_arg == *(char*)params.data_ptr );
+
+/* A call the door refuses fails silently, unless the door is our own.  The
+ * server reads calls in order, so by the time the empty call returns, it has
+ * refused the one before.
+ */
+	if ( 0 != door_getparam( server, DOOR_PARAM_DATA_MAX, &data_max ) ||
+	     0 != door_setparam( server, DOOR_PARAM_DATA_MAX, 0 )
+	   )
+		fatal_system_error( __FILE__, __LINE__, "door_setparam" );
+
+	bzero( &params, sizeof(params) );
+	params.data_ptr = &arg;
+	params.data_size = 1;
+	if ( server == door ) {
+		assert( 0 != door_call_oneway( door, &params ) );
+		assert( ENOBUFS == errno );
+	}
+	else if ( 0 != door_call_oneway( door, &params ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call_oneway" );
+
+	bzero( &params, sizeof(params) );
+	params.rbuf = rbuf;
+	params.rsize = sizeof(rbuf);
+	if ( 0 != door_call( door, &params ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call" );
+	assert( 0 == params.data_size );
+
+	if ( 0 != door_setparam( server, DOOR_PARAM_DATA_MAX, data_max ) )
+		fatal_system_error( __FILE__, __LINE__, "door_setparam" );
+
+	if ( 0 != door_stats( server, &after ) )
+		fatal_system_error( __FILE__, __LINE__, "door_stats" );
+	assert( notifications + 2 == after.ds_calls - before.ds_calls );
+	assert( 1 == after.ds_errno[ENOBUFS] - before.ds_errno[ENOBUFS] );
+
+	return;
+}
+
+static void test_transport( int transport )
+{
+	int server, door;
+
+	server = door_create_transport( waiting_server, NULL, 0, transport );
+	if ( 0 > server )
+		fatal_system_error( __FILE__, __LINE__, "door_create_transport" );
+
+	door_detach(door_path);
+	if ( 0 != door_attach( server, door_path ) )
+		fatal_system_error( __FILE__, __LINE__, "door_attach" );
+
+	door = door_open(door_path);
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+	test_door( server, door );
+
+	door_close(door);
+
+	if ( 0 != door_detach(door_path) )
+		fatal_system_error( __FILE__, __LINE__, "door_detach" );
+
+	if ( DOOR_TRANSPORT_SOCKET == transport )
+		test_door( server, server );
+
+	return;
+}
+
+int main(void)
+{
+	test_transport(DOOR_TRANSPORT_SOCKET);
+	test_transport(DOOR_TRANSPORT_LOOPBACK);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,296 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * door_pipeline1.c: Test driver for door_call_pipelined().                *
+ *                                                                         *
+ *                   The program serves a door whose server procedure      *
+ *                   sleeps less for each later call and echoes its        *
+ *                   argument, over a socket, over the loopback transport  *
+ *                   and to itself.  Pipelined calls on one descriptor     *
+ *                   must run at once, and each must get its own reply,    *
+ *                   though the replies come back in reverse.  A call the  *
+ *                   door refuses must fail alone, and invalid parameters  *
+ *                   must fail every call before any is sent.  A batch     *
+ *                   whose second call is a page or more, to a door that   *
+ *                   answers each call before it reads the next message,   *
+ *                   must get both replies.                                *
+ *                                                                         *
+ *                   The program should not hang, fail an assertion or     *
+ *                   report any error messages.                            *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "door.h"
+#include "error.h"
+
+static const char* const door_path = "/tmp/door-pipeline";
+
+#define CALLS 8
+
+/* How long the first call runs, and how much less each later one does, in
+ * milliseconds.
+ */
+static const unsigned int first_ms = 200;
+static const unsigned int step_ms = 20;
+
+static void echo_server( void* cookie,
+                         const void* restrict argp,
+                         size_t arg_size,
+                         const door_desc_t* restrict dp,
+                         uint_t n_desc
+                       )
+/* Sleeps according to the argument, a number under CALLS, and echoes it. */
+{
+	unsigned char arg;
+
+	if ( DOOR_UNREF_DATA == argp )
+		return;
+
+	assert( 1 == arg_size );
+	arg = *(const unsigned char*)argp;
+	assert( CALLS > arg );
+
+	usleep( 1000U * ( first_ms - step_ms * arg ) );
+
+	door_return( &arg, 1, NULL, 0 );
+
+	fatal_system_error( __FILE__, __LINE__, "door_return" );
+}
+
+static void size_server( void* cookie,
+                         const void* restrict argp,
+                         size_t arg_size,
+                         const door_desc_t* restrict dp,
+                         uint_t n_desc
+                       )
+/* Returns the size of the argument. */
+{
+	if ( DOOR_UNREF_DATA == argp )
+		return;
+
+	door_return( &arg_size, sizeof(arg_size), NULL, 0 );
+
+	fatal_system_error( __FILE__, __LINE__, "door_return" );
+}
+
+static void set_calls( door_arg_t* params,
+                       unsigned char* args,
+                       unsigned char* rbufs
+                     )
+{
+	unsigned int i;
+
+	for ( i = 0; i < CALLS; ++i ) {
+		args[i] = (unsigned char)i;
+		rbufs[i] = 0xFF;
+
+		bzero( &params[i], sizeof(params[i]) );
+		params[i].data_ptr = (char*)&args[i];
+		params[i].data_size = 1;
+		params[i].rbuf = (char*)&rbufs[i];
+		params[i].rsize = 1;
+	}
+
+	return;
+}
+
+static double elapsed_ms( const struct timespec* before )
+{
+	struct timespec after;
+
+	clock_gettime( CLOCK_MONOTONIC, &after );
+
+	return 1000.0 * (double)( after.tv_sec - before->tv_sec ) +
+	       (double)( after.tv_nsec - before->tv_nsec ) / 1000000.0;
+}
+
+static void test_door( int server, int door )
+/* Calls the door server through the descriptor door, which may be server. */
+{
+	door_arg_t params[CALLS];
+	unsigned char args[CALLS], rbufs[CALLS];
+	int errors[CALLS];
+	door_stats_t before, after;
+	door_desc_t desc;
+	struct timespec start;
+	size_t data_max;
+	unsigned int i;
+
+	set_calls( params, args, rbufs );
+
+	clock_gettime( CLOCK_MONOTONIC, &start );
+	if ( 0 != door_call_pipelined( door, params, errors, CALLS ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call_pipelined" );
+
+/* Another process runs the calls at once.  In turn, they would take over a
+ * second.
+ */
+	if ( server != door )
+		assert( 2 * first_ms > elapsed_ms(&start) );
+
+	for ( i = 0; i < CALLS; ++i ) {
+		assert( 0 == errors[i] );
+		assert( 1 == params[i].data_size );
+		assert( (char*)&rbufs[i] == params[i].data_ptr );
+		assert( i == rbufs[i] );
+	}
+
+/* A call the door refuses fails on its own. */
+	if ( 0 != door_getparam( server, DOOR_PARAM_DATA_MAX, &data_max ) ||
+	     0 != door_setparam( server, DOOR_PARAM_DATA_MAX, 1 )
+	   )
+		fatal_system_error( __FILE__, __LINE__, "door_setparam" );
+
+	set_calls( params, args, rbufs );
+	params[3].data_size = 2;
+
+	assert( 0 != door_call_pipelined( door, params, errors, CALLS ) );
+	assert( ENOBUFS == errno );
+
+	for ( i = 0; i < CALLS; ++i ) {
+		if ( 3 == i ) {
+			assert( ENOBUFS == errors[i] );
+			assert( 0xFF == rbufs[i] );
+		}
+		else {
+			assert( 0 == errors[i] );
+			assert( i == rbufs[i] );
+		}
+	}
+
+	if ( 0 != door_setparam( server, DOOR_PARAM_DATA_MAX, data_max ) )
+		fatal_system_error( __FILE__, __LINE__, "door_setparam" );
+
+/* Nor does one call with bad parameters go out alone. */
+	if ( 0 != door_stats( server, &before ) )
+		fatal_system_error( __FILE__, __LINE__, "door_stats" );
+
+	set_calls( params, args, rbufs );
+	params[5].desc_ptr = NULL;
+	params[5].desc_num = 1;
+	params[6].desc_ptr = &desc;
+	params[6].desc_num = 1;
+	bzero( &desc, sizeof(desc) );
+
+	assert( 0 != door_call_pipelined( door, params, NULL, CALLS ) );
+	assert( EFAULT == errno );
+
+	if ( 0 != door_stats( server, &after ) )
+		fatal_system_error( __FILE__, __LINE__, "door_stats" );
+	assert( before.ds_calls == after.ds_calls );
+
+	return;
+}
+
+static void test_mixed( int transport )
+/* Pipelines a small call and a page-sized one on a new descriptor, which
+ * does not yet know whether the door reads large calls by reference.  The
+ * door answers the first call before it reads any question we ask it about
+ * that.
+ */
+{
+	static char large[8192];
+	door_arg_t params[2];
+	size_t rbufs[2];
+	int errors[2];
+	char small = 's';
+	int server, door, i;
+
+	server = door_create_transport( size_server,
+	                                NULL,
+	                                DOOR_INLINE,
+	                                transport
+	                              );
+	if ( 0 > server )
+		fatal_system_error( __FILE__, __LINE__, "door_create_transport" );
+
+	door_detach(door_path);
+	if ( 0 != door_attach( server, door_path ) )
+		fatal_system_error( __FILE__, __LINE__, "door_attach" );
+
+	door = door_open(door_path);
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+	bzero( params, sizeof(params) );
+	params[0].data_ptr = &small;
+	params[0].data_size = sizeof(small);
+	params[1].data_ptr = large;
+	params[1].data_size = sizeof(large);
+
+	for ( i = 0; i < 2; ++i ) {
+		rbufs[i] = 0;
+		params[i].rbuf = (char*)&rbufs[i];
+		params[i].rsize = sizeof(rbufs[i]);
+	}
+
+	if ( 0 != door_call_pipelined( door, params, errors, 2 ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call_pipelined" );
+
+	for ( i = 0; i < 2; ++i ) {
+		assert( 0 == errors[i] );
+		assert( sizeof(size_t) == params[i].data_size );
+	}
+	assert( sizeof(small) == rbufs[0] );
+	assert( sizeof(large) == rbufs[1] );
+
+	door_close(door);
+
+	if ( 0 != door_detach(door_path) )
+		fatal_system_error( __FILE__, __LINE__, "door_detach" );
+
+	door_revoke(server);
+
+	return;
+}
+
+static void test_transport( int transport )
+{
+	int server, door;
+
+	server = door_create_transport( echo_server, NULL, 0, transport );
+	if ( 0 > server )
+		fatal_system_error( __FILE__, __LINE__, "door_create_transport" );
+
+	door_detach(door_path);
+	if ( 0 != door_attach( server, door_path ) )
+		fatal_system_error( __FILE__, __LINE__, "door_attach" );
+
+	door = door_open(door_path);
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+	test_door( server, door );
+
+	door_close(door);
+
+	if ( 0 != door_detach(door_path) )
+		fatal_system_error( __FILE__, __LINE__, "door_detach" );
+
+	if ( DOOR_TRANSPORT_SOCKET == transport )
+		test_door( server, server );
+
+	test_mixed(transport);
+
+	return;
+}
+
+int main(void)
+{
+	test_transport(DOOR_TRANSPORT_SOCKET);
+	test_transport(DOOR_TRANSPORT_LOOPBACK);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,256 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * door_priority1.c: Test driver for door_call_priority() and              *
+ *                   DOOR_PARAM_HIGH_RESERVED.                             *
+ *                                                                         *
+ *                   The program serves a door that runs one call at a     *
+ *                   time, keeps it busy, and queues normal calls and then *
+ *                   a high-priority call behind it.  The high-priority    *
+ *                   call must start first.  Then, with two threads of     *
+ *                   which one is reserved, a second normal call must wait *
+ *                   while a high-priority call starts at once.  The door  *
+ *                   must refuse to reserve every thread it has, and a     *
+ *                   normal call must still run on it.                     *
+ *                                                                         *
+ *                   The program should not hang, fail an assertion or     *
+ *                   report any error messages.                            *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "door.h"
+#include "error.h"
+
+static const char* const door_path = "/tmp/door-priority";
+
+#define NORMAL_CALLS 3
+
+/* How long the server procedure runs for each call, in milliseconds. */
+static const unsigned int slow_ms = 200;
+static const unsigned int quick_ms = 10;
+
+/* The calls the server procedure has started, and their arguments, in order.
+ */
+static unsigned int started = 0;
+static char started_args[16];
+
+/* A call for a thread to make. */
+struct call {
+	int		door;
+	char		arg;
+	unsigned int	priority;
+	pthread_t	thread;
+};
+
+static void logging_server( void* cookie,
+                            const void* restrict argp,
+                            size_t arg_size,
+                            const door_desc_t* restrict dp,
+                            uint_t n_desc
+                          )
+/* Logs the argument, a letter, and sleeps: long for a capital, briefly for
+ * the rest.
+ */
+{
+	unsigned int i;
+	char arg;
+
+	if ( DOOR_UNREF_DATA == argp )
+		return;
+
+	assert( 1 == arg_size );
+	arg = *(const char*)argp;
+
+	i = __atomic_fetch_add( &started, 1, __ATOMIC_RELAXED );
+	assert( i < sizeof(started_args) );
+	started_args[i] = arg;
+
+	usleep( 1000U * ( ( 'A' <= arg && 'Z' >= arg ) ? slow_ms : quick_ms ) );
+
+	door_return( NULL, 0, NULL, 0 );
+
+	fatal_system_error( __FILE__, __LINE__, "door_return" );
+}
+
+static int call_door( int door, char arg, unsigned int priority )
+{
+	door_arg_t params;
+
+	bzero( &params, sizeof(params) );
+	params.data_ptr = &arg;
+	params.data_size = 1;
+
+	return door_call_priority( door, &params, 0, priority );
+}
+
+static void* call_thread( void* p )
+{
+	const struct call* const c = p;
+
+	if ( 0 != call_door( c->door, c->arg, c->priority ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call_priority" );
+
+	return NULL;
+}
+
+static void start_call( struct call* c,
+                        int server,
+                        char arg,
+                        unsigned int priority,
+                        unsigned long long queued
+                      )
+/* Makes the call on a thread and a descriptor of its own, and waits until
+ * the door server has admitted it and has queued calls waiting.
+ */
+{
+	door_stats_t stats;
+	unsigned long long calls;
+	int i;
+
+	if ( 0 != door_stats( server, &stats ) )
+		fatal_system_error( __FILE__, __LINE__, "door_stats" );
+	calls = stats.ds_calls;
+
+	c->door = door_open(door_path);
+	if ( 0 > c->door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+	c->arg = arg;
+	c->priority = priority;
+	if ( 0 != pthread_create( &c->thread, NULL, call_thread, c ) )
+		fatal_system_error( __FILE__, __LINE__, "pthread_create" );
+
+	for ( i = 0; i < 100; ++i ) {
+		if ( 0 != door_stats( server, &stats ) )
+			fatal_system_error( __FILE__, __LINE__, "door_stats" );
+		if ( calls < stats.ds_calls && queued == stats.ds_queued )
+			return;
+		usleep(1000);
+	}
+
+	assert( ! "The call never reached the door" );
+}
+
+static void end_call( struct call* c )
+{
+	if ( 0 != pthread_join( c->thread, NULL ) )
+		fatal_system_error( __FILE__, __LINE__, "pthread_join" );
+
+	door_close(c->door);
+
+	return;
+}
+
+int main(void)
+{
+	struct call busy, normal[NORMAL_CALLS], urgent;
+	size_t value;
+	int server, i;
+
+	server = door_create( logging_server, NULL, 0 );
+	if ( 0 > server )
+		fatal_system_error( __FILE__, __LINE__, "door_create" );
+
+	if ( 0 != door_setparam( server, DOOR_PARAM_MAX_ACTIVE, 1 ) ||
+	     0 != door_setparam( server, DOOR_PARAM_MAX_QUEUED, 8 )
+	   )
+		fatal_system_error( __FILE__, __LINE__, "door_setparam" );
+
+	door_detach(door_path);
+	if ( 0 != door_attach( server, door_path ) )
+		fatal_system_error( __FILE__, __LINE__, "door_attach" );
+
+/* Only two classes exist. */
+	assert( 0 != call_door( server, 'x', DOOR_PRIORITY_HIGH + 1 ) );
+	assert( EINVAL == errno );
+
+/* The high-priority call overtakes the normal calls queued before it. */
+	start_call( &busy, server, 'A', DOOR_PRIORITY_NORMAL, 0 );
+	for ( i = 0; i < NORMAL_CALLS; ++i )
+		start_call( &normal[i],
+		            server,
+		            (char)( 'b' + i ),
+		            DOOR_PRIORITY_NORMAL,
+		            (unsigned long long)i + 1
+		          );
+	start_call( &urgent,
+	            server,
+	            'u',
+	            DOOR_PRIORITY_HIGH,
+	            NORMAL_CALLS + 1
+	          );
+
+	end_call(&busy);
+	for ( i = 0; i < NORMAL_CALLS; ++i )
+		end_call(&normal[i]);
+	end_call(&urgent);
+
+	assert( NORMAL_CALLS + 2 == started );
+	assert( 0 == memcmp( started_args, "Aubcd", NORMAL_CALLS + 2 ) );
+
+/* With a thread reserved, a second normal call must wait, but not a
+ * high-priority one.
+ */
+	if ( 0 != door_setparam( server, DOOR_PARAM_MAX_ACTIVE, 2 ) ||
+	     0 != door_setparam( server, DOOR_PARAM_HIGH_RESERVED, 1 )
+	   )
+		fatal_system_error( __FILE__, __LINE__, "door_setparam" );
+
+	urgent.door = door_open(door_path);
+	if ( 0 > urgent.door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+	if ( 0 != door_getparam( urgent.door, DOOR_PARAM_HIGH_RESERVED, &value ) )
+		fatal_system_error( __FILE__, __LINE__, "door_getparam" );
+	assert( 1 == value );
+
+	started = 0;
+	start_call( &busy, server, 'A', DOOR_PRIORITY_NORMAL, 0 );
+	start_call( &normal[0], server, 'b', DOOR_PRIORITY_NORMAL, 1 );
+
+	if ( 0 != call_door( urgent.door, 'u', DOOR_PRIORITY_HIGH ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call_priority" );
+	assert( 2 == __atomic_load_n( &started, __ATOMIC_RELAXED ) );
+	door_close(urgent.door);
+
+	end_call(&busy);
+	end_call(&normal[0]);
+	assert( 0 == memcmp( started_args, "Aub", 3 ) );
+
+/* Reserving every thread would leave none for a normal call. */
+	assert( 0 != door_setparam( server, DOOR_PARAM_MAX_ACTIVE, 1 ) );
+	assert( EINVAL == errno );
+	assert( 0 != door_setparam( server, DOOR_PARAM_HIGH_RESERVED, 2 ) );
+	assert( EINVAL == errno );
+
+	if ( 0 != door_setparam( server, DOOR_PARAM_HIGH_RESERVED, 0 ) ||
+	     0 != door_setparam( server, DOOR_PARAM_MAX_ACTIVE, 1 ) ||
+	     0 != door_setparam( server, DOOR_PARAM_MAX_QUEUED, 4 )
+	   )
+		fatal_system_error( __FILE__, __LINE__, "door_setparam" );
+	assert( 0 != door_setparam( server, DOOR_PARAM_HIGH_RESERVED, 1 ) );
+	assert( EINVAL == errno );
+
+	urgent.door = door_open(door_path);
+	if ( 0 > urgent.door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+	if ( 0 != call_door( urgent.door, 'n', DOOR_PRIORITY_NORMAL ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call_priority" );
+	door_close(urgent.door);
+
+	if ( 0 != door_detach(door_path) )
+		fatal_system_error( __FILE__, __LINE__, "door_detach" );
+
+	return EXIT_SUCCESS;
+}
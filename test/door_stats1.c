@@ -0,0 +1,200 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * door_stats1.c: Test driver for door_stats().                            *
+ *                                                                         *
+ *                The program creates a door with DOOR_UNREF, opens it,    *
+ *                calls it through the socket and directly, and has one    *
+ *                call refused, checking the counters after each step.     *
+ *                The client must see the same counters as the server.     *
+ *                Once the client closes its descriptor, the connection    *
+ *                and the unreferenced invocation must be counted.  A      *
+ *                revoked door no longer has counters.                     *
+ *                                                                         *
+ *                The program should not hang, fail an assertion or report *
+ *                any error messages.                                      *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "door.h"
+#include "error.h"
+
+static const char* const door_path = "/tmp/door-stats";
+static const char* const message = "0123456789";
+
+static const unsigned long long calls = 100;
+
+static void double_server( void* cookie,
+                           const void* restrict argp,
+                           size_t arg_size,
+                           const door_desc_t* restrict dp,
+                           uint_t n_desc
+                         )
+/* Returns the argument twice over, and ignores unreferenced invocations. */
+{
+	char buf[2 * arg_size + 1];
+
+	if ( DOOR_UNREF_DATA == argp )
+		return;
+
+	memcpy( buf, argp, arg_size );
+	memcpy( buf + arg_size, argp, arg_size );
+
+	door_return( buf, 2 * arg_size, NULL, 0 );
+
+	fatal_system_error( __FILE__, __LINE__, "door_return" );
+}
+
+static void call_door( int door, size_t size )
+{
+	door_arg_t params;
+
+	bzero( &params, sizeof(params) );
+	params.data_ptr = message;
+	params.data_size = size;
+
+	if ( 0 != door_call( door, &params ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call" );
+
+	assert( 2 * size == params.data_size );
+	free(params.rbuf);
+
+	return;
+}
+
+static unsigned long long sum_latency( const door_stats_t* stats )
+{
+	unsigned long long total = 0;
+	int i;
+
+	for ( i = 0; i < DOOR_STATS_BUCKETS; ++i )
+		total += stats->ds_latency[i];
+
+	return total;
+}
+
+int main(void)
+{
+	int server, door, i;
+	int pipe_fds[2];
+	door_stats_t stats, remote;
+	door_arg_t params;
+	unsigned long long n;
+
+	server = door_create( double_server, NULL, DOOR_UNREF );
+	if ( 0 > server )
+		fatal_system_error( __FILE__, __LINE__, "door_create" );
+
+	door_detach(door_path);
+	if ( 0 != door_attach( server, door_path ) )
+		fatal_system_error( __FILE__, __LINE__, "door_attach" );
+
+	if ( 0 != door_stats( server, &stats ) )
+		fatal_system_error( __FILE__, __LINE__, "door_stats" );
+	assert( 0 == stats.ds_calls );
+	assert( 0 == stats.ds_connections );
+
+	door = door_open(door_path);
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+	for ( n = 0; n < calls; ++n )
+		call_door( door, strlen(message) );
+
+/* The results reach us only after the server has counted the call. */
+	if ( 0 != door_stats( server, &stats ) )
+		fatal_system_error( __FILE__, __LINE__, "door_stats" );
+	assert( calls == stats.ds_calls );
+	assert( calls * strlen(message) == stats.ds_bytes_in );
+	assert( 2 * calls * strlen(message) == stats.ds_bytes_out );
+	assert( 0 == stats.ds_active );
+	assert( 0 == stats.ds_errors );
+	assert( 1 == stats.ds_connections );
+	assert( calls == sum_latency(&stats) );
+
+/* The client asks the server for the same counters. */
+	if ( 0 != door_stats( door, &remote ) )
+		fatal_system_error( __FILE__, __LINE__, "door_stats" );
+	assert( 0 == memcmp( &stats, &remote, sizeof(stats) ) );
+
+/* A local call is counted the same way. */
+	call_door( server, 4 );
+
+	if ( 0 != door_stats( server, &stats ) )
+		fatal_system_error( __FILE__, __LINE__, "door_stats" );
+	assert( calls + 1 == stats.ds_calls );
+	assert( calls * strlen(message) + 4 == stats.ds_bytes_in );
+	assert( calls + 1 == sum_latency(&stats) );
+
+/* A call the door refuses counts as an error, under its errno. */
+	if ( 0 != door_setparam( server, DOOR_PARAM_DATA_MAX, 4 ) )
+		fatal_system_error( __FILE__, __LINE__, "door_setparam" );
+
+	bzero( &params, sizeof(params) );
+	params.data_ptr = message;
+	params.data_size = strlen(message);
+	assert( 0 != door_call( door, &params ) );
+	assert( ENOBUFS == errno );
+
+	if ( 0 != door_stats( server, &stats ) )
+		fatal_system_error( __FILE__, __LINE__, "door_stats" );
+	assert( calls + 1 == stats.ds_calls );
+	assert( 1 == stats.ds_errors );
+	assert( 1 == stats.ds_errno[ENOBUFS] );
+
+	if ( 0 != door_stats( door, &remote ) )
+		fatal_system_error( __FILE__, __LINE__, "door_stats" );
+	assert( 1 == remote.ds_errno[ENOBUFS] );
+	assert( 1 == remote.ds_connections );
+
+/* Only a door has counters. */
+	if ( 0 != pipe(pipe_fds) )
+		fatal_system_error( __FILE__, __LINE__, "pipe" );
+
+	assert( 0 != door_stats( pipe_fds[0], &stats ) );
+	assert( EBADF == errno );
+
+	close(pipe_fds[0]);
+	close(pipe_fds[1]);
+
+/* Closing the last client descriptor ends the connection and unreferences
+ * the door.  Give the server up to five seconds to notice.
+ */
+	if ( 0 != door_close(door) )
+		fatal_system_error( __FILE__, __LINE__, "door_close" );
+
+	for ( i = 0; i < 50; ++i ) {
+		if ( 0 != door_stats( server, &stats ) )
+			fatal_system_error( __FILE__, __LINE__, "door_stats" );
+
+		if ( 0 == stats.ds_connections && 1 == stats.ds_unref )
+			break;
+
+		usleep(100000);
+	}
+
+	assert( 0 == stats.ds_connections );
+	assert( 1 == stats.ds_unref );
+
+	if ( 0 != door_detach(door_path) )
+		fatal_system_error( __FILE__, __LINE__, "door_detach" );
+
+	if ( 0 != door_revoke(server) )
+		fatal_system_error( __FILE__, __LINE__, "door_revoke" );
+
+	assert( 0 != door_stats( server, &stats ) );
+	assert( EBADF == errno );
+
+	return EXIT_SUCCESS;
+}
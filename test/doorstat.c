@@ -0,0 +1,301 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * doorstat.c: Live per-door throughput and latency, like iostat.          *
+ *                                                                         *
+ *             The program opens each door named on the command line, or   *
+ *             attached to a socket in a directory named there, and every  *
+ *             interval prints what each did since the last sample: calls  *
+ *             and bytes per second, errors, the calls in progress,        *
+ *             connections and server threads, and the 99th-percentile     *
+ *             latency.  The server runs a thread for every connection and *
+ *             one for every call in progress, so that is the thread       *
+ *             count.  The latency is the upper bound of the power-of-two  *
+ *             bucket door_stats() counted it in.                          *
+ *                                                                         *
+ *             A door that stops answering is reported and opened again at *
+ *             the next sample.                                            *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "door.h"
+
+struct watched {
+	char*		path;
+	int		d;		/* Open descriptor, or -1. */
+	bool		have_last;	/* Whether last holds a sample. */
+	door_stats_t	last;
+};
+
+struct watch_list {
+	struct watched*	doors;
+	size_t		count;
+	size_t		size;
+};
+
+static void usage( const char* name )
+{
+	fprintf( stderr,
+	         "usage: %s [-i seconds] [-c count] directory|path ...\n",
+	         name
+	       );
+	exit(EXIT_FAILURE);
+}
+
+static void add_door( struct watch_list* list, const char* path )
+{
+	struct watched* w;
+
+	if ( list->count == list->size ) {
+		const size_t size = ( 0 == list->size ) ? 16 : 2 * list->size;
+		struct watched* const doors = realloc( list->doors,
+		                                       size * sizeof(*doors)
+		                                     );
+
+		if ( NULL == doors ) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+
+		list->doors = doors;
+		list->size = size;
+	}
+
+	w = &list->doors[list->count];
+	w->path = strdup(path);
+	if ( NULL == w->path ) {
+		perror("strdup");
+		exit(EXIT_FAILURE);
+	}
+	w->d = -1;
+	w->have_last = false;
+	++list->count;
+
+	return;
+}
+
+static void add_directory( struct watch_list* list, const char* dir )
+/* Adds every socket in dir: the default transport attaches doors there. */
+{
+	DIR* const dp = opendir(dir);
+	const struct dirent* entry;
+
+	if ( NULL == dp ) {
+		perror(dir);
+		exit(EXIT_FAILURE);
+	}
+
+	while ( NULL != ( entry = readdir(dp) ) ) {
+		char path[PATH_MAX];
+		struct stat st;
+
+		if ( (int)sizeof(path) <= snprintf( path,
+		                                    sizeof(path),
+		                                    "%s/%s",
+		                                    dir,
+		                                    entry->d_name
+		                                  )
+		   )
+			continue;
+
+		if ( 0 == stat( path, &st ) && S_ISSOCK(st.st_mode) )
+			add_door( list, path );
+	}
+
+	closedir(dp);
+
+	return;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned long long p99_ns( const door_stats_t* cur,
+                                  const door_stats_t* prev
+                                )
+/* Returns the upper bound of the bucket holding the 99th percentile of the
+ * calls finished between the two samples, or 0 if there were none.
+ */
+{
+	unsigned long long total = 0, rank, seen = 0;
+	int i;
+
+	for ( i = 0; i < DOOR_STATS_BUCKETS; ++i )
+		total += cur->ds_latency[i] - prev->ds_latency[i];
+
+	if ( 0 == total )
+		return 0;
+
+	rank = ( 99 * total + 99 ) / 100;
+
+	for ( i = 0; i < DOOR_STATS_BUCKETS - 1; ++i ) {
+		seen += cur->ds_latency[i] - prev->ds_latency[i];
+		if ( seen >= rank )
+			break;
+	}
+
+	return 2ULL << i;
+}
+
+static void print_latency( unsigned long long ns )
+{
+	if ( 0 == ns )
+		printf( " %9s", "-" );
+	else if ( 10000ULL > ns )
+		printf( " %7lluns", ns );
+	else if ( 10000000ULL > ns )
+		printf( " %7lluus", ns / 1000 );
+	else
+		printf( " %7llums", ns / 1000000 );
+
+	return;
+}
+
+static void sample( struct watched* w, double elapsed )
+{
+	door_stats_t stats;
+	const door_stats_t* then = &w->last;
+
+	if ( 0 > w->d ) {
+		w->d = door_open(w->path);
+		if ( 0 > w->d ) {
+			printf( "%-24s %s\n", w->path, strerror(errno) );
+			return;
+		}
+	}
+
+	if ( 0 != door_stats( w->d, &stats ) ) {
+		printf( "%-24s %s\n", w->path, strerror(errno) );
+		door_close(w->d);
+		w->d = -1;
+		w->have_last = false;
+		return;
+	}
+
+/* The first sample, or the first from a restarted server, only sets the
+ * baseline for the rates.
+ */
+	if ( ! w->have_last || stats.ds_calls < then->ds_calls ) {
+		w->last = stats;
+		w->have_last = true;
+		then = &stats;
+	}
+
+	printf( "%-24s %9.1f %9.1f %9.1f %7.1f %6llu %6llu %7llu",
+	        w->path,
+	        ( stats.ds_calls - then->ds_calls ) / elapsed,
+	        ( stats.ds_bytes_in - then->ds_bytes_in ) / elapsed / 1024.0,
+	        ( stats.ds_bytes_out - then->ds_bytes_out ) / elapsed / 1024.0,
+	        ( stats.ds_errors - then->ds_errors ) / elapsed,
+	        stats.ds_active,
+	        stats.ds_connections,
+	        stats.ds_connections + stats.ds_active
+	      );
+	print_latency( p99_ns( &stats, then ) );
+	putchar('\n');
+
+	w->last = stats;
+
+	return;
+}
+
+int main( int argc, char** argv )
+{
+	struct watch_list list = { NULL, 0, 0 };
+	double interval = 1.0, last;
+	long count = 0, n;
+	size_t i;
+	int c;
+
+	while ( -1 != ( c = getopt( argc, argv, "i:c:h" ) ) ) {
+		switch (c) {
+			case 'i':
+				interval = atof(optarg);
+				break;
+
+			case 'c':
+				count = atol(optarg);
+				break;
+
+			default:
+				usage(argv[0]);
+		}
+	}
+
+	if ( argc == optind || 0.0 >= interval || 0 > count )
+		usage(argv[0]);
+
+	for ( ; optind < argc; ++optind ) {
+		struct stat st;
+
+		if ( 0 == stat( argv[optind], &st ) && S_ISDIR(st.st_mode) )
+			add_directory( &list, argv[optind] );
+		else
+			add_door( &list, argv[optind] );
+	}
+
+	if ( 0 == list.count ) {
+		fprintf( stderr, "%s: no doors found\n", argv[0] );
+		return EXIT_FAILURE;
+	}
+
+	last = now();
+
+	for ( n = 0; 0 == count || n < count; ++n ) {
+		double t, elapsed;
+
+		if ( 0 != n ) {
+			struct timespec ts;
+
+			ts.tv_sec = (time_t)interval;
+			ts.tv_nsec = (long)( ( interval - ts.tv_sec ) * 1e9 );
+			nanosleep( &ts, NULL );
+		}
+
+		t = now();
+		elapsed = ( t > last ) ? t - last : interval;
+		last = t;
+
+		printf( "%-24s %9s %9s %9s %7s %6s %6s %7s %9s\n",
+		        "door",
+		        "calls/s",
+		        "KiB/s in",
+		        "KiB/s out",
+		        "err/s",
+		        "active",
+		        "conns",
+		        "threads",
+		        "p99"
+		      );
+
+		for ( i = 0; i < list.count; ++i )
+			sample( &list.doors[i], elapsed );
+
+		putchar('\n');
+		fflush(stdout);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,262 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * flight1.c: Test driver for the slow-call flight recorder.               *
+ *                                                                         *
+ *            The program serves a door whose server procedure sleeps for  *
+ *            as many milliseconds as its argument says, and calls it      *
+ *            through a socket, once quickly and once slowly.  Only the    *
+ *            slow call may be recorded, with its door and its time spent  *
+ *            in the server procedure.  The dump, both direct and from a   *
+ *            signal, must list it.  Every call of a slow batch must be    *
+ *            recorded with sensible times.                                *
+ *                                                                         *
+ *            The program should not hang, fail an assertion or report    *
+ *            any error messages.                                          *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "door.h"
+#include "door_info.h"
+#include "error.h"
+
+static const char* const door_path = "/tmp/door-flight";
+
+#define CALLS 8
+
+/* The largest batch the batch server procedure has served. */
+static size_t largest = 0;
+
+/* Calls that take this long are slow. */
+static const unsigned long long threshold_ns = 20000000ULL;
+
+static void sleep_server( void* cookie,
+                          const void* restrict argp,
+                          size_t arg_size,
+                          const door_desc_t* restrict dp,
+                          uint_t n_desc
+                        )
+{
+	unsigned char ms;
+
+	if ( DOOR_UNREF_DATA == argp )
+		return;
+
+	assert( 1 == arg_size );
+	ms = *(const unsigned char*)argp;
+	usleep( 1000U * ms );
+
+	door_return( NULL, 0, NULL, 0 );
+
+	fatal_system_error( __FILE__, __LINE__, "door_return" );
+}
+
+static void slow_batch_server( void* cookie,
+                               door_batch_call_t* calls,
+                               size_t count
+                             )
+{
+	if ( DOOR_UNREF_DATA == calls[0].argp )
+		return;
+
+	if ( count > __atomic_load_n( &largest, __ATOMIC_RELAXED ) )
+		__atomic_store_n( &largest, count, __ATOMIC_RELAXED );
+
+	usleep(25000);
+
+	return;
+}
+
+static void test_batch(void)
+/* Pipelines calls to a slow batch door until some arrive together. */
+{
+	door_slow_call_t calls[DOOR_SLOW_CALLS];
+	door_arg_t params[CALLS];
+	char args[CALLS];
+	struct door_info info;
+	size_t n, i, recorded = 0;
+	int server, door, round;
+
+	server = door_create_batch( slow_batch_server,
+	                            NULL,
+	                            0,
+	                            DOOR_TRANSPORT_SOCKET
+	                          );
+	if ( 0 > server )
+		fatal_system_error( __FILE__, __LINE__, "door_create_batch" );
+
+	if ( 0 != door_info( server, &info ) )
+		fatal_system_error( __FILE__, __LINE__, "door_info" );
+
+	door_detach(door_path);
+	if ( 0 != door_attach( server, door_path ) )
+		fatal_system_error( __FILE__, __LINE__, "door_attach" );
+
+	door = door_open(door_path);
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+	for ( round = 0;
+	      20 > round && 1 >= __atomic_load_n( &largest, __ATOMIC_RELAXED );
+	      ++round
+	    ) {
+		for ( i = 0; i < CALLS; ++i ) {
+			args[i] = (char)i;
+			bzero( &params[i], sizeof(params[i]) );
+			params[i].data_ptr = &args[i];
+			params[i].data_size = 1;
+		}
+
+		if ( 0 != door_call_pipelined( door, params, NULL, CALLS ) )
+			fatal_system_error( __FILE__,
+			                    __LINE__,
+			                    "door_call_pipelined"
+			                  );
+	}
+	assert( 1 < __atomic_load_n( &largest, __ATOMIC_RELAXED ) );
+
+/* The server records each call after sending its results. */
+	usleep(50000);
+
+	n = door_slow_calls( calls, DOOR_SLOW_CALLS );
+	for ( i = 0; i < n; ++i )
+		if ( info.di_uniquifier == calls[i].sc_door ) {
+			assert( calls[i].sc_queue_ns < 10000000000ULL );
+			assert( threshold_ns <= calls[i].sc_server_ns );
+			assert( calls[i].sc_server_ns < 10000000000ULL );
+			++recorded;
+		}
+	assert( 1 < recorded );
+
+	door_close(door);
+
+	if ( 0 != door_detach(door_path) )
+		fatal_system_error( __FILE__, __LINE__, "door_detach" );
+
+	return;
+}
+
+static void call_door( int door, unsigned char ms )
+{
+	door_arg_t params;
+
+	bzero( &params, sizeof(params) );
+	params.data_ptr = (char*)&ms;
+	params.data_size = 1;
+
+	if ( 0 != door_call( door, &params ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call" );
+
+	return;
+}
+
+static size_t read_dump( int fd, char* buf, size_t size )
+{
+	ssize_t n = read( fd, buf, size - 1 );
+
+	if ( 0 > n )
+		fatal_system_error( __FILE__, __LINE__, "read" );
+
+	buf[n] = '\0';
+
+	return (size_t)n;
+}
+
+int main(void)
+{
+	door_slow_call_t calls[DOOR_SLOW_CALLS];
+	struct door_info info;
+	char dump[4096];
+	int server, door, saved_stderr, i;
+	int pipe_fds[2];
+	size_t n = 0;
+
+	door_slow_threshold(threshold_ns);
+
+	server = door_create( sleep_server, NULL, 0 );
+	if ( 0 > server )
+		fatal_system_error( __FILE__, __LINE__, "door_create" );
+
+	if ( 0 != door_info( server, &info ) )
+		fatal_system_error( __FILE__, __LINE__, "door_info" );
+
+	door_detach(door_path);
+	if ( 0 != door_attach( server, door_path ) )
+		fatal_system_error( __FILE__, __LINE__, "door_attach" );
+
+	door = door_open(door_path);
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+	call_door( door, 0 );
+	call_door( door, 50 );
+
+/* The server records the call after sending the results, so it may not be
+ * there yet.
+ */
+	for ( i = 0; i < 50 && 0 == n; ++i ) {
+		n = door_slow_calls( calls, DOOR_SLOW_CALLS );
+		if ( 0 == n )
+			usleep(10000);
+	}
+
+	assert( 1 == n );
+	assert( info.di_uniquifier == calls[0].sc_door );
+	assert( 1 == calls[0].sc_data_size );
+	assert( threshold_ns <= calls[0].sc_server_ns );
+	assert( calls[0].sc_queue_ns < threshold_ns );
+	assert( 0 != calls[0].sc_thread );
+	assert( 0 != calls[0].sc_time );
+
+	if ( 0 != pipe(pipe_fds) )
+		fatal_system_error( __FILE__, __LINE__, "pipe" );
+
+	if ( 0 != door_slow_dump( pipe_fds[1] ) )
+		fatal_system_error( __FILE__, __LINE__, "door_slow_dump" );
+
+	read_dump( pipe_fds[0], dump, sizeof(dump) );
+	assert( 0 == strncmp( dump, "door slow calls:\n", 17 ) );
+	assert( NULL != strstr( dump, " size 1 queue_ns " ) );
+
+/* The same dump, to standard error, on a signal. */
+	if ( 0 != door_slow_signal(SIGUSR2) )
+		fatal_system_error( __FILE__, __LINE__, "door_slow_signal" );
+
+	saved_stderr = dup(STDERR_FILENO);
+	if ( 0 > saved_stderr || 0 > dup2( pipe_fds[1], STDERR_FILENO ) )
+		fatal_system_error( __FILE__, __LINE__, "dup2" );
+
+	raise(SIGUSR2);
+
+	if ( 0 > dup2( saved_stderr, STDERR_FILENO ) )
+		fatal_system_error( __FILE__, __LINE__, "dup2" );
+	close(saved_stderr);
+
+	read_dump( pipe_fds[0], dump, sizeof(dump) );
+	assert( 0 == strncmp( dump, "door slow calls:\n", 17 ) );
+	assert( NULL != strstr( dump, " server_ns " ) );
+
+	close(pipe_fds[0]);
+	close(pipe_fds[1]);
+
+	door_close(door);
+
+	if ( 0 != door_detach(door_path) )
+		fatal_system_error( __FILE__, __LINE__, "door_detach" );
+
+	test_batch();
+
+	return EXIT_SUCCESS;
+}
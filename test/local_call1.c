@@ -0,0 +1,209 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * local_call1.c: Test driver for door_call() on a descriptor returned by  *
+ *                door_create() in the same process.                       *
+ *                                                                         *
+ *                The program calls a local door that reverses a string,   *
+ *                once with a results buffer large enough to hold the      *
+ *                reply and once without one, then calls a door whose      *
+ *                server procedure returns without calling door_return(),  *
+ *                and one that returns the tail of arguments passed in its *
+ *                caller's results buffer.                                 *
+ *                Last, it revokes a door while another thread calls it:   *
+ *                every call must either succeed or fail with EBADF.       *
+ *                None of the doors is ever attached to the filesystem.    *
+ *                                                                         *
+ *                The program should not hang, fail an assertion or report *
+ *                any error messages.                                      *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "door.h"
+#include "error.h"
+
+static const char* const message = "Hello, world!";
+static const char* const reversed = "!dlrow ,olleH";
+
+static void reverse_server( void* cookie,
+                            const void* restrict argp,
+                            size_t arg_size,
+                            const door_desc_t* restrict dp,
+                            uint_t n_desc
+                          )
+{
+	char buf[64];
+	size_t i;
+
+	assert( arg_size <= sizeof(buf) );
+
+	for ( i = 0; i < arg_size; ++i )
+		buf[i] = ( (const char*)argp )[arg_size - 1 - i];
+
+	door_return( buf, arg_size, NULL, 0 );
+
+	fatal_system_error( __FILE__, __LINE__, "door_return" );
+}
+
+static void forgetful_server( void* cookie,
+                              const void* restrict argp,
+                              size_t arg_size,
+                              const door_desc_t* restrict dp,
+                              uint_t n_desc
+                            )
+{
+	return;
+}
+
+static void tail_server( void* cookie,
+                         const void* restrict argp,
+                         size_t arg_size,
+                         const door_desc_t* restrict dp,
+                         uint_t n_desc
+                       )
+/* Returns all but the first byte of its arguments, in place. */
+{
+	assert( 0 < arg_size );
+
+	door_return( (const char*)argp + 1, arg_size - 1, NULL, 0 );
+
+	fatal_system_error( __FILE__, __LINE__, "door_return" );
+}
+
+static void* calling_thread( void* p )
+/* Calls the door *p until it fails, as it must once revoked. */
+{
+	const int door = *(const int*)p;
+	door_arg_t params;
+	char rbuf[64];
+
+	do {
+		bzero( &params, sizeof(params) );
+		params.data_ptr = message;
+		params.data_size = strlen(message);
+		params.rbuf = rbuf;
+		params.rsize = sizeof(rbuf);
+	} while ( 0 == door_call( door, &params ) );
+
+	assert( EBADF == errno );
+
+	return NULL;
+}
+
+int main(void)
+{
+	pthread_t thread;
+	int door;
+	char rbuf[64];
+	door_arg_t params;
+
+	door = door_create( reverse_server, NULL, DOOR_REFUSE_DESC );
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_create" );
+
+	bzero( &params, sizeof(params) );
+	params.data_ptr = message;
+	params.data_size = strlen(message);
+	params.rbuf = rbuf;
+	params.rsize = sizeof(rbuf);
+
+	if ( 0 != door_call( door, &params ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call" );
+
+	assert( rbuf == params.rbuf );
+	assert( strlen(reversed) == params.data_size );
+	assert( 0 == memcmp( params.data_ptr, reversed, params.data_size ) );
+
+/* No results buffer, so the library must allocate one. */
+	bzero( &params, sizeof(params) );
+	params.data_ptr = message;
+	params.data_size = strlen(message);
+
+	if ( 0 != door_call( door, &params ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call" );
+
+	assert( NULL != params.rbuf );
+	assert( strlen(reversed) == params.data_size );
+	assert( 0 == memcmp( params.data_ptr, reversed, params.data_size ) );
+	free(params.rbuf);
+
+/* The same checks apply as for a call from another process. */
+	bzero( &params, sizeof(params) );
+	params.data_ptr = rbuf;
+	params.data_size = sizeof(rbuf);
+
+	if ( 0 != door_setparam( door, DOOR_PARAM_DATA_MAX, sizeof(rbuf) - 1 ) )
+		fatal_system_error( __FILE__, __LINE__, "door_setparam" );
+
+	assert( 0 != door_call( door, &params ) );
+	assert( ENOBUFS == errno );
+
+/* A server procedure that simply returns gives an empty result. */
+	door = door_create( forgetful_server, NULL, DOOR_REFUSE_DESC );
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_create" );
+
+	bzero( &params, sizeof(params) );
+	params.data_ptr = message;
+	params.data_size = strlen(message);
+
+	if ( 0 != door_call( door, &params ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call" );
+
+	assert( 0 == params.data_size );
+
+/* The results overlap the arguments, which the caller passed in rbuf. */
+	door = door_create( tail_server, NULL, DOOR_REFUSE_DESC );
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_create" );
+
+	strcpy( rbuf, message );
+	bzero( &params, sizeof(params) );
+	params.data_ptr = rbuf;
+	params.data_size = strlen(message);
+	params.rbuf = rbuf;
+	params.rsize = sizeof(rbuf);
+
+	if ( 0 != door_call( door, &params ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call" );
+
+	assert( rbuf == params.data_ptr );
+	assert( strlen(message) - 1 == params.data_size );
+	assert( 0 == memcmp( params.data_ptr, message + 1, params.data_size ) );
+
+/* Revoking a door ends its calls, whether in progress or still to come. */
+	door = door_create( reverse_server, NULL, DOOR_REFUSE_DESC );
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_create" );
+
+	if ( 0 != pthread_create( &thread, NULL, calling_thread, &door ) )
+		fatal_system_error( __FILE__, __LINE__, "pthread_create" );
+
+	usleep(10000);
+	if ( 0 != door_revoke(door) )
+		fatal_system_error( __FILE__, __LINE__, "door_revoke" );
+
+	if ( 0 != pthread_join( thread, NULL ) )
+		fatal_system_error( __FILE__, __LINE__, "pthread_join" );
+
+	bzero( &params, sizeof(params) );
+	assert( 0 != door_call( door, &params ) );
+	assert( EBADF == errno );
+
+	assert( 0 != door_revoke(door) );
+	assert( EBADF == errno );
+
+	return EXIT_SUCCESS;
+}
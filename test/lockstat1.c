@@ -0,0 +1,106 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * lockstat1.c: Test driver for door_lock_stats().                         *
+ *                                                                         *
+ *              The program checks that bad arguments are refused, then    *
+ *              makes calls through a socket door.  In a library built     *
+ *              with LOCKSTAT=1, each kind of lock must have been taken    *
+ *              and no wait may be longer than the total; otherwise,       *
+ *              door_lock_stats() must report ENOTSUP.                     *
+ *                                                                         *
+ *              The program should not hang, fail an assertion or report   *
+ *              any error messages.                                        *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "door.h"
+#include "error.h"
+
+static const char* const door_path = "/tmp/door-lockstat";
+
+static void empty_server( void* cookie,
+                          const void* restrict argp,
+                          size_t arg_size,
+                          const door_desc_t* restrict dp,
+                          uint_t n_desc
+                        )
+{
+	if ( DOOR_UNREF_DATA == argp )
+		return;
+
+	door_return( NULL, 0, NULL, 0 );
+
+	fatal_system_error( __FILE__, __LINE__, "door_return" );
+}
+
+int main(void)
+{
+	door_lock_stats_t stats;
+	door_arg_t params;
+	int server, door, i;
+
+	assert( 0 != door_lock_stats( DOOR_LOCKS, &stats ) );
+	assert( EINVAL == errno );
+	assert( 0 != door_lock_stats( -1, &stats ) );
+	assert( EINVAL == errno );
+	assert( 0 != door_lock_stats( DOOR_LOCK_TABLE, NULL ) );
+	assert( EFAULT == errno );
+
+	server = door_create( empty_server, NULL, 0 );
+	if ( 0 > server )
+		fatal_system_error( __FILE__, __LINE__, "door_create" );
+
+	door_detach(door_path);
+	if ( 0 != door_attach( server, door_path ) )
+		fatal_system_error( __FILE__, __LINE__, "door_attach" );
+
+	door = door_open(door_path);
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+	for ( i = 0; i < 10; ++i ) {
+		bzero( &params, sizeof(params) );
+		if ( 0 != door_call( door, &params ) )
+			fatal_system_error( __FILE__, __LINE__, "door_call" );
+	}
+
+	if ( 0 != door_lock_stats( DOOR_LOCK_TABLE, &stats ) ) {
+/* An uninstrumented library. */
+		assert( ENOTSUP == errno );
+	}
+	else {
+		for ( i = 0; i < DOOR_LOCKS; ++i ) {
+			if ( 0 != door_lock_stats( i, &stats ) )
+				fatal_system_error( __FILE__,
+				                    __LINE__,
+				                    "door_lock_stats"
+				                  );
+
+			assert( 0 < stats.dl_acquired );
+			assert( stats.dl_contended <= stats.dl_acquired );
+			assert( stats.dl_max_wait_ns <= stats.dl_wait_ns );
+		}
+
+/* Each call holds the descriptor's lock. */
+		door_lock_stats( DOOR_LOCK_DESC, &stats );
+		assert( 10 <= stats.dl_acquired );
+	}
+
+	door_close(door);
+
+	if ( 0 != door_detach(door_path) )
+		fatal_system_error( __FILE__, __LINE__, "door_detach" );
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,195 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * loopback1.c: Test driver for doors created on the loopback transport.   *
+ *                                                                         *
+ *              The program creates a door with DOOR_TRANSPORT_LOOPBACK,   *
+ *              attaches it to a name, and checks that no file appears     *
+ *              there.  It opens the door and calls it many times, with    *
+ *              small and large arguments and with a descriptor, checking  *
+ *              each reply, then checks door_info() and door_getparam().   *
+ *              Once the door is detached, door_open() must fail.          *
+ *                                                                         *
+ *              The program should not hang, fail an assertion or report   *
+ *              any error messages.                                        *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "door.h"
+#include "error.h"
+
+static const char* const door_path = "/tmp/door-loopback";
+static const char* const message = "Hello, world!";
+static const char* const reversed = "!dlrow ,olleH";
+
+/* Repeat the call often enough to wrap around the transport's queues. */
+static const int repeats = 1000;
+
+/* Large enough that door_call() asks about passing it by reference. */
+static const size_t large_size = 512U * 1024U;
+
+static void reverse_server( void* cookie,
+                            const void* restrict argp,
+                            size_t arg_size,
+                            const door_desc_t* restrict dp,
+                            uint_t n_desc
+                          )
+/* Returns the argument reversed.  Writes the argument into any descriptor it
+ * receives and closes it.
+ */
+{
+/* The transport copies the reply before door_return() ends the thread, so
+ * it can live on the stack.
+ */
+	char buf[arg_size ? arg_size : 1];
+	size_t i;
+
+	if ( 1 == n_desc ) {
+		if ( (ssize_t)arg_size !=
+		     write( dp[0].d_data.d_desc.d_descriptor, argp, arg_size )
+		   )
+			fatal_system_error( __FILE__, __LINE__, "write" );
+
+		close(dp[0].d_data.d_desc.d_descriptor);
+	}
+
+	for ( i = 0; i < arg_size; ++i )
+		buf[i] = ( (const char*)argp )[arg_size - 1 - i];
+
+	door_return( buf, arg_size, NULL, 0 );
+
+	fatal_system_error( __FILE__, __LINE__, "door_return" );
+}
+
+static void call_reverse( int door, const char* data, size_t size )
+{
+	door_arg_t params;
+	size_t i;
+
+	bzero( &params, sizeof(params) );
+	params.data_ptr = data;
+	params.data_size = size;
+
+	if ( 0 != door_call( door, &params ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call" );
+
+	assert( size == params.data_size );
+	for ( i = 0; i < size; ++i )
+		assert( data[size - 1 - i] ==
+		        ( (const char*)params.data_ptr )[i]
+		      );
+
+	free(params.rbuf);
+
+	return;
+}
+
+int main(void)
+{
+	int door, server;
+	int pipe_fds[2];
+	struct stat st;
+	struct door_info info;
+	door_desc_t passed;
+	door_arg_t params;
+	size_t data_max;
+	char* large;
+	char buf[64];
+	ssize_t n;
+	size_t i;
+
+	server = door_create_transport( reverse_server,
+	                                NULL,
+	                                0,
+	                                DOOR_TRANSPORT_LOOPBACK
+	                              );
+	if ( 0 > server )
+		fatal_system_error( __FILE__, __LINE__, "door_create_transport" );
+
+	if ( 0 != door_attach( server, door_path ) )
+		fatal_system_error( __FILE__, __LINE__, "door_attach" );
+
+/* Nothing is attached to the filesystem. */
+	assert( 0 != stat( door_path, &st ) );
+	assert( ENOENT == errno );
+
+/* An unknown transport is refused. */
+	assert( 0 > door_create_transport( reverse_server, NULL, 0, 42 ) );
+	assert( EINVAL == errno );
+
+	door = door_open(door_path);
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+	for ( i = 0; i < (size_t)repeats; ++i )
+		call_reverse( door, message, strlen(message) );
+
+	if ( 0 != door_getparam( door, DOOR_PARAM_DATA_MAX, &data_max ) )
+		fatal_system_error( __FILE__, __LINE__, "door_getparam" );
+	assert( large_size <= data_max );
+
+	large = malloc(large_size);
+	if ( NULL == large )
+		fatal_system_error( __FILE__, __LINE__, "malloc" );
+
+	for ( i = 0; i < large_size; ++i )
+		large[i] = (char)( i * 7 + i / 251 );
+
+	call_reverse( door, large, large_size );
+	free(large);
+
+/* Pass the write end of a pipe, and read back what the server wrote. */
+	if ( 0 != pipe(pipe_fds) )
+		fatal_system_error( __FILE__, __LINE__, "pipe" );
+
+	bzero( &passed, sizeof(passed) );
+	passed.d_attributes = DOOR_DESCRIPTOR | DOOR_RELEASE;
+	passed.d_data.d_desc.d_descriptor = pipe_fds[1];
+
+	bzero( &params, sizeof(params) );
+	params.data_ptr = message;
+	params.data_size = strlen(message);
+	params.desc_ptr = &passed;
+	params.desc_num = 1;
+
+	if ( 0 != door_call( door, &params ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call" );
+
+	assert( strlen(reversed) == params.data_size );
+	assert( 0 == memcmp( params.data_ptr, reversed, params.data_size ) );
+	free(params.rbuf);
+
+	n = read( pipe_fds[0], buf, sizeof(buf) );
+	assert( (ssize_t)strlen(message) == n );
+	assert( 0 == memcmp( buf, message, (size_t)n ) );
+	assert( 0 == read( pipe_fds[0], buf, sizeof(buf) ) );
+	close(pipe_fds[0]);
+
+	if ( 0 != door_info( door, &info ) )
+		fatal_system_error( __FILE__, __LINE__, "door_info" );
+	assert( getpid() == info.di_target );
+	assert( DOOR_LOCAL & info.di_attributes );
+
+	if ( 0 != door_close(door) )
+		fatal_system_error( __FILE__, __LINE__, "door_close" );
+
+	if ( 0 != door_detach(door_path) )
+		fatal_system_error( __FILE__, __LINE__, "door_detach" );
+
+	assert( 0 > door_open(door_path) );
+	assert( ENOENT == errno );
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,156 @@
+/***************************************************************************
+ * Portland Doors                                                          *
+ * stats_export1.c: Test driver for door_stats_export().                   *
+ *                                                                         *
+ *                  The program publishes its doors' counters in a         *
+ *                  directory, creates a door and calls it through a       *
+ *                  socket, and then reads the door's counters by mapping  *
+ *                  its file, as a collector would.  They must match what  *
+ *                  door_stats() reports.                                  *
+ *                                                                         *
+ *                  The program should not hang, fail an assertion or      *
+ *                  report any error messages.                             *
+ *                                                                         *
+ * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
+ * Loren B. Davis.  Based on work by Jason Lango.                          *
+ ***************************************************************************/
+
+#include "standards.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "door.h"
+#include "door_info.h"
+#include "error.h"
+
+static const char* const export_dir = "/tmp/door-export";
+static const char* const door_path = "/tmp/door-export-door";
+
+static const int calls = 5;
+
+static void empty_server( void* cookie,
+                          const void* restrict argp,
+                          size_t arg_size,
+                          const door_desc_t* restrict dp,
+                          uint_t n_desc
+                        )
+{
+	if ( DOOR_UNREF_DATA == argp )
+		return;
+
+	door_return( NULL, 0, NULL, 0 );
+
+	fatal_system_error( __FILE__, __LINE__, "door_return" );
+}
+
+int main(void)
+{
+	struct door_info info;
+	door_stats_t stats;
+	const door_stats_header_t* header;
+	const door_stats_t* published;
+	struct stat st;
+	door_arg_t params;
+	char file[256];
+	void* mapping;
+	int server, door, fd, i;
+
+	assert( 0 != door_stats_export("/nonexistent/door-export") );
+	assert( ENOENT == errno );
+
+	mkdir( export_dir, 0755 );
+	if ( 0 != door_stats_export(export_dir) )
+		fatal_system_error( __FILE__, __LINE__, "door_stats_export" );
+
+	server = door_create( empty_server, NULL, 0 );
+	if ( 0 > server )
+		fatal_system_error( __FILE__, __LINE__, "door_create" );
+
+/* Doors created from now on keep their counters on the heap. */
+	if ( 0 != door_stats_export(NULL) )
+		fatal_system_error( __FILE__, __LINE__, "door_stats_export" );
+
+	if ( 0 != door_info( server, &info ) )
+		fatal_system_error( __FILE__, __LINE__, "door_info" );
+
+	door_detach(door_path);
+	if ( 0 != door_attach( server, door_path ) )
+		fatal_system_error( __FILE__, __LINE__, "door_attach" );
+
+	door = door_open(door_path);
+	if ( 0 > door )
+		fatal_system_error( __FILE__, __LINE__, "door_open" );
+
+	for ( i = 0; i < calls; ++i ) {
+		char c = 'x';
+
+		bzero( &params, sizeof(params) );
+		params.data_ptr = &c;
+		params.data_size = 1;
+		if ( 0 != door_call( door, &params ) )
+			fatal_system_error( __FILE__, __LINE__, "door_call" );
+	}
+
+	snprintf( file,
+	          sizeof(file),
+	          "%s/door.%ld.%llu",
+	          export_dir,
+	          (long)getpid(),
+	          info.di_uniquifier
+	        );
+
+	fd = open( file, O_RDONLY );
+	if ( 0 > fd )
+		fatal_system_error( __FILE__, __LINE__, "open" );
+
+	if ( 0 != fstat( fd, &st ) )
+		fatal_system_error( __FILE__, __LINE__, "fstat" );
+
+	mapping = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+	if ( MAP_FAILED == mapping )
+		fatal_system_error( __FILE__, __LINE__, "mmap" );
+	close(fd);
+
+	header = mapping;
+	assert( DOOR_STATS_MAGIC == header->dh_magic );
+	assert( DOOR_STATS_VERSION == header->dh_version );
+	assert( sizeof(door_stats_header_t) == header->dh_header_size );
+	assert( sizeof(door_stats_t) == header->dh_stats_size );
+	assert( (unsigned long long)getpid() == header->dh_pid );
+	assert( info.di_uniquifier == header->dh_door );
+	assert( header->dh_stats_offset + header->dh_stats_size <=
+	        (unsigned long long)st.st_size
+	      );
+
+	published = (const door_stats_t*)
+( (const char*)mapping + header->dh_stats_offset );
+
+	if ( 0 != door_stats( server, &stats ) )
+		fatal_system_error( __FILE__, __LINE__, "door_stats" );
+
+	assert( (unsigned long long)calls == published->ds_calls );
+	assert( (unsigned long long)calls == published->ds_bytes_in );
+	assert( 1 == published->ds_connections );
+	assert( 0 == memcmp( published, &stats, sizeof(stats) ) );
+
+	munmap( mapping, (size_t)st.st_size );
+
+	door_close(door);
+
+/* The door is never revoked, so its file stays until we remove it. */
+	if ( 0 != door_detach(door_path) )
+		fatal_system_error( __FILE__, __LINE__, "door_detach" );
+	unlink(file);
+	rmdir(export_dir);
+
+	return EXIT_SUCCESS;
+}
@@ -14,6 +14,9 @@
  *            Unreferenced invocation received and DOOR_IS_UNREF is        *
  *            properly set.                                                *
  *                                                                         *
+ *            A call without data must not look like an unreferenced       *
+ *            invocation to the server procedure.                          *
+ *                                                                         *
  * Released under the LGPL version 3 (see COPYING).  Copyright (C) 2008    *
  * Loren B. Davis.  Based on work by Jason Lango.                          *
  ***************************************************************************/
@@ -23,6 +26,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <strings.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -32,6 +36,9 @@
 static const char* const door_path = "/tmp/door";
 static const char* const unref_msg = "Unreferenced invocation received";
 
+/* How many ordinary calls the server procedure has answered. */
+static unsigned int calls = 0;
+
 static void unref_server( const int* restrict fd,
                           const void* restrict unref_data,
                           size_t unused1,
@@ -41,7 +48,13 @@ static void unref_server( const int* restrict fd,
 {
 	struct door_info info;
 
-	assert( DOOR_UNREF_DATA == unref_data );
+	if ( DOOR_UNREF_DATA != unref_data ) {
+		assert( 0 == unused1 );
+		__atomic_fetch_add( &calls, 1, __ATOMIC_RELAXED );
+		door_return( NULL, 0, NULL, 0 );
+		fatal_system_error( __FILE__, __LINE__, "door_return" );
+	}
+
 	assert( 0 == unused1 );
 	assert( NULL == unused2 );
 	assert( 0 == unused3 );
@@ -89,6 +102,7 @@ static void client_proc(void)
 {
 	int door1, door2, door3;	/* Door descriptors. */
 	struct door_info info;		/* Used by door_info(). */
+	door_arg_t params;		/* Used by door_call(). */
 
 	door1 = door_open(door_path);
 	if ( 0 > door1 )
@@ -99,6 +113,13 @@ static void client_proc(void)
 
 	assert( !( info.di_attributes & DOOR_IS_UNREF ) );
 
+/* A call without data is an ordinary call. */
+	bzero( &params, sizeof(params) );
+	if ( 0 != door_call( door1, &params ) )
+		fatal_system_error( __FILE__, __LINE__, "door_call" );
+	assert( 0 == params.data_size );
+	assert( 1 == __atomic_load_n( &calls, __ATOMIC_RELAXED ) );
+
 	printf("There should be exactly two \"Unreferenced invocation "
 	       "received\" messages, both following this line.\n"
 	      );